@@ -37,12 +37,19 @@ void top_level_task(const Task *task,
 {
   size_t num_elements = 32768;
   size_t num_pieces = 1;
+  // with -irregular N, the axpy is replaced by one whose per-element cost
+  //  ramps up to N+1 units, using the loop schedule picked by -sched
+  //  (static, dynamic or guided)
+  int irregular = 0;
+  std::string sched_name = "static";
 
   const InputArgs &command_args = Runtime::get_input_args();
 
   bool ok = Realm::CommandLineParser()
     .add_option_int("-n", num_elements)
     .add_option_int("-p", num_pieces)
+    .add_option_int("-irregular", irregular)
+    .add_option_string("-sched", sched_name)
     .parse_command_line(command_args.argc, (const char **)command_args.argv);
 
   if(!ok) {
@@ -66,7 +73,26 @@ void top_level_task(const Task *task,
   x.fill(runtime, ctx, 2.0);
   y.fill(runtime, ctx, 3.0);
 
-  axpy(runtime, ctx, 0.5f, x, y, ip_dist);
+  if(irregular > 0) {
+    LoopSchedule sched;
+    if(sched_name == "static")
+      sched = SCHED_STATIC;
+    else if(sched_name == "dynamic")
+      sched = SCHED_DYNAMIC;
+    else if(sched_name == "guided")
+      sched = SCHED_GUIDED;
+    else {
+      log_app.fatal() << "unknown loop schedule: " << sched_name;
+      exit(1);
+    }
+    double elapsed = irregular_axpy(runtime, ctx, 0.5f, x, y,
+				    irregular, sched);
+    log_app.print() << "irregular axpy: schedule=" << sched_name
+		    << " elements=" << num_elements
+		    << " max_extra=" << irregular
+		    << " time=" << elapsed << " us";
+  } else
+    axpy(runtime, ctx, 0.5f, x, y, ip_dist);
 
   float result = dot(runtime, ctx, x, y, ip_dist);
   float exp_result = num_elements * 2.0 * (3.0 + 0.5 * 2.0);
@@ -44,6 +44,66 @@ void BlasTaskImplementations<float>::axpy_task_cpu(const Task *task,
     fa_y[i] += alpha * fa_x[i];
 }
 
+// each element does 1 + (max_extra * its position in the array) units of
+//  work, which is the same value each time, so the result matches axpy
+static inline float irregular_term(const float *xp, coord_t i, coord_t lo,
+				   coord_t count, int max_extra)
+{
+  int reps = 1 + (int)((i - lo) * max_extra / count);
+  float acc = 0;
+  for(int k = 0; k < reps; k++)
+    acc += xp[0];
+  return acc / reps;
+}
+
+template <>
+double BlasTaskImplementations<float>::irregular_axpy_task_cpu(const Task *task,
+							       const std::vector<PhysicalRegion> &regions,
+							       Context ctx, Runtime *runtime)
+{
+  IndexSpace is = regions[1].get_logical_region().get_index_space();
+  Rect<1> bounds = runtime->get_index_space_domain(ctx, is);
+
+  const IrregularArgs& args = *(const IrregularArgs *)(task->args);
+
+  const FieldAccessor<READ_ONLY,float,1,coord_t,
+          Realm::AffineAccessor<float,1,coord_t> > fa_x(regions[0], task->regions[0].instance_fields[0]);
+  const FieldAccessor<READ_WRITE,float,1,coord_t,
+          Realm::AffineAccessor<float,1,coord_t> > fa_y(regions[1], task->regions[1].instance_fields[0]);
+
+  coord_t lo = bounds.lo[0];
+  coord_t count = bounds.hi[0] - bounds.lo[0] + 1;
+  float alpha = args.alpha;
+  int max_extra = args.max_extra;
+
+  double t_start = Realm::Clock::current_time_in_microseconds();
+  switch(args.sched) {
+  case SCHED_STATIC:
+    {
+#pragma omp parallel for schedule(static) if(blas_do_parallel)
+      for(int i = bounds.lo[0]; i <= bounds.hi[0]; i++)
+	fa_y[i] += alpha * irregular_term(fa_x.ptr(i), i, lo, count, max_extra);
+      break;
+    }
+  case SCHED_DYNAMIC:
+    {
+#pragma omp parallel for schedule(dynamic, 64) if(blas_do_parallel)
+      for(int i = bounds.lo[0]; i <= bounds.hi[0]; i++)
+	fa_y[i] += alpha * irregular_term(fa_x.ptr(i), i, lo, count, max_extra);
+      break;
+    }
+  case SCHED_GUIDED:
+    {
+#pragma omp parallel for schedule(guided, 16) if(blas_do_parallel)
+      for(int i = bounds.lo[0]; i <= bounds.hi[0]; i++)
+	fa_y[i] += alpha * irregular_term(fa_x.ptr(i), i, lo, count, max_extra);
+      break;
+    }
+  }
+  double t_end = Realm::Clock::current_time_in_microseconds();
+  return t_end - t_start;
+}
+
 template <>
 float BlasTaskImplementations<float>::dot_task_cpu(const Task *task,
 						   const std::vector<PhysicalRegion> &regions,
@@ -53,6 +53,20 @@ void axpy(Runtime *runtime, Context ctx,
 	  T alpha, const BlasArrayRef<T>& x, BlasArrayRef<T> y,
 	  IndexPartition distpart = IndexPartition::NO_PART);
 
+// an axpy whose per-element cost grows from 1 to 'max_extra'+1 units across
+//  the array, for comparing loop schedules - returns the loop's time in
+//  microseconds
+enum LoopSchedule {
+  SCHED_STATIC,
+  SCHED_DYNAMIC,
+  SCHED_GUIDED,
+};
+
+template <typename T>
+double irregular_axpy(Runtime *runtime, Context ctx,
+		      T alpha, const BlasArrayRef<T>& x, BlasArrayRef<T> y,
+		      int max_extra, LoopSchedule sched);
+
 template <typename T>
 T dot(Runtime *runtime, Context ctx,
       const BlasArrayRef<T>& x, BlasArrayRef<T> y,
@@ -62,6 +76,7 @@ template <typename T>
 class BlasTaskImplementations {
 public:
   TaskID axpy_task_id;
+  TaskID irregular_axpy_task_id;
   TaskID dot_task_id;
 
   // performs _static_ registration of tasks at startup
@@ -73,6 +88,16 @@ public: // these must be public as they are used as template arguments
 			    const std::vector<PhysicalRegion> &regions,
 			    Context ctx, Runtime *runtime);
 
+  struct IrregularArgs {
+    T alpha;
+    int max_extra;
+    LoopSchedule sched;
+  };
+
+  static double irregular_axpy_task_cpu(const Task *task,
+					const std::vector<PhysicalRegion> &regions,
+					Context ctx, Runtime *runtime);
+
   static T dot_task_cpu(const Task *task,
 			const std::vector<PhysicalRegion> &regions,
 			Context ctx, Runtime *runtime);
@@ -86,6 +86,23 @@ inline void axpy(Runtime *runtime, Context ctx,
   runtime->execute_task(ctx, launcher);
 }
 
+template <typename T>
+inline double irregular_axpy(Runtime *runtime, Context ctx,
+			     T alpha, const BlasArrayRef<T>& x, BlasArrayRef<T> y,
+			     int max_extra, LoopSchedule sched)
+{
+  typename BlasTaskImplementations<T>::IrregularArgs args;
+  args.alpha = alpha;
+  args.max_extra = max_extra;
+  args.sched = sched;
+  TaskLauncher launcher(blas_impl_s.irregular_axpy_task_id,
+			TaskArgument(&args, sizeof(args)));
+  x.add_requirement(launcher, READ_ONLY);
+  y.add_requirement(launcher, READ_WRITE);
+  Future f = runtime->execute_task(ctx, launcher);
+  return f.get_result<double>();
+}
+
 template <typename T>
 inline T dot(Runtime *runtime, Context ctx,
 	     const BlasArrayRef<T>& x, BlasArrayRef<T> y,
@@ -109,6 +126,13 @@ inline void BlasTaskImplementations<T>::preregister_tasks(void)
     Runtime::preregister_task_variant<BlasTaskImplementations<T>::axpy_task_cpu>(tvr, "axpy (cpu)");
   }
 
+  {
+    irregular_axpy_task_id = Runtime::generate_static_task_id();
+    TaskVariantRegistrar tvr(irregular_axpy_task_id);
+    tvr.add_constraint(ProcessorConstraint(Processor::LOC_PROC));
+    Runtime::preregister_task_variant<double, BlasTaskImplementations<T>::irregular_axpy_task_cpu>(tvr, "irregular axpy (cpu)");
+  }
+
   {
     dot_task_id = Runtime::generate_static_task_id();
     TaskVariantRegistrar tvr(dot_task_id);
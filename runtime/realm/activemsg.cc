@@ -47,6 +47,21 @@ static const void *ignore_gasnet_warning2 __attribute__((unused)) = (void *)_gas
 
 #include <pthread.h>
 
+// and the shared memory transport needs these
+#include <deque>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
 #define GASNETHSL_IMPL     pthread_mutex_t mutex
 #define GASNETCONDVAR_IMPL pthread_cond_t  condvar
 
@@ -56,6 +71,7 @@ static const void *ignore_gasnet_warning2 __attribute__((unused)) = (void *)_gas
 #include "realm/cmdline.h"
 
 #include <queue>
+#include <algorithm>
 #include <assert.h>
 #ifdef REALM_PROFILE_AM_HANDLERS
 #include <math.h>
@@ -80,8 +96,8 @@ enum { MSGID_LONG_EXTENSION = 253,
 NodeID my_node_id = 0;
 NodeID max_node_id = 0;
 
-// most of this file assumes the use of gasnet - stubs for a few entry
-//  points are defined at the bottom for the !USE_GASNET case
+// most of this file assumes the use of gasnet - the !USE_GASNET case (a
+//  shared memory transport between ranks on one node) is at the bottom
 #ifdef USE_GASNET
 
 #define CHECK_PTHREAD(cmd) do { \
@@ -150,34 +166,6 @@ void GASNetCondVar::wait(void)
   gasnett_cond_wait(&condvar, &(mutex.mutex.lock));
 }
 
-#ifdef REALM_PROFILE_AM_HANDLERS
-struct ActiveMsgHandlerStats {
-  size_t count, sum, sum2, minval, maxval;
-
-  ActiveMsgHandlerStats(void)
-  : count(0), sum(0), sum2(0), minval(0), maxval(0) {}
-
-  void record(struct timespec& ts_start, struct timespec& ts_end)
-  {
-    size_t val = 1000000000LL * (ts_end.tv_sec - ts_start.tv_sec) + ts_end.tv_nsec - ts_start.tv_nsec;
-    if(!count || (val < minval)) minval = val;
-    if(!count || (val > maxval)) maxval = val;
-    count++;
-    sum += val;
-    sum2 += val * val;
-  }
-};
-
-static ActiveMsgHandlerStats handler_stats[256];
-
-void record_activemsg_profiling(int msgid,
-				const struct timespec& ts_start,
-				const struct timespec& ts_end)
-{
-  handler_stats[msgid].record(ts_start, ts_end);
-}
-#endif
-
 NodeID get_message_source(token_t token)
 {
   gasnet_node_t src;
@@ -210,10 +198,6 @@ void record_am_handler(int handler_id, const char *description, bool reply)
 }
 #endif
 
-#ifdef REALM_PROFILE_AM_HANDLERS
-/*extern*/ ActiveMsgHandlerStats handler_stats[256];
-#endif
-
 static const int DEFERRED_FREE_COUNT = 128;
 gasnet_hsl_t deferred_free_mutex;
 int deferred_free_pos;
@@ -229,34 +213,6 @@ static bool is_registered(void *ptr)
   return false;
 }
 
-class IncomingMessageManager {
-public:
-  IncomingMessageManager(int _nodes, Realm::CoreReservationSet& crs);
-  ~IncomingMessageManager(void);
-
-  void add_incoming_message(int sender, IncomingMessage *msg);
-
-  void start_handler_threads(int count, size_t stack_size);
-
-  void shutdown(void);
-
-  IncomingMessage *get_messages(int &sender, bool wait = true);
-
-  void handler_thread_loop(void);
-
-protected:
-  int nodes;
-  int shutdown_flag;
-  IncomingMessage **heads;
-  IncomingMessage ***tails;
-  int *todo_list; // list of nodes with non-empty message lists
-  int todo_oldest, todo_newest;
-  gasnet_hsl_t mutex;
-  gasnett_cond_t condvar;
-  Realm::CoreReservation *core_rsrv;
-  std::vector<Realm::Thread *> handler_threads;
-};
-
 void init_deferred_frees(void)
 {
   gasnet_hsl_init(&deferred_free_mutex);
@@ -1017,29 +973,209 @@ protected:
 static DetailedMessageTiming detailed_message_timing;
 #endif
 
-IncomingMessageManager::IncomingMessageManager(int _nodes, Realm::CoreReservationSet& crs)
-  : nodes(_nodes), shutdown_flag(0)
+#endif // USE_GASNET
+
+#ifdef REALM_PROFILE_AM_HANDLERS
+struct ActiveMsgHandlerStats {
+  GASNetHSL mutex;
+  size_t count, sum, sum2, minval, maxval;
+
+  ActiveMsgHandlerStats(void)
+  : count(0), sum(0), sum2(0), minval(0), maxval(0) {}
+
+  void record(const struct timespec& ts_start, const struct timespec& ts_end)
+  {
+    size_t val = 1000000000LL * (ts_end.tv_sec - ts_start.tv_sec) + ts_end.tv_nsec - ts_start.tv_nsec;
+    // several handler threads can be recording at once
+    mutex.lock();
+    if(!count || (val < minval)) minval = val;
+    if(!count || (val > maxval)) maxval = val;
+    count++;
+    sum += val;
+    sum2 += val * val;
+    mutex.unlock();
+  }
+
+  void report(const char *what, int msgid)
+  {
+    if(!count) return;
+    double avg = ((double)sum) / ((double)count);
+    double stddev = sqrt((((double)sum2) / ((double)count)) - avg * avg);
+    printf("AM %s: node %d, msg %d: count = %10zd, avg = %8.2f, dev = %8.2f, min = %8zd, max = %8zd\n",
+           what, my_node_id, msgid, count, avg, stddev, minval, maxval);
+  }
+};
+
+// time spent in each message's handler, and time spent waiting in the
+//  incoming message queues before the handler ran
+static ActiveMsgHandlerStats handler_stats[256];
+static ActiveMsgHandlerStats queue_delay_stats[256];
+
+void record_activemsg_profiling(int msgid,
+				const struct timespec& ts_start,
+				const struct timespec& ts_end)
 {
-  heads = new IncomingMessage *[nodes];
-  tails = new IncomingMessage **[nodes];
-  for(int i = 0; i < nodes; i++) {
-    heads[i] = 0;
-    tails[i] = 0;
+  handler_stats[msgid].record(ts_start, ts_end);
+}
+
+void record_activemsg_queue_delay(int msgid,
+				  const struct timespec& ts_enqueue,
+				  const struct timespec& ts_start)
+{
+  queue_delay_stats[msgid].record(ts_enqueue, ts_start);
+}
+
+static void report_activemsg_profiling(void)
+{
+  for(int i = 0; i < 256; i++) {
+    handler_stats[i].report("profiling", i);
+    queue_delay_stats[i].report("queueing", i);
+  }
+}
+#endif
+
+// handler threads dedicated to the fast lane (0 sends every message through
+//  the regular handler threads), and how many shards each lane's incoming
+//  queues are split into (0 = one per handler thread in the lane)
+static int am_fast_handler_threads = 1;
+static int am_queue_shards = 0;
+
+// messages whose handlers are short and never wait on other messages -
+//  these go through the fast lane so that they don't queue up behind
+//  expensive handlers (e.g. task registration or remote copies)
+static bool is_fast_lane_message(int msgid)
+{
+  switch(msgid) {
+  case LOCK_REQUEST_MSGID:
+  case LOCK_RELEASE_MSGID:
+  case LOCK_GRANT_MSGID:
+  case EVENT_SUBSCRIBE_MSGID:
+  case EVENT_TRIGGER_MSGID:
+  case EVENT_UPDATE_MSGID:
+  case EVENT_SUBSCRIBE_BATCH_MSGID:
+  case EVENT_BATCH_MSGID:
+  case BARRIER_ADJUST_MSGID:
+  case BARRIER_SUBSCRIBE_MSGID:
+  case BARRIER_TRIGGER_MSGID:
+    return true;
+  default:
+    return false;
   }
-  todo_list = new int[nodes + 1];  // an extra entry to distinguish full from empty
-  todo_oldest = todo_newest = 0;
-  gasnet_hsl_init(&mutex);
-  gasnett_cond_init(&condvar);
+}
+
+// incoming messages are queued per sender and handed off to a pool of
+//  handler threads - this is shared by the GASNet and shared memory transports
+//
+// there are two lanes, each with its own handler threads: a fast lane for
+//  cheap handlers (see is_fast_lane_message) and a regular lane for
+//  everything else - within a lane, the senders are split across shards
+//  that are locked independently, and a handler thread starts looking for
+//  work in its own shard before stealing from the others
+class IncomingMessageManager {
+public:
+  IncomingMessageManager(int _nodes, int _regular_threads, int _fast_threads,
+			 int _shards, Realm::CoreReservationSet& crs);
+  ~IncomingMessageManager(void);
+
+  void add_incoming_message(int sender, IncomingMessage *msg);
+
+  void start_handler_threads(size_t stack_size);
+
+  void shutdown(void);
+
+  void handler_thread_loop(void);
+
+protected:
+  struct Shard {
+    GASNetHSL mutex;
+    IncomingMessage **heads;
+    IncomingMessage ***tails;
+    int *todo_list; // list of senders with non-empty message lists
+    volatile int todo_oldest, todo_newest;
+    int todo_size;
+    char pad[64]; // keep neighboring shards' locks off the same cache line
+  };
+
+  struct Lane {
+    Lane(void);
+
+    int num_threads;
+    int num_shards;
+    Shard *shards;
+    volatile int pending;  // non-empty message lists across all shards
+    volatile int sleepers; // handler threads waiting for work
+    GASNetHSL sleep_mutex;
+    GASNetCondVar sleep_condvar;
+  };
+
+  enum { LANE_REGULAR, LANE_FAST, NUM_LANES };
+
+  void init_lane(Lane& lane, int threads, int shards);
+
+  IncomingMessage *get_messages(Lane& lane, int home_shard,
+				int &sender, bool wait = true);
+
+  int nodes;
+  volatile int shutdown_flag;
+  bool fast_lane_msgids[256];
+  Lane lanes[NUM_LANES];
+  int next_thread_index;
+  Realm::CoreReservation *core_rsrv;
+  std::vector<Realm::Thread *> handler_threads;
+};
+
+IncomingMessageManager::Lane::Lane(void)
+  : num_threads(0), num_shards(0), shards(0), pending(0), sleepers(0)
+  , sleep_condvar(sleep_mutex)
+{}
+
+IncomingMessageManager::IncomingMessageManager(int _nodes, int _regular_threads,
+					       int _fast_threads, int _shards,
+					       Realm::CoreReservationSet& crs)
+  : nodes(_nodes), shutdown_flag(0), next_thread_index(0)
+{
+  init_lane(lanes[LANE_REGULAR], _regular_threads, _shards);
+  init_lane(lanes[LANE_FAST], _fast_threads, _shards);
+
+  for(int i = 0; i < 256; i++)
+    fast_lane_msgids[i] = (_fast_threads > 0) && is_fast_lane_message(i);
 
   core_rsrv = new Realm::CoreReservation("AM handlers", crs,
 					 Realm::CoreReservationParameters());
 }
 
+void IncomingMessageManager::init_lane(Lane& lane, int threads, int shards)
+{
+  lane.num_threads = threads;
+  // no point in having more shards than senders
+  lane.num_shards = std::max(1, std::min(((shards > 0) ? shards : threads),
+					 nodes));
+  lane.shards = new Shard[lane.num_shards];
+  int per_shard = (nodes + lane.num_shards - 1) / lane.num_shards;
+  for(int i = 0; i < lane.num_shards; i++) {
+    Shard& shard = lane.shards[i];
+    shard.heads = new IncomingMessage *[per_shard];
+    shard.tails = new IncomingMessage **[per_shard];
+    for(int j = 0; j < per_shard; j++) {
+      shard.heads[j] = 0;
+      shard.tails[j] = 0;
+    }
+    shard.todo_size = per_shard + 1;  // an extra entry to distinguish full from empty
+    shard.todo_list = new int[shard.todo_size];
+    shard.todo_oldest = shard.todo_newest = 0;
+  }
+}
+
 IncomingMessageManager::~IncomingMessageManager(void)
 {
-  delete[] heads;
-  delete[] tails;
-  delete[] todo_list;
+  for(int l = 0; l < NUM_LANES; l++) {
+    for(int i = 0; i < lanes[l].num_shards; i++) {
+      delete[] lanes[l].shards[i].heads;
+      delete[] lanes[l].shards[i].tails;
+      delete[] lanes[l].shards[i].todo_list;
+    }
+    delete[] lanes[l].shards;
+  }
 }
 
 void IncomingMessageManager::add_incoming_message(int sender, IncomingMessage *msg)
@@ -1047,35 +1183,59 @@ void IncomingMessageManager::add_incoming_message(int sender, IncomingMessage *m
 #ifdef DEBUG_INCOMING
   printf("adding incoming message from %d\n", sender);
 #endif
-  gasnet_hsl_lock(&mutex);
-  if(heads[sender]) {
+#ifdef REALM_PROFILE_AM_HANDLERS
+  clock_gettime(CLOCK_MONOTONIC, &msg->ts_enqueue);
+#endif
+  Lane& lane = lanes[fast_lane_msgids[msg->get_msgid()] ? LANE_FAST : LANE_REGULAR];
+  Shard& shard = lane.shards[sender % lane.num_shards];
+  int idx = sender / lane.num_shards;
+
+  bool new_list;
+  shard.mutex.lock();
+  if(shard.heads[idx]) {
     // tack this on to the existing list
-    assert(tails[sender]);
-    *(tails[sender]) = msg;
-    tails[sender] = &(msg->next_msg);
+    assert(shard.tails[idx]);
+    *(shard.tails[idx]) = msg;
+    shard.tails[idx] = &(msg->next_msg);
+    new_list = false;
   } else {
-    // this starts a list, and the node needs to be added to the todo list
-    heads[sender] = msg;
-    tails[sender] = &(msg->next_msg);
-    todo_list[todo_newest] = sender;
-    todo_newest++;
-    if(todo_newest > nodes)
-      todo_newest = 0;
-    assert(todo_newest != todo_oldest);  // should never wrap around
-    gasnett_cond_broadcast(&condvar);  // wake up any sleepers
+    // this starts a list, and the sender needs to be added to the todo list
+    shard.heads[idx] = msg;
+    shard.tails[idx] = &(msg->next_msg);
+    int newest = shard.todo_newest;
+    shard.todo_list[newest] = idx;
+    newest++;
+    if(newest >= shard.todo_size)
+      newest = 0;
+    assert(newest != shard.todo_oldest);  // should never wrap around
+    shard.todo_newest = newest;
+    new_list = true;
+  }
+  shard.mutex.unlock();
+
+  if(new_list) {
+    // the increment of 'pending' must be visible before we look for sleepers
+    //  (and a sleeper announces itself before checking 'pending'), so only
+    //  take the sleep lock if somebody might actually need waking up
+    __sync_fetch_and_add(&lane.pending, 1);
+    if(__sync_fetch_and_add(&lane.sleepers, 0) > 0) {
+      lane.sleep_mutex.lock();
+      lane.sleep_condvar.broadcast();
+      lane.sleep_mutex.unlock();
+    }
   }
-  gasnet_hsl_unlock(&mutex);
 }
 
-void IncomingMessageManager::start_handler_threads(int count, size_t stack_size)
+void IncomingMessageManager::start_handler_threads(size_t stack_size)
 {
+  int count = lanes[LANE_FAST].num_threads + lanes[LANE_REGULAR].num_threads;
   handler_threads.resize(count);
 
   Realm::ThreadLaunchParameters tlp;
   tlp.set_stack_size(stack_size);
 
   for(int i = 0; i < count; i++)
-    handler_threads[i] = Realm::Thread::create_kernel_thread<IncomingMessageManager, 
+    handler_threads[i] = Realm::Thread::create_kernel_thread<IncomingMessageManager,
 							     &IncomingMessageManager::handler_thread_loop>(this,
 													   tlp,
 													   *core_rsrv);
@@ -1083,12 +1243,13 @@ void IncomingMessageManager::start_handler_threads(int count, size_t stack_size)
 
 void IncomingMessageManager::shutdown(void)
 {
-  gasnet_hsl_lock(&mutex);
-  if(!shutdown_flag) {
-    shutdown_flag = true;
-    gasnett_cond_broadcast(&condvar);  // wake up any sleepers
+  shutdown_flag = 1;
+  __sync_synchronize();
+  for(int l = 0; l < NUM_LANES; l++) {
+    lanes[l].sleep_mutex.lock();
+    lanes[l].sleep_condvar.broadcast();  // wake up any sleepers
+    lanes[l].sleep_mutex.unlock();
   }
-  gasnet_hsl_unlock(&mutex);
 
   for(std::vector<Realm::Thread *>::iterator it = handler_threads.begin();
       it != handler_threads.end();
@@ -1099,42 +1260,64 @@ void IncomingMessageManager::shutdown(void)
   handler_threads.clear();
 }
 
-IncomingMessage *IncomingMessageManager::get_messages(int &sender, bool wait)
+IncomingMessage *IncomingMessageManager::get_messages(Lane& lane, int home_shard,
+						      int &sender, bool wait)
 {
-  gasnet_hsl_lock(&mutex);
-  while(todo_oldest == todo_newest) {
-    // todo list is empty
-    if(shutdown_flag || !wait)
-      break;
+  while(true) {
+    // look through the shards, starting with our own
+    for(int i = 0; i < lane.num_shards; i++) {
+      int shard_idx = (home_shard + i) % lane.num_shards;
+      Shard& shard = lane.shards[shard_idx];
+      // unlocked peek - a list added after this is caught by 'pending' below
+      if(shard.todo_oldest == shard.todo_newest)
+	continue;
+
+      shard.mutex.lock();
+      if(shard.todo_oldest == shard.todo_newest) {
+	// somebody else got it first
+	shard.mutex.unlock();
+	continue;
+      }
+      // pop the oldest entry off the todo list
+      int oldest = shard.todo_oldest;
+      int idx = shard.todo_list[oldest];
+      oldest++;
+      if(oldest >= shard.todo_size)
+	oldest = 0;
+      shard.todo_oldest = oldest;
+      IncomingMessage *retval = shard.heads[idx];
+      shard.heads[idx] = 0;
+      shard.tails[idx] = 0;
+      shard.mutex.unlock();
+
+      __sync_fetch_and_sub(&lane.pending, 1);
+      sender = idx * lane.num_shards + shard_idx;
 #ifdef DEBUG_INCOMING
-    printf("incoming message list is empty - sleeping\n");
+      printf("handling incoming messages from %d\n", sender);
 #endif
-    gasnett_cond_wait(&condvar, &mutex.lock);
-  }
-  IncomingMessage *retval;
-  if(todo_oldest == todo_newest) {
-    // still empty
-    sender = -1;
-    retval = 0;
+      return retval;
+    }
+
+    if(shutdown_flag || !wait) {
 #ifdef DEBUG_INCOMING
-    printf("incoming message list is still empty!\n");
+      printf("incoming message list is still empty!\n");
 #endif
-  } else {
-    // pop the oldest entry off the todo list
-    sender = todo_list[todo_oldest];
-    todo_oldest++;
-    if(todo_oldest > nodes)
-      todo_oldest = 0;
-    retval = heads[sender];
-    heads[sender] = 0;
-    tails[sender] = 0;
+      sender = -1;
+      return 0;
+    }
+
+    // nothing to do - sleep until a new list shows up (or shutdown)
 #ifdef DEBUG_INCOMING
-    printf("handling incoming messages from %d\n", sender);
+    printf("incoming message list is empty - sleeping\n");
 #endif
+    lane.sleep_mutex.lock();
+    __sync_fetch_and_add(&lane.sleepers, 1);
+    while((lane.pending <= 0) && !shutdown_flag)
+      lane.sleep_condvar.wait();
+    __sync_fetch_and_sub(&lane.sleepers, 1);
+    lane.sleep_mutex.unlock();
   }
-  gasnet_hsl_unlock(&mutex);
-  return retval;
-}    
+}
 
 static IncomingMessageManager *incoming_message_manager = 0;
 
@@ -1149,12 +1332,20 @@ extern void enqueue_incoming(NodeID sender, IncomingMessage *msg)
 
 void IncomingMessageManager::handler_thread_loop(void)
 {
+#ifdef USE_GASNET
   // messages enqueued in response to incoming messages can never be stalled
   ThreadLocal::always_allow_spilling = true;
+#endif
+
+  // the first threads started serve the fast lane, the rest the regular one
+  int index = __sync_fetch_and_add(&next_thread_index, 1);
+  bool fast = (index < lanes[LANE_FAST].num_threads);
+  Lane& lane = lanes[fast ? LANE_FAST : LANE_REGULAR];
+  int home_shard = (fast ? index : (index - lanes[LANE_FAST].num_threads)) % lane.num_shards;
 
   while (true) {
     int sender = -1;
-    IncomingMessage *current_msg = get_messages(sender);
+    IncomingMessage *current_msg = get_messages(lane, home_shard, sender);
     if(!current_msg) {
 #ifdef DEBUG_INCOMING
       printf("received empty list - assuming shutdown!\n");
@@ -1186,6 +1377,8 @@ void IncomingMessageManager::handler_thread_loop(void)
   }
 }
 
+#ifdef USE_GASNET
+
 class ActiveMessageEndpoint {
 public:
   struct ChunkInfo {
@@ -2451,7 +2644,9 @@ void init_endpoints(int gasnet_mem_size_in_mb,
     .add_option_int("-ll:maxsend", max_msgs_to_send)
     .add_option_int("-ll:spillwarn", spillwarn_in_mb)
     .add_option_int("-ll:spillstep", spillstep_in_mb)
-    .add_option_int("-ll:spillstall", spillstep_in_mb);
+    .add_option_int("-ll:spillstall", spillstep_in_mb)
+    .add_option_int("-ll:afast", am_fast_handler_threads)
+    .add_option_int("-ll:ashards", am_queue_shards);
 
   bool ok = cp.parse_command_line(cmdline);
   assert(ok);
@@ -2644,9 +2839,11 @@ void start_polling_threads(int count)
 
 void start_handler_threads(int count, Realm::CoreReservationSet& crs, size_t stack_size)
 {
-  incoming_message_manager = new IncomingMessageManager(gasnet_nodes(), crs);
+  incoming_message_manager = new IncomingMessageManager(gasnet_nodes(), count,
+							 am_fast_handler_threads,
+							 am_queue_shards, crs);
 
-  incoming_message_manager->start_handler_threads(count, stack_size);
+  incoming_message_manager->start_handler_threads(stack_size);
 }
 
 void stop_activemsg_threads(void)
@@ -2657,15 +2854,7 @@ void stop_activemsg_threads(void)
   delete incoming_message_manager;
 
 #ifdef REALM_PROFILE_AM_HANDLERS
-  for(int i = 0; i < 256; i++) {
-    if(!handler_stats[i].count) continue;
-    double avg = ((double)handler_stats[i].sum) / ((double)handler_stats[i].count);
-    double stddev = sqrt((((double)handler_stats[i].sum2) / ((double)handler_stats[i].count)) -
-                         avg * avg);
-    printf("AM profiling: node %d, msg %d: count = %10zd, avg = %8.2f, dev = %8.2f, min = %8zd, max = %8zd\n",
-           gasnet_mynode(), i,
-           handler_stats[i].count, avg, stddev, handler_stats[i].minval, handler_stats[i].maxval);
-  }
+  report_activemsg_profiling();
 #endif
 
 #ifdef DETAILED_MESSAGE_TIMING
@@ -2906,12 +3095,849 @@ void GASNetCondVar::wait(void)
   pthread_cond_wait(&condvar, &mutex.mutex);
 }
 
+Realm::Logger log_shm("shm");
+
+// shared memory transport for several ranks on one node without GASNet
+//
+// rank 0 creates an anonymous shared mapping and then forks the other ranks,
+//  so the segment is at the same address in every process.  It holds:
+//  - a control block (barrier, scratch space for collectives, doorbells)
+//  - a single-producer/single-consumer ring of message headers (and small
+//     payloads) for every ordered pair of ranks
+//  - a heap per sending rank for larger payloads - the receiver hands these
+//     to the message handler in place and marks them done afterwards
+//  - a window per rank for its registered memories, so that a payload with
+//     a destination pointer can be written directly to its final location
+//
+// the senders to a given ring are serialized by a process-local mutex, and
+//  messages that can't be sent right away (full ring or heap) are queued and
+//  retried by the polling thread, so senders never block
+
+// these values can be overridden by command-line parameters
+static int shm_ranks = 1;
+static size_t shm_ring_size = 1 << 20;        // per ordered pair of ranks
+static size_t shm_heap_size = 64 << 20;       // per sending rank
+static size_t shm_regmem_size = 1024 << 20;   // per rank, only touched pages use memory
+static size_t shm_inline_max = 4096;          // larger payloads go through the heap
+
+static const int SHM_MAX_RANKS = 64;
+static const size_t SHM_SCRATCH_SIZE = 256;
+static const size_t SHM_CACHE_LINE = 64;
+static const unsigned SHM_WRAP_MSGID = 0xffff;
+
+static void (*shm_handlers[256])(void);
+
+struct ShmControl {
+  // sense-reversing barrier
+  volatile int barrier_count;
+  volatile int barrier_sense;
+  char pad[SHM_CACHE_LINE - 2 * sizeof(int)];
+  struct Rank {
+    volatile int doorbell;   // bumped whenever a message is sent to this rank
+    volatile int sleeping;   // set while this rank's poller may be waiting
+    volatile int heap_wait;  // set while this rank has sends waiting for heap space
+    char pad[SHM_CACHE_LINE - 3 * sizeof(int)];
+  } ranks[SHM_MAX_RANKS];
+  char scratch[SHM_MAX_RANKS][SHM_SCRATCH_SIZE];
+};
+
+struct ShmRing {
+  volatile uint64_t head;  // next byte to be read, advanced by the receiver
+  char pad1[SHM_CACHE_LINE - sizeof(uint64_t)];
+  volatile uint64_t tail;  // next byte to be written, advanced by the sender
+  char pad2[SHM_CACHE_LINE - sizeof(uint64_t)];
+  // followed by shm_ring_size bytes of data
+};
+
+enum {
+  SHM_PAYLOAD_NONE,    // short message
+  SHM_PAYLOAD_EMPTY,   // medium message with a zero-length payload
+  SHM_PAYLOAD_INLINE,  // payload follows the header in the ring
+  SHM_PAYLOAD_HEAP,    // payload is in the sender's heap
+  SHM_PAYLOAD_DIRECT,  // payload was written to the destination pointer
+};
+
+struct ShmMessageHeader {
+  uint32_t length;  // bytes used in the ring, including any inline payload
+  uint16_t msgid;
+  uint8_t num_args;
+  uint8_t payload_loc;
+  uint64_t payload_size;
+  void *payload_ptr;
+  handlerarg_t args[16];
+};
+
+struct ShmHeapBlock {
+  volatile uint64_t size;  // including this header
+  volatile int done;       // set by the receiver once the payload is consumed
+  char pad[SHM_CACHE_LINE - sizeof(uint64_t) - sizeof(int)];
+};
+
+// a payload to be sent - contiguous (line_count == 1), 2D, or a span list
+struct ShmPayload {
+  ShmPayload(const void *_data, size_t _size)
+    : data(_data), line_size(_size), line_count(1), line_stride(_size), spans(0)
+  {}
+  ShmPayload(const void *_data, size_t _line_size, off_t _line_stride, size_t _line_count)
+    : data(_data), line_size(_line_size), line_count(_line_count),
+      line_stride(_line_stride), spans(0)
+  {}
+  ShmPayload(const SpanList *_spans)
+    : data(0), line_size(0), line_count(0), line_stride(0), spans(_spans)
+  {}
+
+  void copy_data(void *dest) const;
+
+  const void *data;
+  size_t line_size, line_count;
+  off_t line_stride;
+  const SpanList *spans;
+};
+
+void ShmPayload::copy_data(void *dest) const
+{
+  char *dst_c = (char *)dest;
+  if(spans) {
+    for(SpanList::const_iterator it = spans->begin(); it != spans->end(); it++) {
+      memcpy(dst_c, it->first, it->second);
+      dst_c += it->second;
+    }
+  } else {
+    const char *src_c = (const char *)data;
+    for(size_t i = 0; i < line_count; i++) {
+      memcpy(dst_c, src_c, line_size);
+      dst_c += line_size;
+      src_c += line_stride;
+    }
+  }
+}
+
+// a message that is waiting for space in a ring or the heap - the payload
+//  (if it isn't DIRECT) is a private copy
+struct ShmPendingMessage {
+  ShmMessageHeader hdr;
+  void *payload;
+};
+
+static void shm_futex_wait(volatile int *addr, int val, long timeout_ns)
+{
+#ifdef __linux__
+  struct timespec ts;
+  ts.tv_sec = timeout_ns / 1000000000;
+  ts.tv_nsec = timeout_ns % 1000000000;
+  syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, 0, 0);
+#else
+  if(*addr == val)
+    usleep(timeout_ns / 1000);
+#endif
+}
+
+static void shm_futex_wake(volatile int *addr, int count)
+{
+#ifdef __linux__
+  syscall(SYS_futex, addr, FUTEX_WAKE, count, 0, 0, 0);
+#endif
+}
+
+class ShmTransport {
+public:
+  ShmTransport(char *_base, const std::vector<pid_t>& _children);
+  ~ShmTransport(void);
+
+  static size_t segment_size(void);
+
+  void send(NodeID target, int msgid, const void *args, size_t arg_size,
+	    const ShmPayload& payload, size_t payload_size,
+	    int payload_mode, void *dstptr);
+
+  // receives whatever has arrived and retries pending sends - returns true
+  //  if any messages were received
+  bool poll(void);
+
+  void release_payload(NodeID source, const void *ptr);
+
+  size_t max_payload_size(void) const;
+  void *registered_base(NodeID rank) const;
+
+  void barrier(void);
+  void gather(NodeID root, void *dst, const void *src, size_t bytes);
+  void broadcast(NodeID root, void *dst, const void *src, size_t bytes);
+
+  void start_polling_thread(void);
+  void stop_polling_thread(void);
+  void polling_thread_loop(void);
+
+  // rank 0 only - waits for the other ranks to exit
+  void wait_for_children(void);
+
+  Realm::CoreReservation *core_rsrv;
+
+protected:
+  ShmRing *get_ring(NodeID sender, NodeID receiver) const;
+  bool try_send(NodeID target, ShmMessageHeader& hdr, const ShmPayload& payload);
+  void *heap_alloc(size_t bytes);
+  bool flush_pending(NodeID target);
+  void dispatch(NodeID sender, const ShmMessageHeader *hdr);
+  void ring_doorbell(NodeID target);
+  void check_children(void);
+
+  char *base;
+  ShmControl *control;
+  char *rings_base, *heaps_base, *regmem_base;
+  size_t ring_stride;
+
+  GASNetHSL *send_mutexes;                // per target
+  std::deque<ShmPendingMessage> *pending; // per target
+  volatile int pending_count;
+
+  GASNetHSL heap_mutex;
+  uint64_t heap_head, heap_tail;
+
+  volatile int poll_busy;
+  int barrier_sense;
+  volatile bool shutdown_flag;
+  Realm::Thread *polling_thread;
+  std::vector<pid_t> children;
+};
+
+static ShmTransport *shm_transport = 0;
+
+static size_t shm_round_up(size_t bytes, size_t align)
+{
+  return ((bytes + align - 1) / align) * align;
+}
+
+/*static*/ size_t ShmTransport::segment_size(void)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (shm_round_up(sizeof(ShmControl), page) +
+	  (shm_ranks * shm_ranks * shm_round_up(sizeof(ShmRing) + shm_ring_size, page)) +
+	  (shm_ranks * shm_heap_size) +
+	  (shm_ranks * shm_regmem_size));
+}
+
+ShmTransport::ShmTransport(char *_base, const std::vector<pid_t>& _children)
+  : core_rsrv(0), base(_base), pending_count(0), heap_head(0), heap_tail(0),
+    poll_busy(0), barrier_sense(0), shutdown_flag(false), polling_thread(0),
+    children(_children)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  control = (ShmControl *)base;
+  ring_stride = shm_round_up(sizeof(ShmRing) + shm_ring_size, page);
+  rings_base = base + shm_round_up(sizeof(ShmControl), page);
+  heaps_base = rings_base + (shm_ranks * shm_ranks * ring_stride);
+  regmem_base = heaps_base + (shm_ranks * shm_heap_size);
+
+  send_mutexes = new GASNetHSL[shm_ranks];
+  pending = new std::deque<ShmPendingMessage>[shm_ranks];
+}
+
+ShmTransport::~ShmTransport(void)
+{
+  // the segment itself stays mapped until the process exits - the other
+  //  ranks may still be tearing down
+  delete[] send_mutexes;
+  delete[] pending;
+}
+
+ShmRing *ShmTransport::get_ring(NodeID sender, NodeID receiver) const
+{
+  return (ShmRing *)(rings_base + ((sender * shm_ranks) + receiver) * ring_stride);
+}
+
+size_t ShmTransport::max_payload_size(void) const
+{
+  // leave room for several payloads in flight
+  return shm_heap_size / 4;
+}
+
+void *ShmTransport::registered_base(NodeID rank) const
+{
+  return regmem_base + (rank * shm_regmem_size);
+}
+
+void ShmTransport::ring_doorbell(NodeID target)
+{
+  ShmControl::Rank& r = control->ranks[target];
+  // the atomic increment orders the ring update before the check of the
+  //  sleeping flag
+  __sync_fetch_and_add(&r.doorbell, 1);
+  if(r.sleeping)
+    shm_futex_wake(&r.doorbell, 1);
+}
+
+void ShmTransport::send(NodeID target, int msgid, const void *args, size_t arg_size,
+			const ShmPayload& payload, size_t payload_size,
+			int payload_mode, void *dstptr)
+{
+  assert((target >= 0) && (target <= max_node_id) && (target != my_node_id));
+  assert((msgid >= 0) && (msgid < 256));
+
+  ShmMessageHeader hdr;
+  hdr.msgid = msgid;
+  // handlers take an even number of arguments (see AtLeastEightBytes), and
+  //  any past the end of the message are zeros
+  assert(arg_size <= sizeof(hdr.args));
+  hdr.num_args = 2 * ((std::max(arg_size, (size_t)8) + 7) / 8);
+  memset(hdr.args, 0, sizeof(hdr.args));
+  memcpy(hdr.args, args, arg_size);
+  hdr.payload_size = payload_size;
+  hdr.payload_ptr = 0;
+
+  if(payload_mode == PAYLOAD_NONE) {
+    hdr.payload_loc = SHM_PAYLOAD_NONE;
+    hdr.payload_size = 0;
+  } else if(payload_size == 0) {
+    hdr.payload_loc = SHM_PAYLOAD_EMPTY;
+  } else if(dstptr != 0) {
+    // the destination is in the target's registered memory window, which
+    //  we have mapped too
+    payload.copy_data(dstptr);
+    hdr.payload_loc = SHM_PAYLOAD_DIRECT;
+    hdr.payload_ptr = dstptr;
+  } else if(payload_size <= shm_inline_max) {
+    hdr.payload_loc = SHM_PAYLOAD_INLINE;
+  } else {
+    if(payload_size > max_payload_size()) {
+      log_shm.fatal() << "message " << msgid << " payload of " << payload_size
+		      << " bytes is larger than the shared memory heap allows (-ll:shm_heap)";
+      abort();
+    }
+    hdr.payload_loc = SHM_PAYLOAD_HEAP;
+  }
+  hdr.length = sizeof(ShmMessageHeader);
+  if(hdr.payload_loc == SHM_PAYLOAD_INLINE)
+    hdr.length += shm_round_up(payload_size, 8);
+
+  // a contiguous PAYLOAD_FREE buffer can be handed to a pending message
+  //  instead of being copied
+  bool can_take = ((payload_mode == PAYLOAD_FREE) && !payload.spans &&
+		   (payload.line_count == 1));
+  bool taken = false;
+  {
+    AutoHSLLock al(send_mutexes[target]);
+
+    // messages to a target stay in order, so don't pass any pending ones
+    if(!pending[target].empty() || !try_send(target, hdr, payload)) {
+      ShmPendingMessage pm;
+      pm.hdr = hdr;
+      pm.payload = 0;
+      if((hdr.payload_loc == SHM_PAYLOAD_INLINE) ||
+	 (hdr.payload_loc == SHM_PAYLOAD_HEAP)) {
+	if(can_take) {
+	  pm.payload = const_cast<void *>(payload.data);
+	  taken = true;
+	} else {
+	  pm.payload = malloc(payload_size);
+	  assert(pm.payload != 0);
+	  payload.copy_data(pm.payload);
+	}
+      }
+      pending[target].push_back(pm);
+      __sync_fetch_and_add(&pending_count, 1);
+    }
+  }
+
+  if(can_take && !taken)
+    free(const_cast<void *>(payload.data));
+}
+
+// caller must hold send_mutexes[target]
+bool ShmTransport::try_send(NodeID target, ShmMessageHeader& hdr, const ShmPayload& payload)
+{
+  ShmRing *r = get_ring(my_node_id, target);
+  char *data = ((char *)r) + sizeof(ShmRing);
+
+  // we're the only writer of the tail, but the receiver must be done with
+  //  the space before we can reuse it
+  uint64_t tail = r->tail;
+  uint64_t head = r->head;
+  __sync_synchronize();
+
+  size_t ofs = tail & (shm_ring_size - 1);
+  size_t wrap = 0;
+  if((ofs + hdr.length) > shm_ring_size)
+    wrap = shm_ring_size - ofs;
+  if((tail + wrap + hdr.length - head) > shm_ring_size)
+    return false;
+
+  if(hdr.payload_loc == SHM_PAYLOAD_HEAP) {
+    void *ptr = heap_alloc(hdr.payload_size);
+    if(!ptr) {
+      // ask the receivers to wake us up when they free something
+      control->ranks[my_node_id].heap_wait = 1;
+      return false;
+    }
+    payload.copy_data(ptr);
+    hdr.payload_ptr = ptr;
+  }
+
+  if(wrap) {
+    // skip the end of the ring - records are 8-byte aligned, so there's
+    //  always room for the length and msgid
+    ShmMessageHeader *skip = (ShmMessageHeader *)(data + ofs);
+    skip->length = wrap;
+    skip->msgid = SHM_WRAP_MSGID;
+    tail += wrap;
+    ofs = 0;
+  }
+
+  memcpy(data + ofs, &hdr, sizeof(ShmMessageHeader));
+  if(hdr.payload_loc == SHM_PAYLOAD_INLINE)
+    payload.copy_data(data + ofs + sizeof(ShmMessageHeader));
+
+  // publish the message
+  __sync_synchronize();
+  r->tail = tail + hdr.length;
+
+  ring_doorbell(target);
+  return true;
+}
+
+void *ShmTransport::heap_alloc(size_t bytes)
+{
+  AutoHSLLock al(heap_mutex);
+
+  char *heap = heaps_base + (my_node_id * shm_heap_size);
+
+  // first reclaim any blocks (in allocation order) that receivers are done with
+  while(heap_tail != heap_head) {
+    ShmHeapBlock *b = (ShmHeapBlock *)(heap + (heap_tail % shm_heap_size));
+    if(!b->done) break;
+    heap_tail += b->size;
+  }
+  __sync_synchronize();
+
+  size_t needed = shm_round_up(sizeof(ShmHeapBlock) + bytes, SHM_CACHE_LINE);
+  size_t ofs = heap_head % shm_heap_size;
+  size_t wrap = 0;
+  if((ofs + needed) > shm_heap_size)
+    wrap = shm_heap_size - ofs;
+  if((heap_head + wrap + needed - heap_tail) > shm_heap_size)
+    return 0;
+
+  if(wrap) {
+    // the end of the heap is skipped with an already-done block
+    ShmHeapBlock *skip = (ShmHeapBlock *)(heap + ofs);
+    skip->size = wrap;
+    skip->done = 1;
+    heap_head += wrap;
+    ofs = 0;
+  }
+
+  ShmHeapBlock *b = (ShmHeapBlock *)(heap + ofs);
+  b->size = needed;
+  b->done = 0;
+  heap_head += needed;
+  return (b + 1);
+}
+
+void ShmTransport::release_payload(NodeID source, const void *ptr)
+{
+  if(!ptr) return;
+
+  const char *p = (const char *)ptr;
+  if((p >= heaps_base) && (p < (heaps_base + (shm_ranks * shm_heap_size)))) {
+    // hand the block back to the sender
+    ShmHeapBlock *b = ((ShmHeapBlock *)ptr) - 1;
+    __sync_synchronize();
+    b->done = 1;
+    NodeID owner = (p - heaps_base) / shm_heap_size;
+    if(control->ranks[owner].heap_wait)
+      ring_doorbell(owner);
+    return;
+  }
+
+  // payloads written directly to registered memory stay where they are
+  if((p >= regmem_base) && (p < (regmem_base + (shm_ranks * shm_regmem_size))))
+    return;
+
+  // anything else is a private copy of an inline payload
+  free(const_cast<void *>(ptr));
+}
+
+bool ShmTransport::flush_pending(NodeID target)
+{
+  AutoHSLLock al(send_mutexes[target]);
+
+  bool sent_any = false;
+  while(!pending[target].empty()) {
+    ShmPendingMessage& pm = pending[target].front();
+    if(!try_send(target, pm.hdr, ShmPayload(pm.payload, pm.hdr.payload_size)))
+      break;
+    if(pm.payload)
+      free(pm.payload);
+    pending[target].pop_front();
+    __sync_fetch_and_sub(&pending_count, 1);
+    sent_any = true;
+  }
+  return sent_any;
+}
+
+#define SHM_SHORT_CASE(n) \
+  case n: \
+    (reinterpret_cast<void (*)(token_t, HANDLERARG_PARAMS_ ## n)>(fnptr))(token, HANDLERARG_VALS_ ## n); \
+    break
+
+#define SHM_MEDIUM_CASE(n) \
+  case n: \
+    (reinterpret_cast<void (*)(token_t, void *, size_t, HANDLERARG_PARAMS_ ## n)>(fnptr))(token, buf, nbytes, HANDLERARG_VALS_ ## n); \
+    break
+
+void ShmTransport::dispatch(NodeID sender, const ShmMessageHeader *hdr)
+{
+  void (*fnptr)(void) = shm_handlers[hdr->msgid];
+  if(!fnptr) {
+    log_shm.fatal() << "no handler for message " << hdr->msgid << " from rank " << sender;
+    abort();
+  }
+
+  // the token is just the sender's rank (see get_message_source)
+  token_t token = reinterpret_cast<token_t>(static_cast<intptr_t>(sender));
+  const handlerarg_t *a = hdr->args;
+  handlerarg_t arg0 = a[0], arg1 = a[1], arg2 = a[2], arg3 = a[3];
+  handlerarg_t arg4 = a[4], arg5 = a[5], arg6 = a[6], arg7 = a[7];
+  handlerarg_t arg8 = a[8], arg9 = a[9], arg10 = a[10], arg11 = a[11];
+  handlerarg_t arg12 = a[12], arg13 = a[13], arg14 = a[14], arg15 = a[15];
+
+  if(hdr->payload_loc == SHM_PAYLOAD_NONE) {
+    switch(hdr->num_args) {
+      SHM_SHORT_CASE(2);
+      SHM_SHORT_CASE(4);
+      SHM_SHORT_CASE(6);
+      SHM_SHORT_CASE(8);
+      SHM_SHORT_CASE(10);
+      SHM_SHORT_CASE(12);
+      SHM_SHORT_CASE(14);
+      SHM_SHORT_CASE(16);
+    default: assert(0);
+    }
+  } else {
+    void *buf;
+    size_t nbytes = hdr->payload_size;
+    switch(hdr->payload_loc) {
+    case SHM_PAYLOAD_EMPTY:
+      buf = 0;
+      break;
+    case SHM_PAYLOAD_INLINE:
+      // the ring space is reused as soon as we return, so copy it out
+      buf = malloc(nbytes);
+      assert(buf != 0);
+      memcpy(buf, hdr + 1, nbytes);
+      break;
+    default:
+      // heap and direct payloads are used in place
+      buf = hdr->payload_ptr;
+      break;
+    }
+    switch(hdr->num_args) {
+      SHM_MEDIUM_CASE(2);
+      SHM_MEDIUM_CASE(4);
+      SHM_MEDIUM_CASE(6);
+      SHM_MEDIUM_CASE(8);
+      SHM_MEDIUM_CASE(10);
+      SHM_MEDIUM_CASE(12);
+      SHM_MEDIUM_CASE(14);
+      SHM_MEDIUM_CASE(16);
+    default: assert(0);
+    }
+  }
+}
+
+#undef SHM_SHORT_CASE
+#undef SHM_MEDIUM_CASE
+
+bool ShmTransport::poll(void)
+{
+  bool received = false;
+
+  // only one thread at a time may consume from our rings
+  if(__sync_bool_compare_and_swap(&poll_busy, 0, 1)) {
+    for(NodeID sender = 0; sender <= max_node_id; sender++) {
+      if(sender == my_node_id) continue;
+
+      ShmRing *r = get_ring(sender, my_node_id);
+      const char *data = ((const char *)r) + sizeof(ShmRing);
+      uint64_t head = r->head;
+      uint64_t tail = r->tail;
+      if(head == tail) continue;
+      __sync_synchronize();
+
+      while(head != tail) {
+	const ShmMessageHeader *hdr = (const ShmMessageHeader *)(data + (head & (shm_ring_size - 1)));
+	if(hdr->msgid != SHM_WRAP_MSGID)
+	  dispatch(sender, hdr);
+	head += hdr->length;
+      }
+
+      // let the sender reuse the space
+      __sync_synchronize();
+      r->head = head;
+      received = true;
+    }
+    __sync_synchronize();
+    poll_busy = 0;
+  }
+
+  if(pending_count > 0) {
+    control->ranks[my_node_id].heap_wait = 0;
+    for(NodeID target = 0; target <= max_node_id; target++)
+      if(target != my_node_id)
+	flush_pending(target);
+  }
+
+  return received;
+}
+
+void ShmTransport::barrier(void)
+{
+  barrier_sense = 1 - barrier_sense;
+  if(__sync_add_and_fetch(&control->barrier_count, 1) == shm_ranks) {
+    // last one in resets the count and releases everybody else
+    control->barrier_count = 0;
+    __sync_synchronize();
+    control->barrier_sense = barrier_sense;
+    shm_futex_wake(&control->barrier_sense, SHM_MAX_RANKS);
+  } else {
+    while(control->barrier_sense != barrier_sense)
+      shm_futex_wait(&control->barrier_sense, 1 - barrier_sense, 100000000);
+  }
+  __sync_synchronize();
+}
+
+void ShmTransport::gather(NodeID root, void *dst, const void *src, size_t bytes)
+{
+  assert(bytes <= SHM_SCRATCH_SIZE);
+  memcpy(control->scratch[my_node_id], src, bytes);
+  barrier();
+  if(my_node_id == root)
+    for(NodeID i = 0; i <= max_node_id; i++)
+      memcpy(((char *)dst) + (i * bytes), control->scratch[i], bytes);
+  // nobody can reuse the scratch space until the root has read it
+  barrier();
+}
+
+void ShmTransport::broadcast(NodeID root, void *dst, const void *src, size_t bytes)
+{
+  assert(bytes <= SHM_SCRATCH_SIZE);
+  if(my_node_id == root)
+    memcpy(control->scratch[root], src, bytes);
+  barrier();
+  if(dst != src)
+    memcpy(dst, control->scratch[root], bytes);
+  barrier();
+}
+
+void ShmTransport::start_polling_thread(void)
+{
+  polling_thread = Realm::Thread::create_kernel_thread<ShmTransport,
+						       &ShmTransport::polling_thread_loop>(this,
+											   Realm::ThreadLaunchParameters(),
+											   *core_rsrv);
+}
+
+void ShmTransport::stop_polling_thread(void)
+{
+  shutdown_flag = true;
+  ring_doorbell(my_node_id);
+  if(polling_thread) {
+    polling_thread->join();
+    delete polling_thread;
+    polling_thread = 0;
+  }
+}
+
+void ShmTransport::polling_thread_loop(void)
+{
+  ShmControl::Rank& me = control->ranks[my_node_id];
+  int idle_polls = 0;
+  while(!shutdown_flag) {
+    if(poll()) {
+      idle_polls = 0;
+      continue;
+    }
+
+    // spin for a little while before going to sleep
+    if(++idle_polls < 64) {
+      sched_yield();
+      continue;
+    }
+
+    int seen = me.doorbell;
+    me.sleeping = 1;
+    __sync_synchronize();
+    // check again now that senders can see we might be sleeping
+    bool any = false;
+    for(NodeID sender = 0; (sender <= max_node_id) && !any; sender++)
+      if(sender != my_node_id) {
+	ShmRing *r = get_ring(sender, my_node_id);
+	any = (r->head != r->tail);
+      }
+    if(!any && !shutdown_flag)
+      // wait less long if we have sends waiting for space
+      shm_futex_wait(&me.doorbell, seen,
+		     (pending_count > 0) ? 1000000 : 100000000);
+    me.sleeping = 0;
+    idle_polls = 0;
+
+    if(my_node_id == 0)
+      check_children();
+  }
+}
+
+void ShmTransport::check_children(void)
+{
+  // a rank that dies would leave everybody else waiting on it forever
+  while(true) {
+    int status;
+    pid_t pid = waitpid(-1, &status, WNOHANG);
+    if(pid <= 0) break;
+    std::vector<pid_t>::iterator it = std::find(children.begin(), children.end(), pid);
+    if(it == children.end()) continue;
+    children.erase(it);
+    if(WIFSIGNALED(status) || (WIFEXITED(status) && (WEXITSTATUS(status) != 0))) {
+      log_shm.fatal() << "shared memory rank (pid " << pid << ") exited unexpectedly: status=" << status;
+      exit(1);
+    }
+  }
+}
+
+void ShmTransport::wait_for_children(void)
+{
+  bool ok = true;
+  for(std::vector<pid_t>::const_iterator it = children.begin();
+      it != children.end();
+      it++) {
+    int status;
+    pid_t pid;
+    do {
+      pid = waitpid(*it, &status, 0);
+    } while((pid < 0) && (errno == EINTR));
+    if((pid < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+      log_shm.error() << "shared memory rank (pid " << *it << ") exited abnormally: status=" << status;
+      ok = false;
+    }
+  }
+  children.clear();
+  if(!ok)
+    exit(1);
+}
+
+bool init_shm_ranks(int argc, char **argv)
+{
+  // the logger isn't configured yet, so errors go straight to stderr
+  size_t ring_size_in_kb = shm_ring_size >> 10;
+  size_t heap_size_in_mb = shm_heap_size >> 20;
+  size_t regmem_size_in_mb = shm_regmem_size >> 20;
+
+  Realm::CommandLineParser cp;
+  cp.add_option_int("-ll:shm_ranks", shm_ranks)
+    .add_option_int("-ll:shm_ring", ring_size_in_kb)
+    .add_option_int("-ll:shm_heap", heap_size_in_mb)
+    .add_option_int("-ll:shm_rsize", regmem_size_in_mb);
+  bool ok = cp.parse_command_line(argc, (const char **)argv);
+  if(!ok) {
+    fprintf(stderr, "ERROR: could not parse shared memory transport options\n");
+    return false;
+  }
+
+  if(shm_ranks <= 1) {
+    shm_ranks = 1;
+    return true;
+  }
+  if(shm_ranks > SHM_MAX_RANKS) {
+    fprintf(stderr, "ERROR: at most %d shared memory ranks are supported\n", SHM_MAX_RANKS);
+    return false;
+  }
+
+  // the ring size must be a power of two (and big enough for the largest
+  //  inline message)
+  shm_ring_size = 64 << 10;
+  while(shm_ring_size < (ring_size_in_kb << 10))
+    shm_ring_size <<= 1;
+  shm_heap_size = heap_size_in_mb << 20;
+  shm_regmem_size = regmem_size_in_mb << 20;
+
+  // reserve the whole segment up front - pages are only allocated as they
+  //  are touched
+  size_t seg_size = ShmTransport::segment_size();
+  void *base = mmap(0, seg_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(base == MAP_FAILED) {
+    fprintf(stderr, "ERROR: could not map %zd MB shared memory segment: %s\n",
+	    seg_size >> 20, strerror(errno));
+    return false;
+  }
+
+  // don't let the children inherit (and repeat) any buffered output
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> children;
+  pid_t parent = getpid();
+  for(int i = 1; i < shm_ranks; i++) {
+    pid_t pid = fork();
+    if(pid < 0) {
+      fprintf(stderr, "ERROR: fork failed: %s\n", strerror(errno));
+      for(size_t j = 0; j < children.size(); j++)
+	kill(children[j], SIGKILL);
+      return false;
+    }
+    if(pid == 0) {
+      // in the child - don't outlive rank 0
+#ifdef __linux__
+      prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+      if(getppid() != parent)
+	exit(1);
+      my_node_id = i;
+      children.clear();
+      break;
+    }
+    children.push_back(pid);
+  }
+  max_node_id = shm_ranks - 1;
+
+  shm_transport = new ShmTransport((char *)base, children);
+  return true;
+}
+
+void *get_shm_registered_base(void)
+{
+  return (shm_transport ? shm_transport->registered_base(my_node_id) : 0);
+}
+
+void shm_barrier(void)
+{
+  if(shm_transport)
+    shm_transport->barrier();
+}
+
+void shm_gather(NodeID root, void *dst, const void *src, size_t bytes)
+{
+  if(shm_transport)
+    shm_transport->gather(root, dst, src, bytes);
+  else
+    memcpy(dst, src, bytes);
+}
+
+void shm_broadcast(NodeID root, void *dst, const void *src, size_t bytes)
+{
+  if(shm_transport)
+    shm_transport->broadcast(root, dst, src, bytes);
+  else if(dst != src)
+    memcpy(dst, src, bytes);
+}
+
 void enqueue_message(NodeID target, int msgid,
 		     const void *args, size_t arg_size,
 		     const void *payload, size_t payload_size,
 		     int payload_mode, void *dstptr)
 {
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  assert((shm_transport != 0) && "compiled without USE_GASNET and not using -ll:shm_ranks - active messages not available!");
+  shm_transport->send(target, msgid, args, arg_size,
+		      ShmPayload(payload, payload_size), payload_size,
+		      payload_mode, dstptr);
 }
 
 void enqueue_message(NodeID target, int msgid,
@@ -2920,7 +3946,10 @@ void enqueue_message(NodeID target, int msgid,
 		     off_t line_stride, size_t line_count,
 		     int payload_mode, void *dstptr)
 {
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  assert((shm_transport != 0) && "compiled without USE_GASNET and not using -ll:shm_ranks - active messages not available!");
+  shm_transport->send(target, msgid, args, arg_size,
+		      ShmPayload(payload, line_size, line_stride, line_count),
+		      line_size * line_count, payload_mode, dstptr);
 }
 
 void enqueue_message(NodeID target, int msgid,
@@ -2928,17 +3957,23 @@ void enqueue_message(NodeID target, int msgid,
 		     const SpanList& spans, size_t payload_size,
 		     int payload_mode, void *dstptr)
 {
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  assert((shm_transport != 0) && "compiled without USE_GASNET and not using -ll:shm_ranks - active messages not available!");
+  shm_transport->send(target, msgid, args, arg_size,
+		      ShmPayload(&spans), payload_size,
+		      payload_mode, dstptr);
 }
 
 void do_some_polling(void)
 {
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  assert((shm_transport != 0) && "compiled without USE_GASNET and not using -ll:shm_ranks - active messages not available!");
+  // our caller is going to spin, so give the other ranks a chance to run
+  if(!shm_transport->poll())
+    sched_yield();
 }
 
 size_t get_lmb_size(NodeID target_node)
 {
-  return 0;
+  return (shm_transport ? shm_transport->max_payload_size() : 0);
 }
 
 void record_message(NodeID source, bool sent_reply)
@@ -2951,28 +3986,26 @@ void send_srcptr_release(token_t token, uint64_t srcptr)
 
 NodeID get_message_source(token_t token)
 {
-  return 0;
-}
-
-void enqueue_incoming(NodeID sender, IncomingMessage *msg)
-{
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  return static_cast<NodeID>(reinterpret_cast<intptr_t>(token));
 }
 
 bool adjust_long_msgsize(NodeID source, void *&ptr, size_t &buffer_size,
 			 int message_id, int chunks)
 {
-  return false;
+  // payloads always arrive in one piece
+  return true;
 }
 
 void handle_long_msgptr(NodeID source, const void *ptr)
 {
-  assert(0 && "compiled without USE_GASNET - active messages not available!");
+  assert((shm_transport != 0) && "compiled without USE_GASNET and not using -ll:shm_ranks - active messages not available!");
+  shm_transport->release_payload(source, ptr);
 }
 
 void add_handler_entry(int msgid, void (*fnptr)())
 {
-  // ignored
+  assert((msgid >= 0) && (msgid < 256));
+  shm_handlers[msgid] = fnptr;
 }
 
 void init_endpoints(int gasnet_mem_size_in_mb,
@@ -2981,19 +4014,79 @@ void init_endpoints(int gasnet_mem_size_in_mb,
 		    Realm::CoreReservationSet& crs,
 		    std::vector<std::string>& cmdline)
 {
-  // nothing to do without GASNet
+  // the shared memory options were used before the ranks were forked - just
+  //  remove them from the command line here
+  int dummy_int = 0;
+  size_t dummy_size = 0;
+  Realm::CommandLineParser cp;
+  cp.add_option_int("-ll:shm_ranks", dummy_int)
+    .add_option_int("-ll:shm_ring", dummy_size)
+    .add_option_int("-ll:shm_heap", dummy_size)
+    .add_option_int("-ll:shm_rsize", dummy_size)
+    .add_option_int("-ll:afast", am_fast_handler_threads)
+    .add_option_int("-ll:ashards", am_queue_shards);
+  bool ok = cp.parse_command_line(cmdline);
+  assert(ok);
+
+  if(!shm_transport) return;
+
+  size_t regmem_needed = ((((size_t)registered_mem_size_in_mb) << 20) +
+			  (((size_t)registered_ib_mem_size_in_mb) << 20));
+  if(regmem_needed > shm_regmem_size) {
+    log_shm.fatal() << "registered memory (" << (regmem_needed >> 20)
+		    << " MB) does not fit in the shared memory window ("
+		    << (shm_regmem_size >> 20) << " MB) - increase -ll:shm_rsize";
+    abort();
+  }
+  if(gasnet_mem_size_in_mb > 0) {
+    // each rank would get its own private copy, silently breaking anything
+    //  that expects global memory to be global
+    log_shm.fatal() << "global memory (-ll:gsize) is not supported with shared memory ranks";
+    abort();
+  }
+
+  shm_transport->core_rsrv = new Realm::CoreReservation("shm transport poller", crs,
+							Realm::CoreReservationParameters());
+
+  log_shm.info() << "rank " << my_node_id << " of " << shm_ranks
+		 << ": ring=" << (shm_ring_size >> 10) << " KB, heap="
+		 << (shm_heap_size >> 20) << " MB, rsize=" << (shm_regmem_size >> 20) << " MB";
 }
 
-void start_polling_threads(int)
+void start_polling_threads(int count)
 {
+  // the rings have a single consumer, so one thread does all the polling
+  if(shm_transport)
+    shm_transport->start_polling_thread();
 }
 
-void start_handler_threads(int, Realm::CoreReservationSet&, size_t)
+void start_handler_threads(int count, Realm::CoreReservationSet& crs, size_t stack_size)
 {
+  if(!shm_transport) return;
+
+  incoming_message_manager = new IncomingMessageManager(max_node_id + 1, count,
+							 am_fast_handler_threads,
+							 am_queue_shards, crs);
+
+  incoming_message_manager->start_handler_threads(stack_size);
 }
 
 void stop_activemsg_threads(void)
 {
+  if(!shm_transport) return;
+
+  shm_transport->stop_polling_thread();
+
+  incoming_message_manager->shutdown();
+  delete incoming_message_manager;
+  incoming_message_manager = 0;
+
+#ifdef REALM_PROFILE_AM_HANDLERS
+  report_activemsg_profiling();
+#endif
+
+  if(my_node_id == 0)
+    shm_transport->wait_for_children();
 }
 
 #endif
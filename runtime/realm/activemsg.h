@@ -95,6 +95,8 @@
       MEM_STORAGE_ALLOC_RESP_MSGID,
       MEM_STORAGE_RELEASE_REQ_MSGID,
       MEM_STORAGE_RELEASE_RESP_MSGID,
+      EVENT_SUBSCRIBE_BATCH_MSGID,
+      EVENT_BATCH_MSGID,
     };
 
 
@@ -203,6 +205,24 @@ extern size_t get_lmb_size(NodeID target_node);
 //  to the caller rather than spinning
 extern void do_some_polling(void);
 
+#ifndef USE_GASNET
+// without GASNet, several ranks can still be run on a single node: with
+//  -ll:shm_ranks N, the process forks N-1 more ranks that exchange active
+//  messages through a shared memory segment - this must be called before
+//  any threads are created, and sets my_node_id and max_node_id
+extern bool init_shm_ranks(int argc, char **argv);
+
+// returns the start of this rank's window in the shared memory segment for
+//  registered memories, or 0 if they should just be malloc'd
+extern void *get_shm_registered_base(void);
+
+// collectives across all the shared memory ranks (these stand in for the
+//  gasnet_barrier_* and gasnet_coll_* calls of a GASNet build)
+extern void shm_barrier(void);
+extern void shm_gather(NodeID root, void *dst, const void *src, size_t bytes);
+extern void shm_broadcast(NodeID root, void *dst, const void *src, size_t bytes);
+#endif
+
 /* Necessary base structure for all medium and long active messages */
 struct BaseMedium {
   static const handlerarg_t MESSAGE_ID_MAGIC = 0x0bad0bad;
@@ -257,14 +277,16 @@ extern void record_message(NodeID source, bool sent_reply);
 extern void record_activemsg_profiling(int msgid,
 				       const struct timespec& ts_start,
 				       const struct timespec& ts_end);
+extern void record_activemsg_queue_delay(int msgid,
+					 const struct timespec& ts_enqueue,
+					 const struct timespec& ts_start);
 
+// records how long the message waited in the incoming queues and how long
+//  its handler took
 template <int MSGID>
 class ActiveMsgProfilingHelper {
  public:
-  ActiveMsgProfilingHelper(void) 
-  {
-    clock_gettime(CLOCK_MONOTONIC, &ts_start);
-  }
+  ActiveMsgProfilingHelper(const IncomingMessage *msg);
 
   ~ActiveMsgProfilingHelper(void)
   {
@@ -284,7 +306,7 @@ class ActiveMsgProfilingHelper {
  public:
   // have to define a constructor or the uses of this below will be 
   //  reported as unused variables...
-  ActiveMsgProfilingHelper(void) {}
+  ActiveMsgProfilingHelper(const IncomingMessage *msg) {}
 };
 #endif
 
@@ -304,8 +326,20 @@ class IncomingMessage {
   virtual size_t get_msgsize(void) = 0;
 
   IncomingMessage *next_msg;
+#ifdef REALM_PROFILE_AM_HANDLERS
+  struct timespec ts_enqueue; // set when the message is queued for a handler
+#endif
 };
 
+#ifdef REALM_PROFILE_AM_HANDLERS
+template <int MSGID>
+inline ActiveMsgProfilingHelper<MSGID>::ActiveMsgProfilingHelper(const IncomingMessage *msg)
+{
+  clock_gettime(CLOCK_MONOTONIC, &ts_start);
+  record_activemsg_queue_delay(MSGID, msg->ts_enqueue, ts_start);
+}
+#endif
+
 template <class MSGTYPE>
 void dummy_short_handler(MSGTYPE dummy) {}
 
@@ -327,7 +361,7 @@ class IncomingShortMessage : public IncomingMessage {
 
   virtual void run_handler(void)
   {
-    ActiveMsgProfilingHelper<MSGID> amph;
+    ActiveMsgProfilingHelper<MSGID> amph(this);
     (*SHORT_HNDL_PTR)(u.typed);
   }
 
@@ -353,7 +387,7 @@ class IncomingMediumMessage : public IncomingMessage {
   virtual void run_handler(void)
   {
     {
-      ActiveMsgProfilingHelper<MSGID> amph;
+      ActiveMsgProfilingHelper<MSGID> amph(this);
       (*MED_HNDL_PTR)(u.typed, msgdata, msglen);
     }
     handle_long_msgptr(sender, msgdata);
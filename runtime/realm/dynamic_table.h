@@ -18,6 +18,9 @@
 #ifndef REALM_DYNAMIC_TABLE_H
 #define REALM_DYNAMIC_TABLE_H
 
+#include <pthread.h>
+#include <map>
+
 namespace Realm {
 
     // we have a base type that's element-type agnostic
@@ -62,10 +65,17 @@ namespace Realm {
       bool has_entry(IT index) const;
       ET *lookup_entry(IT index, int owner, typename ALLOCATOR::FreeList *free_list = 0);
 
+      // never takes a lock - returns 0 if the leaf holding 'index' hasn't
+      //  been populated yet
+      ET *lookup_existing_entry(IT index) const;
+
     protected:
       NodeBase *new_tree_node(int level, IT first_index, IT last_index,
 			      int owner, typename ALLOCATOR::FreeList *free_list);
 
+      // walks the existing tree to the leaf for 'index', if there is one
+      NodeBase *find_leaf(IT index) const;
+
       // lock protects _changes_ to 'root', but not access to it
       LT lock;
       NodeBase * volatile root;
@@ -81,6 +91,14 @@ namespace Realm {
       typedef typename ALLOCATOR::LT LT;
 
       DynamicTableFreeList(DynamicTable<ALLOCATOR>& _table, int _owner);
+      ~DynamicTableFreeList(void);
+
+      // each thread keeps a small cache of free entries, which is refilled
+      //  from the shared list this many entries at a time, so that most
+      //  allocations and frees don't need the lock - a cache that reaches
+      //  this size gives all but half a batch back, so threads that only
+      //  free entries don't hoard them
+      static const int THREAD_CACHE_BATCH = 32;
 
       ET *alloc_entry(void);
       void free_entry(ET *entry);
@@ -94,6 +112,36 @@ namespace Realm {
       LT lock;
       ET * volatile first_free;
       IT volatile next_alloc;
+
+    protected:
+      struct ThreadCache {
+	int serial;
+	ET *first_free;
+	int count;
+	ThreadCache *next;
+      };
+
+      ThreadCache *get_thread_cache(void);
+
+      // moves a chain of 'count' entries onto the shared list
+      void return_entries(ET *first, ET *last);
+
+      // called on thread exit to give each of the thread's caches back to
+      //  its free list (if that still exists)
+      static void flush_thread_caches(void *arg);
+      static void create_cache_key(void);
+
+      // caches are matched by serial number rather than address so that a
+      //  free list allocated where an old one was doesn't inherit its
+      //  entries
+      int serial;
+      static int next_serial;
+      static __thread ThreadCache *thread_caches;
+      static pthread_key_t cache_key;
+      static pthread_once_t cache_key_once;
+      // free lists that haven't been destroyed yet, by serial
+      static pthread_mutex_t live_lists_mutex;
+      static std::map<int, DynamicTableFreeList<ALLOCATOR> *> *live_lists;
     };
 	
 }; // namespace Realm
@@ -101,7 +101,7 @@ namespace Realm {
   }
 
   template<typename ALLOCATOR>
-  bool DynamicTable<ALLOCATOR>::has_entry(IT index) const
+  typename DynamicTable<ALLOCATOR>::NodeBase *DynamicTable<ALLOCATOR>::find_leaf(IT index) const
   {
     // first, figure out how many levels the tree must have to find our index
     int level_needed = 0;
@@ -113,14 +113,15 @@ namespace Realm {
 
     NodeBase *n = root;
     if (!n || (n->level < level_needed))
-      return false;
+      return 0;
 
     // when we get here, root is high enough
     assert((level_needed <= n->level) &&
 	   (index >= n->first_index) &&
 	   (index <= n->last_index));
 
-    // now walk tree, populating the path we need
+    // now walk tree - nodes are fully constructed before they are linked in,
+    //  so no locks are needed to read them
     while(n->level > 0) {
       // intermediate nodes
       typename ALLOCATOR::INNER_TYPE *inner = static_cast<typename ALLOCATOR::INNER_TYPE *>(n);
@@ -129,9 +130,9 @@ namespace Realm {
 	      ((((IT)1) << ALLOCATOR::INNER_BITS) - 1));
       assert((i >= 0) && (((size_t)i) < ALLOCATOR::INNER_TYPE::SIZE));
 
-      NodeBase *child = inner->elems[i];
+      NodeBase *child = *static_cast<NodeBase * volatile *>(&inner->elems[i]);
       if(child == 0) {
-	return false;	
+	return 0;
       }
       assert((child != 0) &&
 	     (child->level == (n->level - 1)) &&
@@ -139,12 +140,37 @@ namespace Realm {
 	     (index <= child->last_index));
       n = child;
     }
-    return true;
+    return n;
+  }
+
+  template<typename ALLOCATOR>
+  bool DynamicTable<ALLOCATOR>::has_entry(IT index) const
+  {
+    return (find_leaf(index) != 0);
+  }
+
+  template <typename ALLOCATOR>
+  typename DynamicTable<ALLOCATOR>::ET *DynamicTable<ALLOCATOR>::lookup_existing_entry(IT index) const
+  {
+    NodeBase *n = find_leaf(index);
+    if(!n)
+      return 0;
+
+    typename ALLOCATOR::LEAF_TYPE *leaf = static_cast<typename ALLOCATOR::LEAF_TYPE *>(n);
+    int ofs = (index & ((((IT)1) << ALLOCATOR::LEAF_BITS) - 1));
+    return &(leaf->elems[ofs]);
   }
 
   template <typename ALLOCATOR>
   typename DynamicTable<ALLOCATOR>::ET *DynamicTable<ALLOCATOR>::lookup_entry(IT index, int owner, typename ALLOCATOR::FreeList *free_list /*= 0*/)
   {
+    // the common case is an entry in a leaf that's already there
+    {
+      ET *entry = lookup_existing_entry(index);
+      if(entry)
+	return entry;
+    }
+
     // first, figure out how many levels the tree must have to find our index
     int level_needed = 0;
     int elems_addressable = 1 << ALLOCATOR::LEAF_BITS;
@@ -163,7 +189,10 @@ namespace Realm {
 
       if(!root) {
 	// simple case - just create a root node at the level we want
-	root = new_tree_node(level_needed, 0, elems_addressable - 1, owner, free_list);
+	NodeBase *new_root = new_tree_node(level_needed, 0, elems_addressable - 1, owner, free_list);
+	// lock-free readers must never see a partially-constructed node
+	__sync_synchronize();
+	root = new_root;
 	// we're always first to add a node, so no race conditions here
 	bool ok = __sync_bool_compare_and_swap(&first_alloced_node,
 					       0,
@@ -178,6 +207,7 @@ namespace Realm {
 	  NodeBase *parent = new_tree_node(parent_level, parent_first, parent_last, owner, free_list);
 	  typename ALLOCATOR::INNER_TYPE *inner = static_cast<typename ALLOCATOR::INNER_TYPE *>(parent);
 	  inner->elems[0] = root;
+	  __sync_synchronize();
 	  root = parent;
 	  // this is not synchronized against threads that might be adding
 	  //  interior/leaf nodes, so CAS loop is required
@@ -224,7 +254,8 @@ namespace Realm {
 	  IT child_last = inner->first_index + ((i + 1) << child_shift) - 1;
 
 	  child = new_tree_node(child_level, child_first, child_last, owner, free_list);
-	  inner->elems[i] = child;
+	  __sync_synchronize();
+	  *static_cast<NodeBase * volatile *>(&inner->elems[i]) = child;
 	  // this is not synchronized against threads that might be adding
 	  //  parent or other interior/leaf nodes, so CAS loop is required
 	  while(true) {
@@ -257,36 +288,151 @@ namespace Realm {
   // class DynamicTableFreeList<ALLOCATOR>
   //
 
+  template <typename ALLOCATOR>
+  /*static*/ int DynamicTableFreeList<ALLOCATOR>::next_serial = 0;
+
+  template <typename ALLOCATOR>
+  /*static*/ __thread typename DynamicTableFreeList<ALLOCATOR>::ThreadCache *DynamicTableFreeList<ALLOCATOR>::thread_caches = 0;
+
+  template <typename ALLOCATOR>
+  /*static*/ pthread_key_t DynamicTableFreeList<ALLOCATOR>::cache_key;
+
+  template <typename ALLOCATOR>
+  /*static*/ pthread_once_t DynamicTableFreeList<ALLOCATOR>::cache_key_once = PTHREAD_ONCE_INIT;
+
+  template <typename ALLOCATOR>
+  /*static*/ pthread_mutex_t DynamicTableFreeList<ALLOCATOR>::live_lists_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+  template <typename ALLOCATOR>
+  /*static*/ std::map<int, DynamicTableFreeList<ALLOCATOR> *> *DynamicTableFreeList<ALLOCATOR>::live_lists = 0;
+
   template <typename ALLOCATOR>
   DynamicTableFreeList<ALLOCATOR>::DynamicTableFreeList(DynamicTable<ALLOCATOR>& _table, int _owner)
     : table(_table), owner(_owner), first_free(0), next_alloc(0)
-  {}
+    , serial(__sync_fetch_and_add(&next_serial, 1))
+  {
+    pthread_mutex_lock(&live_lists_mutex);
+    if(!live_lists)
+      live_lists = new std::map<int, DynamicTableFreeList<ALLOCATOR> *>;
+    (*live_lists)[serial] = this;
+    pthread_mutex_unlock(&live_lists_mutex);
+  }
 
   template <typename ALLOCATOR>
-  typename DynamicTableFreeList<ALLOCATOR>::ET *DynamicTableFreeList<ALLOCATOR>::alloc_entry(void)
+  DynamicTableFreeList<ALLOCATOR>::~DynamicTableFreeList(void)
   {
-    // take the lock first, since we're messing with the free list
-    lock.lock();
+    // exiting threads must not hand entries back to us after this
+    pthread_mutex_lock(&live_lists_mutex);
+    live_lists->erase(serial);
+    pthread_mutex_unlock(&live_lists_mutex);
+  }
 
-    // if the free list is empty, we can fill it up by referencing the next entry to be allocated -
-    // this uses the existing dynamic-filling code to avoid race conditions
-    while(!first_free) {
-      IT to_lookup = next_alloc;
-      next_alloc += ((IT)1) << ALLOCATOR::LEAF_BITS; // do this before letting go of lock
-      lock.unlock();
+  template <typename ALLOCATOR>
+  /*static*/ void DynamicTableFreeList<ALLOCATOR>::create_cache_key(void)
+  {
 #ifndef NDEBUG
-      typename DynamicTable<ALLOCATOR>::ET *dummy =
+    int ret =
 #endif
-        table.lookup_entry(to_lookup, owner, this);
-      assert(dummy != 0);
-      // can't actually use dummy because we let go of lock - retake lock and hopefully find non-empty
-      //  list next time
-      lock.lock();
+      pthread_key_create(&cache_key, flush_thread_caches);
+    assert(ret == 0);
+  }
+
+  template <typename ALLOCATOR>
+  /*static*/ void DynamicTableFreeList<ALLOCATOR>::flush_thread_caches(void *arg)
+  {
+    ThreadCache *tc = (ThreadCache *)arg;
+    thread_caches = 0;
+
+    pthread_mutex_lock(&live_lists_mutex);
+    while(tc) {
+      if(tc->first_free) {
+	typename std::map<int, DynamicTableFreeList<ALLOCATOR> *>::const_iterator it = live_lists->find(tc->serial);
+	if(it != live_lists->end()) {
+	  ET *last = tc->first_free;
+	  while(last->next_free)
+	    last = last->next_free;
+	  it->second->return_entries(tc->first_free, last);
+	}
+      }
+      ThreadCache *next = tc->next;
+      delete tc;
+      tc = next;
     }
+    pthread_mutex_unlock(&live_lists_mutex);
+  }
 
-    typename DynamicTable<ALLOCATOR>::ET *entry = first_free;
-    first_free = entry->next_free;
+  template <typename ALLOCATOR>
+  void DynamicTableFreeList<ALLOCATOR>::return_entries(ET *first, ET *last)
+  {
+    lock.lock();
+    last->next_free = first_free;
+    first_free = first;
     lock.unlock();
+  }
+
+  template <typename ALLOCATOR>
+  typename DynamicTableFreeList<ALLOCATOR>::ThreadCache *DynamicTableFreeList<ALLOCATOR>::get_thread_cache(void)
+  {
+    // a thread rarely uses more than one or two free lists of a given type
+    for(ThreadCache *tc = thread_caches; tc; tc = tc->next)
+      if(tc->serial == serial)
+	return tc;
+
+    ThreadCache *tc = new ThreadCache;
+    tc->serial = serial;
+    tc->first_free = 0;
+    tc->count = 0;
+    tc->next = thread_caches;
+    thread_caches = tc;
+    // the key's value is what gets flushed when this thread exits
+    pthread_once(&cache_key_once, create_cache_key);
+    pthread_setspecific(cache_key, tc);
+    return tc;
+  }
+
+  template <typename ALLOCATOR>
+  typename DynamicTableFreeList<ALLOCATOR>::ET *DynamicTableFreeList<ALLOCATOR>::alloc_entry(void)
+  {
+    ThreadCache *tc = get_thread_cache();
+
+    if(!tc->first_free) {
+      // take the lock first, since we're messing with the free list
+      lock.lock();
+
+      // if the free list is empty, we can fill it up by referencing the next entry to be allocated -
+      // this uses the existing dynamic-filling code to avoid race conditions
+      while(!first_free) {
+	IT to_lookup = next_alloc;
+	next_alloc += ((IT)1) << ALLOCATOR::LEAF_BITS; // do this before letting go of lock
+	lock.unlock();
+#ifndef NDEBUG
+	typename DynamicTable<ALLOCATOR>::ET *dummy =
+#endif
+	  table.lookup_entry(to_lookup, owner, this);
+	assert(dummy != 0);
+	// can't actually use dummy because we let go of lock - retake lock and hopefully find non-empty
+	//  list next time
+	lock.lock();
+      }
+
+      // move up to a batch of entries to this thread's cache
+      ET *last = first_free;
+      int count = 1;
+      while((count < THREAD_CACHE_BATCH) && last->next_free) {
+	last = last->next_free;
+	count++;
+      }
+      tc->first_free = first_free;
+      first_free = last->next_free;
+      lock.unlock();
+
+      last->next_free = 0;
+      tc->count = count;
+    }
+
+    ET *entry = tc->first_free;
+    tc->first_free = entry->next_free;
+    tc->count--;
 
     return entry;
   }
@@ -294,11 +440,24 @@ namespace Realm {
   template <typename ALLOCATOR>
   void DynamicTableFreeList<ALLOCATOR>::free_entry(ET *entry)
   {
-    // just stick ourselves on front of free list
-    lock.lock();
-    entry->next_free = first_free;
-    first_free = entry;
-    lock.unlock();
+    // just stick ourselves on front of this thread's free list
+    ThreadCache *tc = get_thread_cache();
+    entry->next_free = tc->first_free;
+    tc->first_free = entry;
+    tc->count++;
+
+    // if the cache has grown too big, give most of it back to the shared
+    //  list in one go
+    if(tc->count >= THREAD_CACHE_BATCH) {
+      int to_return = tc->count - (THREAD_CACHE_BATCH / 2);
+      ET *first = tc->first_free;
+      ET *last = first;
+      for(int i = 1; i < to_return; i++)
+	last = last->next_free;
+      tc->first_free = last->next_free;
+      tc->count -= to_return;
+      return_entries(first, last);
+    }
   }
 
   // allocates a range of IDs that can be given to a remote node for remote allocation
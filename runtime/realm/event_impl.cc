@@ -20,6 +20,10 @@
 #include "realm/logging.h"
 #include "realm/threads.h"
 #include "realm/profiling.h"
+#include "realm/cmdline.h"
+
+#include <algorithm>
+#include <unistd.h>
 
 namespace Realm {
 
@@ -358,6 +362,16 @@ namespace Realm {
     // if non-zero, eagerly checks deferred user event triggers for loops up to the
     //  specified limit
     int event_loop_detection_limit = 0;
+
+    // if greater than one, merges of more than this many untriggered events are
+    //  built as a tree of mergers with at most this fan-in
+    int event_merge_radix = 0;
+
+    // if greater than one, barrier trigger notifications to more than this
+    //  many nodes are sent down a tree with this fan-out, and (if event
+    //  message batching is enabled) ready arrivals are combined on their way
+    //  up a tree of the same radix to the owner
+    int barrier_radix = 0;
   };
 
   void UserEvent::trigger(Event wait_on) const
@@ -656,6 +670,45 @@ namespace Realm {
   }
 
 
+    // subscriptions to remote events that a merge needs are collected by owner
+    //  node so that each owner gets a single message no matter how many of the
+    //  inputs it owns
+    class SubscriptionBatcher {
+    public:
+      void add(NodeID owner, Event event, EventImpl::gen_t previous_gen)
+      {
+	EventSubscribeBatchMessage::Subscription s;
+	s.event = event;
+	s.previous_subscribe_gen = previous_gen;
+	by_owner[owner].push_back(s);
+      }
+
+      void send_all(void)
+      {
+	for(std::map<NodeID, std::vector<EventSubscribeBatchMessage::Subscription> >::const_iterator it = by_owner.begin();
+	    it != by_owner.end();
+	    it++) {
+	  const std::vector<EventSubscribeBatchMessage::Subscription>& subs = it->second;
+	  if(subs.size() == 1)
+	    EventSubscribeMessage::send_request(it->first, subs[0].event,
+						subs[0].previous_subscribe_gen);
+	  else
+	    for(size_t i = 0; i < subs.size(); i += MAX_BATCH_SIZE) {
+	      size_t count = subs.size() - i;
+	      if(count > MAX_BATCH_SIZE) count = MAX_BATCH_SIZE;
+	      EventSubscribeBatchMessage::send_request(it->first, &subs[i], count);
+	    }
+	}
+	by_owner.clear();
+      }
+
+    protected:
+      // keeps each message's payload to a reasonable size
+      static const size_t MAX_BATCH_SIZE = 4096;
+
+      std::map<NodeID, std::vector<EventSubscribeBatchMessage::Subscription> > by_owner;
+    };
+
     // Perform our merging events in a lock free way
     class EventMerger : public EventWaiter {
     public:
@@ -693,6 +746,25 @@ namespace Realm {
 	EventImpl::add_waiter(wait_for, this);
       }
 
+      // like add_event, but for an input the caller has already seen as
+      //  untriggered - if a generational event needs a remote subscription, it
+      //  is added to 'batcher' instead of being sent right away
+      void add_untriggered_event(Event wait_for, SubscriptionBatcher& batcher)
+      {
+        __sync_fetch_and_add(&count_needed, 1);
+	ID id(wait_for);
+	if(id.is_event()) {
+	  GenEventImpl *impl = get_runtime()->get_genevent_impl(wait_for);
+	  NodeID subscribe_owner = -1;
+	  EventImpl::gen_t previous_subscribe_gen = 0;
+	  impl->add_waiter(id.event.generation, this,
+			   subscribe_owner, previous_subscribe_gen);
+	  if(subscribe_owner != -1)
+	    batcher.add(subscribe_owner, wait_for, previous_subscribe_gen);
+	} else
+	  EventImpl::add_waiter(wait_for, this);
+      }
+
       // arms the merged event once you're done adding input events - just
       //  decrements the count for the implicit 'init done' event
       // return a boolean saying whether it triggered upon arming (which
@@ -748,90 +820,31 @@ namespace Realm {
       int faults_observed;
     };
 
-    // creates an event that won't trigger until all input events have
-    /*static*/ Event GenEventImpl::merge_events(const std::set<Event>& wait_for,
-						bool ignore_faults)
+    // adds inputs that were untriggered when the caller looked at them to a
+    //  merger - generational events get their subscriptions (if any) batched
+    static void add_untriggered_events(EventMerger *m, Event finish_event,
+				       const std::vector<Event>& inputs,
+				       SubscriptionBatcher& batcher)
     {
-      if (wait_for.empty())
-        return Event::NO_EVENT;
-      // scan through events to see how many exist/haven't fired - we're
-      //  interested in counts of 0, 1, or 2+ - also remember the first
-      //  event we saw for the count==1 case
-      int wait_count = 0;
-      Event first_wait;
-      for(std::set<Event>::const_iterator it = wait_for.begin();
-	  (it != wait_for.end()) && (wait_count < 2);
-	  it++) {
-	bool poisoned = false;
-	if((*it).has_triggered_faultaware(poisoned)) {
-          if(poisoned) {
-	    // if we're not ignoring faults, we need to propagate this fault, and can do
-	    //  so by just returning this poisoned event
-	    if(!ignore_faults) {
-	      log_poison.info() << "merging events - " << (*it) << " already poisoned";
-	      return *it;
-	    }
-          }
-	} else {
-	  if(!wait_count) first_wait = *it;
-	  wait_count++;
-	}
-      }
-      log_event.debug() << "merging events - at least " << wait_count << " not triggered";
-
-      // Avoid these optimizations if we are doing event graph tracing
-      // we also cannot return an input event directly in the (wait_count == 1) case
-      //  if we're ignoring faults
-#ifndef EVENT_GRAPH_TRACE
-      // counts of 0 or 1 don't require any merging
-      if(wait_count == 0) return Event::NO_EVENT;
-      if((wait_count == 1) && !ignore_faults) return first_wait;
-#else
-      if((wait_for.size() == 1) && !ignore_faults)
-        return *(wait_for.begin());
-#endif
-      // counts of 2+ require building a new event and a merger to trigger it
-      Event finish_event = GenEventImpl::create_genevent()->current_event();
-      EventMerger *m = new EventMerger(finish_event, ignore_faults);
-
-#ifdef EVENT_GRAPH_TRACE
-      log_event_graph.info("Event Merge: (" IDFMT ",%d) %ld", 
-			   finish_event.id, finish_event.gen, wait_for.size());
-#endif
-
-      for(std::set<Event>::const_iterator it = wait_for.begin();
-	  it != wait_for.end();
+      for(std::vector<Event>::const_iterator it = inputs.begin();
+	  it != inputs.end();
 	  it++) {
 	log_event.info() << "event merging: event=" << finish_event << " wait_on=" << *it;
-	m->add_event(*it);
-#ifdef EVENT_GRAPH_TRACE
-        log_event_graph.info("Event Precondition: (" IDFMT ",%d) (" IDFMT ",%d)",
-                             finish_event.id, finish_event.gen,
-                             it->id, it->gen);
-#endif
+	m->add_untriggered_event(*it, batcher);
       }
-
-      // once they're all added - arm the thing (it might go off immediately)
-      if(m->arm())
-        delete m;
-
-      return finish_event;
     }
 
-    // creates an event that won't trigger until all input events have
-    /*static*/ Event GenEventImpl::merge_events(const std::vector<Event>& wait_for,
-						bool ignore_faults)
+    // common code for merging a set or vector of events
+    template <typename IT>
+    static Event merge_event_range(IT first, IT last, size_t input_count,
+				   bool ignore_faults)
     {
-      if (wait_for.empty())
+      if(first == last)
         return Event::NO_EVENT;
-      // scan through events to see how many exist/haven't fired - we're
-      //  interested in counts of 0, 1, or 2+ - also remember the first
-      //  event we saw for the count==1 case
-      int wait_count = 0;
-      Event first_wait;
-      for(std::vector<Event>::const_iterator it = wait_for.begin();
-	  (it != wait_for.end()) && (wait_count < 2);
-	  it++) {
+      // a single pass through the inputs finds the ones that haven't triggered
+      //  yet - nothing else needs to be looked at (or subscribed to) again
+      std::vector<Event> pending;
+      for(IT it = first; it != last; it++) {
 	bool poisoned = false;
 	if((*it).has_triggered_faultaware(poisoned)) {
           if(poisoned) {
@@ -842,45 +855,68 @@ namespace Realm {
 	      return *it;
 	    }
           }
-	} else {
-	  if(!wait_count) first_wait = *it;
-	  wait_count++;
-	}
+	} else
+	  pending.push_back(*it);
       }
-      log_event.debug() << "merging events - at least " << wait_count << " not triggered";
+      log_event.debug() << "merging events - " << pending.size() << " not triggered";
 
       // Avoid these optimizations if we are doing event graph tracing
       // we also cannot return an input event directly in the (wait_count == 1) case
       //  if we're ignoring faults
 #ifndef EVENT_GRAPH_TRACE
       // counts of 0 or 1 don't require any merging
-      if(wait_count == 0) return Event::NO_EVENT;
-      if((wait_count == 1) && !ignore_faults) return first_wait;
+      if(pending.empty()) return Event::NO_EVENT;
+      if((pending.size() == 1) && !ignore_faults) return pending[0];
 #else
-      if((wait_for.size() == 1) && !ignore_faults)
-        return *(wait_for.begin());
+      if((input_count == 1) && !ignore_faults)
+        return *first;
 #endif
       // counts of 2+ require building a new event and a merger to trigger it
       Event finish_event = GenEventImpl::create_genevent()->current_event();
-      EventMerger *m = new EventMerger(finish_event, ignore_faults);
 
 #ifdef EVENT_GRAPH_TRACE
       log_event_graph.info("Event Merge: (" IDFMT ",%d) %ld", 
-			   finish_event.id, finish_event.gen, wait_for.size());
-#endif
-
-      for(std::vector<Event>::const_iterator it = wait_for.begin();
-	  it != wait_for.end();
-	  it++) {
-	log_event.info() << "event merging: event=" << finish_event << " wait_on=" << *it;
-	m->add_event(*it);
-#ifdef EVENT_GRAPH_TRACE
+			   finish_event.id, finish_event.gen, input_count);
+      for(IT it = first; it != last; it++)
         log_event_graph.info("Event Precondition: (" IDFMT ",%d) (" IDFMT ",%d)",
                              finish_event.id, finish_event.gen,
                              it->id, it->gen);
 #endif
+
+      SubscriptionBatcher batcher;
+
+      // very wide merges are built as a tree of mergers with bounded fan-in,
+      //  so that the triggering of the inputs isn't all contending on (and
+      //  cascading from) a single merger
+      size_t radix = Config::event_merge_radix;
+      if(radix > 1) {
+	while(pending.size() > radix) {
+	  std::vector<Event> next_level;
+	  for(size_t i = 0; i < pending.size(); i += radix) {
+	    if((i + 1) == pending.size()) {
+	      next_level.push_back(pending[i]);
+	      break;
+	    }
+	    std::vector<Event> group(pending.begin() + i,
+				     pending.begin() + std::min(i + radix, pending.size()));
+	    Event sub_event = GenEventImpl::create_genevent()->current_event();
+	    EventMerger *sub = new EventMerger(sub_event, ignore_faults);
+	    add_untriggered_events(sub, sub_event, group, batcher);
+	    if(sub->arm())
+	      delete sub;
+	    next_level.push_back(sub_event);
+	  }
+	  pending.swap(next_level);
+	}
       }
 
+      EventMerger *m = new EventMerger(finish_event, ignore_faults);
+      add_untriggered_events(m, finish_event, pending, batcher);
+
+      // subscriptions go out before arming - a merger can't trigger until armed
+      //  anyway, and this gets the requests to the owners as early as possible
+      batcher.send_all();
+
       // once they're all added - arm the thing (it might go off immediately)
       if(m->arm())
         delete m;
@@ -888,6 +924,22 @@ namespace Realm {
       return finish_event;
     }
 
+    // creates an event that won't trigger until all input events have
+    /*static*/ Event GenEventImpl::merge_events(const std::set<Event>& wait_for,
+						bool ignore_faults)
+    {
+      return merge_event_range(wait_for.begin(), wait_for.end(),
+			       wait_for.size(), ignore_faults);
+    }
+
+    // creates an event that won't trigger until all input events have
+    /*static*/ Event GenEventImpl::merge_events(const std::vector<Event>& wait_for,
+						bool ignore_faults)
+    {
+      return merge_event_range(wait_for.begin(), wait_for.end(),
+			       wait_for.size(), ignore_faults);
+    }
+
     /*static*/ Event GenEventImpl::ignorefaults(Event wait_for)
     {
       bool poisoned = false;
@@ -1050,6 +1102,23 @@ namespace Realm {
 
     bool GenEventImpl::add_waiter(gen_t needed_gen, EventWaiter *waiter)
     {
+      NodeID subscribe_owner = -1;
+      gen_t previous_subscribe_gen = 0;
+      bool ok = add_waiter(needed_gen, waiter,
+			   subscribe_owner, previous_subscribe_gen);
+
+      if(subscribe_owner != -1)
+	EventSubscribeMessage::send_request(subscribe_owner,
+					    make_event(needed_gen),
+					    previous_subscribe_gen);
+
+      return ok;
+    }
+
+    bool GenEventImpl::add_waiter(gen_t needed_gen, EventWaiter *waiter,
+				  NodeID& subscribe_owner,
+				  gen_t& previous_subscribe_gen)
+    {
 #ifdef EVENT_TRACING
       {
         EventTraceItem &item = Tracer<EventTraceItem>::trace_item();
@@ -1064,8 +1133,6 @@ namespace Realm {
       bool trigger_now = false;
       bool trigger_poisoned = false;
 
-      int subscribe_owner = -1;
-      gen_t previous_subscribe_gen = 0;
       {
 	AutoHSLLock a(mutex);
 
@@ -1108,11 +1175,6 @@ namespace Realm {
 	}
       }
 
-      if((subscribe_owner != -1))
-	EventSubscribeMessage::send_request(owner,
-					    make_event(needed_gen),
-					    previous_subscribe_gen);
-
       if(trigger_now) {
 	bool nuke = waiter->event_triggered(make_event(needed_gen),
 					    trigger_poisoned);
@@ -1164,9 +1226,26 @@ namespace Realm {
   };
   
 
+  // adds an update for each target of a broadcast to the event batcher
+  //  (each one goes out on its own if the batcher has shut down since)
+  struct BatchedUpdateHelper {
+    inline void apply(NodeID target)
+    {
+      EventUpdateMessage::send_request(target, event,
+				       num_poisoned, poisoned_generations);
+    }
+
+    Event event;
+    int num_poisoned;
+    const EventImpl::gen_t *poisoned_generations;
+  };
+
   /*static*/ void EventTriggerMessage::send_request(NodeID target, Event event,
 						    bool poisoned)
   {
+    if(get_runtime()->event_batcher.add_trigger(target, event, poisoned))
+      return;
+
     RequestArgs args;
 
     args.node = my_node_id;
@@ -1180,6 +1259,10 @@ namespace Realm {
 						   int num_poisoned,
 						   const EventImpl::gen_t *poisoned_generations)
   {
+    if(get_runtime()->event_batcher.add_update(target, event,
+					       num_poisoned, poisoned_generations))
+      return;
+
     RequestArgs args;
 
     args.event = event;
@@ -1193,6 +1276,15 @@ namespace Realm {
 							int num_poisoned,
 							const EventImpl::gen_t *poisoned_generations)
   {
+    if(get_runtime()->event_batcher.is_enabled()) {
+      BatchedUpdateHelper helper;
+      helper.event = event;
+      helper.num_poisoned = num_poisoned;
+      helper.poisoned_generations = poisoned_generations;
+      targets.map(helper);
+      return;
+    }
+
     MediumBroadcastHelper<EventUpdateMessage> args;
 
     args.event = event;
@@ -1204,6 +1296,9 @@ namespace Realm {
 
   /*static*/ void EventSubscribeMessage::send_request(NodeID target, Event event, EventImpl::gen_t previous_gen)
   {
+    if(get_runtime()->event_batcher.add_subscribe(target, event, previous_gen))
+      return;
+
     RequestArgs args;
 
     args.node = my_node_id;
@@ -1212,6 +1307,374 @@ namespace Realm {
     Message::request(target, args);
   }
 
+  /*static*/ void EventSubscribeBatchMessage::send_request(NodeID target,
+							 const Subscription *subscriptions,
+							 size_t count)
+  {
+    // if event messages are being batched anyway, these go in the same
+    //  buffer as everything else headed to this target
+    if(get_runtime()->event_batcher.is_enabled()) {
+      for(size_t i = 0; i < count; i++)
+	EventSubscribeMessage::send_request(target, subscriptions[i].event,
+					    subscriptions[i].previous_subscribe_gen);
+      return;
+    }
+
+    RequestArgs args;
+
+    args.node = my_node_id;
+    Message::request(target, args, subscriptions, count * sizeof(Subscription),
+		     PAYLOAD_COPY);
+  }
+
+  /*static*/ void EventSubscribeBatchMessage::handle_request(RequestArgs args,
+							   const void *data,
+							   size_t datalen)
+  {
+    const Subscription *subscriptions = static_cast<const Subscription *>(data);
+    size_t count = datalen / sizeof(Subscription);
+    assert((count * sizeof(Subscription)) == datalen);
+
+    log_event.debug() << "batched event subscription: node=" << args.node
+		      << " count=" << count;
+
+    // each one is handled exactly as if it had arrived on its own
+    for(size_t i = 0; i < count; i++) {
+      EventSubscribeMessage::RequestArgs sub_args;
+      sub_args.node = args.node;
+      sub_args.event = subscriptions[i].event;
+      sub_args.previous_subscribe_gen = subscriptions[i].previous_subscribe_gen;
+      EventSubscribeMessage::handle_request(sub_args);
+    }
+  }
+
+  /*static*/ void EventBatchMessage::send_request(NodeID target,
+						 void *data, size_t datalen)
+  {
+    RequestArgs args;
+
+    args.node = my_node_id;
+    Message::request(target, args, data, datalen, PAYLOAD_FREE);
+  }
+
+  /*static*/ void EventBatchMessage::handle_request(RequestArgs args,
+						   const void *data,
+						   size_t datalen)
+  {
+    log_event.debug() << "event batch: node=" << args.node << " bytes=" << datalen;
+
+    // each record is handled exactly as if it had arrived on its own
+    const char *pos = static_cast<const char *>(data);
+    const char *end = pos + datalen;
+    while(pos < end) {
+      RecordHeader hdr;
+      memcpy(&hdr, pos, sizeof(RecordHeader));
+      pos += sizeof(RecordHeader);
+
+      switch(hdr.type) {
+      case SUBSCRIBE_RECORD:
+	{
+	  EventSubscribeMessage::RequestArgs sub_args;
+	  sub_args.node = args.node;
+	  sub_args.event = hdr.event;
+	  sub_args.previous_subscribe_gen = hdr.previous_subscribe_gen;
+	  EventSubscribeMessage::handle_request(sub_args);
+	  break;
+	}
+
+      case TRIGGER_RECORD:
+	{
+	  EventTriggerMessage::RequestArgs trig_args;
+	  trig_args.node = args.node;
+	  trig_args.event = hdr.event;
+	  trig_args.poisoned = hdr.poisoned;
+	  EventTriggerMessage::handle_request(trig_args);
+	  break;
+	}
+
+      case UPDATE_RECORD:
+	{
+	  EventUpdateMessage::RequestArgs upd_args;
+	  upd_args.set_magic();
+	  upd_args.event = hdr.event;
+	  size_t bytes = hdr.num_poisoned * sizeof(EventImpl::gen_t);
+	  // copy the poisoned generations out so that they're properly aligned
+	  std::vector<EventImpl::gen_t> poisoned_gens(hdr.num_poisoned);
+	  if(bytes > 0)
+	    memcpy(&poisoned_gens[0], pos, bytes);
+	  pos += bytes;
+	  EventUpdateMessage::handle_request(upd_args,
+					     (bytes ? &poisoned_gens[0] : 0),
+					     bytes);
+	  break;
+	}
+
+      default:
+	assert(0);
+      }
+    }
+    assert(pos == end);
+  }
+
+
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class EventMessageBatcher
+  //
+
+  EventMessageBatcher::EventMessageBatcher(void)
+    : enabled(false)
+    , buffers(0)
+    , shutdown_flag(false)
+    , core_rsrv(0)
+    , flush_thread(0)
+    , records_batched(0)
+    , batches_sent(0)
+    , arrivals_combined(0)
+    , cfg_delay_us(0)
+    , cfg_max_bytes(4096)
+  {}
+
+  EventMessageBatcher::~EventMessageBatcher(void)
+  {
+    assert(flush_thread == 0);
+    delete[] buffers;
+    delete records_batched;
+    delete batches_sent;
+    delete arrivals_combined;
+  }
+
+  void EventMessageBatcher::configure_from_cmdline(std::vector<std::string>& cmdline)
+  {
+    CommandLineParser cp;
+    cp.add_option_int("-realm:event_batch_us", cfg_delay_us)
+      .add_option_int("-realm:event_batch_bytes", cfg_max_bytes);
+
+    bool ok = cp.parse_command_line(cmdline);
+    assert(ok);
+
+    // nothing to batch if there's nobody to talk to
+    enabled = (cfg_delay_us > 0) && (max_node_id > 0);
+    if(!enabled)
+      return;
+
+    buffers = new TargetBuffer[max_node_id + 1];
+    records_batched = new ProfilingGauges::EventCounter<int>("realm/event messages batched");
+    batches_sent = new ProfilingGauges::EventCounter<int>("realm/event batches sent");
+    arrivals_combined = new ProfilingGauges::EventCounter<int>("realm/barrier arrivals combined");
+  }
+
+  void EventMessageBatcher::start(CoreReservationSet& crs)
+  {
+    if(!enabled)
+      return;
+
+    CoreReservationParameters params;
+    params.set_num_cores(1);
+    core_rsrv = new CoreReservation("event batcher", crs, params);
+    ThreadLaunchParameters tparams;
+    flush_thread = Thread::create_kernel_thread<EventMessageBatcher,
+						&EventMessageBatcher::flush_loop>(this,
+										  tparams,
+										  *core_rsrv);
+  }
+
+  void EventMessageBatcher::shutdown(void)
+  {
+    if(!enabled)
+      return;
+
+    shutdown_flag = true;
+    flush_thread->join();
+    delete flush_thread;
+    flush_thread = 0;
+    delete core_rsrv;
+    core_rsrv = 0;
+
+    // close each buffer before its final flush - a record can't be added
+    //  after that, so later messages go out directly instead of sitting in
+    //  a buffer that nobody will flush
+    for(NodeID i = 0; i <= max_node_id; i++) {
+      {
+	AutoHSLLock al(buffers[i].mutex);
+	buffers[i].closed = true;
+      }
+      flush(i);
+    }
+    enabled = false;
+  }
+
+  bool EventMessageBatcher::add_subscribe(NodeID target, Event event,
+					  EventImpl::gen_t previous_gen)
+  {
+    if(!enabled)
+      return false;
+
+    EventBatchMessage::RecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = EventBatchMessage::SUBSCRIBE_RECORD;
+    hdr.event = event;
+    hdr.previous_subscribe_gen = previous_gen;
+    return add_record(target, hdr, 0);
+  }
+
+  bool EventMessageBatcher::add_trigger(NodeID target, Event event, bool poisoned)
+  {
+    if(!enabled)
+      return false;
+
+    EventBatchMessage::RecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = EventBatchMessage::TRIGGER_RECORD;
+    hdr.event = event;
+    hdr.poisoned = poisoned;
+    return add_record(target, hdr, 0);
+  }
+
+  bool EventMessageBatcher::add_update(NodeID target, Event event,
+				       int num_poisoned,
+				       const EventImpl::gen_t *poisoned_generations)
+  {
+    if(!enabled)
+      return false;
+
+    EventBatchMessage::RecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = EventBatchMessage::UPDATE_RECORD;
+    hdr.event = event;
+    hdr.num_poisoned = num_poisoned;
+    return add_record(target, hdr, poisoned_generations);
+  }
+
+  bool EventMessageBatcher::add_barrier_arrival(NodeID target, Barrier barrier,
+						int delta, const void *reduce_value,
+						size_t reduce_value_size)
+  {
+    if(!enabled)
+      return false;
+
+    TargetBuffer& tb = buffers[target];
+    bool full;
+    {
+      AutoHSLLock al(tb.mutex);
+
+      if(tb.closed)
+	return false;
+
+      PendingArrival& pa = tb.arrivals[barrier.id];
+      pa.barrier = barrier;
+      pa.delta += delta;
+      if(reduce_value_size > 0)
+	pa.values.insert(pa.values.end(),
+			 static_cast<const char *>(reduce_value),
+			 static_cast<const char *>(reduce_value) + reduce_value_size);
+
+      full = (pa.values.size() >= cfg_max_bytes);
+    }
+
+    (*arrivals_combined) += 1;
+
+    if(full)
+      flush(target);
+
+    return true;
+  }
+
+  bool EventMessageBatcher::add_record(NodeID target,
+				       const EventBatchMessage::RecordHeader& hdr,
+				       const EventImpl::gen_t *poisoned_generations)
+  {
+    size_t extra = hdr.num_poisoned * sizeof(EventImpl::gen_t);
+    size_t bytes = sizeof(EventBatchMessage::RecordHeader) + extra;
+
+    TargetBuffer& tb = buffers[target];
+    bool full;
+    {
+      AutoHSLLock al(tb.mutex);
+
+      if(tb.closed)
+	return false;
+
+      if((tb.size + bytes) > tb.capacity) {
+	size_t new_capacity = std::max(tb.capacity * 2,
+				       std::max(cfg_max_bytes, tb.size + bytes));
+	tb.data = static_cast<char *>(realloc(tb.data, new_capacity));
+	assert(tb.data != 0);
+	tb.capacity = new_capacity;
+      }
+      memcpy(tb.data + tb.size, &hdr, sizeof(EventBatchMessage::RecordHeader));
+      if(extra > 0)
+	memcpy(tb.data + tb.size + sizeof(EventBatchMessage::RecordHeader),
+	       poisoned_generations, extra);
+      tb.size += bytes;
+      tb.count++;
+
+      full = (tb.size >= cfg_max_bytes);
+    }
+
+    (*records_batched) += 1;
+
+    if(full)
+      flush(target);
+
+    return true;
+  }
+
+  void EventMessageBatcher::flush(NodeID target)
+  {
+    TargetBuffer& tb = buffers[target];
+    char *data;
+    size_t size;
+    int count;
+    std::map<ID::IDType, PendingArrival> arrivals;
+    {
+      AutoHSLLock al(tb.mutex);
+
+      // the message takes the buffer - the next record will allocate another
+      data = tb.data;
+      size = tb.size;
+      count = tb.count;
+      tb.data = 0;
+      tb.size = 0;
+      tb.capacity = 0;
+      tb.count = 0;
+
+      arrivals.swap(tb.arrivals);
+    }
+
+    if(size > 0) {
+      log_event.debug() << "sending event batch: target=" << target
+			<< " records=" << count << " bytes=" << size;
+      (*batches_sent) += 1;
+      EventBatchMessage::send_request(target, data, size);
+    } else if(data)
+      free(data);
+
+    for(std::map<ID::IDType, PendingArrival>::const_iterator it = arrivals.begin();
+	it != arrivals.end();
+	++it) {
+      log_barrier.info() << "sending combined barrier arrival: target=" << target
+			 << " barrier=" << it->second.barrier
+			 << " delta=" << it->second.delta
+			 << " bytes=" << it->second.values.size();
+      BarrierAdjustMessage::send_request(target, it->second.barrier, it->second.delta,
+					 Event::NO_EVENT, my_node_id, false /*!forwarded*/,
+					 (it->second.values.empty() ? 0 : &it->second.values[0]),
+					 it->second.values.size());
+    }
+  }
+
+  void EventMessageBatcher::flush_loop(void)
+  {
+    while(!shutdown_flag) {
+      usleep(cfg_delay_us);
+
+      for(NodeID i = 0; i <= max_node_id; i++)
+	if(i != my_node_id)
+	  flush(i);
+    }
+  }
+
     // only called for generational events
     /*static*/ void EventSubscribeMessage::handle_request(EventSubscribeMessage::RequestArgs args)
     {
@@ -1820,7 +2283,8 @@ namespace Realm {
 							EventImpl::gen_t trigger_gen, EventImpl::gen_t previous_gen,
 							EventImpl::gen_t first_generation, ReductionOpID redop_id,
 							NodeID migration_target,	unsigned base_arrival_count,
-							const void *data, size_t datalen)
+							const void *data, size_t datalen,
+							int forward_count /*= 0*/)
     {
       RequestArgs args;
 
@@ -1832,6 +2296,7 @@ namespace Realm {
       args.redop_id = redop_id;
       args.migration_target = migration_target;
       args.base_arrival_count = base_arrival_count;
+      args.forward_count = forward_count;
 
       Message::request(target, args, data, datalen, PAYLOAD_COPY);
     }
@@ -1951,6 +2416,105 @@ static void *bytedup(const void *data, size_t datalen)
       EventImpl::gen_t trigger_gen, previous_gen;
     };
 
+    // a trigger message that must be passed on carries this, followed by the
+    //  RemoteNotifications for the other nodes and then reduction values for
+    //  generations (data_gen, data_last]
+    struct ForwardedNotificationHeader {
+      EventImpl::gen_t data_gen, data_last;
+    };
+
+    // sends trigger notifications to a list of remote nodes - if there are
+    //  more than Config::barrier_radix of them, the list is split into that
+    //  many groups and only the first node in each is sent a message, which
+    //  it passes on to the rest of its group
+    // 'values' holds the reduction results (if any) for generations after
+    //  'values_gen'
+    static void send_barrier_notifications(ID::IDType barrier_id,
+					   const RemoteNotification *targets, size_t count,
+					   EventImpl::gen_t first_generation,
+					   ReductionOpID redop_id, size_t value_size,
+					   NodeID migration_target, unsigned base_arrival_count,
+					   const char *values, EventImpl::gen_t values_gen)
+    {
+      size_t radix = Config::barrier_radix;
+
+      if((radix <= 1) || (count <= radix)) {
+	for(size_t i = 0; i < count; i++) {
+	  const RemoteNotification& rn = targets[i];
+	  log_barrier.info() << "sending remote trigger notification: " << ID(barrier_id) << "/"
+			     << rn.previous_gen << " -> " << rn.trigger_gen << ", dest=" << rn.node;
+	  const void *data = 0;
+	  size_t datalen = 0;
+	  if(values) {
+	    data = values + ((rn.previous_gen - values_gen) * value_size);
+	    datalen = (rn.trigger_gen - rn.previous_gen) * value_size;
+	  }
+	  BarrierTriggerMessage::send_request(rn.node, barrier_id, rn.trigger_gen, rn.previous_gen,
+					      first_generation, redop_id, migration_target, base_arrival_count,
+					      data, datalen);
+	}
+	return;
+      }
+
+      // migration only happens when there's a single remote waiter
+      assert(migration_target == (NodeID) -1);
+
+      for(size_t g = 0; g < radix; g++) {
+	size_t first = (count * g) / radix;
+	size_t last = (count * (g + 1)) / radix;
+	if((last - first) == 1) {
+	  send_barrier_notifications(barrier_id, targets + first, 1,
+				     first_generation, redop_id, value_size,
+				     migration_target, base_arrival_count,
+				     values, values_gen);
+	  continue;
+	}
+
+	// the group's head gets enough reduction data for the whole group
+	ForwardedNotificationHeader hdr;
+	hdr.data_gen = targets[first].previous_gen;
+	hdr.data_last = targets[first].trigger_gen;
+	for(size_t i = first + 1; i < last; i++) {
+	  if(targets[i].previous_gen < hdr.data_gen)
+	    hdr.data_gen = targets[i].previous_gen;
+	  if(targets[i].trigger_gen > hdr.data_last)
+	    hdr.data_last = targets[i].trigger_gen;
+	}
+	size_t forward_count = last - first - 1;
+	size_t entry_bytes = forward_count * sizeof(RemoteNotification);
+	size_t value_bytes = (values ? ((hdr.data_last - hdr.data_gen) * value_size) : 0);
+	size_t datalen = sizeof(hdr) + entry_bytes + value_bytes;
+	char *data = static_cast<char *>(malloc(datalen));
+	assert(data != 0);
+	memcpy(data, &hdr, sizeof(hdr));
+	memcpy(data + sizeof(hdr), targets + first + 1, entry_bytes);
+	if(value_bytes > 0)
+	  memcpy(data + sizeof(hdr) + entry_bytes,
+		 values + ((hdr.data_gen - values_gen) * value_size), value_bytes);
+
+	const RemoteNotification& head = targets[first];
+	log_barrier.info() << "sending remote trigger notification: " << ID(barrier_id) << "/"
+			   << head.previous_gen << " -> " << head.trigger_gen << ", dest=" << head.node
+			   << ", forwarding to " << forward_count << " others";
+	BarrierTriggerMessage::send_request(head.node, barrier_id, head.trigger_gen, head.previous_gen,
+					    first_generation, redop_id, migration_target, base_arrival_count,
+					    data, datalen, forward_count);
+	free(data);
+      }
+    }
+
+    // ready arrivals from a node other than the barrier's owner go to its
+    //  parent in a radix-k tree rooted at the owner (numbering the nodes
+    //  starting from the owner)
+    static NodeID barrier_arrival_parent(NodeID owner)
+    {
+      int num_nodes = max_node_id + 1;
+      int pos = (my_node_id - owner + num_nodes) % num_nodes;
+      assert(pos > 0);
+      int parent_pos = (pos - 1) / Config::barrier_radix;
+      return (owner + parent_pos) % num_nodes;
+    }
+
     // used to adjust a barrier's arrival count either up or down
     // if delta > 0, timestamp is current time (on requesting node)
     // if delta < 0, timestamp says which positive adjustment this arrival must wait for
@@ -2123,7 +2687,8 @@ static void *bytedup(const void *data, size_t datalen)
 	//  being held - no need to have lots of reduce values lying around
 	if(reduce_value_size > 0) {
 	  assert(redop != 0);
-	  assert(redop->sizeof_rhs == reduce_value_size);
+	  // arrivals combined on the way here carry several values back to back
+	  assert((reduce_value_size % redop->sizeof_rhs) == 0);
 
 	  // do we have space for this reduction result yet?
 	  int rel_gen = barrier_gen - first_generation;
@@ -2138,7 +2703,9 @@ static void *bytedup(const void *data, size_t datalen)
 	    }
 	  }
 
-	  redop->apply(final_values + ((rel_gen - 1) * redop->sizeof_lhs), reduce_value, 1, true);
+	  for(size_t ofs = 0; ofs < reduce_value_size; ofs += redop->sizeof_rhs)
+	    redop->apply(final_values + ((rel_gen - 1) * redop->sizeof_lhs),
+			 static_cast<const char *>(reduce_value) + ofs, 1, true);
 	}
 
 	// do this AFTER we actually update the reduction value above :)
@@ -2155,6 +2722,13 @@ static void *bytedup(const void *data, size_t datalen)
 
       if(forward_to_node != (NodeID) -1) {
 	Barrier b = make_barrier(barrier_gen, timestamp);
+	// an arrival that doesn't need ordering against alter_arrival_count
+	//  calls can be combined with others on the way to the owner
+	if((timestamp == 0) && (Config::barrier_radix > 1) &&
+	   get_runtime()->event_batcher.add_barrier_arrival(barrier_arrival_parent(forward_to_node),
+							    b, delta,
+							    reduce_value, reduce_value_size))
+	  return;
 	BarrierAdjustMessage::send_request(forward_to_node, b, delta, Event::NO_EVENT,
 					   sender, (sender != my_node_id),
 					   reduce_value, reduce_value_size);
@@ -2180,21 +2754,12 @@ static void *bytedup(const void *data, size_t datalen)
 	}
 
 	// now do remote notifications
-	for(std::vector<RemoteNotification>::const_iterator it = remote_notifications.begin();
-	    it != remote_notifications.end();
-	    it++) {
-	  log_barrier.info() << "sending remote trigger notification: " << me << "/"
-			     << (*it).previous_gen << " -> " << (*it).trigger_gen << ", dest=" << (*it).node;
-	  void *data = 0;
-	  size_t datalen = 0;
-	  if(final_values_copy) {
-	    data = (char *)final_values_copy + (((*it).previous_gen - oldest_previous) * redop->sizeof_lhs);
-	    datalen = ((*it).trigger_gen - (*it).previous_gen) * redop->sizeof_lhs;
-	  }
-	  BarrierTriggerMessage::send_request((*it).node, me.id, (*it).trigger_gen, (*it).previous_gen,
-					      first_generation, redop_id, migration_target, base_arrival_count,
-					      data, datalen);
-	}
+	if(!remote_notifications.empty())
+	  send_barrier_notifications(me.id, &remote_notifications[0], remote_notifications.size(),
+				     first_generation, redop_id,
+				     (final_values_copy ? redop->sizeof_lhs : 0),
+				     migration_target, base_arrival_count,
+				     static_cast<const char *>(final_values_copy), oldest_previous);
       }
 
       // free our copy of the final values, if we had one
@@ -2402,6 +2967,33 @@ static void *bytedup(const void *data, size_t datalen)
       log_barrier.info("received remote barrier trigger: " IDFMT "/%d -> %d",
 		       args.barrier_id, args.previous_gen, args.trigger_gen);
 
+      // pass the notification on to the rest of our group (if any) before
+      //  doing our own, and then find our part of the reduction data
+      if(args.forward_count > 0) {
+	const ForwardedNotificationHeader *hdr = static_cast<const ForwardedNotificationHeader *>(data);
+	const RemoteNotification *entries = reinterpret_cast<const RemoteNotification *>(hdr + 1);
+	const char *values = reinterpret_cast<const char *>(entries + args.forward_count);
+	size_t value_size = 0;
+	if(args.redop_id != 0)
+	  value_size = get_runtime()->reduce_op_table[args.redop_id]->sizeof_lhs;
+	assert(datalen == (sizeof(ForwardedNotificationHeader) +
+			   (args.forward_count * sizeof(RemoteNotification)) +
+			   ((hdr->data_last - hdr->data_gen) * value_size)));
+
+	send_barrier_notifications(args.barrier_id, entries, args.forward_count,
+				   args.first_generation, args.redop_id, value_size,
+				   (NodeID) -1 /*no migration*/, args.base_arrival_count,
+				   (value_size ? values : 0), hdr->data_gen);
+
+	if(value_size > 0) {
+	  data = values + ((args.previous_gen - hdr->data_gen) * value_size);
+	  datalen = (args.trigger_gen - args.previous_gen) * value_size;
+	} else {
+	  data = 0;
+	  datalen = 0;
+	}
+      }
+
       ID id(args.barrier_id);
       id.barrier.generation = args.trigger_gen;
       Barrier b = id.convert<Barrier>();
@@ -24,12 +24,17 @@
 #include "realm/faults.h"
 
 #include "realm/activemsg.h"
+#include "realm/sampling.h"
 
 #include <vector>
 #include <map>
 
 namespace Realm {
 
+    class Thread;
+    class CoreReservation;
+    class CoreReservationSet;
+
 #ifdef EVENT_TRACING
     // For event tracing
     struct EventTraceItem {
@@ -98,6 +103,12 @@ namespace Realm {
 
       virtual bool add_waiter(gen_t needed_gen, EventWaiter *waiter);
 
+      // same as above, except that if a subscription to the (remote) owner is
+      //  needed, the owner and previously-subscribed generation are returned
+      //  to the caller to send (subscribe_owner is left alone otherwise)
+      bool add_waiter(gen_t needed_gen, EventWaiter *waiter,
+		      NodeID& subscribe_owner, gen_t& previous_subscribe_gen);
+
       // creates an event that won't trigger until all input events have
       static Event merge_events(const std::set<Event>& wait_for,
 				bool ignore_faults);
@@ -266,6 +277,30 @@ namespace Realm {
     static void send_request(NodeID target, Event event, EventImpl::gen_t previous_gen);
   };
 
+  // EventSubscribeBatchMessage carries any number of subscriptions to events
+  //  owned by the target node - merge_events uses it so that a wide merge
+  //  doesn't send one subscription message per remote input
+
+  struct EventSubscribeBatchMessage {
+    struct RequestArgs : public BaseMedium {
+      NodeID node;
+    };
+
+    struct Subscription {
+      Event event;
+      EventImpl::gen_t previous_subscribe_gen;
+    };
+
+    static void handle_request(RequestArgs args, const void *data, size_t datalen);
+
+    typedef ActiveMessageMediumNoReply<EVENT_SUBSCRIBE_BATCH_MSGID,
+				       RequestArgs,
+				       handle_request> Message;
+
+    static void send_request(NodeID target, const Subscription *subscriptions,
+			     size_t count);
+  };
+
   // EventTriggerMessage is used by non-owner nodes to trigger an event
   // EventUpdateMessage is used by the owner node to tell non-owner nodes about one or
   //   more triggerings of an event
@@ -305,6 +340,115 @@ namespace Realm {
 				  int num_poisoned, const EventImpl::gen_t *poisoned_generations);
   };
 
+  // EventBatchMessage carries any number of subscription, trigger and update
+  //  records for a single target node, as accumulated by the EventMessageBatcher
+
+  struct EventBatchMessage {
+    struct RequestArgs : public BaseMedium {
+      NodeID node;
+    };
+
+    enum RecordType {
+      SUBSCRIBE_RECORD,
+      TRIGGER_RECORD,
+      UPDATE_RECORD,
+    };
+
+    // every record starts with this header - update records are followed by
+    //  'num_poisoned' poisoned generations
+    struct RecordHeader {
+      int type;
+      int num_poisoned;  // update records only
+      bool poisoned;     // trigger records only
+      Event event;
+      EventImpl::gen_t previous_subscribe_gen;  // subscribe records only
+    };
+
+    static void handle_request(RequestArgs args, const void *data, size_t datalen);
+
+    typedef ActiveMessageMediumNoReply<EVENT_BATCH_MSGID,
+				       RequestArgs,
+				       handle_request> Message;
+
+    // takes ownership of 'data', which must have been malloc'd
+    static void send_request(NodeID target, void *data, size_t datalen);
+  };
+
+  // buffers the event subscriptions, triggers and updates headed to each remote
+  //  node and sends them as a single EventBatchMessage once the buffer reaches
+  //  a size threshold or has been waiting for the configured delay - when the
+  //  delay is zero (the default), batching is disabled and every message is
+  //  sent right away
+  class EventMessageBatcher {
+  public:
+    EventMessageBatcher(void);
+    ~EventMessageBatcher(void);
+
+    void configure_from_cmdline(std::vector<std::string>& cmdline);
+
+    // the flush thread is started once active messages can be sent, and
+    //  stopped (after sending whatever is left) before they can't be
+    void start(CoreReservationSet& crs);
+    void shutdown(void);
+
+    bool is_enabled(void) const { return enabled; }
+
+    // each of these returns false if batching is disabled, in which case the
+    //  caller should send the message itself
+    bool add_subscribe(NodeID target, Event event, EventImpl::gen_t previous_gen);
+    bool add_trigger(NodeID target, Event event, bool poisoned);
+    bool add_update(NodeID target, Event event,
+		    int num_poisoned, const EventImpl::gen_t *poisoned_generations);
+
+    // ready barrier arrivals for the same generation are combined into a
+    //  single adjustment - reduction values are just concatenated, since
+    //  only the owner is guaranteed to know the reduction op
+    bool add_barrier_arrival(NodeID target, Barrier barrier, int delta,
+			     const void *reduce_value, size_t reduce_value_size);
+
+    // sends anything buffered for 'target' right away
+    void flush(NodeID target);
+
+  protected:
+    bool add_record(NodeID target, const EventBatchMessage::RecordHeader& hdr,
+		    const EventImpl::gen_t *poisoned_generations);
+
+    void flush_loop(void);
+
+    struct PendingArrival {
+      PendingArrival(void) : delta(0) {}
+
+      Barrier barrier;
+      int delta;
+      std::vector<char> values;
+    };
+
+    struct TargetBuffer {
+      TargetBuffer(void) : data(0), size(0), capacity(0), count(0), closed(false) {}
+
+      GASNetHSL mutex;
+      char *data;
+      size_t size, capacity;
+      int count;
+      bool closed;  // set at shutdown - no more records are accepted
+      std::map<ID::IDType, PendingArrival> arrivals;
+    };
+
+    bool enabled;
+    TargetBuffer *buffers;  // one per node
+    volatile bool shutdown_flag;
+    CoreReservation *core_rsrv;
+    Thread *flush_thread;
+    ProfilingGauges::EventCounter<int> *records_batched;
+    ProfilingGauges::EventCounter<int> *batches_sent;
+    ProfilingGauges::EventCounter<int> *arrivals_combined;
+
+  public:
+    // configurable settings
+    int cfg_delay_us;        // longest a record may wait before being sent
+    size_t cfg_max_bytes;    // a buffer this big is sent immediately
+  };
+
     struct BarrierAdjustMessage {
       struct RequestArgs : public BaseMedium {
 	int sender;
@@ -354,6 +498,9 @@ namespace Realm {
 	ReductionOpID redop_id;
 	NodeID migration_target;
 	unsigned base_arrival_count;
+	// if nonzero, the payload starts with notifications for this many other
+	//  nodes that the receiver must pass on (see BarrierImpl::adjust_arrival)
+	int forward_count;
       };
 
       static void handle_request(RequestArgs args, const void *data, size_t datalen);
@@ -366,7 +513,8 @@ namespace Realm {
 			       EventImpl::gen_t trigger_gen, EventImpl::gen_t previous_gen,
 			       EventImpl::gen_t first_generation, ReductionOpID redop_id,
 			       NodeID migration_target, unsigned base_arrival_count,
-			       const void *data, size_t datalen);
+			       const void *data, size_t datalen,
+			       int forward_count = 0);
     };
 
     struct BarrierMigrationMessage {
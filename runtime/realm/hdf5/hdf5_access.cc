@@ -59,6 +59,7 @@ namespace Realm {
 	hlp->bounds = space.bounds;
 	hlp->filename = file_name;
 	hlp->dsetname = field_files[i];
+	hlp->read_only = read_only;
 	for(int j = 0; j < N; j++)
 	  hlp->offset[j] = 0;
 	layout->piece_lists[i].pieces.push_back(hlp);
@@ -46,6 +46,7 @@ namespace Realm {
 
     std::string filename, dsetname;
     Point<N, hsize_t> offset;
+    bool read_only;
   };
 
 }; // namespace Realm
@@ -27,6 +27,7 @@ namespace Realm {
   template <int N, typename T>
   inline HDF5LayoutPiece<N,T>::HDF5LayoutPiece(void)
     : InstanceLayoutPiece<N,T>(InstanceLayoutPiece<N,T>::HDF5LayoutType)
+    , read_only(false)
   {}
 
   template <int N, typename T>
@@ -37,7 +38,8 @@ namespace Realm {
     if((s >> hlp->bounds) &&
        (s >> hlp->filename) &&
        (s >> hlp->dsetname) &&
-       (s >> hlp->offset)) {
+       (s >> hlp->offset) &&
+       (s >> hlp->read_only)) {
       return hlp;
     } else {
       delete hlp;
@@ -70,7 +72,8 @@ namespace Realm {
     return ((s << this->bounds) &&
 	    (s << filename) &&
 	    (s << dsetname) &&
-	    (s << offset));
+	    (s << offset) &&
+	    (s << read_only));
   }
 
 
@@ -16,6 +16,10 @@
 #include "realm/hdf5/hdf5_internal.h"
 
 #include "realm/logging.h"
+#include "realm/inst_impl.h"
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace Realm {
 
@@ -112,6 +116,205 @@ namespace Realm {
       return my_node_id;
     }
 
+    void HDF5Memory::release_instance_storage(RegionInstance i,
+					      Event precondition)
+    {
+      // the HDF5 memory is always local, so this is where the instance
+      //  really goes away
+      {
+	AutoHSLLock al(hdf5_lock);
+	hdf5_handle_cache.release_instance(i);
+      }
+
+      MemoryImpl::release_instance_storage(i, precondition);
+    }
+
+
+    ////////////////////////////////////////////////////////////////////////
+    //
+    // class HDF5HandleCache
+
+    GASNetHSL hdf5_lock;
+    HDF5HandleCache hdf5_handle_cache;
+
+    HDF5HandleCache::HDF5HandleCache(void)
+      : direct_io(true)
+      , chunk_cache_bytes(64 << 20)
+    {}
+
+    HDF5HandleCache::FileInfo *HDF5HandleCache::open_file(const std::string& filename,
+							   bool read_only)
+    {
+      FileInfo *info = new FileInfo;
+      info->read_only = read_only;
+      info->users = 0;
+      info->raw_fd = -1;
+
+      hid_t fapl_id;
+      CHECK_HDF5( fapl_id = H5Pcreate(H5P_FILE_ACCESS) );
+      // raw data must not be cached by libhdf5 if we're also going to
+      //  access it directly
+      if(direct_io) {
+	CHECK_HDF5( H5Pset_sieve_buf_size(fapl_id, 0) );
+	info->raw_fd = open(filename.c_str(), (read_only ? O_RDONLY : O_RDWR));
+      }
+      CHECK_HDF5( info->file_id = H5Fopen(filename.c_str(),
+					  (read_only ? H5F_ACC_RDONLY :
+					               H5F_ACC_RDWR),
+					  fapl_id) );
+      CHECK_HDF5( H5Pclose(fapl_id) );
+      log_hdf5.info() << "H5Fopen(\"" << filename << "\") = " << info->file_id;
+      return info;
+    }
+
+    void HDF5HandleCache::close_file(const std::string& filename, FileInfo *info)
+    {
+      assert(info->users == 0);
+      for(std::map<std::string, HDF5Dataset *>::const_iterator it = info->datasets.begin();
+	  it != info->datasets.end();
+	  ++it) {
+	log_hdf5.info() << "H5Dclose(" << it->second->dset_id << " /* \"" << it->first << "\" */)";
+	CHECK_HDF5( H5Tclose(it->second->dtype_id) );
+	CHECK_HDF5( H5Dclose(it->second->dset_id) );
+	delete it->second;
+      }
+      log_hdf5.info() << "H5Fclose(" << info->file_id << " /* \"" << filename << "\" */)";
+      CHECK_HDF5( H5Fclose(info->file_id) );
+      if(info->raw_fd >= 0)
+	close(info->raw_fd);
+      delete info;
+    }
+
+    HDF5Dataset *HDF5HandleCache::open_dataset(const std::string& filename,
+					       const std::string& dsetname,
+					       bool read_only, RegionInstance inst)
+    {
+      FileInfo *info;
+      std::map<std::string, FileInfo *>::iterator it = files.find(filename);
+      if(it != files.end()) {
+	info = it->second;
+	// a file that was opened read-only for another instance has to be
+	//  reopened for one that was attached read-write, which can only be
+	//  done once nobody's using it
+	if(info->read_only && !read_only) {
+	  if(info->users > 0)
+	    return 0;
+	  std::set<RegionInstance> instances;
+	  instances.swap(info->instances);
+	  close_file(filename, info);
+	  info = open_file(filename, false /*!read_only*/);
+	  info->instances.swap(instances);
+	  it->second = info;
+	}
+      } else {
+	info = open_file(filename, read_only);
+	files[filename] = info;
+      }
+      info->instances.insert(inst);
+
+      HDF5Dataset *dset;
+      std::map<std::string, HDF5Dataset *>::const_iterator it2 = info->datasets.find(dsetname);
+      if(it2 != info->datasets.end()) {
+	dset = it2->second;
+      } else {
+	dset = new HDF5Dataset;
+	dset->filename = filename;
+
+	hid_t dapl_id;
+	CHECK_HDF5( dapl_id = H5Pcreate(H5P_DATASET_ACCESS) );
+	// big enough to hold a whole row of chunks for a large transfer - w0
+	//  of 1.0 evicts chunks that have been completely read/written first
+	CHECK_HDF5( H5Pset_chunk_cache(dapl_id, 10007, chunk_cache_bytes, 1.0) );
+	CHECK_HDF5( dset->dset_id = H5Dopen2(info->file_id, dsetname.c_str(),
+					     dapl_id) );
+	CHECK_HDF5( H5Pclose(dapl_id) );
+	log_hdf5.info() << "H5Dopen2(" << info->file_id << ", \"" << dsetname << "\") = " << dset->dset_id;
+
+	CHECK_HDF5( dset->dtype_id = H5Dget_type(dset->dset_id) );
+	dset->elem_size = H5Tget_size(dset->dtype_id);
+
+	hid_t space_id;
+	CHECK_HDF5( space_id = H5Dget_space(dset->dset_id) );
+	CHECK_HDF5( dset->ndims = H5Sget_simple_extent_dims(space_id,
+							    dset->dims, 0) );
+	CHECK_HDF5( H5Sclose(space_id) );
+
+	hid_t dcpl_id;
+	CHECK_HDF5( dcpl_id = H5Dget_create_plist(dset->dset_id) );
+	H5D_layout_t layout = H5Pget_layout(dcpl_id);
+	dset->chunked = (layout == H5D_CHUNKED);
+	if(dset->chunked)
+	  CHECK_HDF5( H5Pget_chunk(dcpl_id, dset->ndims, dset->chunk_dims) );
+	dset->raw_offset = -1;
+	dset->raw_fd = -1;
+	if((info->raw_fd >= 0) &&
+	   (layout == H5D_CONTIGUOUS) &&
+	   (H5Pget_nfilters(dcpl_id) == 0) &&
+	   (H5Pget_external_count(dcpl_id) == 0))
+	  dset->raw_fd = info->raw_fd;
+	CHECK_HDF5( H5Pclose(dcpl_id) );
+
+	info->datasets[dsetname] = dset;
+      }
+
+      // contiguous storage isn't allocated until the first write, so keep
+      //  checking until it is
+      if((dset->raw_fd >= 0) && (dset->raw_offset < 0)) {
+	haddr_t addr = H5Dget_offset(dset->dset_id);
+	if(addr != HADDR_UNDEF)
+	  dset->raw_offset = addr;
+      }
+
+      info->users++;
+      return dset;
+    }
+
+    void HDF5HandleCache::release_dataset(HDF5Dataset *dset)
+    {
+      std::map<std::string, FileInfo *>::iterator it = files.find(dset->filename);
+      assert(it != files.end());
+      FileInfo *info = it->second;
+      assert(info->users > 0);
+      info->users--;
+      // close it if its instances went away while it was in use
+      if((info->users == 0) && info->instances.empty()) {
+	close_file(it->first, info);
+	files.erase(it);
+      }
+    }
+
+    void HDF5HandleCache::flush_file(const std::string& filename)
+    {
+      std::map<std::string, FileInfo *>::const_iterator it = files.find(filename);
+      if(it != files.end())
+	CHECK_HDF5( H5Fflush(it->second->file_id, H5F_SCOPE_LOCAL) );
+    }
+
+    void HDF5HandleCache::release_instance(RegionInstance inst)
+    {
+      std::map<std::string, FileInfo *>::iterator it = files.begin();
+      while(it != files.end()) {
+	FileInfo *info = it->second;
+	info->instances.erase(inst);
+	if(info->instances.empty() && (info->users == 0)) {
+	  close_file(it->first, info);
+	  files.erase(it++);
+	} else
+	  ++it;
+      }
+    }
+
+    void HDF5HandleCache::close_all(void)
+    {
+      for(std::map<std::string, FileInfo *>::iterator it = files.begin();
+	  it != files.end();
+	  ++it) {
+	it->second->users = 0;
+	close_file(it->first, it->second);
+      }
+      files.clear();
+    }
+
 
     ////////////////////////////////////////////////////////////////////////
     //
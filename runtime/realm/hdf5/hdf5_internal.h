@@ -22,6 +22,8 @@
 
 #include <hdf5.h>
 
+#include <set>
+
 #define CHECK_HDF5(cmd) \
   do { \
     herr_t res = (cmd); \
@@ -55,6 +57,10 @@ namespace Realm {
       virtual void *get_direct_ptr(off_t offset, size_t size);
       virtual int get_home_node(off_t offset, size_t size);
 
+      // closes any files the instance's transfers left open
+      virtual void release_instance_storage(RegionInstance i,
+					    Event precondition);
+
     public:
       struct HDFMetadata {
         int lo[3];
@@ -67,6 +73,78 @@ namespace Realm {
       std::map<RegionInstance, HDFMetadata *> hdf_metadata;
     };
 
+    // libhdf5 is generally not built thread-safe, so all calls into it from
+    //  the DMA system must hold this lock
+    extern GASNetHSL hdf5_lock;
+
+    // an open dataset, shared by all the transfers that use it
+    struct HDF5Dataset {
+      std::string filename;
+      hid_t dset_id, dtype_id;
+      size_t elem_size;
+      int ndims;
+      hsize_t dims[H5S_MAX_RANK];
+      // chunked datasets are transferred in whole rows of chunks where
+      //  possible so that no chunk is read (or decompressed) twice
+      bool chunked;
+      hsize_t chunk_dims[H5S_MAX_RANK];
+      // contiguous, unfiltered datasets whose storage has been allocated can
+      //  be accessed directly with pread/pwrite at this offset in the file,
+      //  bypassing libhdf5 (and its lock) entirely - -1 if not possible
+      off_t raw_offset;
+      int raw_fd;
+    };
+
+    // keeps files and datasets open across transfers - a file is closed
+    //  once no transfer is using it and the instances that used it have
+    //  been destroyed
+    // all methods must be called while holding hdf5_lock
+    class HDF5HandleCache {
+    public:
+      HDF5HandleCache(void);
+
+      // returns the named dataset, opening the file and/or dataset if
+      //  needed - the file is held open for 'inst' until release_instance,
+      //  and each open_dataset must be matched with a release_dataset
+      // 'read_only' is the attach mode of 'inst' - if the file is currently
+      //  open read-only for transfers that are still in flight and has to
+      //  be reopened for writing, 0 is returned and the caller must try
+      //  again later
+      HDF5Dataset *open_dataset(const std::string& filename,
+				const std::string& dsetname,
+				bool read_only, RegionInstance inst);
+      void release_dataset(HDF5Dataset *dset);
+
+      // flushes any writes to a file back to disk
+      void flush_file(const std::string& filename);
+
+      // the instance has been destroyed - closes files nobody else needs
+      void release_instance(RegionInstance inst);
+
+      void close_all(void);
+
+      // configuration
+      bool direct_io;
+      size_t chunk_cache_bytes;
+
+    protected:
+      struct FileInfo {
+	hid_t file_id;
+	bool read_only;
+	int raw_fd;
+	int users;  // datasets opened but not yet released
+	std::set<RegionInstance> instances;
+	std::map<std::string, HDF5Dataset *> datasets;
+      };
+
+      FileInfo *open_file(const std::string& filename, bool read_only);
+      void close_file(const std::string& filename, FileInfo *info);
+
+      std::map<std::string, FileInfo *> files;
+    };
+
+    extern HDF5HandleCache hdf5_handle_cache;
+
     class HDF5WriteChannel : public MemPairCopierFactory {
     public:
       HDF5WriteChannel(HDF5Memory *_mem);
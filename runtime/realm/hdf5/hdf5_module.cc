@@ -40,6 +40,8 @@ namespace Realm {
     HDF5Module::HDF5Module(void)
       : Module("hdf5")
       , cfg_showerrors(true)
+      , cfg_direct_io(1)
+      , cfg_chunk_cache_in_mb(64)
       , version_major(0)
       , version_minor(0)
       , version_rel(0)
@@ -62,7 +64,9 @@ namespace Realm {
       {
 	CommandLineParser cp;
 
-	cp.add_option_bool("-hdf5:showerrors", m->cfg_showerrors);
+	cp.add_option_bool("-hdf5:showerrors", m->cfg_showerrors)
+	  .add_option_int("-hdf5:direct", m->cfg_direct_io)
+	  .add_option_int("-hdf5:chunkcache", m->cfg_chunk_cache_in_mb);
 	
 	bool ok = cp.parse_command_line(cmdline);
 	if(!ok) {
@@ -102,6 +106,9 @@ namespace Realm {
 			<< (m->threadsafe ? " (thread-safe)" : " (NOT thread-safe)");
       }
 
+      hdf5_handle_cache.direct_io = (m->cfg_direct_io != 0);
+      hdf5_handle_cache.chunk_cache_bytes = m->cfg_chunk_cache_in_mb << 20;
+
       hdf5mod = m; // hack for now
       return m;
     }
@@ -169,6 +176,13 @@ namespace Realm {
     {
       Module::cleanup();
 
+      // any files that transfers left open have to be closed before the
+      //  library is
+      {
+	AutoHSLLock al(hdf5_lock);
+	hdf5_handle_cache.close_all();
+      }
+
       herr_t err = H5close();
       if(err < 0)
 	log_hdf5.warning() << "unable to close HDF5 library - result = " << err;
@@ -60,6 +60,11 @@ namespace Realm {
 
     public:
       bool cfg_showerrors;
+      // contiguous datasets are read/written directly (and in parallel)
+      //  rather than through libhdf5
+      int cfg_direct_io;
+      // size of the chunk cache for each open chunked dataset
+      size_t cfg_chunk_cache_in_mb;
 
       unsigned version_major, version_minor, version_rel;
       bool threadsafe;
@@ -22,6 +22,13 @@
 #include "realm/runtime_impl.h"
 #include "realm/profiling.h"
 #include "realm/utils.h"
+#include "realm/timers.h"
+#include "realm/transfer/lowlevel_dma.h"
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
 #ifdef USE_GASNET
 #ifndef GASNET_PAR
@@ -49,6 +56,15 @@ namespace Realm {
   Logger log_copy("copy");
   extern Logger log_inst; // in inst_impl.cc
 
+  namespace Config {
+    std::vector<std::string> best_fit_memory_kinds;
+    size_t instance_pool_size_in_mb = 0;
+    int cpu_mem_mmap = 0;
+    size_t cpu_mem_hugetlb_kb = 0;
+    int cpu_mem_prefault_threads = 0;
+    bool file_mmap = false;
+  };
+
 
 
   ////////////////////////////////////////////////////////////////////////
@@ -88,6 +104,127 @@ namespace Realm {
     /*static*/ const Memory Memory::NO_MEMORY = { 0 };
 
 
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class InstancePool
+  //
+
+  InstancePool::InstancePool(Memory _mem, size_t _max_bytes)
+    : max_bytes(_max_bytes)
+    , cached_bytes(0)
+    , next_tag(1)
+    , hits(stringbuilder() << "realm/mem " << _mem << "/pool hits")
+    , misses(stringbuilder() << "realm/mem " << _mem << "/pool misses")
+    , cached_gauge(stringbuilder() << "realm/mem " << _mem << "/pool cached")
+  {}
+
+  InstancePool::~InstancePool(void)
+  {}
+
+  /*static*/ size_t InstancePool::size_class(size_t bytes)
+  {
+    // classes are an eighth of a power of two apart, so rounding up wastes
+    //  at most 12.5%
+    size_t step = 1;
+    while((step << 4) <= bytes)
+      step <<= 1;
+    return ((bytes + step - 1) / step) * step;
+  }
+
+  bool InstancePool::allocate(RegionInstance inst, size_t bytes, size_t alignment,
+			      size_t& offset)
+  {
+    AutoHSLLock al(mutex);
+
+    std::map<size_t, std::vector<Block> >::iterator it = cached.find(size_class(bytes));
+    if(it != cached.end()) {
+      // most recently freed first - it's the most likely to still be in cache
+      std::vector<Block>& blocks = it->second;
+      for(size_t i = blocks.size(); i > 0; i--) {
+	Block& b = blocks[i - 1];
+	if((alignment > 0) && ((b.offset % alignment) != 0))
+	  continue;
+
+	offset = b.offset;
+	live[inst] = b;
+	cached_bytes -= b.bytes;
+	cached_gauge = cached_bytes;
+	blocks.erase(blocks.begin() + (i - 1));
+	if(blocks.empty())
+	  cached.erase(it);
+	hits += 1;
+	return true;
+      }
+    }
+
+    misses += 1;
+    return false;
+  }
+
+  RegionInstance InstancePool::make_tag(void)
+  {
+    // these never collide with real instance IDs, which always have their
+    //  type bits set
+    RegionInstance tag;
+    tag.id = __sync_fetch_and_add(&next_tag, 1);
+    return tag;
+  }
+
+  void InstancePool::record_allocation(RegionInstance inst, RegionInstance tag,
+				       size_t offset, size_t bytes)
+  {
+    Block b;
+    b.tag = tag;
+    b.offset = offset;
+    b.bytes = bytes;
+
+    AutoHSLLock al(mutex);
+    live[inst] = b;
+  }
+
+  bool InstancePool::release(RegionInstance inst, RegionInstance& tag)
+  {
+    AutoHSLLock al(mutex);
+
+    std::map<RegionInstance, Block>::iterator it = live.find(inst);
+    if(it == live.end()) {
+      // not one of ours
+      tag = inst;
+      return false;
+    }
+
+    Block b = it->second;
+    live.erase(it);
+
+    // past the high-water mark, blocks go back to the range allocator
+    if((cached_bytes + b.bytes) > max_bytes) {
+      tag = b.tag;
+      return false;
+    }
+
+    cached[b.bytes].push_back(b);
+    cached_bytes += b.bytes;
+    cached_gauge = cached_bytes;
+    return true;
+  }
+
+  void InstancePool::flush(std::vector<RegionInstance>& tags)
+  {
+    AutoHSLLock al(mutex);
+
+    for(std::map<size_t, std::vector<Block> >::const_iterator it = cached.begin();
+	it != cached.end();
+	++it)
+      for(std::vector<Block>::const_iterator it2 = it->second.begin();
+	  it2 != it->second.end();
+	  ++it2)
+	tags.push_back(it2->tag);
+    cached.clear();
+    cached_bytes = 0;
+    cached_gauge = 0;
+  }
+
+
   ////////////////////////////////////////////////////////////////////////
   //
   // class MemoryImpl
@@ -95,15 +232,36 @@ namespace Realm {
 
     MemoryImpl::MemoryImpl(Memory _me, size_t _size, MemoryKind _kind, size_t _alignment, Memory::Kind _lowlevel_kind)
       : me(_me), size(_size), kind(_kind), alignment(_alignment), lowlevel_kind(_lowlevel_kind)
+      , instance_pool(0)
       , usage(stringbuilder() << "realm/mem " << _me << "/usage")
       , peak_usage(stringbuilder() << "realm/mem " << _me << "/peak_usage")
       , peak_footprint(stringbuilder() << "realm/mem " << _me << "/peak_footprint")
     {
       allocator.add_range(0, _size);
+
+      // check whether this kind of memory has asked for best-fit allocation
+      const char *kind_name = 0;
+      switch(_lowlevel_kind) {
+#define KIND_NAME(name, desc) case Memory::name: kind_name = #name; break;
+	REALM_MEMORY_KINDS(KIND_NAME)
+#undef KIND_NAME
+      }
+      for(std::vector<std::string>::const_iterator it = Config::best_fit_memory_kinds.begin();
+	  it != Config::best_fit_memory_kinds.end();
+	  ++it)
+	if(kind_name && (*it == kind_name))
+	  allocator.policy = BasicRangeAllocator<size_t, RegionInstance>::BEST_FIT;
+
+      // only the owner node does allocations
+      if((Config::instance_pool_size_in_mb > 0) &&
+	 (ID(_me).memory.owner_node == my_node_id))
+	instance_pool = new InstancePool(_me, Config::instance_pool_size_in_mb << 20);
     }
 
     MemoryImpl::~MemoryImpl(void)
     {
+      delete instance_pool;
+
       for(std::vector<RegionInstanceImpl *>::iterator it = local_instances.instances.begin();
 	  it != local_instances.instances.end();
 	  ++it)
@@ -418,10 +576,43 @@ namespace Realm {
       }
 
       bool ok;
-      {
+      if(instance_pool && (bytes > 0)) {
+	// recycled storage doesn't need the range allocator at all
+	ok = instance_pool->allocate(i, bytes, alignment, offset);
+	if(!ok) {
+	  size_t class_bytes = InstancePool::size_class(bytes);
+	  RegionInstance tag = instance_pool->make_tag();
+	  {
+	    AutoHSLLock al(allocator_mutex);
+	    ok = allocator.allocate(tag, class_bytes, alignment, offset);
+	  }
+
+	  // the cache may be what's in the way, so give it all back and
+	  //  try again before failing
+	  if(!ok) {
+	    std::vector<RegionInstance> tags;
+	    instance_pool->flush(tags);
+	    if(!tags.empty()) {
+	      AutoHSLLock al(allocator_mutex);
+	      for(std::vector<RegionInstance>::const_iterator it = tags.begin();
+		  it != tags.end();
+		  ++it)
+		allocator.deallocate(*it);
+	      ok = allocator.allocate(tag, class_bytes, alignment, offset);
+	    }
+	  }
+
+	  if(ok)
+	    instance_pool->record_allocation(i, tag, offset, class_bytes);
+	}
+      } else {
 	AutoHSLLock al(allocator_mutex);
 	ok = allocator.allocate(i, bytes, alignment, offset);
       }
+      // this format is what test/performance/realm/range_alloc replays
+      log_malloc.debug() << "alloc: mem=" << me << " inst=" << i
+			 << " size=" << bytes << " align=" << alignment
+			 << " ok=" << ok;
 
       if(ID(i).instance.creator_node == my_node_id) {
 	// local notification of result
@@ -460,9 +651,16 @@ namespace Realm {
       assert(impl->metadata.inst_offset != size_t(-1));
       // deallocate unless the allocation had failed
       if(impl->metadata.inst_offset != size_t(-2)) {
-	AutoHSLLock al(allocator_mutex);
-	allocator.deallocate(i);
+	// copy plans record addresses within the instance
+	invalidate_copy_plans(i);
+
+	RegionInstance tag = i;
+	if(!instance_pool || !instance_pool->release(i, tag)) {
+	  AutoHSLLock al(allocator_mutex);
+	  allocator.deallocate(tag);
+	}
       }
+      log_malloc.debug() << "free: mem=" << me << " inst=" << i;
 
       if(ID(i).instance.creator_node == my_node_id) {
 	// local notification of result
@@ -477,42 +675,96 @@ namespace Realm {
 
   ////////////////////////////////////////////////////////////////////////
   //
-  // class LocalCPUMemory
+  // class LocalCPUMemory::Prefaulter
   //
 
-  LocalCPUMemory::LocalCPUMemory(Memory _me, size_t _size, 
-                                 int _numa_node, Memory::Kind _lowlevel_kind,
-				 void *prealloc_base /*= 0*/, bool _registered /*= false*/) 
-    : MemoryImpl(_me, _size, MKIND_SYSMEM, ALIGNMENT, _lowlevel_kind),
-      numa_node(_numa_node)
+  // faults in the whole mapping, splitting it into page-aligned chunks that
+  //  are touched by separate threads in the memory's NUMA domain, so the
+  //  kernel's page zeroing happens in parallel (and locally) rather than on
+  //  first use
+  class LocalCPUMemory::Prefaulter {
+  public:
+    Prefaulter(LocalCPUMemory *_mem, int _num_threads,
+	       CoreReservationSet& crs);
+    ~Prefaulter(void);
+
+    void prefault_chunk(void);
+
+  protected:
+    LocalCPUMemory *mem;
+    int num_threads;
+    int next_chunk, chunks_done;
+    long long t_start;
+    CoreReservation *core_rsrv;
+    std::vector<Thread *> threads;
+  };
+
+  LocalCPUMemory::Prefaulter::Prefaulter(LocalCPUMemory *_mem,
+					 int _num_threads,
+					 CoreReservationSet& crs)
+    : mem(_mem), num_threads(_num_threads)
+    , next_chunk(0), chunks_done(0), t_start(0)
   {
-    if(prealloc_base) {
-      base = (char *)prealloc_base;
-      prealloced = true;
-      registered = _registered;
-    } else {
-      // allocate our own space
-      // enforce alignment on the whole memory range
-      base_orig = new char[_size + ALIGNMENT - 1];
-      size_t ofs = reinterpret_cast<size_t>(base_orig) % ALIGNMENT;
-      if(ofs > 0) {
-	base = base_orig + (ALIGNMENT - ofs);
-      } else {
-	base = base_orig;
-      }
-      prealloced = false;
-      assert(!_registered);
-      registered = false;
+    size_t num_pages = mem->mapped_size / mem->page_size;
+    if((size_t)num_threads > num_pages)
+      num_threads = num_pages;
+
+    // the threads only run once, while the runtime is starting up, so they
+    //  can share cores with the domain's processors
+    CoreReservationParameters params;
+    params.set_num_cores(num_threads);
+    params.set_numa_domain(mem->numa_node);
+    params.set_alu_usage(params.CORE_USAGE_MINIMAL);
+    params.set_fpu_usage(params.CORE_USAGE_NONE);
+    params.set_ldst_usage(params.CORE_USAGE_MINIMAL);
+
+    std::string name = stringbuilder() << "prefault " << mem->me;
+    core_rsrv = new CoreReservation(name, crs, params);
+
+    // the threads won't actually start until core reservations are satisfied
+    ThreadLaunchParameters tparams;
+    for(int i = 0; i < num_threads; i++)
+      threads.push_back(Thread::create_kernel_thread<Prefaulter,
+			                              &Prefaulter::prefault_chunk>(this,
+										  tparams,
+										  *core_rsrv));
+  }
+
+  LocalCPUMemory::Prefaulter::~Prefaulter(void)
+  {
+    for(std::vector<Thread *>::const_iterator it = threads.begin();
+	it != threads.end();
+	++it) {
+      (*it)->join();
+      delete *it;
     }
-    log_malloc.debug("CPU memory at %p, size = %zd%s%s", base, _size, 
-		     prealloced ? " (prealloced)" : "", registered ? " (registered)" : "");
-    free_blocks[0] = _size;
+    delete core_rsrv;
   }
 
-  LocalCPUMemory::~LocalCPUMemory(void)
+  void LocalCPUMemory::Prefaulter::prefault_chunk(void)
   {
-    if(!prealloced)
-      delete[] base_orig;
+    // each thread takes the next chunk, whichever thread it is
+    int chunk = __sync_fetch_and_add(&next_chunk, 1);
+    if(chunk == 0)
+      t_start = Clock::current_time_in_microseconds();
+
+    size_t num_pages = mem->mapped_size / mem->page_size;
+    size_t first_page = (num_pages * chunk) / num_threads;
+    size_t last_page = (num_pages * (chunk + 1)) / num_threads;
+
+    // instances may already be in use by the time we get here, so the
+    //  touch must not change anything - an atomic add of zero still
+    //  faults the page in for writing
+    for(size_t pg = first_page; pg < last_page; pg++)
+      __sync_fetch_and_add(reinterpret_cast<int *>(mem->base_orig +
+						   (pg * mem->page_size)), 0);
+
+    if(__sync_add_and_fetch(&chunks_done, 1) == num_threads) {
+      long long t_end = Clock::current_time_in_microseconds();
+      log_malloc.info() << "prefaulted " << (mem->mapped_size >> 20) << " MB for " << mem->me
+			<< " using " << num_threads << " threads in "
+			<< (t_end - t_start) << " us";
+    }
   }
 
   off_t LocalCPUMemory::alloc_bytes(size_t size)
@@ -551,6 +803,113 @@ namespace Realm {
     return registered ? base : 0;
   };
   
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class LocalCPUMemory
+  //
+
+  LocalCPUMemory::LocalCPUMemory(Memory _me, size_t _size, 
+                                 int _numa_node, Memory::Kind _lowlevel_kind,
+				 void *prealloc_base /*= 0*/, bool _registered /*= false*/) 
+    : MemoryImpl(_me, _size, MKIND_SYSMEM, ALIGNMENT, _lowlevel_kind),
+      prefaulter(0), numa_node(_numa_node), mapped_size(0), page_size(0)
+  {
+    if(prealloc_base) {
+      base = (char *)prealloc_base;
+      prealloced = true;
+      registered = _registered;
+    } else {
+      prealloced = false;
+      assert(!_registered);
+      registered = false;
+
+      if(((Config::cpu_mem_mmap > 0) || (Config::cpu_mem_hugetlb_kb > 0)) &&
+	 map_storage(_size)) {
+	// mmap'd storage is page-aligned, which satisfies ALIGNMENT
+	base = base_orig;
+	if(Config::cpu_mem_prefault_threads > 0)
+	  prefaulter = new Prefaulter(this, Config::cpu_mem_prefault_threads,
+				      get_runtime()->core_reservation_set());
+      } else {
+	// allocate our own space
+	// enforce alignment on the whole memory range
+	base_orig = new char[_size + ALIGNMENT - 1];
+	size_t ofs = reinterpret_cast<size_t>(base_orig) % ALIGNMENT;
+	if(ofs > 0) {
+	  base = base_orig + (ALIGNMENT - ofs);
+	} else {
+	  base = base_orig;
+	}
+      }
+    }
+    log_malloc.debug("CPU memory at %p, size = %zd%s%s%s", base, _size, 
+		     prealloced ? " (prealloced)" : "", registered ? " (registered)" : "",
+		     mapped_size ? " (mmap'd)" : "");
+    free_blocks[0] = _size;
+  }
+
+  LocalCPUMemory::~LocalCPUMemory(void)
+  {
+    // the prefault threads finished long ago, but still need to be reaped
+    delete prefaulter;
+
+    if(!prealloced) {
+      if(mapped_size > 0)
+	munmap(base_orig, mapped_size);
+      else
+	delete[] base_orig;
+    }
+  }
+
+  // attempts to back the memory with an anonymous mapping (using huge pages
+  //  if requested) - returns false if that's not possible, in which case the
+  //  caller falls back to new[]
+  bool LocalCPUMemory::map_storage(size_t _size)
+  {
+    // no MAP_NORESERVE - for huge pages we want the mmap to fail now if not
+    //  enough have been reserved, rather than a SIGBUS on first touch
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    page_size = sysconf(_SC_PAGESIZE);
+
+    if(Config::cpu_mem_hugetlb_kb > 0) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+      page_size = Config::cpu_mem_hugetlb_kb << 10;
+      int log2_size = 0;
+      while((((size_t)1) << log2_size) < page_size) log2_size++;
+      if((((size_t)1) << log2_size) != page_size) {
+	log_malloc.warning() << "huge page size must be a power of two: " << Config::cpu_mem_hugetlb_kb << " KB";
+	return false;
+      }
+      flags |= MAP_HUGETLB | (log2_size << MAP_HUGE_SHIFT);
+#else
+      log_malloc.warning() << "explicit huge pages not supported on this platform";
+      return false;
+#endif
+    }
+
+    // mappings must be a multiple of the page size
+    mapped_size = ((_size + page_size - 1) / page_size) * page_size;
+    void *ptr = mmap(0, mapped_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(ptr == MAP_FAILED) {
+      log_malloc.warning() << "mmap of " << mapped_size << " bytes failed for " << me
+			   << " (" << strerror(errno) << ") - falling back to malloc";
+      mapped_size = 0;
+      return false;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if((Config::cpu_mem_hugetlb_kb == 0) && (Config::cpu_mem_mmap >= 2)) {
+      if(madvise(ptr, mapped_size, MADV_HUGEPAGE) != 0)
+	log_malloc.info() << "madvise(MADV_HUGEPAGE) failed for " << me
+			  << " (" << strerror(errno) << ")";
+    }
+#endif
+
+    base_orig = static_cast<char *>(ptr);
+    return true;
+  }
+
+
   ////////////////////////////////////////////////////////////////////////
   //
   // class RemoteMemory
@@ -595,7 +954,10 @@ namespace Realm {
       void *srcptr = ((char *)regbase) + offset;
       gasnet_get(dst, ID(me).memory.owner_node, srcptr, size);
 #else
-      assert(0 && "no remote get_bytes without GASNET");
+      // the only RDMA-able remote memories without GASNet are the registered
+      //  memories of other shared memory ranks, which we have mapped too
+      assert(kind == MemoryImpl::MKIND_RDMA);
+      memcpy(dst, ((char *)regbase) + offset, size);
 #endif
     }
 
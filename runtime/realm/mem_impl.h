@@ -37,6 +37,34 @@ namespace Realm {
 
   class RegionInstanceImpl;
 
+  namespace Config {
+    // memory kinds (by name, e.g. "SYSTEM_MEM") whose instance allocators
+    //  should use best-fit rather than first-fit placement
+    extern std::vector<std::string> best_fit_memory_kinds;
+
+    // if nonzero, each memory caches up to this many MB of storage from
+    //  destroyed instances for reuse by new instances of the same size class
+    extern size_t instance_pool_size_in_mb;
+
+    // how a LocalCPUMemory gets storage it allocates itself (i.e. not
+    //  preallocated): 0 = new[], 1 = anonymous mmap (pages are faulted in
+    //  lazily), 2 = mmap with a transparent huge page hint
+    extern int cpu_mem_mmap;
+
+    // if nonzero, back the memory with explicit huge pages of this size in KB
+    //  (e.g. 2048 or 1048576) - the pages must have been reserved with the
+    //  kernel (see /proc/sys/vm/nr_hugepages) and this implies mmap
+    extern size_t cpu_mem_hugetlb_kb;
+
+    // if nonzero, mmap'd memory is faulted in at startup using this many
+    //  threads rather than on first use
+    extern int cpu_mem_prefault_threads;
+
+    // if true, attached file instances are backed by a shared mmap of the
+    //  file so that they can be accessed directly rather than only copied
+    extern bool file_mmap;
+  };
+
   // manages a basic free list of ranges (using range type RT) and allocated
   //  ranges, which are tagged (tag type TT)
   // NOT thread-safe - must be protected from outside
@@ -51,10 +79,22 @@ namespace Realm {
       Range *prev_free, *next_free;  // double-linked list of just free ranges
     };
 
+    // free ranges are also kept in a tree ordered by (size, first) so that
+    //  requests can be matched without walking the whole free list
+    struct SizeOrder {
+      bool operator()(const Range *a, const Range *b) const;
+    };
+
+    enum AllocPolicy {
+      FIRST_FIT, // lowest-addressed free range that fits (walks free list)
+      BEST_FIT,  // smallest free range that fits (size tree lookup)
+    };
+
     std::map<TT, Range *> allocated;  // direct lookup of allocated ranges by tag
     std::map<RT, Range *> by_first;   // direct lookup of all ranges by first
+    std::set<Range *, SizeOrder> free_by_size; // free ranges by size
     Range sentinel;
-    // TODO: sized-based lookup of free ranges
+    AllocPolicy policy;
 
     BasicRangeAllocator(void);
     ~BasicRangeAllocator(void);
@@ -62,8 +102,62 @@ namespace Realm {
     void add_range(RT first, RT last);
     bool allocate(TT tag, RT size, RT alignment, RT& first);
     void deallocate(TT tag);
+
+    // returns the size of the largest free range (0 if none)
+    RT largest_free_range(void) const;
+
+  protected:
+    Range *find_first_fit(RT size, RT alignment);
+    Range *find_best_fit(RT size, RT alignment);
   };
   
+  // caches the storage of recently-destroyed instances by size class, so
+  //  that short-lived instances of the same shape can reuse it without going
+  //  through the memory's range allocator (or its mutex)
+  // blocks handled by the pool are allocated from the range allocator under
+  //  tags of the pool's own making, so they can stay allocated while cached
+  //  and move from one instance to the next
+  class InstancePool {
+  public:
+    InstancePool(Memory _mem, size_t _max_bytes);
+    ~InstancePool(void);
+
+    // rounds a request up to its size class - storage that goes through the
+    //  pool is always allocated in these sizes
+    static size_t size_class(size_t bytes);
+
+    // tries to satisfy an allocation from the cache
+    bool allocate(RegionInstance inst, size_t bytes, size_t alignment, size_t& offset);
+
+    // returns a fresh tag for a range allocator allocation
+    RegionInstance make_tag(void);
+
+    // remembers a block obtained from the range allocator for 'inst'
+    void record_allocation(RegionInstance inst, RegionInstance tag,
+			   size_t offset, size_t bytes);
+
+    // called when 'inst' releases its storage - returns true if the block
+    //  was cached, otherwise sets 'tag' to the range allocator tag to free
+    bool release(RegionInstance inst, RegionInstance& tag);
+
+    // empties the cache, returning the range allocator tags to free
+    void flush(std::vector<RegionInstance>& tags);
+
+  protected:
+    struct Block {
+      RegionInstance tag;
+      size_t offset, bytes;
+    };
+
+    GASNetHSL mutex;
+    size_t max_bytes, cached_bytes;
+    unsigned long long next_tag;
+    std::map<RegionInstance, Block> live;  // blocks in use, by instance
+    std::map<size_t, std::vector<Block> > cached;  // by size class
+    ProfilingGauges::EventCounter<int> hits, misses;
+    ProfilingGauges::AbsoluteGauge<size_t> cached_gauge;
+  };
+
     class MemoryImpl {
     public:
       enum MemoryKind {
@@ -159,6 +253,7 @@ namespace Realm {
       std::map<off_t, off_t> free_blocks;
       GASNetHSL allocator_mutex;
       BasicRangeAllocator<size_t, RegionInstance> allocator;
+      InstancePool *instance_pool;  // 0 if disabled
       ProfilingGauges::AbsoluteGauge<size_t> usage, peak_usage, peak_footprint;
     };
 
@@ -179,10 +274,18 @@ namespace Realm {
       virtual int get_home_node(off_t offset, size_t size);
       virtual void *local_reg_base(void);
 
+    protected:
+      bool map_storage(size_t _size);
+
+      // faults in the mapping from helper threads in our NUMA domain
+      class Prefaulter;
+      Prefaulter *prefaulter;
+
     public:
       const int numa_node;
     public: //protected:
       char *base, *base_orig;
+      size_t mapped_size, page_size;  // mapped_size == 0 if not mmap'd
       bool prealloced, registered;
     };
 
@@ -274,12 +377,36 @@ namespace Realm {
       virtual void *get_direct_ptr(off_t offset, size_t size);
       virtual int get_home_node(off_t offset, size_t size);
 
+      // every file instance gets its own (never reused) range of offsets so
+      //  that a mapped file can be found from an address in it
+      virtual bool allocate_instance_storage(RegionInstance i,
+					     size_t bytes, size_t alignment,
+					     Event precondition,
+					     size_t offset = 0);
+      virtual void release_instance_storage(RegionInstance i,
+					    Event precondition);
+
+      // maps the first 'size' bytes of a file at the instance's 'offset' -
+      //  returns false (and leaves the instance unmapped) on failure
+      bool map_file(off_t offset, size_t size, const char *filename,
+		    realm_file_mode_t file_mode);
+
       int get_file_des(ID::IDType inst_id);
     public:
+      struct MappedFile {
+	char *base;
+	size_t size;
+      };
+
       std::vector<int> file_vec;
       pthread_mutex_t vector_lock;
       off_t next_offset;
       std::map<off_t, int> offset_map;
+      std::map<off_t, MappedFile> mapped_files;
+
+    protected:
+      // returns the mapping covering [offset, offset+size), or null
+      const MappedFile *find_mapping(off_t offset, size_t size, off_t& rel_offset);
     };
 
     class RemoteMemory : public MemoryImpl {
@@ -35,9 +35,21 @@ namespace Realm {
     , prev_free(0), next_free(0)
   {}
 
+  template <typename RT, typename TT>
+  inline bool BasicRangeAllocator<RT,TT>::SizeOrder::operator()(const Range *a,
+								const Range *b) const
+  {
+    RT a_size = a->last - a->first;
+    RT b_size = b->last - b->first;
+    if(a_size != b_size)
+      return a_size < b_size;
+    return a->first < b->first;
+  }
+
   template <typename RT, typename TT>
   inline BasicRangeAllocator<RT,TT>::BasicRangeAllocator(void)
     : sentinel((RT)-1,0)
+    , policy(FIRST_FIT)
   {
     // sentinel is the start and end of both dllists
     sentinel.prev = sentinel.next = &sentinel;
@@ -76,22 +88,27 @@ namespace Realm {
       // free block list
       newr->prev_free = prev_free; newr->next_free = prev_free->next_free;
       prev_free->next_free = newr->next_free->prev_free = newr;
+      by_first[first] = newr;
+      free_by_size.insert(newr);
       return;
     }
 
     assert(0);
   }
-   
+
   template <typename RT, typename TT>
-  inline bool BasicRangeAllocator<RT,TT>::allocate(TT tag, RT size, RT alignment, RT& alloc_first)
+  inline RT BasicRangeAllocator<RT,TT>::largest_free_range(void) const
   {
-    // empty allocation requests are trivial
-    if(size == 0) {
-      allocated[tag] = 0;
-      return true;
-    }
+    if(free_by_size.empty())
+      return 0;
+    const Range *r = *(free_by_size.rbegin());
+    return (r->last - r->first);
+  }
 
-    // walk free ranges and just take the first that fits
+  template <typename RT, typename TT>
+  inline typename BasicRangeAllocator<RT,TT>::Range *BasicRangeAllocator<RT,TT>::find_first_fit(RT size, RT alignment)
+  {
+    // walk free ranges (in address order) and just take the first that fits
     Range *r = sentinel.next_free;
     while(r != &sentinel) {
       RT ofs = 0;
@@ -100,74 +117,116 @@ namespace Realm {
 	if(rem > 0)
 	  ofs = alignment - rem;
       }
-      // do we have enough space?
-      if((r->last - r->first) >= (size + ofs)) {
-	// yes, but we may need chop things up to make the exact range we want
-	alloc_first = r->first + ofs;
-	RT alloc_last = alloc_first + size;
-
-        // do we need to carve off a new (free) block before us?
-        if(alloc_first != r->first) {
-          Range *new_prev = new Range(r->first, alloc_first);
-          r->first = alloc_first;
-          new_prev->prev = r->prev; new_prev->prev->next = new_prev;
-          new_prev->next = r;
-          r->prev = new_prev;
-          new_prev->prev_free = r->prev_free;
-          new_prev->prev_free->next_free = new_prev;
-          new_prev->next_free = r;
-          r->prev_free = new_prev;
-        }
-
-	// four cases to deal with
-	if(alloc_last == r->last) {
-	  if(alloc_first == r->first) {
-	    // case 1 - exact fit
-	    //
-	    // all we have to do here is remove this range from the free range dlist
-	    //  and add to the allocated lookup map
-	    r->prev_free->next_free = r->next_free;
-	    r->next_free->prev_free = r->prev_free;
-	    r->prev_free = r->next_free = 0;
-
-	    allocated[tag] = r;
-	    return true;
-	  } else {
-	    // case 2 - leftover at beginning
-	    assert(0);
-	  }
-	} else {
-	  if(alloc_first == r->first) {
-	    // case 3 - leftover at end
-	    Range *r_after = new Range(alloc_last, r->last);
-	    by_first[alloc_last] = r_after;
-	    r->last = alloc_last;
-
-	    // r_after goes after r in all block list
-	    r_after->prev = r; r_after->next = r->next;
-	    r->next->prev = r_after; r->next = r_after;
-
-	    // r_after replaces r in the free block list
-	    r_after->prev_free = r->prev_free;
-	    r_after->next_free = r->next_free;
-	    r->prev_free->next_free = r_after;
-	    r->next_free->prev_free = r_after;
-	    r->prev_free = r->next_free = 0;
-
-	    allocated[tag] = r;
-	    return true;
-	  } else {
-	    // case 4 - leftover on both sides
-	    assert(0);
-	  }
-	}
+      if((r->last - r->first) >= (size + ofs))
+	return r;
+      r = r->next_free;
+    }
+    return 0;
+  }
+
+  template <typename RT, typename TT>
+  inline typename BasicRangeAllocator<RT,TT>::Range *BasicRangeAllocator<RT,TT>::find_best_fit(RT size, RT alignment)
+  {
+    // start at the smallest range that is at least as big as the request -
+    //  alignment padding may push us to a bigger one, but any range with at
+    //  least (size + alignment - 1) bytes is guaranteed to work
+    Range key(0, size);
+    typename std::set<Range *, SizeOrder>::iterator it = free_by_size.lower_bound(&key);
+    while(it != free_by_size.end()) {
+      Range *r = *it;
+      RT ofs = 0;
+      if(alignment) {
+	RT rem = r->first % alignment;
+	if(rem > 0)
+	  ofs = alignment - rem;
       }
+      if((r->last - r->first) >= (size + ofs))
+	return r;
+      ++it;
+    }
+    return 0;
+  }
+   
+  template <typename RT, typename TT>
+  inline bool BasicRangeAllocator<RT,TT>::allocate(TT tag, RT size, RT alignment, RT& alloc_first)
+  {
+    // empty allocation requests are trivial
+    if(size == 0) {
+      allocated[tag] = 0;
+      return true;
+    }
 
-      // no, go to next one
-      r = r->next_free;
+    // quick rejection if no free range is big enough, regardless of policy
+    if(largest_free_range() < size)
+      return false;
+
+    Range *r = ((policy == BEST_FIT) ? find_best_fit(size, alignment) :
+		                       find_first_fit(size, alignment));
+    if(!r)
+      return false;
+
+    RT ofs = 0;
+    if(alignment) {
+      RT rem = r->first % alignment;
+      if(rem > 0)
+	ofs = alignment - rem;
+    }
+    assert((r->last - r->first) >= (size + ofs));
+
+    // r is leaving the free list (in some form), so take it out of the size
+    //  tree before we start changing its bounds
+    free_by_size.erase(r);
+
+    // we may need chop things up to make the exact range we want
+    alloc_first = r->first + ofs;
+    RT alloc_last = alloc_first + size;
+
+    // do we need to carve off a new (free) block before us?
+    if(alloc_first != r->first) {
+      Range *new_prev = new Range(r->first, alloc_first);
+      by_first[new_prev->first] = new_prev;
+      r->first = alloc_first;
+      by_first[r->first] = r;
+      new_prev->prev = r->prev; new_prev->prev->next = new_prev;
+      new_prev->next = r;
+      r->prev = new_prev;
+      new_prev->prev_free = r->prev_free;
+      new_prev->prev_free->next_free = new_prev;
+      new_prev->next_free = r;
+      r->prev_free = new_prev;
+      free_by_size.insert(new_prev);
     }
-    // allocation failed
-    return false;
+
+    if(alloc_last == r->last) {
+      // exact fit
+      //
+      // all we have to do here is remove this range from the free range dlist
+      //  and add to the allocated lookup map
+      r->prev_free->next_free = r->next_free;
+      r->next_free->prev_free = r->prev_free;
+      r->prev_free = r->next_free = 0;
+    } else {
+      // leftover at end
+      Range *r_after = new Range(alloc_last, r->last);
+      by_first[alloc_last] = r_after;
+      r->last = alloc_last;
+
+      // r_after goes after r in all block list
+      r_after->prev = r; r_after->next = r->next;
+      r->next->prev = r_after; r->next = r_after;
+
+      // r_after replaces r in the free block list
+      r_after->prev_free = r->prev_free;
+      r_after->next_free = r->next_free;
+      r->prev_free->next_free = r_after;
+      r->next_free->prev_free = r_after;
+      r->prev_free = r->next_free = 0;
+
+      free_by_size.insert(r_after);
+    }
+
+    allocated[tag] = r;
+    return true;
   }
 
   template <typename RT, typename TT>
@@ -206,10 +265,12 @@ namespace Realm {
 	// case 1 - no merging (exact match)
 	r->prev_free = prev_free; r->next_free = next_free;
 	prev_free->next_free = next_free->prev_free = r;
+	free_by_size.insert(r);
       } else {
 	// case 2 - merge before
 	Range *old_prev = r->prev;
 	assert(r->first == old_prev->last);
+	free_by_size.erase(old_prev);
 	by_first.erase(r->first);
 	r->first = old_prev->first;
 	by_first[r->first] = r;
@@ -223,7 +284,7 @@ namespace Realm {
 	r->prev_free->next_free = r;
 	r->next_free = old_prev->next_free;
 	r->next_free->prev_free = r;
-
+	free_by_size.insert(r);
 
 	delete old_prev;
       }
@@ -232,6 +293,7 @@ namespace Realm {
 	// case 3 - merge after
 	Range *old_next = r->next;
 	assert(r->last == old_next->first);
+	free_by_size.erase(old_next);
 	r->last = old_next->last;
 	by_first.erase(old_next->first);
 
@@ -244,6 +306,7 @@ namespace Realm {
 	r->prev_free->next_free = r;
 	r->next_free = old_next->next_free;
 	r->next_free->prev_free = r;
+	free_by_size.insert(r);
 
 	delete old_next;
       } else {
@@ -251,12 +314,14 @@ namespace Realm {
 	
 	Range *old_prev = r->prev;
 	assert(r->first == old_prev->last);
+	free_by_size.erase(old_prev);
 	by_first.erase(r->first);
 	r->first = old_prev->first;
 	by_first[r->first] = r;
 
 	Range *old_next = r->next;
 	assert(r->last == old_next->first);
+	free_by_size.erase(old_next);
 	r->last = old_next->last;
 	by_first.erase(old_next->first);
 
@@ -266,6 +331,7 @@ namespace Realm {
 
 	r->prev_free = old_prev->prev_free; r->prev_free->next_free = r;
 	r->next_free = old_next->next_free; r->next_free->prev_free = r;
+	free_by_size.insert(r);
 
 	delete old_prev;
 	delete old_next;
@@ -22,6 +22,9 @@
 #include "realm/threads.h"
 #include "realm/runtime_impl.h"
 #include "realm/utils.h"
+#include "realm/timers.h"
+
+#include <unistd.h>
 
 namespace Realm {
 
@@ -86,6 +89,79 @@ namespace Realm {
 
   namespace Numa {
 
+    ////////////////////////////////////////////////////////////////////////
+    //
+    // class NumaPageToucher
+
+    // faults in every page of a NUMA memory from a thread running in that
+    //  domain, so that the kernel allocates and zeroes the pages locally and
+    //  the first tasks to use the memory don't pay for it
+    class NumaPageToucher {
+    public:
+      NumaPageToucher(int _numa_node, void *_base, size_t _bytes,
+		      CoreReservationSet& crs);
+      ~NumaPageToucher(void);
+
+      void touch_pages(void);
+
+    protected:
+      int numa_node;
+      char *base;
+      size_t bytes;
+      CoreReservation *core_rsrv;
+      Thread *thread;
+    };
+
+    NumaPageToucher::NumaPageToucher(int _numa_node, void *_base, size_t _bytes,
+				     CoreReservationSet& crs)
+      : numa_node(_numa_node)
+      , base(static_cast<char *>(_base))
+      , bytes(_bytes)
+    {
+      // the thread only runs once, while the runtime is starting up, so it
+      //  can share cores with the domain's processors
+      CoreReservationParameters params;
+      params.set_num_cores(1);
+      params.set_numa_domain(numa_node);
+      params.set_alu_usage(params.CORE_USAGE_MINIMAL);
+      params.set_fpu_usage(params.CORE_USAGE_NONE);
+      params.set_ldst_usage(params.CORE_USAGE_MINIMAL);
+
+      std::string name = stringbuilder() << "NUMA" << numa_node << " page touch";
+      core_rsrv = new CoreReservation(name, crs, params);
+
+      // the thread won't actually start until core reservations are satisfied
+      ThreadLaunchParameters tparams;
+      thread = Thread::create_kernel_thread<NumaPageToucher,
+					    &NumaPageToucher::touch_pages>(this,
+									   tparams,
+									   *core_rsrv);
+    }
+
+    NumaPageToucher::~NumaPageToucher(void)
+    {
+      thread->join();
+      delete thread;
+      delete core_rsrv;
+    }
+
+    void NumaPageToucher::touch_pages(void)
+    {
+      long long t_start = Clock::current_time_in_microseconds();
+
+      // instances may already be in use by the time we get here, so the
+      //  touch must not change anything - an atomic add of zero still
+      //  faults the page in for writing
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      for(size_t ofs = 0; ofs < bytes; ofs += page_size)
+	__sync_fetch_and_add(reinterpret_cast<int *>(base + ofs), 0);
+
+      long long t_end = Clock::current_time_in_microseconds();
+      log_numa.info() << "touched " << (bytes >> 20) << " MB in NUMA node " << numa_node
+		      << " in " << (t_end - t_start) << " us";
+    }
+
+
     ////////////////////////////////////////////////////////////////////////
     //
     // class NumaModule
@@ -96,6 +172,7 @@ namespace Realm {
       , cfg_numa_nocpu_mem_size_in_mb(-1)
       , cfg_num_numa_cpus(0)
       , cfg_pin_memory(false)
+      , cfg_first_touch(false)
       , cfg_stack_size_in_mb(2)
     {
     }
@@ -117,7 +194,8 @@ namespace Realm {
 	cp.add_option_int("-ll:nsize", m->cfg_numa_mem_size_in_mb)
 	  .add_option_int("-ll:ncsize", m->cfg_numa_nocpu_mem_size_in_mb)
 	  .add_option_int("-ll:ncpu", m->cfg_num_numa_cpus)
-	  .add_option_bool("-numa:pin", m->cfg_pin_memory);
+	  .add_option_bool("-numa:pin", m->cfg_pin_memory)
+	  .add_option_bool("-numa:touch", m->cfg_first_touch);
 	
 	bool ok = cp.parse_command_line(cmdline);
 	if(!ok) {
@@ -241,6 +319,53 @@ namespace Realm {
 						     false /*!registered*/);
 	runtime->add_memory(numamem);
 	memories[mem_node] = numamem;
+
+	if(cfg_first_touch)
+	  page_touchers.push_back(new NumaPageToucher(mem_node, base_ptr, mem_size,
+						      runtime->core_reservation_set()));
+      }
+
+      // copies between NUMA memories (and to/from regular system memory)
+      //  get the same distance-based costs as accesses from processors
+      std::vector<MemoryImpl *>& local_mems = runtime->nodes[my_node_id].memories;
+      for(std::map<int, MemoryImpl *>::const_iterator it = memories.begin();
+	  it != memories.end();
+	  ++it) {
+	for(std::map<int, MemoryImpl *>::const_iterator it2 = memories.begin();
+	    it2 != memories.end();
+	    ++it2) {
+	  if(it2->first == it->first) continue;
+
+	  Machine::MemoryMemoryAffinity mma;
+	  mma.m1 = it->second->me;
+	  mma.m2 = it2->second->me;
+	  int d = numasysif_get_distance(it->first, it2->first);
+	  if(d >= 0) {
+	    mma.bandwidth = 150 - d;
+	    mma.latency = d / 10;
+	  } else {
+	    mma.bandwidth = 100;
+	    mma.latency = 5;
+	  }
+	  runtime->add_mem_mem_affinity(mma);
+	}
+
+	for(std::vector<MemoryImpl *>::const_iterator it2 = local_mems.begin();
+	    it2 != local_mems.end();
+	    ++it2) {
+	  if((*it2)->get_kind() != Memory::SYSTEM_MEM) continue;
+
+	  // system memory isn't bound to any domain - use the same made-up
+	  //  numbers as for processors
+	  Machine::MemoryMemoryAffinity mma;
+	  mma.m1 = it->second->me;
+	  mma.m2 = (*it2)->me;
+	  mma.bandwidth = 100;
+	  mma.latency = 5;
+	  runtime->add_mem_mem_affinity(mma);
+	  std::swap(mma.m1, mma.m2);
+	  runtime->add_mem_mem_affinity(mma);
+	}
       }
     }
 
@@ -330,6 +455,9 @@ namespace Realm {
     {
       Module::cleanup();
 
+      // touch threads finished long ago, but still need to be reaped
+      delete_container_contents(page_touchers);
+
       // free our allocations here
       for(std::map<int, void *>::iterator it = numa_mem_bases.begin();
 	  it != numa_mem_bases.end();
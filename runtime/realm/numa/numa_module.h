@@ -24,6 +24,8 @@ namespace Realm {
 
   namespace Numa {
 
+    class NumaPageToucher;
+
     // our interface to the rest of the runtime
     class NumaModule : public Module {
     protected:
@@ -62,6 +64,7 @@ namespace Realm {
       ssize_t cfg_numa_nocpu_mem_size_in_mb;
       int cfg_num_numa_cpus;
       bool cfg_pin_memory;
+      bool cfg_first_touch;
       size_t cfg_stack_size_in_mb;
 
       // "global" variables live here too
@@ -69,6 +72,7 @@ namespace Realm {
       std::map<int, size_t> numa_mem_sizes;
       std::map<int, int> numa_cpu_counts;
       std::map<int, MemoryImpl *> memories;
+      std::vector<NumaPageToucher *> page_touchers;
     };
 
     REGISTER_REALM_MODULE(NumaModule);
@@ -19,10 +19,45 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
+#include <algorithm>
 
 namespace Realm {
   extern Logger log_omp;
 
+  // threads that aren't part of an OpenMP processor's pool run worksharing
+  //  constructs by themselves
+  static ThreadPool::WorkerInfo *get_worksharing_info(void)
+  {
+    static __thread ThreadPool::WorkerInfo serial_info;
+    ThreadPool::WorkerInfo *wi = ThreadPool::get_worker_info();
+    return (wi ? wi : &serial_info);
+  }
+
+  // named critical sections (and the reduction fallback) hand us a zeroed,
+  //  pointer-sized (at least) location to keep a lock in
+  static GASNetHSL *get_lazy_lock(void **pptr)
+  {
+    GASNetHSL *lock = (GASNetHSL *)(*pptr);
+    if(!lock) {
+      GASNetHSL *new_lock = new GASNetHSL;
+      if(__sync_bool_compare_and_swap(pptr, 0, new_lock)) {
+	lock = new_lock;
+      } else {
+	delete new_lock;
+	lock = (GASNetHSL *)(*pptr);
+      }
+    }
+    return lock;
+  }
+
+  // maps a chunk [first, last) of a loop's iterations back to loop values
+  template <typename T>
+  static inline T loop_value(const ThreadPool::LoopParams& lp, uint64_t idx)
+  {
+    return (T)(lp.base + (idx * lp.stride));
+  }
+
   // application-visible calls - always generated
   extern "C" {
     int omp_get_num_threads(void)
@@ -38,11 +73,97 @@ namespace Realm {
     {
       Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
       if(wi)
-	return wi->pool->get_num_workers() + 1;
+	return (wi->nthreads_var ?
+		  std::min(wi->nthreads_var, wi->pool->get_num_workers() + 1) :
+		  wi->pool->get_num_workers() + 1);
       else
 	return 1;
     }
 
+    void omp_set_num_threads(int num_threads)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      if(wi)
+	wi->nthreads_var = std::max(num_threads, 0);
+    }
+
+    int omp_in_parallel(void)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      return ((wi && (ThreadPool::get_active_levels(wi) > 0)) ? 1 : 0);
+    }
+
+    int omp_get_level(void)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      int level = 0;
+      if(wi)
+	for(const ThreadPool::WorkItem *w = wi->work_item;
+	    w;
+	    w = w->parent_work_item)
+	  level++;
+      return level;
+    }
+
+    int omp_get_active_level(void)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      return (wi ? ThreadPool::get_active_levels(wi) : 0);
+    }
+
+    // each work item remembers its thread's id and team size in the
+    //  enclosing level, so walk up until we get to the requested level
+    int omp_get_ancestor_thread_num(int level)
+    {
+      int cur_level = omp_get_level();
+      if((level < 0) || (level > cur_level))
+	return -1;
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      if(level == cur_level)
+	return (wi ? wi->thread_id : 0);
+      const ThreadPool::WorkItem *w = wi->work_item;
+      while(--cur_level > level)
+	w = w->parent_work_item;
+      return w->prev_thread_id;
+    }
+
+    int omp_get_team_size(int level)
+    {
+      int cur_level = omp_get_level();
+      if((level < 0) || (level > cur_level))
+	return -1;
+      if(level == 0)
+	return 1;
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      const ThreadPool::WorkItem *w = wi->work_item;
+      while(cur_level-- > level)
+	w = w->parent_work_item;
+      return w->num_threads;
+    }
+
+    void omp_set_max_active_levels(int max_levels)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      if(wi)
+	wi->pool->set_max_active_levels(max_levels);
+    }
+
+    int omp_get_max_active_levels(void)
+    {
+      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+      return (wi ? wi->pool->get_max_active_levels() : 1);
+    }
+
+    void omp_set_nested(int nested)
+    {
+      omp_set_max_active_levels(nested ? INT_MAX : 1);
+    }
+
+    int omp_get_nested(void)
+    {
+      return ((omp_get_max_active_levels() > 1) ? 1 : 0);
+    }
+
     int omp_get_thread_num(void)
     {
       Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
@@ -54,33 +175,106 @@ namespace Realm {
   };
 
 #ifdef REALM_OPENMP_GOMP_SUPPORT
+  // common code for GOMP_parallel_start and the combined parallel+loop
+  //  entry points
+  static void gomp_parallel_start(void (*fnptr)(void *data), void *data,
+				  int nthreads,
+				  const ThreadPool::LoopParams *preset_loop)
+  {
+    Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+    if(!wi) {
+      log_omp.warning() << "OpenMP-parallelized loop on non-OpenMP Realm processor!";
+      if(preset_loop)
+	get_worksharing_info()->loop_start(*preset_loop);
+      return;
+    }
+
+    wi->pool->start_team(wi, nthreads, fnptr, data, preset_loop);
+  }
+
+  // builds the iteration space for a GOMP loop, which runs from 'start' up
+  //  to (or down to) 'end', exclusive
+  template <typename T>
+  static ThreadPool::LoopParams gomp_loop_params(int schedule, bool up,
+						 T start, T end,
+						 T incr, T chunk)
+  {
+    ThreadPool::LoopParams lp;
+    lp.schedule = schedule;
+    if(up)
+      lp.count = ((end > start) ?
+		    (((uint64_t)end - (uint64_t)start + (uint64_t)incr - 1) /
+		     (uint64_t)incr) :
+		    0);
+    else
+      lp.count = ((start > end) ?
+		    (((uint64_t)start - (uint64_t)end - (uint64_t)incr - 1) /
+		     -(uint64_t)incr) :
+		    0);
+    lp.chunk = chunk;
+    lp.base = start;
+    lp.stride = incr;
+    return lp;
+  }
+
+  template <typename T>
+  static bool gomp_loop_next(T *istart, T *iend)
+  {
+    ThreadPool::WorkerInfo *wi = get_worksharing_info();
+    uint64_t first, last;
+    if(!wi->loop_next(first, last))
+      return false;
+    // the end of the chunk is one past its last value (in the direction of
+    //  travel), which can't overflow unless the loop does
+    const ThreadPool::LoopParams& lp = wi->workshare.loop;
+    *istart = loop_value<T>(lp, first);
+    *iend = loop_value<T>(lp, last - 1);
+    if((int64_t)lp.stride > 0)
+      *iend += 1;
+    else
+      *iend -= 1;
+    return true;
+  }
+
+  template <typename T>
+  static bool gomp_loop_start(int schedule, bool up, T start, T end,
+			      T incr, T chunk, T *istart, T *iend)
+  {
+    ThreadPool::WorkerInfo *wi = get_worksharing_info();
+    wi->loop_start(gomp_loop_params<T>(schedule, up,
+				       start, end, incr, chunk));
+    return gomp_loop_next<T>(istart, iend);
+  }
+
+  extern "C" {
+    void GOMP_parallel_end(void);
+  };
+
+  // combined parallel+loop regions - every thread's first call is to the
+  //  _next function, so the loop is set up before the team starts
+  static void gomp_parallel_loop(void (*fnptr)(void *data), void *data,
+				 unsigned nthreads, int schedule,
+				 long start, long end, long incr, long chunk)
+  {
+    ThreadPool::LoopParams lp = gomp_loop_params<long>(schedule, (incr > 0),
+						       start, end,
+						       incr, chunk);
+    gomp_parallel_start(fnptr, data, nthreads, &lp);
+    fnptr(data);
+    GOMP_parallel_end();
+  }
+
+  // libgomp's default 'runtime' schedule
+  static const int GOMP_RUNTIME_SCHEDULE = ThreadPool::LOOP_DYNAMIC;
+  static const long GOMP_RUNTIME_CHUNK = 1;
+
+  static GASNetHSL gomp_critical_lock, gomp_atomic_lock;
+
   extern "C" {
     void GOMP_parallel_start(void (*fnptr)(void *data), void *data, int nthreads)
     {
       //printf("GOMP_parallel_start(%p, %p, %d)\n", fnptr, data, nthreads);
-      Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
-      if(!wi) {
-	log_omp.warning() << "OpenMP-parallelized loop on non-OpenMP Realm processor!";
-	return;
-      }
-
-      std::set<int> worker_ids;
-      wi->pool->claim_workers(nthreads - 1, worker_ids);
-      int act_threads = 1 + worker_ids.size();
-
-      ThreadPool::WorkItem *work = new ThreadPool::WorkItem;
-      work->remaining_workers = act_threads;
-      wi->push_work_item(work);
-
-      wi->thread_id = 0;
-      wi->num_threads = act_threads;
-      int idx = 1;
-      for(std::set<int>::const_iterator it = worker_ids.begin();
-	  it != worker_ids.end();
-	  ++it) {
-	wi->pool->start_worker(*it, idx, act_threads, fnptr, data, work);
-	idx++;
-      }
+      gomp_parallel_start(fnptr, data, nthreads, 0);
       // in GOMP, the master thread runs fnptr itself, so we just return
     }
 
@@ -93,15 +287,7 @@ namespace Realm {
       if(!wi)
 	return;
 
-      ThreadPool::WorkItem *work = wi->pop_work_item();
-      assert(work != 0);
-      // make sure all workers have finished
-      if(__sync_sub_and_fetch(&(work->remaining_workers), 1) > 0) {
-	log_omp.info() << "waiting for workers to complete";
-	while(__sync_sub_and_fetch(&(work->remaining_workers), 0) > 0)
-	  sched_yield();
-      }
-      delete work;
+      wi->pool->end_team(wi);
     }
 
     void GOMP_parallel(void (*fnptr)(void *data), void *data, unsigned nthreads, unsigned int flags)
@@ -110,6 +296,284 @@ namespace Realm {
       fnptr(data);
       GOMP_parallel_end();
     }
+
+    void GOMP_parallel_loop_dynamic(void (*fnptr)(void *data), void *data,
+				    unsigned nthreads, long start, long end,
+				    long incr, long chunk, unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, ThreadPool::LOOP_DYNAMIC,
+			 start, end, incr, chunk);
+    }
+
+    void GOMP_parallel_loop_guided(void (*fnptr)(void *data), void *data,
+				   unsigned nthreads, long start, long end,
+				   long incr, long chunk, unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, ThreadPool::LOOP_GUIDED,
+			 start, end, incr, chunk);
+    }
+
+    void GOMP_parallel_loop_runtime(void (*fnptr)(void *data), void *data,
+				    unsigned nthreads, long start, long end,
+				    long incr, unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, GOMP_RUNTIME_SCHEDULE,
+			 start, end, incr, GOMP_RUNTIME_CHUNK);
+    }
+
+    void GOMP_parallel_loop_nonmonotonic_dynamic(void (*fnptr)(void *data),
+						 void *data, unsigned nthreads,
+						 long start, long end,
+						 long incr, long chunk,
+						 unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, ThreadPool::LOOP_DYNAMIC,
+			 start, end, incr, chunk);
+    }
+
+    void GOMP_parallel_loop_nonmonotonic_guided(void (*fnptr)(void *data),
+						void *data, unsigned nthreads,
+						long start, long end,
+						long incr, long chunk,
+						unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, ThreadPool::LOOP_GUIDED,
+			 start, end, incr, chunk);
+    }
+
+    void GOMP_parallel_loop_maybe_nonmonotonic_runtime(void (*fnptr)(void *data),
+						       void *data,
+						       unsigned nthreads,
+						       long start, long end,
+						       long incr,
+						       unsigned flags)
+    {
+      gomp_parallel_loop(fnptr, data, nthreads, GOMP_RUNTIME_SCHEDULE,
+			 start, end, incr, GOMP_RUNTIME_CHUNK);
+    }
+
+    // worksharing loops - newer compilers default to the 'nonmonotonic'
+    //  variants, which are the same thing here
+    bool GOMP_loop_dynamic_start(long start, long end, long incr, long chunk,
+				 long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(ThreadPool::LOOP_DYNAMIC, (incr > 0),
+				   start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_dynamic_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    bool GOMP_loop_nonmonotonic_dynamic_start(long start, long end, long incr,
+					      long chunk,
+					      long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(ThreadPool::LOOP_DYNAMIC, (incr > 0),
+				   start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_nonmonotonic_dynamic_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    bool GOMP_loop_guided_start(long start, long end, long incr, long chunk,
+				long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(ThreadPool::LOOP_GUIDED, (incr > 0),
+				   start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_guided_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    bool GOMP_loop_nonmonotonic_guided_start(long start, long end, long incr,
+					     long chunk,
+					     long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(ThreadPool::LOOP_GUIDED, (incr > 0),
+				   start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_nonmonotonic_guided_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    bool GOMP_loop_runtime_start(long start, long end, long incr,
+				 long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(GOMP_RUNTIME_SCHEDULE, (incr > 0),
+				   start, end, incr, GOMP_RUNTIME_CHUNK,
+				   istart, iend);
+    }
+
+    bool GOMP_loop_runtime_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    bool GOMP_loop_maybe_nonmonotonic_runtime_start(long start, long end,
+						    long incr,
+						    long *istart, long *iend)
+    {
+      return gomp_loop_start<long>(GOMP_RUNTIME_SCHEDULE, (incr > 0),
+				   start, end, incr, GOMP_RUNTIME_CHUNK,
+				   istart, iend);
+    }
+
+    bool GOMP_loop_maybe_nonmonotonic_runtime_next(long *istart, long *iend)
+    {
+      return gomp_loop_next<long>(istart, iend);
+    }
+
+    typedef unsigned long long gomp_ull;
+
+    bool GOMP_loop_ull_dynamic_start(bool up, gomp_ull start, gomp_ull end,
+				     gomp_ull incr, gomp_ull chunk,
+				     gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(ThreadPool::LOOP_DYNAMIC, up,
+				       start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_ull_dynamic_next(gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    bool GOMP_loop_ull_nonmonotonic_dynamic_start(bool up, gomp_ull start,
+						  gomp_ull end, gomp_ull incr,
+						  gomp_ull chunk,
+						  gomp_ull *istart,
+						  gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(ThreadPool::LOOP_DYNAMIC, up,
+				       start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_ull_nonmonotonic_dynamic_next(gomp_ull *istart,
+						 gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    bool GOMP_loop_ull_guided_start(bool up, gomp_ull start, gomp_ull end,
+				    gomp_ull incr, gomp_ull chunk,
+				    gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(ThreadPool::LOOP_GUIDED, up,
+				       start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_ull_guided_next(gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    bool GOMP_loop_ull_nonmonotonic_guided_start(bool up, gomp_ull start,
+						 gomp_ull end, gomp_ull incr,
+						 gomp_ull chunk,
+						 gomp_ull *istart,
+						 gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(ThreadPool::LOOP_GUIDED, up,
+				       start, end, incr, chunk, istart, iend);
+    }
+
+    bool GOMP_loop_ull_nonmonotonic_guided_next(gomp_ull *istart,
+						gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    bool GOMP_loop_ull_runtime_start(bool up, gomp_ull start, gomp_ull end,
+				     gomp_ull incr,
+				     gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(GOMP_RUNTIME_SCHEDULE, up,
+				       start, end, incr, GOMP_RUNTIME_CHUNK,
+				       istart, iend);
+    }
+
+    bool GOMP_loop_ull_runtime_next(gomp_ull *istart, gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    bool GOMP_loop_ull_maybe_nonmonotonic_runtime_start(bool up,
+							gomp_ull start,
+							gomp_ull end,
+							gomp_ull incr,
+							gomp_ull *istart,
+							gomp_ull *iend)
+    {
+      return gomp_loop_start<gomp_ull>(GOMP_RUNTIME_SCHEDULE, up,
+				       start, end, incr, GOMP_RUNTIME_CHUNK,
+				       istart, iend);
+    }
+
+    bool GOMP_loop_ull_maybe_nonmonotonic_runtime_next(gomp_ull *istart,
+						       gomp_ull *iend)
+    {
+      return gomp_loop_next<gomp_ull>(istart, iend);
+    }
+
+    void GOMP_loop_end(void)
+    {
+      get_worksharing_info()->team_barrier();
+    }
+
+    void GOMP_loop_end_nowait(void)
+    {
+      // nothing to do - the loop's slot is recycled once everybody is done
+    }
+
+    void GOMP_barrier(void)
+    {
+      get_worksharing_info()->team_barrier();
+    }
+
+    bool GOMP_single_start(void)
+    {
+      return get_worksharing_info()->claim_single();
+    }
+
+    // GCC uses critical sections (or the atomic lock) for reductions that
+    //  it can't do with atomic instructions
+    void GOMP_critical_start(void)
+    {
+      gomp_critical_lock.lock();
+    }
+
+    void GOMP_critical_end(void)
+    {
+      gomp_critical_lock.unlock();
+    }
+
+    void GOMP_critical_name_start(void **pptr)
+    {
+      get_lazy_lock(pptr)->lock();
+    }
+
+    void GOMP_critical_name_end(void **pptr)
+    {
+      get_lazy_lock(pptr)->unlock();
+    }
+
+    void GOMP_atomic_start(void)
+    {
+      gomp_atomic_lock.lock();
+    }
+
+    void GOMP_atomic_end(void)
+    {
+      gomp_atomic_lock.unlock();
+    }
   };
 #endif
 
@@ -131,6 +595,8 @@ namespace Realm {
     kmp_int32 __kmpc_global_thread_num(ident_t *loc);
 
     void __kmpc_fork_call(ident_t *loc, kmp_int32 argc, kmpc_micro microtask, ...);
+    void __kmpc_push_num_threads(ident_t *loc, kmp_int32 global_tid,
+				 kmp_int32 num_threads);
     void __kmpc_for_static_init_4(ident_t *loc, kmp_int32 global_tid,
 				  kmp_int32 schedtype,
 				  kmp_int32 *plastiter,
@@ -156,12 +622,58 @@ namespace Realm {
 				   kmp_uint64 *pstride,
 				   kmp_uint64 incr, kmp_uint64 chunk);
     void __kmpc_for_static_fini(ident_t *loc, kmp_int32 global_tid);
+
+    void __kmpc_dispatch_init_4(ident_t *loc, kmp_int32 global_tid,
+				kmp_int32 schedtype,
+				kmp_int32 lower, kmp_int32 upper,
+				kmp_int32 stride, kmp_int32 chunk);
+    void __kmpc_dispatch_init_4u(ident_t *loc, kmp_int32 global_tid,
+				 kmp_int32 schedtype,
+				 kmp_uint32 lower, kmp_uint32 upper,
+				 kmp_int32 stride, kmp_int32 chunk);
+    void __kmpc_dispatch_init_8(ident_t *loc, kmp_int32 global_tid,
+				kmp_int32 schedtype,
+				kmp_int64 lower, kmp_int64 upper,
+				kmp_int64 stride, kmp_int64 chunk);
+    void __kmpc_dispatch_init_8u(ident_t *loc, kmp_int32 global_tid,
+				 kmp_int32 schedtype,
+				 kmp_uint64 lower, kmp_uint64 upper,
+				 kmp_int64 stride, kmp_int64 chunk);
+    int __kmpc_dispatch_next_4(ident_t *loc, kmp_int32 global_tid,
+			       kmp_int32 *plastiter,
+			       kmp_int32 *plower, kmp_int32 *pupper,
+			       kmp_int32 *pstride);
+    int __kmpc_dispatch_next_4u(ident_t *loc, kmp_int32 global_tid,
+				kmp_int32 *plastiter,
+				kmp_uint32 *plower, kmp_uint32 *pupper,
+				kmp_int32 *pstride);
+    int __kmpc_dispatch_next_8(ident_t *loc, kmp_int32 global_tid,
+			       kmp_int32 *plastiter,
+			       kmp_int64 *plower, kmp_int64 *pupper,
+			       kmp_int64 *pstride);
+    int __kmpc_dispatch_next_8u(ident_t *loc, kmp_int32 global_tid,
+				kmp_int32 *plastiter,
+				kmp_uint64 *plower, kmp_uint64 *pupper,
+				kmp_int64 *pstride);
+
+    void __kmpc_barrier(ident_t *loc, kmp_int32 global_tid);
+    void __kmpc_critical(ident_t *loc, kmp_int32 global_tid,
+			 kmp_critical_name *lck);
+    void __kmpc_end_critical(ident_t *loc, kmp_int32 global_tid,
+			     kmp_critical_name *lck);
+
     kmp_int32 __kmpc_reduce_nowait(ident_t *loc, kmp_int32 global_tid,
 				   kmp_int32 nvars, size_t reduce_size,
 				   void *reduce_data, kmpc_reduce reduce_func,
 				   kmp_critical_name *lck);
     void __kmpc_end_reduce_nowait(ident_t *loc, kmp_int32 global_tid,
 				  kmp_critical_name *lck);
+    kmp_int32 __kmpc_reduce(ident_t *loc, kmp_int32 global_tid,
+			    kmp_int32 nvars, size_t reduce_size,
+			    void *reduce_data, kmpc_reduce reduce_func,
+			    kmp_critical_name *lck);
+    void __kmpc_end_reduce(ident_t *loc, kmp_int32 global_tid,
+			   kmp_critical_name *lck);
 
     void __kmpc_serialized_parallel(ident_t *loc, kmp_int32 global_tid);
     void __kmpc_end_serialized_parallel(ident_t *loc, kmp_int32 global_tid);
@@ -364,38 +876,22 @@ namespace Realm {
       return;
     }
 
-    std::set<int> worker_ids;
-    // TODO: thread limit comes from where?
-    wi->pool->claim_workers(-1, worker_ids);
-    int act_threads = 1 + worker_ids.size();
-
-    ThreadPool::WorkItem *work = new ThreadPool::WorkItem;
-    work->remaining_workers = act_threads;
-    wi->push_work_item(work);
-
-    wi->thread_id = 0;
-    wi->num_threads = act_threads;
-    int idx = 1;
-    for(std::set<int>::const_iterator it = worker_ids.begin();
-	it != worker_ids.end();
-	++it) {
-      wi->pool->start_worker(*it, idx, act_threads, invoker, &thunk, work);
-      idx++;
-    }
+    // team size comes from __kmpc_push_num_threads (if called)
+    wi->pool->start_team(wi, 0, invoker, &thunk);
 
     // in kmp version, we invoke the thunk for the master ourselves
     (*invoker)(&thunk);
 
     // and then we immediately clean things up (c.f. GOMP_parallel_end)
-    ThreadPool::WorkItem *work2 = wi->pop_work_item();
-    assert(work == work2);
-    // make sure all workers have finished
-    if(__sync_sub_and_fetch(&(work->remaining_workers), 1) > 0) {
-      log_omp.info() << "waiting for workers to complete";
-      while(__sync_sub_and_fetch(&(work->remaining_workers), 0) > 0)
-	sched_yield();
-    }
-    delete work;
+    wi->pool->end_team(wi);
+  }
+
+  void __kmpc_push_num_threads(ident_t *loc, kmp_int32 global_tid,
+			       kmp_int32 num_threads)
+  {
+    Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
+    if(wi)
+      wi->pushed_num_threads = num_threads;
   }
 
   // templated code for __kmpc_for_static_init_{4,4u,8,8u}
@@ -493,13 +989,189 @@ namespace Realm {
     //printf("static_fini(%p, %d)\n", loc, global_tid);
   }
 
+  // templated code for __kmpc_dispatch_init_{4,4u,8,8u} - the bounds are
+  //  inclusive
+  template <typename T, typename ST>
+  static inline void kmpc_dispatch_init(ident_t *loc, kmp_int32 global_tid,
+					kmp_int32 schedtype,
+					T lower, T upper, ST stride, ST chunk)
+  {
+    ThreadPool::LoopParams lp;
+    lp.chunk = ((chunk > 0) ? chunk : 0);
+    // ignore the monotonic/nonmonotonic modifiers
+    kmp_int32 sched = schedtype & ~((1 << 29) | (1 << 30));
+    switch(sched) {
+    case 33 /* kmp_sch_static_chunked */:
+    case 34 /* kmp_sch_static */:
+      {
+	lp.schedule = ThreadPool::LOOP_STATIC;
+	if(sched == 34)
+	  lp.chunk = 0;
+	break;
+      }
+    case 35 /* kmp_sch_dynamic_chunked */:
+    case 44 /* kmp_sch_static_steal */:
+      {
+	lp.schedule = ThreadPool::LOOP_DYNAMIC;
+	break;
+      }
+    case 36 /* kmp_sch_guided_chunked */:
+    case 38 /* kmp_sch_auto */:
+    case 42 /* kmp_sch_guided_iterative_chunked */:
+    case 43 /* kmp_sch_guided_analytical_chunked */:
+      {
+	lp.schedule = ThreadPool::LOOP_GUIDED;
+	break;
+      }
+    case 37 /* kmp_sch_runtime */:
+      {
+	// same as libgomp's default
+	lp.schedule = ThreadPool::LOOP_DYNAMIC;
+	lp.chunk = 1;
+	break;
+      }
+    default:
+      {
+	log_omp.fatal() << "unsupported loop schedule: " << schedtype;
+	assert(0);
+      }
+    }
+
+    if(stride > 0)
+      lp.count = ((upper < lower) ? 0 :
+		    (((uint64_t)upper - (uint64_t)lower) / stride) + 1);
+    else
+      lp.count = ((lower < upper) ? 0 :
+		    (((uint64_t)lower - (uint64_t)upper) / -(uint64_t)stride) + 1);
+    lp.base = lower;
+    lp.stride = (int64_t)stride;
+
+    get_worksharing_info()->loop_start(lp);
+  }
+
+  template <typename T, typename ST>
+  static inline int kmpc_dispatch_next(ident_t *loc, kmp_int32 global_tid,
+				       kmp_int32 *plastiter,
+				       T *plower, T *pupper, ST *pstride)
+  {
+    ThreadPool::WorkerInfo *wi = get_worksharing_info();
+    uint64_t first, last;
+    if(!wi->loop_next(first, last))
+      return 0;
+    const ThreadPool::LoopParams& lp = wi->workshare.loop;
+    *plower = loop_value<T>(lp, first);
+    *pupper = loop_value<T>(lp, last - 1);
+    if(pstride)
+      *pstride = (ST)(lp.stride);
+    if(plastiter)
+      *plastiter = (last == lp.count);
+    return 1;
+  }
+
+  void __kmpc_dispatch_init_4(ident_t *loc, kmp_int32 global_tid,
+			      kmp_int32 schedtype,
+			      kmp_int32 lower, kmp_int32 upper,
+			      kmp_int32 stride, kmp_int32 chunk)
+  {
+    kmpc_dispatch_init<kmp_int32, kmp_int32>(loc, global_tid, schedtype,
+					     lower, upper, stride, chunk);
+  }
+
+  void __kmpc_dispatch_init_4u(ident_t *loc, kmp_int32 global_tid,
+			       kmp_int32 schedtype,
+			       kmp_uint32 lower, kmp_uint32 upper,
+			       kmp_int32 stride, kmp_int32 chunk)
+  {
+    kmpc_dispatch_init<kmp_uint32, kmp_int32>(loc, global_tid, schedtype,
+					      lower, upper, stride, chunk);
+  }
+
+  void __kmpc_dispatch_init_8(ident_t *loc, kmp_int32 global_tid,
+			      kmp_int32 schedtype,
+			      kmp_int64 lower, kmp_int64 upper,
+			      kmp_int64 stride, kmp_int64 chunk)
+  {
+    kmpc_dispatch_init<kmp_int64, kmp_int64>(loc, global_tid, schedtype,
+					     lower, upper, stride, chunk);
+  }
+
+  void __kmpc_dispatch_init_8u(ident_t *loc, kmp_int32 global_tid,
+			       kmp_int32 schedtype,
+			       kmp_uint64 lower, kmp_uint64 upper,
+			       kmp_int64 stride, kmp_int64 chunk)
+  {
+    kmpc_dispatch_init<kmp_uint64, kmp_int64>(loc, global_tid, schedtype,
+					      lower, upper, stride, chunk);
+  }
+
+  int __kmpc_dispatch_next_4(ident_t *loc, kmp_int32 global_tid,
+			     kmp_int32 *plastiter,
+			     kmp_int32 *plower, kmp_int32 *pupper,
+			     kmp_int32 *pstride)
+  {
+    return kmpc_dispatch_next<kmp_int32, kmp_int32>(loc, global_tid,
+						    plastiter,
+						    plower, pupper, pstride);
+  }
+
+  int __kmpc_dispatch_next_4u(ident_t *loc, kmp_int32 global_tid,
+			      kmp_int32 *plastiter,
+			      kmp_uint32 *plower, kmp_uint32 *pupper,
+			      kmp_int32 *pstride)
+  {
+    return kmpc_dispatch_next<kmp_uint32, kmp_int32>(loc, global_tid,
+						     plastiter,
+						     plower, pupper, pstride);
+  }
+
+  int __kmpc_dispatch_next_8(ident_t *loc, kmp_int32 global_tid,
+			     kmp_int32 *plastiter,
+			     kmp_int64 *plower, kmp_int64 *pupper,
+			     kmp_int64 *pstride)
+  {
+    return kmpc_dispatch_next<kmp_int64, kmp_int64>(loc, global_tid,
+						    plastiter,
+						    plower, pupper, pstride);
+  }
+
+  int __kmpc_dispatch_next_8u(ident_t *loc, kmp_int32 global_tid,
+			      kmp_int32 *plastiter,
+			      kmp_uint64 *plower, kmp_uint64 *pupper,
+			      kmp_int64 *pstride)
+  {
+    return kmpc_dispatch_next<kmp_uint64, kmp_int64>(loc, global_tid,
+						     plastiter,
+						     plower, pupper, pstride);
+  }
+
+  void __kmpc_barrier(ident_t *loc, kmp_int32 global_tid)
+  {
+    get_worksharing_info()->team_barrier();
+  }
+
+  void __kmpc_critical(ident_t *loc, kmp_int32 global_tid,
+		       kmp_critical_name *lck)
+  {
+    get_lazy_lock((void **)lck)->lock();
+  }
+
+  void __kmpc_end_critical(ident_t *loc, kmp_int32 global_tid,
+			   kmp_critical_name *lck)
+  {
+    get_lazy_lock((void **)lck)->unlock();
+  }
+
+  // reductions are combined by the team using the compiler-provided
+  //  'reduce_func', and one thread is then told to fold the result into the
+  //  shared variables (i.e. we always pick method 1)
   kmp_int32 __kmpc_reduce_nowait(ident_t *loc, kmp_int32 global_tid,
 				 kmp_int32 nvars, size_t reduce_size,
 				 void *reduce_data, kmpc_reduce reduce_func,
 				 kmp_critical_name *lck)
   {
-    // tell caller to just do it themselves in all cases
-    return 2;
+    return (get_worksharing_info()->team_reduce(reduce_data, reduce_func,
+						false /*!wait_for_result*/) ?
+	      1 : 0);
   }
 
   void __kmpc_end_reduce_nowait(ident_t *loc, kmp_int32 global_tid,
@@ -508,6 +1180,23 @@ namespace Realm {
     // do nothing
   }
 
+  kmp_int32 __kmpc_reduce(ident_t *loc, kmp_int32 global_tid,
+			  kmp_int32 nvars, size_t reduce_size,
+			  void *reduce_data, kmpc_reduce reduce_func,
+			  kmp_critical_name *lck)
+  {
+    return (get_worksharing_info()->team_reduce(reduce_data, reduce_func,
+						true /*wait_for_result*/) ?
+	      1 : 0);
+  }
+
+  void __kmpc_end_reduce(ident_t *loc, kmp_int32 global_tid,
+			 kmp_critical_name *lck)
+  {
+    // the other threads can see the result now
+    get_worksharing_info()->reduce_done();
+  }
+
   void __kmpc_serialized_parallel(ident_t *loc, kmp_int32 global_tid)
   {
     Realm::ThreadPool::WorkerInfo *wi = Realm::ThreadPool::get_worker_info();
@@ -41,7 +41,8 @@ namespace Realm {
     LocalOpenMPProcessor(Processor _me, int _numa_node,
 			 int _num_threads, bool _fake_cpukind,
 			 CoreReservationSet& crs, size_t _stack_size,
-			 bool _force_kthreads);
+			 bool _force_kthreads,
+			 bool _hot_teams, int _max_active_levels);
     virtual ~LocalOpenMPProcessor(void);
 
     virtual void shutdown(void);
@@ -61,13 +62,15 @@ namespace Realm {
 					     bool _fake_cpukind,
 					     CoreReservationSet& crs,
 					     size_t _stack_size,
-					     bool _force_kthreads)
+					     bool _force_kthreads,
+					     bool _hot_teams,
+					     int _max_active_levels)
     : LocalTaskProcessor(_me, (_fake_cpukind ? Processor::LOC_PROC :
 			                       Processor::OMP_PROC))
     , numa_node(_numa_node)
     , num_threads(_num_threads)
   {
-    pool = new ThreadPool(num_threads - 1);
+    pool = new ThreadPool(num_threads - 1, _hot_teams, _max_active_levels);
 
     // master runs in a user threads if possible
     {
@@ -163,6 +166,8 @@ namespace Realm {
       , cfg_use_numa(true)
       , cfg_fake_cpukind(false)
       , cfg_stack_size_in_mb(2)
+      , cfg_hot_teams(true)
+      , cfg_max_active_levels(0)
     {
     }
       
@@ -184,6 +189,8 @@ namespace Realm {
 	  .add_option_int("-ll:othr", m->cfg_num_threads_per_cpu)
 	  .add_option_int("-ll:onuma", m->cfg_use_numa)
 	  .add_option_int("-ll:ostack", m->cfg_stack_size_in_mb)
+	  .add_option_int("-ll:ohot", m->cfg_hot_teams)
+	  .add_option_int("-ll:onest", m->cfg_max_active_levels)
 	  .add_option_bool("-ll:okindhack", m->cfg_fake_cpukind);
 	
 	bool ok = cp.parse_command_line(cmdline);
@@ -261,7 +268,9 @@ namespace Realm {
                                                      cfg_fake_cpukind,
                                                      runtime->core_reservation_set(),
                                                      cfg_stack_size_in_mb << 20,
-                                                     Config::force_kernel_threads);
+                                                     Config::force_kernel_threads,
+                                                     cfg_hot_teams,
+                                                     cfg_max_active_levels);
         runtime->add_processor(pi);
 
         // FIXME: once the stuff in runtime_impl.cc is removed, remove
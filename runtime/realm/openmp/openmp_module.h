@@ -65,6 +65,8 @@ namespace Realm {
       bool cfg_use_numa;
       bool cfg_fake_cpukind;
       size_t cfg_stack_size_in_mb;
+      bool cfg_hot_teams;  // reuse the master's team between regions
+      int cfg_max_active_levels;  // nesting limit for teams (0 = none)
 
       std::vector<int> active_numa_domains;
     };
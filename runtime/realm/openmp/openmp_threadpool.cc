@@ -18,6 +18,9 @@
 
 #include "realm/logging.h"
 
+#include <algorithm>
+#include <limits.h>
+
 namespace Realm {
 
   Logger log_pool("threadpool");
@@ -26,6 +29,49 @@ namespace Realm {
     __thread ThreadPool::WorkerInfo *threadpool_workerinfo = 0;
   };
 
+  static void reset_workshare(ThreadPool::WorkshareState& ws)
+  {
+    ws.loops_started = 0;
+    ws.reductions_started = 0;
+    ws.singles_started = 0;
+    ws.loop_slot = -1;
+    ws.static_next = 0;
+    ws.loop.schedule = ThreadPool::LOOP_NONE;
+  }
+
+
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class ThreadPool::WorkItem
+
+  ThreadPool::WorkItem::WorkItem(void)
+    : prev_thread_id(0)
+    , prev_num_threads(1)
+    , num_threads(1)
+    , parent_work_item(0)
+    , remaining_workers(0)
+    , barrier_arrivals(0)
+    , barrier_generation(0)
+    , reduce_lock(0)
+    , reduce_arrivals(0)
+    , reduce_generation(0)
+    , reduce_data(0)
+    , singles_claimed(0)
+  {
+    for(int i = 0; i < NUM_LOOP_SLOTS; i++) {
+      loop_slots[i].next = 0;
+      loop_slots[i].finished = 0;
+      loop_slots[i].generation = 0;
+    }
+    preset_loop.schedule = LOOP_NONE;
+    preset_loop.count = 0;
+    preset_loop.chunk = 0;
+    preset_loop.base = 0;
+    preset_loop.stride = 0;
+    reset_workshare(prev_workshare);
+  }
+
+
   ////////////////////////////////////////////////////////////////////////
   //
   // class ThreadPool::WorkerInfo
@@ -36,6 +82,8 @@ namespace Realm {
     new_work->prev_num_threads = num_threads;
     new_work->parent_work_item = work_item;
     work_item = new_work;
+    new_work->prev_workshare = workshare;
+    reset_workshare(workshare);
   }
 
   ThreadPool::WorkItem *ThreadPool::WorkerInfo::pop_work_item(void)
@@ -44,16 +92,194 @@ namespace Realm {
     thread_id = old_item->prev_thread_id;
     num_threads = old_item->prev_num_threads;
     work_item = old_item->parent_work_item;
+    workshare = old_item->prev_workshare;
     return old_item;
   }
 
+  void ThreadPool::WorkerInfo::team_barrier(void)
+  {
+    if(!work_item || (num_threads == 1))
+      return;
+
+    // read the generation before arriving - the last arrival resets the
+    //  count and then moves the generation on to release everybody else
+    int gen = work_item->barrier_generation;
+    if(__sync_add_and_fetch(&(work_item->barrier_arrivals), 1) == num_threads) {
+      work_item->barrier_arrivals = 0;
+      __sync_fetch_and_add(&(work_item->barrier_generation), 1);
+    } else {
+      while(work_item->barrier_generation == gen)
+	sched_yield();
+    }
+  }
+
+  bool ThreadPool::WorkerInfo::claim_single(void)
+  {
+    if(!work_item || (num_threads == 1))
+      return true;
+
+    // a thread that's behind the rest of the team will find the count has
+    //  already moved on
+    int seq = workshare.singles_started++;
+    return __sync_bool_compare_and_swap(&(work_item->singles_claimed),
+					seq, seq + 1);
+  }
+
+  void ThreadPool::WorkerInfo::loop_start(const LoopParams& params)
+  {
+    workshare.loop = params;
+    // a static loop without a chunk size gets one contiguous block per
+    //  thread, but other schedules need a minimum chunk size
+    if((workshare.loop.chunk == 0) && (params.schedule != LOOP_STATIC))
+      workshare.loop.chunk = 1;
+    workshare.static_next = 0;
+
+    // dynamic and guided loops need a shared counter unless we're alone
+    if(!work_item || (num_threads == 1) ||
+       (params.schedule == LOOP_STATIC)) {
+      workshare.loop_slot = NUM_LOOP_SLOTS; // i.e. no slot
+      return;
+    }
+
+    int seq = workshare.loops_started++;
+    int slot = seq % NUM_LOOP_SLOTS;
+    int gen = seq / NUM_LOOP_SLOTS;
+    // if we've gotten far enough ahead of the rest of the team, wait for
+    //  them to be done with the last loop that used this slot
+    while(work_item->loop_slots[slot].generation < gen)
+      sched_yield();
+    workshare.loop_slot = slot;
+  }
+
+  bool ThreadPool::WorkerInfo::loop_next(uint64_t& first, uint64_t& last)
+  {
+    // the first loop of a combined parallel+loop region is started
+    //  implicitly
+    if((workshare.loop_slot < 0) && (workshare.loop.schedule == LOOP_NONE) &&
+       work_item && (work_item->preset_loop.schedule != LOOP_NONE))
+      loop_start(work_item->preset_loop);
+
+    if(workshare.loop_slot < 0)
+      return false;
+
+    const LoopParams& lp = workshare.loop;
+
+    if(workshare.loop_slot == NUM_LOOP_SLOTS) {
+      // no shared state - either we're alone or the loop is static
+      int nt = (work_item ? num_threads : 1);
+      int tid = (work_item ? thread_id : 0);
+      uint64_t chunk = lp.chunk;
+      if((chunk == 0) || (nt == 1))
+	chunk = (lp.count + nt - 1) / nt;
+      uint64_t idx = tid + (workshare.static_next++ * nt);
+      if((chunk == 0) || (idx >= ((lp.count + chunk - 1) / chunk))) {
+	workshare.loop_slot = -1;
+	return false;
+      }
+      first = idx * chunk;
+      last = std::min(first + chunk, lp.count);
+      return true;
+    }
+
+    LoopSlot& ls = work_item->loop_slots[workshare.loop_slot];
+    if(lp.schedule == LOOP_GUIDED) {
+      // each chunk is a share of what's left, but no smaller than 'chunk'
+      while(true) {
+	uint64_t cur = ls.next;
+	if(cur >= lp.count)
+	  break;
+	uint64_t left = lp.count - cur;
+	uint64_t amt = (left + num_threads - 1) / num_threads;
+	if(amt < lp.chunk)
+	  amt = lp.chunk;
+	if(amt > left)
+	  amt = left;
+	if(__sync_bool_compare_and_swap(&(ls.next), cur, cur + amt)) {
+	  first = cur;
+	  last = cur + amt;
+	  return true;
+	}
+      }
+    } else {
+      uint64_t cur = __sync_fetch_and_add(&(ls.next), lp.chunk);
+      if(cur < lp.count) {
+	first = cur;
+	last = std::min(cur + lp.chunk, lp.count);
+	return true;
+      }
+    }
+
+    // out of iterations - the last thread to notice recycles the slot
+    workshare.loop_slot = -1;
+    if(__sync_add_and_fetch(&(ls.finished), 1) == num_threads) {
+      ls.next = 0;
+      ls.finished = 0;
+      __sync_fetch_and_add(&(ls.generation), 1);
+    }
+    return false;
+  }
+
+  bool ThreadPool::WorkerInfo::team_reduce(void *data,
+					   void (*combine)(void *lhs, void *rhs),
+					   bool wait_for_result)
+  {
+    if(!work_item || (num_threads == 1))
+      return true;
+
+    WorkItem *w = work_item;
+    // wait for any previous reduction to be completely finished
+    int seq = workshare.reductions_started++;
+    while(w->reduce_generation < seq)
+      sched_yield();
+
+    // the first arrival's data is the accumulator - everybody else folds
+    //  theirs in, after which they're done with it
+    bool owner = false;
+    while(__sync_lock_test_and_set(&(w->reduce_lock), 1))
+      sched_yield();
+    if(w->reduce_data == 0) {
+      w->reduce_data = data;
+      owner = true;
+    } else
+      (*combine)(w->reduce_data, data);
+    __sync_add_and_fetch(&(w->reduce_arrivals), 1);
+    __sync_lock_release(&(w->reduce_lock));
+
+    if(owner) {
+      while(w->reduce_arrivals < num_threads)
+	sched_yield();
+      w->reduce_data = 0;
+      w->reduce_arrivals = 0;
+      if(!wait_for_result)
+	__sync_fetch_and_add(&(w->reduce_generation), 1);
+    } else {
+      if(wait_for_result)
+	while(w->reduce_generation <= seq)
+	  sched_yield();
+    }
+    return owner;
+  }
+
+  void ThreadPool::WorkerInfo::reduce_done(void)
+  {
+    if(!work_item || (num_threads == 1))
+      return;
+
+    // releases the threads held in team_reduce
+    __sync_fetch_and_add(&(work_item->reduce_generation), 1);
+  }
+
 
   ////////////////////////////////////////////////////////////////////////
   //
   // class ThreadPool
 
-  ThreadPool::ThreadPool(int _num_workers)
+  ThreadPool::ThreadPool(int _num_workers, bool _hot_teams,
+			 int _max_active_levels)
     : num_workers(_num_workers)
+    , hot_teams(_hot_teams)
+    , max_active_levels((_max_active_levels > 0) ? _max_active_levels :
+			                           INT_MAX)
   {
     // these will be filled in as workers show up
     worker_threads.resize(num_workers, 0);
@@ -68,6 +294,10 @@ namespace Realm {
       wi.fnptr = 0;
       wi.data = 0;
       wi.work_item = 0;
+      reset_workshare(wi.workshare);
+      wi.hot_team = false;
+      wi.nthreads_var = 0;
+      wi.pushed_num_threads = 0;
     }
 
     log_pool.info() << "pool " << (void *)this << " started - " << num_workers << " workers";
@@ -115,6 +345,7 @@ namespace Realm {
       switch(wi->status) {
       case WorkerInfo::WORKER_IDLE:
       case WorkerInfo::WORKER_CLAIMED:
+      case WorkerInfo::WORKER_HOT:
 	{
 	  sched_yield();
 	  break;
@@ -125,8 +356,18 @@ namespace Realm {
 	  log_pool.info() << "worker " << wi->thread_id << "/" << wi->num_threads << " executing: " << (void *)(wi->fnptr) << "(" << wi->data << ")";
 	  (wi->fnptr)(wi->data);
 	  log_pool.info() << "worker " << wi->thread_id << "/" << wi->num_threads << " done";
-	  __sync_fetch_and_sub(&(wi->work_item->remaining_workers), 1);
-	  wi->status = WorkerInfo::WORKER_IDLE;
+	  // update our status before telling the master we're done, so that
+	  //  a hot team is ready to go again as soon as the master sees the
+	  //  count reach zero - once we're idle, another team can claim us,
+	  //  so don't look at our WorkerInfo after that
+	  WorkItem *item = wi->work_item;
+	  bool ok = __sync_bool_compare_and_swap(&(wi->status),
+						 WorkerInfo::WORKER_ACTIVE,
+						 (wi->hot_team ?
+						    WorkerInfo::WORKER_HOT :
+						    WorkerInfo::WORKER_IDLE));
+	  assert(ok);
+	  __sync_fetch_and_sub(&(item->remaining_workers), 1);
 	  break;
 	}
 
@@ -151,11 +392,15 @@ namespace Realm {
 	it != worker_infos.end();
 	++it) {
       if(it->status == WorkerInfo::WORKER_MASTER) continue;
-      bool ok = __sync_bool_compare_and_swap(&(it->status),
-					     WorkerInfo::WORKER_IDLE,
-					     WorkerInfo::WORKER_SHUTDOWN);
+      bool ok = (__sync_bool_compare_and_swap(&(it->status),
+					      WorkerInfo::WORKER_IDLE,
+					      WorkerInfo::WORKER_SHUTDOWN) ||
+		 __sync_bool_compare_and_swap(&(it->status),
+					      WorkerInfo::WORKER_HOT,
+					      WorkerInfo::WORKER_SHUTDOWN));
       assert(ok);
     }
+    hot_workers.clear();
 
     // now join on all threads
     for(std::vector<Thread *>::const_iterator it = worker_threads.begin();
@@ -191,15 +436,119 @@ namespace Realm {
     assert((worker_id >= 0) && (worker_id <= num_workers));
     WorkerInfo *wi = &worker_infos[worker_id];
     
-    assert(wi->status == WorkerInfo::WORKER_CLAIMED);
+    int prev_status = wi->status;
+    assert((prev_status == WorkerInfo::WORKER_CLAIMED) ||
+	   (prev_status == WorkerInfo::WORKER_HOT));
     wi->thread_id = thread_id;
     wi->num_threads = num_threads;
     wi->fnptr = fnptr;
     wi->data = data;
     wi->work_item = work_item;
+    wi->hot_team = (work_item == &hot_work_item);
+    reset_workshare(wi->workshare);
     __sync_bool_compare_and_swap(&(wi->status),
-				 WorkerInfo::WORKER_CLAIMED,
+				 prev_status,
 				 WorkerInfo::WORKER_ACTIVE);
   }
 
+  void ThreadPool::start_team(WorkerInfo *master, int nthreads,
+			      void (*fnptr)(void *data), void *data,
+			      const LoopParams *preset_loop /*= 0*/)
+  {
+    // a 'num_threads' clause wins over omp_set_num_threads
+    if(nthreads <= 0)
+      nthreads = (master->pushed_num_threads ? master->pushed_num_threads :
+		                               master->nthreads_var);
+    master->pushed_num_threads = 0;
+
+    // decide how many workers we'd like - a nested region with no size
+    //  specified gets an even split of the pool between the members of
+    //  the enclosing team, so that they don't race for whoever's idle
+    int active_levels = get_active_levels(master);
+    int want;
+    if(active_levels >= max_active_levels)
+      want = 0;
+    else if(nthreads > 0)
+      want = std::min(nthreads - 1, num_workers);
+    else if(active_levels == 0)
+      want = num_workers;
+    else
+      want = std::max((num_workers + 1) / master->num_threads - 1, 0);
+
+    WorkItem *work;
+    const std::set<int> *worker_ids;
+    std::set<int> claimed;
+    if(hot_teams && (master == &worker_infos[0]) && !master->work_item) {
+      // the master's top-level regions reuse the previous team, giving
+      //  back extra workers or claiming more if the size has changed
+      while((int)hot_workers.size() > want) {
+	std::set<int>::iterator it = hot_workers.end();
+	--it;
+	bool ok = __sync_bool_compare_and_swap(&(worker_infos[*it].status),
+					       WorkerInfo::WORKER_HOT,
+					       WorkerInfo::WORKER_IDLE);
+	assert(ok);
+	hot_workers.erase(it);
+      }
+      if((int)hot_workers.size() < want)
+	claim_workers(want - hot_workers.size(), hot_workers);
+      worker_ids = &hot_workers;
+      // start from a clean slate (the work item is not in use - all of the
+      //  previous team has finished with it)
+      hot_work_item = WorkItem();
+      work = &hot_work_item;
+    } else {
+      if(want > 0)
+	claim_workers(want, claimed);
+      worker_ids = &claimed;
+      work = new WorkItem;
+    }
+
+    int act_threads = 1 + worker_ids->size();
+    work->remaining_workers = act_threads;
+    work->num_threads = act_threads;
+    if(preset_loop)
+      work->preset_loop = *preset_loop;
+    master->push_work_item(work);
+
+    master->thread_id = 0;
+    master->num_threads = act_threads;
+    int idx = 1;
+    for(std::set<int>::const_iterator it = worker_ids->begin();
+	it != worker_ids->end();
+	++it) {
+      start_worker(*it, idx, act_threads, fnptr, data, work);
+      idx++;
+    }
+  }
+
+  void ThreadPool::end_team(WorkerInfo *master)
+  {
+    WorkItem *work = master->pop_work_item();
+    assert(work != 0);
+    // make sure all workers have finished
+    if(__sync_sub_and_fetch(&(work->remaining_workers), 1) > 0) {
+      log_pool.info() << "waiting for workers to complete";
+      while(__sync_sub_and_fetch(&(work->remaining_workers), 0) > 0)
+	sched_yield();
+    }
+    if(work != &hot_work_item)
+      delete work;
+  }
+
+  void ThreadPool::set_max_active_levels(int levels)
+  {
+    // unlike the constructor, 0 really means no active levels here
+    max_active_levels = std::max(levels, 0);
+  }
+
+  /*static*/ int ThreadPool::get_active_levels(const WorkerInfo *wi)
+  {
+    int levels = 0;
+    for(const WorkItem *w = wi->work_item; w; w = w->parent_work_item)
+      if(w->num_threads > 1)
+	levels++;
+    return levels;
+  }
+
 };
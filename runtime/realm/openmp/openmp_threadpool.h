@@ -19,11 +19,17 @@
 
 #include "realm/threads.h"
 
+#include <stdint.h>
+
 namespace Realm {
 
   class ThreadPool {
   public:
-    ThreadPool(int _num_workers);
+    // 'hot_teams' lets the master keep the workers from one parallel region
+    //  reserved for the next, and 'max_active_levels' limits how deeply
+    //  nested regions get their own teams (0 = no limit)
+    ThreadPool(int _num_workers, bool _hot_teams = true,
+	       int _max_active_levels = 0);
     ~ThreadPool(void);
 
     // associates the calling thread as the master of the threadpool
@@ -32,11 +38,66 @@ namespace Realm {
     // entry point for workers - does not return until thread pool is shut down
     void worker_entry(void);
 
+    // worksharing loops with dynamic or guided schedules hand out chunks of
+    //  a 0-based iteration space from a counter shared by the team - a team
+    //  cycles through a few of these so that threads can run ahead into the
+    //  next loop (i.e. 'nowait') while others finish the current one
+    enum LoopSchedule {
+      LOOP_NONE,
+      LOOP_STATIC,   // fixed round-robin assignment of chunks
+      LOOP_DYNAMIC,  // fixed-size chunks claimed in order
+      LOOP_GUIDED,   // chunks proportional to the remaining iterations
+    };
+
+    static const int NUM_LOOP_SLOTS = 4;
+
+    struct LoopSlot {
+      volatile uint64_t next;   // first unclaimed iteration
+      volatile int finished;    // team members that have seen it run out
+      volatile int generation;  // number of loops that have used this slot
+    };
+
+    // a loop's schedule and iteration space - base and stride aren't used
+    //  by the pool, but let the caller map iterations back to loop variable
+    //  values
+    struct LoopParams {
+      int schedule;
+      uint64_t count, chunk;
+      uint64_t base, stride;
+    };
+
+    // a thread's position in its team's sequence of worksharing constructs
+    struct WorkshareState {
+      int loops_started;
+      int reductions_started;
+      int singles_started;
+      int loop_slot;  // -1 when not in a loop
+      uint64_t static_next; // next chunk index for static loops
+      LoopParams loop;
+    };
+
     struct WorkItem {
+      WorkItem(void);
+
       int prev_thread_id;
       int prev_num_threads;
+      int num_threads;  // size of the team running this item
       WorkItem *parent_work_item;
       int remaining_workers;
+      WorkshareState prev_workshare;
+
+      // team-wide state for barriers, reductions and worksharing loops
+      volatile int barrier_arrivals;
+      volatile int barrier_generation;
+      volatile int reduce_lock;
+      volatile int reduce_arrivals;
+      volatile int reduce_generation;
+      void *reduce_data;
+      volatile int singles_claimed;
+      LoopSlot loop_slots[NUM_LOOP_SLOTS];
+      // a loop set up by a combined parallel+loop entry point, which every
+      //  team member joins without an explicit start
+      LoopParams preset_loop;
     };
 
     struct WorkerInfo {
@@ -46,6 +107,7 @@ namespace Realm {
 	WORKER_IDLE,
 	WORKER_CLAIMED,
 	WORKER_ACTIVE,
+	WORKER_HOT,      // idle, but reserved for the master's next team
 	WORKER_SHUTDOWN,
       };
       int /*Status*/ status; // int allows CAS primitives
@@ -55,9 +117,37 @@ namespace Realm {
       void (*fnptr)(void *data);
       void *data;
       WorkItem *work_item;
+      WorkshareState workshare;
+      bool hot_team;  // return to WORKER_HOT rather than WORKER_IDLE
+      int nthreads_var;  // omp_set_num_threads (0 = pool's choice)
+      int pushed_num_threads;  // 'num_threads' clause for the next team
 
       void push_work_item(WorkItem *new_work);
       WorkItem *pop_work_item(void);
+
+      // these must be called by every thread in the current team, in the
+      //  same order - a thread without a team (or in a team of one) gets
+      //  the trivial behavior
+
+      // waits for every thread in the team to arrive
+      void team_barrier(void);
+
+      // returns true for the first thread to reach a given 'single' block
+      bool claim_single(void);
+
+      // starts a worksharing loop over 'params.count' iterations
+      void loop_start(const LoopParams& params);
+      // claims the next chunk [first, last) of iterations for this thread,
+      //  returning false once the loop has run out
+      bool loop_next(uint64_t& first, uint64_t& last);
+
+      // folds 'data' into the team's reduction with 'combine(lhs, rhs)',
+      //  returning true in exactly one thread, whose 'data' then holds the
+      //  combined value - if 'wait_for_result' is set, the other threads
+      //  are held until that thread calls reduce_done()
+      bool team_reduce(void *data, void (*combine)(void *lhs, void *rhs),
+		       bool wait_for_result);
+      void reduce_done(void);
     };
       
     // returns the WorkerInfo (if any) associated with the caller (which
@@ -74,12 +164,35 @@ namespace Realm {
 		      void (*fnptr)(void *data), void *data,
 		      WorkItem *work_item);
 
+    // forms a team of up to 'nthreads' threads (0 = the pool's choice) led
+    //  by 'master', which must be the calling thread, and starts the other
+    //  members on 'fnptr(data)' - the caller runs its own share and then
+    //  calls end_team to wait for the rest
+    void start_team(WorkerInfo *master, int nthreads,
+		    void (*fnptr)(void *data), void *data,
+		    const LoopParams *preset_loop = 0);
+    void end_team(WorkerInfo *master);
+
     int get_num_workers() const { return num_workers; }
 
+    int get_max_active_levels(void) const { return max_active_levels; }
+    void set_max_active_levels(int levels);
+
+    // number of enclosing teams (with more than one thread) of the
+    //  caller's current work item
+    static int get_active_levels(const WorkerInfo *wi);
+
   protected:
     int num_workers;
+    bool hot_teams;
+    volatile int max_active_levels;
     std::vector<Thread *> worker_threads;
     std::vector<WorkerInfo> worker_infos;
+    // the master's most recent top-level team - these workers sit in
+    //  WORKER_HOT between regions so the next region can restart them
+    //  without searching the pool or allocating a new work item
+    std::set<int> hot_workers;
+    WorkItem hot_work_item;
   };
 
 }; // namespace Realm
@@ -20,6 +20,7 @@
 
 #include <deque>
 #include <map>
+#include <vector>
 
 #include "realm/sampling.h"
 
@@ -104,6 +105,92 @@ namespace Realm {
     ProfilingGauges::AbsoluteRangeGauge<int> *entries_in_queue;
   };
 
+  // a sharded priority queue has the same interface and semantics as
+  //  PriorityQueue, but keeps a separate lock (of type LT) for each priority
+  //  level rather than one for the whole queue - the set of levels (and the
+  //  set of subscriptions) is published as an immutable snapshot, so finding a
+  //  level, checking for emptiness and performing notifications are lock-free
+  // levels are never destroyed (until the queue is), so a queue that drains
+  //  and refills does not churn through allocations the way a map of deques does
+  template <typename T, typename LT>
+  class ShardedPriorityQueue {
+  public:
+    ShardedPriorityQueue(void);
+    ~ShardedPriorityQueue(void);
+
+    typedef T ITEMTYPE;
+
+    typedef int priority_t;
+    static const priority_t PRI_MAX_FINITE = INT_MAX - 1;
+    static const priority_t PRI_MIN_FINITE = -(INT_MAX - 1);
+    static const priority_t PRI_POS_INF = PRI_MAX_FINITE + 1;
+    static const priority_t PRI_NEG_INF = PRI_MIN_FINITE - 1;
+
+    void put(T item, priority_t priority, bool add_to_back = true);
+
+    T get(priority_t *item_priority, priority_t higher_than = PRI_NEG_INF);
+
+    T peek(priority_t *item_priority, priority_t higher_than = PRI_NEG_INF) const;
+
+    bool empty(priority_t higher_than = PRI_NEG_INF) const;
+
+    // notifications are performed with the lock for the new item's priority
+    //  level held - they are sent when the level goes from empty to non-empty
+    //  and no higher level has any items in it
+    class NotificationCallback {
+    public:
+      virtual bool item_available(T item, priority_t item_priority) = 0;
+    };
+
+    void add_subscription(NotificationCallback *callback, priority_t higher_than = PRI_NEG_INF);
+    void remove_subscription(NotificationCallback *callback);
+
+    void set_gauge(ProfilingGauges::AbsoluteRangeGauge<int> *new_gauge);
+
+  protected:
+    struct Level {
+      Level(priority_t _priority);
+
+      priority_t priority;
+      // 'count' may be read without the lock held, but only written with the lock
+      volatile int count;
+      mutable LT lock;
+      std::deque<T> items;
+    };
+
+    // snapshot of all levels, sorted from highest to lowest priority
+    struct LevelList {
+      std::vector<Level *> levels;
+    };
+
+    struct SubscriptionList {
+      std::vector<std::pair<NotificationCallback *, priority_t> > subscriptions;
+    };
+
+    // returns the level for the specified priority, creating it if necessary
+    Level *find_or_create_level(priority_t priority);
+
+    // returns true if any level above the specified priority is non-empty
+    bool higher_nonempty(const LevelList *snapshot, priority_t priority) const;
+
+    // helper that performs notifications for a new item - returns true if a callback
+    //  consumes the item
+    bool perform_notifications(T item, priority_t item_priority);
+
+    // the current snapshots - only replaced while holding 'update_lock'
+    const LevelList * volatile level_list;
+    const SubscriptionList * volatile subscription_list;
+
+    // old snapshots can't be freed while a reader might still be looking at
+    //  them, so they are kept until the queue is destroyed
+    std::vector<const LevelList *> retired_levels;
+    std::vector<const SubscriptionList *> retired_subscriptions;
+
+    LT update_lock;
+
+    ProfilingGauges::AbsoluteRangeGauge<int> *entries_in_queue;
+  };
+
 }; // namespace Realm
 
 #include "realm/pri_queue.inl"
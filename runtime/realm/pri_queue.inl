@@ -233,4 +233,307 @@ namespace Realm {
     entries_in_queue = new_gauge;
   }
 
+
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class ShardedPriorityQueue<T, LT>
+
+  template <typename T, typename LT>
+  inline ShardedPriorityQueue<T, LT>::Level::Level(priority_t _priority)
+    : priority(_priority)
+    , count(0)
+  {}
+
+  template <typename T, typename LT>
+  inline ShardedPriorityQueue<T, LT>::ShardedPriorityQueue(void)
+    : level_list(new LevelList)
+    , subscription_list(new SubscriptionList)
+    , entries_in_queue(0)
+  {
+  }
+
+  template <typename T, typename LT>
+  inline ShardedPriorityQueue<T, LT>::~ShardedPriorityQueue(void)
+  {
+    for(typename std::vector<Level *>::const_iterator it = level_list->levels.begin();
+	it != level_list->levels.end();
+	++it)
+      delete *it;
+    delete level_list;
+    delete subscription_list;
+
+    for(typename std::vector<const LevelList *>::const_iterator it = retired_levels.begin();
+	it != retired_levels.end();
+	++it)
+      delete *it;
+    for(typename std::vector<const SubscriptionList *>::const_iterator it = retired_subscriptions.begin();
+	it != retired_subscriptions.end();
+	++it)
+      delete *it;
+  }
+
+  template <typename T, typename LT>
+  inline typename ShardedPriorityQueue<T, LT>::Level *ShardedPriorityQueue<T, LT>::find_or_create_level(priority_t priority)
+  {
+    // fast path - binary search of the current snapshot (sorted highest first)
+    {
+      const LevelList *snapshot = level_list;
+      size_t lo = 0;
+      size_t hi = snapshot->levels.size();
+      while(lo < hi) {
+	size_t mid = (lo + hi) >> 1;
+	Level *l = snapshot->levels[mid];
+	if(l->priority == priority)
+	  return l;
+	if(l->priority > priority)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+    }
+
+    // slow path - take the update lock and check again, since somebody else
+    //  may have created the level while we were waiting
+    update_lock.lock();
+    const LevelList *old_snapshot = level_list;
+    for(typename std::vector<Level *>::const_iterator it = old_snapshot->levels.begin();
+	it != old_snapshot->levels.end();
+	++it)
+      if((*it)->priority == priority) {
+	update_lock.unlock();
+	return *it;
+      }
+
+    // build a new snapshot with the new level inserted in sorted order
+    Level *found = new Level(priority);
+    LevelList *new_snapshot = new LevelList;
+    new_snapshot->levels.reserve(old_snapshot->levels.size() + 1);
+    bool inserted = false;
+    for(typename std::vector<Level *>::const_iterator it = old_snapshot->levels.begin();
+	it != old_snapshot->levels.end();
+	++it) {
+      if(!inserted && ((*it)->priority < priority)) {
+	new_snapshot->levels.push_back(found);
+	inserted = true;
+      }
+      new_snapshot->levels.push_back(*it);
+    }
+    if(!inserted)
+      new_snapshot->levels.push_back(found);
+
+    // make sure the contents of the new snapshot are visible before the pointer
+    __sync_synchronize();
+    level_list = new_snapshot;
+    retired_levels.push_back(old_snapshot);
+    update_lock.unlock();
+    return found;
+  }
+
+  template <typename T, typename LT>
+  inline bool ShardedPriorityQueue<T, LT>::higher_nonempty(const LevelList *snapshot,
+							   priority_t priority) const
+  {
+    for(typename std::vector<Level *>::const_iterator it = snapshot->levels.begin();
+	it != snapshot->levels.end();
+	++it) {
+      if((*it)->priority <= priority)
+	break;
+      if((*it)->count > 0)
+	return true;
+    }
+    return false;
+  }
+
+  template <typename T, typename LT>
+  inline void ShardedPriorityQueue<T, LT>::put(T item,
+					       priority_t priority,
+					       bool add_to_back /*= true*/)
+  {
+    // step 1: clamp the priority to the "finite" range
+    if(priority > PRI_MAX_FINITE)
+      priority = PRI_MAX_FINITE;
+    else if(priority < PRI_MIN_FINITE)
+      priority = PRI_MIN_FINITE;
+
+    // increase the entry count, if we care
+    if(entries_in_queue)
+      (*entries_in_queue) += 1;
+
+    // step 2: find the level and take its lock
+    Level *l = find_or_create_level(priority);
+    l->lock.lock();
+
+    // step 3: add the item - this has to be visible before any notifications
+    //  are performed, or a worker that samples its work counter after the
+    //  notification could miss the item and go to sleep
+    if(add_to_back)
+      l->items.push_back(item);
+    else
+      l->items.push_front(item);
+    int old_count = l->count;
+    l->count = old_count + 1;
+
+    // step 4: if this level was empty and nothing above it has work, this is
+    //  a new highest-priority item and subscribers need to know
+    if((old_count == 0) && !higher_nonempty(level_list, priority)) {
+      if(perform_notifications(item, priority)) {
+	// item was taken, so remove it again - nobody else can have seen it
+	//  while we hold the level's lock
+	if(add_to_back)
+	  l->items.pop_back();
+	else
+	  l->items.pop_front();
+	l->count = old_count;
+	l->lock.unlock();
+	if(entries_in_queue)
+	  (*entries_in_queue) -= 1;
+	return;
+      }
+    }
+
+    l->lock.unlock();
+  }
+
+  template <typename T, typename LT>
+  inline T ShardedPriorityQueue<T, LT>::get(priority_t *item_priority,
+					    priority_t higher_than /*= PRI_NEG_INF*/)
+  {
+    const LevelList *snapshot = level_list;
+    for(typename std::vector<Level *>::const_iterator it = snapshot->levels.begin();
+	it != snapshot->levels.end();
+	++it) {
+      Level *l = *it;
+
+      // not interesting enough? (neither is anything after this)
+      if(l->priority <= higher_than)
+	break;
+
+      // lock-free check before we bother taking the lock
+      if(l->count == 0)
+	continue;
+
+      l->lock.lock();
+      if(l->items.empty()) {
+	// lost a race with another getter
+	l->lock.unlock();
+	continue;
+      }
+      T item = l->items.front();
+      l->items.pop_front();
+      l->count = l->count - 1;
+      l->lock.unlock();
+
+      // decrease the entry count, if we care
+      if(entries_in_queue)
+	(*entries_in_queue) -= 1;
+
+      if(item_priority)
+	*item_priority = l->priority;
+      return item;
+    }
+
+    return 0; // TODO - EMPTY_VAL
+  }
+
+  template <typename T, typename LT>
+  inline T ShardedPriorityQueue<T, LT>::peek(priority_t *item_priority,
+					     priority_t higher_than /*= PRI_NEG_INF*/) const
+  {
+    const LevelList *snapshot = level_list;
+    for(typename std::vector<Level *>::const_iterator it = snapshot->levels.begin();
+	it != snapshot->levels.end();
+	++it) {
+      const Level *l = *it;
+
+      if(l->priority <= higher_than)
+	break;
+
+      if(l->count == 0)
+	continue;
+
+      l->lock.lock();
+      if(l->items.empty()) {
+	l->lock.unlock();
+	continue;
+      }
+      T item = l->items.front();
+      l->lock.unlock();
+
+      if(item_priority)
+	*item_priority = l->priority;
+      return item;
+    }
+
+    return 0; // TODO - EMPTY_VAL
+  }
+
+  template <typename T, typename LT>
+  inline bool ShardedPriorityQueue<T, LT>::empty(priority_t higher_than /*= PRI_NEG_INF*/) const
+  {
+    return !higher_nonempty(level_list, higher_than);
+  }
+
+  template <typename T, typename LT>
+  inline void ShardedPriorityQueue<T, LT>::add_subscription(NotificationCallback *callback,
+							    priority_t higher_than /*= PRI_NEG_INF*/)
+  {
+    update_lock.lock();
+    const SubscriptionList *old_list = subscription_list;
+    SubscriptionList *new_list = new SubscriptionList(*old_list);
+    bool found = false;
+    for(size_t i = 0; i < new_list->subscriptions.size(); i++)
+      if(new_list->subscriptions[i].first == callback) {
+	new_list->subscriptions[i].second = higher_than;
+	found = true;
+      }
+    if(!found)
+      new_list->subscriptions.push_back(std::make_pair(callback, higher_than));
+    __sync_synchronize();
+    subscription_list = new_list;
+    retired_subscriptions.push_back(old_list);
+    update_lock.unlock();
+  }
+
+  template <typename T, typename LT>
+  inline void ShardedPriorityQueue<T, LT>::remove_subscription(NotificationCallback *callback)
+  {
+    update_lock.lock();
+    const SubscriptionList *old_list = subscription_list;
+    SubscriptionList *new_list = new SubscriptionList;
+    for(size_t i = 0; i < old_list->subscriptions.size(); i++)
+      if(old_list->subscriptions[i].first != callback)
+	new_list->subscriptions.push_back(old_list->subscriptions[i]);
+    __sync_synchronize();
+    subscription_list = new_list;
+    retired_subscriptions.push_back(old_list);
+    update_lock.unlock();
+  }
+
+  template <typename T, typename LT>
+  inline bool ShardedPriorityQueue<T, LT>::perform_notifications(T item, priority_t item_priority)
+  {
+    // level lock already held by caller
+    const SubscriptionList *snapshot = subscription_list;
+    for(typename std::vector<std::pair<NotificationCallback *, priority_t> >::const_iterator it = snapshot->subscriptions.begin();
+	it != snapshot->subscriptions.end();
+	it++) {
+      // skip if this isn't interesting to this callback
+      if(item_priority <= it->second)
+	continue;
+
+      // do callback - a return of true means the item was consumed (so we shouldn't do
+      //  any more callbacks
+      if(it->first->item_available(item, item_priority))
+	return true;
+    }
+
+    return false;
+  }
+
+  template <typename T, typename LT>
+  inline void ShardedPriorityQueue<T, LT>::set_gauge(ProfilingGauges::AbsoluteRangeGauge<int> *new_gauge)
+  {
+    entries_in_queue = new_gauge;
+  }
+
 }; // namespace Realm
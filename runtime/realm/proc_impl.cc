@@ -344,6 +344,20 @@ namespace Realm {
       return finish_event;
     }
 
+    /*static*/ void Processor::set_task_stealable(Kind target_kind,
+						  TaskFuncID func_id,
+						  bool stealable /*= true*/)
+    {
+      std::set<Processor> local_procs;
+      get_runtime()->machine->get_local_processors_by_kind(local_procs, target_kind);
+      for(std::set<Processor>::const_iterator it = local_procs.begin();
+	  it != local_procs.end();
+	  it++) {
+	ProcessorImpl *p = get_runtime()->get_processor_impl(*it);
+	p->set_task_stealable(func_id, stealable);
+      }
+    }
+
     // reports an execution fault in the currently running task
     /*static*/ void Processor::report_execution_fault(int reason,
 						      const void *reason_data,
@@ -434,6 +448,12 @@ namespace Realm {
       assert(0);
     }
 
+    void ProcessorImpl::set_task_stealable(Processor::TaskFuncID func_id,
+					   bool stealable)
+    {
+      // nothing to do - this processor never steals tasks
+    }
+
 
   ////////////////////////////////////////////////////////////////////////
   //
@@ -809,6 +829,7 @@ namespace Realm {
     : ProcessorImpl(_me, _kind, _num_cores)
     , sched(0)
     , ready_task_count(stringbuilder() << "realm/proc " << me << "/ready tasks")
+    , steal_count(stringbuilder() << "realm/proc " << me << "/steals")
   {
     task_queue.set_gauge(&ready_task_count);
   }
@@ -847,6 +868,44 @@ namespace Realm {
     sched->add_task_queue(&group->task_queue);
   }
 
+  void LocalTaskProcessor::add_steal_victim(LocalTaskProcessor *victim)
+  {
+    assert(victim != this);
+    sched->set_steal_filter(this);
+    sched->add_steal_queue(&victim->task_queue);
+  }
+
+  bool LocalTaskProcessor::can_steal(const Task *task)
+  {
+    // a task is left where it was sent unless the application has said it
+    //  doesn't care where it runs - this also keeps Realm's internal tasks
+    //  (e.g. processor init/shutdown) on their own processors
+    {
+      AutoHSLLock al(steal_mutex);
+      if(stealable_tasks.count(task->func_id) == 0)
+	return false;
+    }
+    // and we can only run it if it's been registered here too
+    return (task_table.count(task->func_id) > 0);
+  }
+
+  void LocalTaskProcessor::set_task_stealable(Processor::TaskFuncID func_id,
+					      bool stealable)
+  {
+    AutoHSLLock al(steal_mutex);
+    if(stealable)
+      stealable_tasks.insert(func_id);
+    else
+      stealable_tasks.erase(func_id);
+  }
+
+  void LocalTaskProcessor::task_stolen(Task *task)
+  {
+    steal_count += 1;
+    log_task.debug() << "task stolen: proc=" << me << " victim=" << task->proc
+		     << " func=" << task->func_id << " finish=" << task->get_finish_event();
+  }
+
   void LocalTaskProcessor::enqueue_task(Task *task)
   {
     // just jam it into the task queue
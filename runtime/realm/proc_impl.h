@@ -63,6 +63,10 @@ namespace Realm {
 				 CodeDescriptor& codedesc,
 				 const ByteArrayRef& user_data);
 
+      // only processors that can steal work need to track this
+      virtual void set_task_stealable(Processor::TaskFuncID func_id,
+				      bool stealable);
+
     protected:
       friend class Task;
 
@@ -77,7 +81,8 @@ namespace Realm {
 
     // generic local task processor - subclasses must create and configure a task
     // scheduler and pass in with the set_scheduler() method
-    class LocalTaskProcessor : public ProcessorImpl {
+    class LocalTaskProcessor : public ProcessorImpl,
+			       protected ThreadedTaskScheduler::StealFilter {
     public:
       LocalTaskProcessor(Processor _me, Processor::Kind _kind, int num_cores=1);
       virtual ~LocalTaskProcessor(void);
@@ -94,6 +99,9 @@ namespace Realm {
 				 CodeDescriptor& codedesc,
 				 const ByteArrayRef& user_data);
 
+      virtual void set_task_stealable(Processor::TaskFuncID func_id,
+				      bool stealable);
+
       // starts worker threads and performs any per-processor initialization
       virtual void start_threads(void);
 
@@ -102,12 +110,20 @@ namespace Realm {
 
       virtual void add_to_group(ProcessorGroup *group);
 
+      // lets this processor's idle workers steal ready tasks from 'victim'
+      void add_steal_victim(LocalTaskProcessor *victim);
+
     protected:
       void set_scheduler(ThreadedTaskScheduler *_sched);
 
+      // StealFilter methods
+      virtual bool can_steal(const Task *task);
+      virtual void task_stolen(Task *task);
+
       ThreadedTaskScheduler *sched;
-      PriorityQueue<Task *, GASNetHSL> task_queue;
+      ThreadedTaskScheduler::TaskQueue task_queue;
       ProfilingGauges::AbsoluteRangeGauge<int> ready_task_count;
+      ProfilingGauges::EventCounter<int> steal_count;
 
       struct TaskTableEntry {
 	Processor::TaskFuncPtr fnptr;
@@ -116,6 +132,10 @@ namespace Realm {
 
       std::map<Processor::TaskFuncID, TaskTableEntry> task_table;
 
+      // task IDs that may be stolen - can change while workers are looking
+      GASNetHSL steal_mutex;
+      std::set<Processor::TaskFuncID> stealable_tasks;
+
       virtual void execute_task(Processor::TaskFuncID func_id,
 				const ByteArrayRef& task_args);
     };
@@ -208,7 +228,7 @@ namespace Realm {
 
       void request_group_members(void);
 
-      PriorityQueue<Task *, GASNetHSL> task_queue;
+      ThreadedTaskScheduler::TaskQueue task_queue;
       ProfilingGauges::AbsoluteRangeGauge<int> *ready_task_count;
     };
     
@@ -112,6 +112,14 @@ namespace Realm {
 					 const ProfilingRequestSet& prs,
 					 const void *user_data = 0, size_t user_data_len = 0);
 
+      // work stealing (i.e. "-ll:steal") only moves a ready task to another
+      //  processor if its task ID has been marked stealable for that kind of
+      //  processor - don't mark a task that must run on the processor it was
+      //  spawned on (e.g. one that relies on get_executing_processor())
+      // this affects processors in the local address space only
+      static void set_task_stealable(Kind target_kind, TaskFuncID func_id,
+				     bool stealable = true);
+
       // reports an execution fault in the currently running task
       static void report_execution_fault(int reason,
 					 const void *reason_data, size_t reason_size);
@@ -170,7 +170,7 @@ namespace Realm {
 
     std::map<Processor::TaskFuncID, TaskTableEntry> task_table;
 
-    PriorityQueue<Task *, GASNetHSL> task_queue;
+    ThreadedTaskScheduler::TaskQueue task_queue;
     ProfilingGauges::AbsoluteRangeGauge<int> ready_task_count;
   };
 
@@ -37,6 +37,14 @@
 //define REALM_USE_KERNEL_AIO
 #endif
 
+// if set, an io_uring-based implementation of async file I/O is also built,
+//  and can be selected at runtime with -ll:io_uring
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define REALM_USE_IO_URING
+#endif
+#endif
+
 // dynamic loading via dlfcn and a not-completely standard dladdr extension
 #ifdef USE_LIBDL
 #define REALM_USE_DLFCN
@@ -66,6 +74,16 @@ namespace Realm {
     //  specified limit
     extern int event_loop_detection_limit;
 
+    // if greater than one, merges of more than this many untriggered events are
+    //  built as a tree of mergers with at most this fan-in
+    extern int event_merge_radix;
+
+    // if greater than one, barrier trigger notifications to more than this
+    //  many nodes are sent down a tree with this fan-out, and (if event
+    //  message batching is enabled) ready arrivals are combined on their way
+    //  up a tree of the same radix to the owner
+    extern int barrier_radix;
+
     // if true, worker threads that might have used user-level thread switching
     //  fall back to kernel threading
     extern bool force_kernel_threads;
@@ -241,11 +241,13 @@ namespace Realm {
 	assert(impl->owner == my_node_id);
 	assert(impl->count == ReservationImpl::ZERO_COUNT);
 	assert(impl->mode == ReservationImpl::MODE_EXCL);
+	assert(impl->excl_waiters.empty());
 	assert(impl->local_waiters.size() == 0);
         assert(impl->remote_waiter_mask.empty());
 	assert(!impl->in_use);
 
 	impl->in_use = true;
+	impl->enable_fast_path_if_idle();
 
 	log_reservation.info() << "reservation created: rsrv=" << impl->me;
 	return impl->me;
@@ -333,6 +335,7 @@ namespace Realm {
       log_reservation.spew("count init " IDFMT "=[%p]=%d", me.id, &count, count);
       mode = 0;
       in_use = false;
+      fast_state = FAST_DISABLED;
       remote_waiter_mask = NodeSet(); 
       remote_sharer_mask = NodeSet();
       requested = false;
@@ -377,6 +380,9 @@ namespace Realm {
       do {
 	AutoHSLLock a(impl->mutex);
 
+	// a local holder on the fast path has to be visible in count/mode
+	impl->disable_fast_path();
+
 	// case 1: we don't even own the lock any more - pass the request on
 	//  to whoever we think the owner is
 	if(impl->owner != my_node_id) {
@@ -503,6 +509,7 @@ namespace Realm {
 	// make sure we were really waiting for this lock
 	assert(impl->owner != my_node_id);
 	assert(impl->requested);
+	assert(impl->fast_state == ReservationImpl::FAST_DISABLED);
 
 	// first, update our copy of the protected data (if any)
 	const int *pos = (const int *)data;
@@ -550,6 +557,17 @@ namespace Realm {
       // collapse exclusivity into mode
       if(exclusive) new_mode = MODE_EXCL;
 
+      // uncontended fast path (retries and placeholders have bookkeeping to
+      //  do, so they always take the slow path)
+      if((new_mode == MODE_EXCL) &&
+	 ((acquire_type == ACQUIRE_BLOCKING) ||
+	  (acquire_type == ACQUIRE_NONBLOCKING)) &&
+	 try_fast_acquire()) {
+	if(after_lock.exists())
+	  GenEventImpl::trigger(after_lock, false /*!poisoned*/);
+	return after_lock;
+      }
+
       bool got_lock = false;
       int lock_request_target = -1;
       WaiterList bonus_grants;
@@ -557,6 +575,8 @@ namespace Realm {
       {
 	AutoHSLLock a(mutex); // hold mutex on lock while we check things
 
+	disable_fast_path();
+
 	// it'd be bad if somebody tried to take a lock that had been 
 	//   deleted...  (info is only valid on a lock's home node)
 	assert((ID(me).rsrv.creator_node != my_node_id) ||
@@ -583,6 +603,7 @@ namespace Realm {
 	  if((count == ZERO_COUNT) ||
 	     ((mode == new_mode) &&
 	      (mode != MODE_EXCL) &&
+	      excl_waiters.empty() &&
 	      (local_waiters.empty() || (local_waiters.begin()->first > mode)))) {
 	    mode = new_mode;
 	    count++;
@@ -663,7 +684,10 @@ namespace Realm {
 	    {
 	      if(!after_lock.exists())
 		after_lock = GenEventImpl::create_genevent()->current_event();
-	      local_waiters[new_mode].push_back(after_lock);
+	      if(new_mode == MODE_EXCL)
+		excl_waiters.push_back(after_lock);
+	      else
+		local_waiters[new_mode].push_back(after_lock);
 	      break;
 	    }
 
@@ -749,19 +773,20 @@ namespace Realm {
     //  priority than any blocking waiter
     bool ReservationImpl::select_local_waiters(WaiterList& to_wake)
     {
-      if(local_waiters.empty() && retry_events.empty())
+      if(excl_waiters.empty() && local_waiters.empty() && retry_events.empty())
 	return false;
 
-      // further favor exclusive waiters
-      if(local_waiters.find(MODE_EXCL) != local_waiters.end()) {
-	WaiterList& excl_waiters = local_waiters[MODE_EXCL];
+      // further favor exclusive waiters, except that sharers that queued up
+      //  behind an exclusive holder go next (as one batch) - new sharers
+      //  don't join a shared mode while an exclusive waiter is queued, so
+      //  neither side can starve the other
+      bool sharers_next = !local_waiters.empty() && (mode == MODE_EXCL);
+
+      if(!excl_waiters.empty() && !sharers_next) {
+	// hand the reservation straight to the oldest exclusive waiter
 	to_wake.push_back(excl_waiters.front());
 	excl_waiters.pop_front();
 	  
-	// if the set of exclusive waiters is empty, delete it
-	if(excl_waiters.size() == 0)
-	  local_waiters.erase(MODE_EXCL);
-	  
 	mode = MODE_EXCL;
 	count = ZERO_COUNT + 1;
 	log_reservation.spew("count <-1 [%p]=%d", &count, count);
@@ -779,6 +804,13 @@ namespace Realm {
 	  // grab the list of events wanting to share the lock
 	  to_wake.swap(it->second);
 	  local_waiters.erase(it);  // actually pull list off map!
+	  // nonblocking requests for the same mode can retry and come along
+	  //  for the ride
+	  std::map<unsigned, Event>::iterator it3 = retry_events.find(mode);
+	  if(it3 != retry_events.end()) {
+	    to_wake.push_back(it3->second);
+	    retry_events.erase(it3);
+	  }
 	  // TODO: can we share with any other nodes?
 	} else {
 	  // wake up one or more folks that will retry their try_acquires
@@ -798,6 +830,39 @@ namespace Realm {
       return true;
     }
 
+    void ReservationImpl::disable_fast_path(void)
+    {
+      while(true) {
+	int prev = fast_state;
+	if(prev == FAST_DISABLED)
+	  return;
+	if(__sync_bool_compare_and_swap(&fast_state, prev, FAST_DISABLED)) {
+	  if(prev == FAST_HELD) {
+	    // the holder will find the fast path gone and do a normal release
+	    assert(count == ZERO_COUNT);
+	    mode = MODE_EXCL;
+	    count = ZERO_COUNT + 1;
+	  }
+	  return;
+	}
+      }
+    }
+
+    void ReservationImpl::enable_fast_path_if_idle(void)
+    {
+      if(Config::disable_reservation_fast_path)
+	return;
+
+      if((owner == my_node_id) && (count == ZERO_COUNT) && !requested &&
+	 excl_waiters.empty() && local_waiters.empty() &&
+	 retry_count.empty() && retry_events.empty() &&
+	 remote_waiter_mask.empty() && remote_sharer_mask.empty()) {
+	mode = MODE_EXCL;
+	// full barrier - everything above must be visible to a fast acquirer
+	__sync_bool_compare_and_swap(&fast_state, FAST_DISABLED, FAST_FREE);
+      }
+    }
+
     void ReservationImpl::release(void)
     {
       // make a list of events that we be woken - can't do it while holding the
@@ -808,6 +873,11 @@ namespace Realm {
       int grant_target = -1;
       NodeSet copy_waiters;
 
+      // a holder that got the reservation on the fast path can usually give
+      //  it back the same way
+      if(try_fast_release())
+	return;
+
       do {
 #ifdef RSRV_DEBUG_MSGS
 	log_reservation.debug(            "release: reservation=" IDFMT " count=%d mode=%d owner=%d", // share=%lx wait=%lx",
@@ -815,6 +885,8 @@ namespace Realm {
 #endif
 	AutoHSLLock a(mutex); // hold mutex on lock for entire function
 
+	disable_fast_path();
+
 	assert(count > ZERO_COUNT);
 
 	// if this isn't the last holder of the lock, just decrement count
@@ -866,9 +938,13 @@ namespace Realm {
 	}
 
 	// nobody wants it?  just sits in available state
+	assert(excl_waiters.empty());
 	assert(local_waiters.empty());
 	assert(retry_events.empty());
 	assert(remote_waiter_mask.empty());
+
+	// if it's still ours, the next uncontended acquire can be a fast one
+	enable_fast_path_if_idle();
       } while(0);
 
       if(release_target != -1)
@@ -929,6 +1005,10 @@ namespace Realm {
 
     bool ReservationImpl::is_locked(unsigned check_mode, bool excl_ok)
     {
+      // a fast path holder always has it exclusively
+      if(fast_state == FAST_HELD)
+	return ((check_mode == MODE_EXCL) || excl_ok);
+
       // checking the owner can be done atomically, so doesn't need mutex
       if(owner != my_node_id) return false;
 
@@ -953,10 +1033,13 @@ namespace Realm {
       {
 	AutoHSLLock al(mutex);
 
+	disable_fast_path();
+
 	// should only get here if the current node holds an exclusive lock
 	assert(owner == my_node_id);
 	assert(count == 1 + ZERO_COUNT);
 	assert(mode == MODE_EXCL);
+	assert(excl_waiters.empty());
 	assert(local_waiters.size() == 0);
         assert(remote_waiter_mask.empty());
 	assert(in_use);
@@ -1055,6 +1138,7 @@ namespace Realm {
 
   namespace Config {
     bool use_fast_reservation_fallback = false;
+    bool disable_reservation_fast_path = false;
   };
 
   FastReservation::FastReservation(Reservation _rsrv /*= Reservation::NO_RESERVATION*/)
@@ -50,6 +50,7 @@ namespace Realm {
 
     namespace Config {
       extern bool use_fast_reservation_fallback;
+      extern bool disable_reservation_fast_path;
     };
 
     class ReservationImpl {
@@ -89,6 +90,10 @@ namespace Realm {
       typedef std::deque<Event> WaiterList;
 #endif
 
+      // local exclusive waiters are queued in FIFO order and handed the
+      //  reservation directly by whoever releases it - waiters for shared
+      //  modes are kept per mode so that each mode is granted as a batch
+      WaiterList excl_waiters;
       std::map<unsigned, WaiterList> local_waiters;
       std::map<unsigned, unsigned> retry_count;
       std::map<unsigned, Event> retry_events;
@@ -124,6 +129,22 @@ namespace Realm {
 
       bool select_local_waiters(WaiterList& to_wake);
 
+      // uncontended fast path - while this node owns the reservation and
+      //  nobody (local or remote) is waiting for it, an exclusive acquire
+      //  and its release are each a single compare-and-swap on fast_state,
+      //  without taking the mutex or touching count/mode
+      enum { FAST_DISABLED, FAST_FREE, FAST_HELD };
+      volatile int fast_state;
+
+      bool try_fast_acquire(void);
+      bool try_fast_release(void);
+
+      // these must be called with the mutex held - disable_fast_path() also
+      //  folds a fast path holder (if any) back into count/mode, and must be
+      //  called before either of those is looked at
+      void disable_fast_path(void);
+      void enable_fast_path_if_idle(void);
+
       void release(void);
 
       bool is_locked(unsigned check_mode, bool excl_ok);
@@ -20,6 +20,25 @@
 
 namespace Realm {
 
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class ReservationImpl
+  //
+
+    inline bool ReservationImpl::try_fast_acquire(void)
+    {
+      return ((fast_state == FAST_FREE) &&
+	      __sync_bool_compare_and_swap(&fast_state, FAST_FREE, FAST_HELD));
+    }
+
+    inline bool ReservationImpl::try_fast_release(void)
+    {
+      // a reservation in the FAST_HELD state can only be held by the caller,
+      //  so this fails only if a slow path operation has taken over
+      return ((fast_state == FAST_HELD) &&
+	      __sync_bool_compare_and_swap(&fast_state, FAST_HELD, FAST_FREE));
+    }
+
   ////////////////////////////////////////////////////////////////////////
   //
   // class StaticAccess<T>
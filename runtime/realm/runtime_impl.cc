@@ -671,6 +671,7 @@ namespace Realm {
     , concurrent_io_threads(1)  // Legion does not support values > 1 right now
     , sysmem_size_in_mb(512), stack_size_in_mb(2)
     , pin_util_procs(false)
+    , steal_cpu_work(false)
   {}
 
   CoreModule::~CoreModule(void)
@@ -690,6 +691,7 @@ namespace Realm {
       .add_option_int("-ll:csize", m->sysmem_size_in_mb)
       .add_option_int("-ll:stacksize", m->stack_size_in_mb, true /*keep*/)
       .add_option_bool("-ll:pin_util", m->pin_util_procs)
+      .add_option_bool("-ll:steal", m->steal_cpu_work)
       .parse_command_line(cmdline);
 
     return m;
@@ -733,13 +735,23 @@ namespace Realm {
       runtime->add_processor(pi);
     }
 
+    std::vector<LocalCPUProcessor *> cpu_procs;
     for(int i = 0; i < num_cpu_procs; i++) {
       Processor p = runtime->next_local_processor_id();
-      ProcessorImpl *pi = new LocalCPUProcessor(p, runtime->core_reservation_set(),
-						stack_size_in_mb << 20,
-						Config::force_kernel_threads);
+      LocalCPUProcessor *pi = new LocalCPUProcessor(p, runtime->core_reservation_set(),
+						    stack_size_in_mb << 20,
+						    Config::force_kernel_threads);
       runtime->add_processor(pi);
+      cpu_procs.push_back(pi);
     }
+
+    // with work stealing enabled, every CPU processor can take ready tasks
+    //  from any of its siblings (but only for task IDs the application has
+    //  marked with Processor::set_task_stealable)
+    if(steal_cpu_work)
+      for(size_t i = 0; i < cpu_procs.size(); i++)
+	for(size_t j = 1; j < cpu_procs.size(); j++)
+	  cpu_procs[i]->add_steal_victim(cpu_procs[(i + j) % cpu_procs.size()]);
   }
 
   // create any DMA channels provided by the module (default == do nothing)
@@ -1094,6 +1106,13 @@ namespace Realm {
 	}
       }
 
+#ifndef USE_GASNET
+      // without GASNet, this is where any additional ranks for the shared
+      //  memory transport are forked (see -ll:shm_ranks)
+      if(!init_shm_ranks(*argc, *argv))
+	return false;
+#endif
+
       return true;
     }
 
@@ -1170,9 +1189,32 @@ namespace Realm {
 #endif
 
       cp.add_option_int("-realm:eventloopcheck", Config::event_loop_detection_limit);
+      cp.add_option_int("-realm:mergeradix", Config::event_merge_radix);
+      cp.add_option_int("-realm:barrier_radix", Config::barrier_radix);
       cp.add_option_bool("-ll:force_kthreads", Config::force_kernel_threads);
       cp.add_option_bool("-ll:frsrv_fallback", Config::use_fast_reservation_fallback);
+      cp.add_option_bool("-ll:rsrv_slow", Config::disable_reservation_fast_path);
       cp.add_option_int("-ll:machine_query_cache", Config::use_machine_query_cache);
+      cp.add_option_stringlist("-ll:bestfit", Config::best_fit_memory_kinds);
+      cp.add_option_int("-ll:instpool", Config::instance_pool_size_in_mb);
+      cp.add_option_int("-ll:cmmap", Config::cpu_mem_mmap);
+      cp.add_option_int("-ll:chugetlb", Config::cpu_mem_hugetlb_kb);
+      cp.add_option_int("-ll:cprefault", Config::cpu_mem_prefault_threads);
+      cp.add_option_bool("-ll:file_mmap", Config::file_mmap);
+      cp.add_option_bool("-ll:io_uring", Config::use_io_uring);
+      cp.add_option_bool("-ll:io_uring_sqpoll", Config::io_uring_sqpoll);
+      cp.add_option_bool("-ll:io_uring_regbufs", Config::io_uring_register_buffers);
+      cp.add_option_int("-ll:aio_depth", Config::aio_queue_depth);
+      cp.add_option_int("-ll:memcpy_threads", Config::memcpy_threads);
+      cp.add_option_int("-ll:memcpy_split", Config::memcpy_split_threshold);
+      cp.add_option_int("-ll:memcpy_nt", Config::memcpy_nt_threshold);
+      cp.add_option_int("-ll:memcpy_gather", Config::memcpy_gather_max_span);
+      cp.add_option_int("-ll:memcpy_gather_spans", Config::memcpy_gather_max_spans);
+      cp.add_option_int("-ll:xd_quantum", Config::xd_quantum);
+      cp.add_option_int("-ll:copy_cache", Config::copy_plan_cache_size);
+      cp.add_option_int("-ll:copy_cache_pieces", Config::copy_plan_max_pieces);
+      cp.add_option_int("-ll:ib_chunk", Config::ib_chunk_size);
+      cp.add_option_int("-ll:fill_nt", Config::fill_nt_threshold);
 
       bool cmdline_ok = cp.parse_command_line(cmdline);
 
@@ -1232,6 +1274,8 @@ namespace Realm {
 
       sampling_profiler.configure_from_cmdline(cmdline, *core_reservations);
 
+      event_batcher.configure_from_cmdline(cmdline);
+
       // initialize barrier timestamp
       BarrierImpl::barrier_adjustment_timestamp = (((Barrier::timestamp_t)(my_node_id)) << BarrierImpl::BARRIER_TIMESTAMP_NODEID_SHIFT) + 1;
 
@@ -1241,8 +1285,10 @@ namespace Realm {
       LockReleaseMessage::Message::add_handler_entries("Lock Release AM");
       LockGrantMessage::Message::add_handler_entries("Lock Grant AM");
       EventSubscribeMessage::Message::add_handler_entries("Event Subscribe AM");
+      EventSubscribeBatchMessage::Message::add_handler_entries("Event Subscribe Batch AM");
       EventTriggerMessage::Message::add_handler_entries("Event Trigger AM");
       EventUpdateMessage::Message::add_handler_entries("Event Update AM");
+      EventBatchMessage::Message::add_handler_entries("Event Batch AM");
       RemoteMemAllocRequest::Request::add_handler_entries("Remote Memory Allocation Request AM");
       RemoteMemAllocRequest::Response::add_handler_entries("Remote Memory Allocation Response AM");
       //CreateInstanceRequest::Request::add_handler_entries("Create Instance Request AM");
@@ -1335,8 +1381,11 @@ namespace Realm {
 
 #ifndef USE_GASNET
       // network initialization is also responsible for setting the "zero_time"
-      //  for relative timing - no synchronization necessary in non-gasnet case
+      //  for relative timing - the only synchronization needed is between
+      //  shared memory ranks (if any)
+      shm_barrier();
       Realm::Clock::set_zero_time();
+      shm_barrier();
 #endif
 
 #ifdef USE_GASNET
@@ -1392,6 +1441,8 @@ namespace Realm {
 			    *core_reservations,
 			    stack_size_in_mb << 20);
 
+      event_batcher.start(*core_reservations);
+
 #if defined(USE_GASNET) && (((GEX_SPEC_VERSION_MAJOR << 8) + GEX_SPEC_VERSION_MINOR) < 5)
       // this needs to happen after init_endpoints
       gasnet_coll_init(0, 0, 0, 0, 0);
@@ -1446,9 +1497,14 @@ namespace Realm {
 	char *regmem_base = ((char *)(seginfos[my_node_id].addr)) + (gasnet_mem_size_in_mb << 20);
 	delete[] seginfos;
 #else
-	nongasnet_regmem_base = malloc(reg_mem_size_in_mb << 20);
-	assert(nongasnet_regmem_base != 0);
-	char *regmem_base = static_cast<char *>(nongasnet_regmem_base);
+	// shared memory ranks put registered memory in the shared segment so
+	//  that other ranks can write it directly
+	char *regmem_base = static_cast<char *>(get_shm_registered_base());
+	if(!regmem_base) {
+	  nongasnet_regmem_base = malloc(reg_mem_size_in_mb << 20);
+	  assert(nongasnet_regmem_base != 0);
+	  regmem_base = static_cast<char *>(nongasnet_regmem_base);
+	}
 #endif
 	Memory m = get_runtime()->next_local_memory_id();
 	regmem = new LocalCPUMemory(m,
@@ -1475,9 +1531,14 @@ namespace Realm {
                                 + (reg_mem_size_in_mb << 20);
 	delete[] seginfos;
 #else
-	nongasnet_reg_ib_mem_base = malloc(reg_ib_mem_size_in_mb << 20);
-	assert(nongasnet_reg_ib_mem_base != 0);
-	char *reg_ib_mem_base = static_cast<char *>(nongasnet_reg_ib_mem_base);
+	char *reg_ib_mem_base = static_cast<char *>(get_shm_registered_base());
+	if(reg_ib_mem_base) {
+	  reg_ib_mem_base += (reg_mem_size_in_mb << 20);
+	} else {
+	  nongasnet_reg_ib_mem_base = malloc(reg_ib_mem_size_in_mb << 20);
+	  assert(nongasnet_reg_ib_mem_base != 0);
+	  reg_ib_mem_base = static_cast<char *>(nongasnet_reg_ib_mem_base);
+	}
 #endif
 	Memory m = get_runtime()->next_local_ib_memory_id();
 	reg_ib_mem = new LocalCPUMemory(m,
@@ -1839,14 +1900,37 @@ namespace Realm {
 
 #define DEBUG_COLLECTIVES
 
-#if defined(USE_GASNET) && defined(DEBUG_COLLECTIVES)
+#ifdef USE_GASNET
   static const int GASNET_COLL_FLAGS = GASNET_COLL_IN_MYSYNC | GASNET_COLL_OUT_MYSYNC | GASNET_COLL_LOCAL;
-  
+#endif
+
+  // gathers/broadcasts of small values across all nodes use GASNet's
+  //  collectives, or the shared memory transport's without GASNet (which are
+  //  just copies when there's only one rank)
+  static void collective_gather(NodeID root, void *dst, void *src, size_t bytes)
+  {
+#ifdef USE_GASNET
+    gasnet_coll_gather(GASNET_TEAM_ALL, root, dst, src, bytes, GASNET_COLL_FLAGS);
+#else
+    shm_gather(root, dst, src, bytes);
+#endif
+  }
+
+  static void collective_broadcast(NodeID root, void *dst, void *src, size_t bytes)
+  {
+#ifdef USE_GASNET
+    gasnet_coll_broadcast(GASNET_TEAM_ALL, dst, root, src, bytes, GASNET_COLL_FLAGS);
+#else
+    shm_broadcast(root, dst, src, bytes);
+#endif
+  }
+
+#ifdef DEBUG_COLLECTIVES
   template <typename T>
   static void broadcast_check(const T& val, const char *name)
   {
     T bval;
-    gasnet_coll_broadcast(GASNET_TEAM_ALL, &bval, 0, const_cast<T *>(&val), sizeof(T), GASNET_COLL_FLAGS);
+    collective_broadcast(0, &bval, const_cast<T *>(&val), sizeof(T));
     if(val != bval) {
       log_collective.fatal() << "collective mismatch on node " << my_node_id << " for " << name << ": " << val << " != " << bval;
       assert(false);
@@ -1860,7 +1944,6 @@ namespace Realm {
     {
       log_collective.info() << "collective spawn: proc=" << target_proc << " func=" << task_id << " priority=" << priority << " before=" << wait_on;
 
-#ifdef USE_GASNET
 #ifdef DEBUG_COLLECTIVES
       broadcast_check(target_proc, "target_proc");
       broadcast_check(task_id, "task_id");
@@ -1876,7 +1959,7 @@ namespace Realm {
 	// step 1: receive wait_on from every node
 	Event *all_events = 0;
 	all_events = new Event[max_node_id + 1];
-	gasnet_coll_gather(GASNET_TEAM_ALL, root, all_events, &wait_on, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(root, all_events, &wait_on, sizeof(Event));
 
 	// step 2: merge all the events
 	std::set<Event> event_set;
@@ -1894,7 +1977,7 @@ namespace Realm {
 	Event finish_event = target_proc.spawn(task_id, args, arglen, merged_event, priority);
 
 	// step 4: broadcast the finish event to everyone
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &finish_event, root, &finish_event, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(root, &finish_event, &finish_event, sizeof(Event));
 
 	log_collective.info() << "collective spawn: proc=" << target_proc << " func=" << task_id << " priority=" << priority << " after=" << finish_event;
 
@@ -1903,26 +1986,18 @@ namespace Realm {
 	// NON-ROOT NODE
 
 	// step 1: send our wait_on to the root for merging
-	gasnet_coll_gather(GASNET_TEAM_ALL, root, 0, &wait_on, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(root, 0, &wait_on, sizeof(Event));
 
 	// steps 2 and 3: twiddle thumbs
 
 	// step 4: receive finish event
 	Event finish_event;
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &finish_event, root, 0, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(root, &finish_event, 0, sizeof(Event));
 
 	log_collective.info() << "collective spawn: proc=" << target_proc << " func=" << task_id << " priority=" << priority << " after=" << finish_event;
 
 	return finish_event;
       }
-#else
-      // no GASNet, so a collective spawn is the same as a regular spawn
-      Event finish_event = target_proc.spawn(task_id, args, arglen, wait_on, priority);
-
-      log_collective.info() << "collective spawn: proc=" << target_proc << " func=" << task_id << " priority=" << priority << " after=" << finish_event;
-
-      return finish_event;
-#endif
     }
 
     Event RuntimeImpl::collective_spawn_by_kind(Processor::Kind target_kind, Processor::TaskFuncID task_id, 
@@ -1932,7 +2007,6 @@ namespace Realm {
     {
       log_collective.info() << "collective spawn: kind=" << target_kind << " func=" << task_id << " priority=" << priority << " before=" << wait_on;
 
-#ifdef USE_GASNET
 #ifdef DEBUG_COLLECTIVES
       broadcast_check(target_kind, "target_kind");
       broadcast_check(task_id, "task_id");
@@ -1950,7 +2024,7 @@ namespace Realm {
 	// step 1: receive wait_on from every node
 	Event *all_events = 0;
 	all_events = new Event[max_node_id + 1];
-	gasnet_coll_gather(GASNET_TEAM_ALL, 0, all_events, &wait_on, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(0, all_events, &wait_on, sizeof(Event));
 
 	// step 2: merge all the events
 	std::set<Event> event_set;
@@ -1964,22 +2038,18 @@ namespace Realm {
 	merged_event = Event::merge_events(event_set);
 
 	// step 3: broadcast the merged event back to everyone
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &merged_event, 0, &merged_event, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(0, &merged_event, &merged_event, sizeof(Event));
       } else {
 	// NON-ROOT NODE
 
 	// step 1: send our wait_on to the root for merging
-	gasnet_coll_gather(GASNET_TEAM_ALL, 0, 0, &wait_on, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(0, 0, &wait_on, sizeof(Event));
 
 	// step 2: twiddle thumbs
 
 	// step 3: receive merged wait_on event
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &merged_event, 0, 0, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(0, &merged_event, 0, sizeof(Event));
       }
-#else
-      // no GASNet, so our precondition is the only one
-      Event merged_event = wait_on;
-#endif
 
       // now spawn 0 or more local tasks
       std::set<Event> event_set;
@@ -2003,14 +2073,13 @@ namespace Realm {
       // local merge
       Event my_finish = Event::merge_events(event_set);
 
-#ifdef USE_GASNET
       if(my_node_id == 0) {
 	// ROOT NODE
 
 	// step 1: receive wait_on from every node
 	Event *all_events = 0;
 	all_events = new Event[max_node_id + 1];
-	gasnet_coll_gather(GASNET_TEAM_ALL, 0, all_events, &my_finish, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(0, all_events, &my_finish, sizeof(Event));
 
 	// step 2: merge all the events
 	std::set<Event> event_set;
@@ -2024,7 +2093,7 @@ namespace Realm {
 	Event merged_finish = Event::merge_events(event_set);
 
 	// step 3: broadcast the merged event back to everyone
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &merged_finish, 0, &merged_finish, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(0, &merged_finish, &merged_finish, sizeof(Event));
 
 	log_collective.info() << "collective spawn: kind=" << target_kind << " func=" << task_id << " priority=" << priority << " after=" << merged_finish;
 
@@ -2033,24 +2102,18 @@ namespace Realm {
 	// NON-ROOT NODE
 
 	// step 1: send our wait_on to the root for merging
-	gasnet_coll_gather(GASNET_TEAM_ALL, 0, 0, &my_finish, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_gather(0, 0, &my_finish, sizeof(Event));
 
 	// step 2: twiddle thumbs
 
 	// step 3: receive merged wait_on event
 	Event merged_finish;
-	gasnet_coll_broadcast(GASNET_TEAM_ALL, &merged_finish, 0, 0, sizeof(Event), GASNET_COLL_FLAGS);
+	collective_broadcast(0, &merged_finish, 0, sizeof(Event));
 
 	log_collective.info() << "collective spawn: kind=" << target_kind << " func=" << task_id << " priority=" << priority << " after=" << merged_finish;
 
 	return merged_finish;
       }
-#else
-      // no GASNet, so just return our locally merged event
-      log_collective.info() << "collective spawn: kind=" << target_kind << " func=" << task_id << " priority=" << priority << " after=" << my_finish;
-
-      return my_finish;
-#endif
     }
 
 #if 0
@@ -2206,10 +2269,12 @@ namespace Realm {
 	log_runtime.info("shutdown request received - terminating");
       }
 
-#ifdef USE_GASNET
       // don't start tearing things down until all processes agree
+#ifdef USE_GASNET
       gasnet_barrier_notify(0, GASNET_BARRIERFLAG_ANONYMOUS);
       gasnet_barrier_wait(0, GASNET_BARRIERFLAG_ANONYMOUS);
+#else
+      shm_barrier();
 #endif
 
       // Shutdown all the threads
@@ -2218,6 +2283,7 @@ namespace Realm {
       PartitioningOpQueue::stop_worker_threads();
       stop_dma_worker_threads();
       stop_dma_system();
+      event_batcher.shutdown();
       stop_activemsg_threads();
 
       sampling_profiler.shutdown();
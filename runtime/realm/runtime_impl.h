@@ -181,6 +181,7 @@ namespace Realm {
       int concurrent_io_threads;
       size_t sysmem_size_in_mb, stack_size_in_mb;
       bool pin_util_procs;
+      bool steal_cpu_work;
     };
 
     REGISTER_REALM_MODULE(CoreModule);
@@ -281,6 +282,8 @@ namespace Realm {
 
       SamplingProfiler sampling_profiler;
 
+      EventMessageBatcher event_batcher;
+
     public:
       // used by modules to add processors, memories, etc.
       void add_memory(MemoryImpl *m);
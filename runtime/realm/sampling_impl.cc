@@ -820,6 +820,9 @@ namespace Realm {
     template void Gauge::add_gauge<AbsoluteGauge<unsigned long> >(AbsoluteGauge<unsigned long>*, SamplingProfiler*);
     template void Gauge::add_gauge<AbsoluteGauge<unsigned> >(AbsoluteGauge<unsigned>*, SamplingProfiler*);
     template void Gauge::add_gauge<AbsoluteRangeGauge<int> >(AbsoluteRangeGauge<int>*, SamplingProfiler*);
+    template void Gauge::add_gauge<AbsoluteRangeGauge<unsigned long> >(AbsoluteRangeGauge<unsigned long>*, SamplingProfiler*);
+    template void Gauge::add_gauge<EventCounter<int> >(EventCounter<int>*, SamplingProfiler*);
+    template void Gauge::add_gauge<EventCounter<unsigned long> >(EventCounter<unsigned long>*, SamplingProfiler*);
 
   };
 
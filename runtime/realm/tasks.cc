@@ -312,7 +312,9 @@ namespace Realm {
   //
 
   ThreadedTaskScheduler::ThreadedTaskScheduler(void)
-    : shutdown_flag(false)
+    : next_steal_queue(0)
+    , steal_filter(0)
+    , shutdown_flag(false)
     , active_worker_count(0)
     , unassigned_worker_count(0)
     , wcu_task_queues(this)
@@ -344,6 +346,57 @@ namespace Realm {
     queue->add_subscription(&wcu_task_queues);
   }
 
+  void ThreadedTaskScheduler::add_steal_queue(TaskQueue *queue)
+  {
+    AutoHSLLock al(lock);
+
+    steal_queues.push_back(queue);
+
+    // new work in a sibling's queue has to wake up our idle workers too, or
+    //  they'll never notice there's something to steal
+    queue->add_subscription(&wcu_task_queues);
+  }
+
+  void ThreadedTaskScheduler::set_steal_filter(StealFilter *_filter)
+  {
+    AutoHSLLock al(lock);
+
+    steal_filter = _filter;
+  }
+
+  Task *ThreadedTaskScheduler::steal_task(int& task_priority)
+  {
+    size_t num_victims = steal_queues.size();
+    for(size_t i = 0; i < num_victims; i++) {
+      TaskQueue *victim = steal_queues[next_steal_queue];
+      next_steal_queue = (next_steal_queue + 1) % num_victims;
+
+      // peek first so that a task we're not allowed to take stays where it is -
+      //  taking it and putting it back would trigger another round of
+      //  notifications and we'd just spin on it
+      int new_priority;
+      Task *new_task = victim->peek(&new_priority, task_priority);
+      if(!new_task) continue;
+      if(steal_filter && !steal_filter->can_steal(new_task)) continue;
+
+      // the victim's own workers may have beaten us to it, and whatever is on
+      //  top now has to pass the filter as well
+      new_task = victim->get(&new_priority, task_priority);
+      if(!new_task) continue;
+      if(steal_filter && !steal_filter->can_steal(new_task)) {
+	victim->put(new_task, new_priority, false); // back on front of list
+	continue;
+      }
+
+      if(steal_filter)
+	steal_filter->task_stolen(new_task);
+      task_priority = new_priority;
+      return new_task;
+    }
+
+    return 0;
+  }
+
   // helper for tracking/sanity-checking worker counts
   void ThreadedTaskScheduler::update_worker_count(int active_delta,
 						  int unassigned_delta,
@@ -567,6 +620,11 @@ namespace Realm {
 	  }
 	}
 
+	// if our own queues came up empty, see if a sibling has a ready task it
+	//  hasn't gotten to yet
+	if(!task && !steal_queues.empty())
+	  task = steal_task(task_priority);
+
 	// did we find work to do?
 	if(task) {
 	  // we've now got some assigned work, so fire up a new idle worker if we were the last
@@ -18,6 +18,7 @@
 #ifndef REALM_TASKS_H
 #define REALM_TASKS_H
 
+#include "realm/realm_config.h"
 #include "realm/processor.h"
 #include "realm/id.h"
 
@@ -80,10 +81,27 @@ namespace Realm {
 
       virtual ~ThreadedTaskScheduler(void);
 
+#ifdef REALM_SHARDED_TASK_QUEUES
+      typedef ShardedPriorityQueue<Task *, GASNetHSL> TaskQueue;
+#else
       typedef PriorityQueue<Task *, GASNetHSL> TaskQueue;
+#endif
 
       virtual void add_task_queue(TaskQueue *queue);
 
+      // work stealing: a worker that finds nothing in its own task queues may
+      //  take the highest-priority ready task from a sibling's queue, as long as
+      //  the steal filter (if any) allows the task to run here
+      class StealFilter {
+      public:
+	virtual ~StealFilter(void) {}
+	virtual bool can_steal(const Task *task) = 0;
+	virtual void task_stolen(Task *task) = 0;
+      };
+
+      virtual void add_steal_queue(TaskQueue *queue);
+      void set_steal_filter(StealFilter *_filter);
+
       virtual void start(void) = 0;
       virtual void shutdown(void) = 0;
 
@@ -109,8 +127,15 @@ namespace Realm {
       virtual void worker_wake(Thread *to_wake) = 0;
       virtual void worker_terminate(Thread *switch_to) = 0;
 
+      // looks for a task in the steal queues that is of higher priority than
+      //  'task_priority' - lock should be held
+      Task *steal_task(int& task_priority);
+
       GASNetHSL lock;
       std::vector<TaskQueue *> task_queues;
+      std::vector<TaskQueue *> steal_queues;
+      size_t next_steal_queue;  // victims are visited round-robin
+      StealFilter *steal_filter;
       std::vector<Thread *> idle_workers;
       std::set<Thread *> blocked_workers;
 
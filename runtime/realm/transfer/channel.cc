@@ -17,6 +17,16 @@
 #include "realm/transfer/channel.h"
 #include "realm/transfer/channel_disk.h"
 #include "realm/transfer/transfer.h"
+#include "realm/utils.h"
+
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 TYPE_IS_SERIALIZABLE(Realm::XferOrder::Type);
 TYPE_IS_SERIALIZABLE(Realm::XferDes::XferKind);
@@ -202,6 +212,19 @@ namespace Realm {
     }
 
 
+      // the number of bytes moved by a request
+      static size_t request_bytes(const Request *req)
+      {
+	size_t bytes = req->nbytes;
+	if(req->dim != Request::DIM_1D) bytes *= req->nlines;
+	if(req->dim == Request::DIM_3D) bytes *= req->nplanes;
+	return bytes;
+      }
+
+      // XferDes's are created in roughly the order their copies were
+      //  issued, so this gives first-come-first-served order within a
+      //  priority to start with
+      static uint64_t next_sched_seq = 0;
 
       XferDes::XferDes(DmaRequest* _dma_request, NodeID _launch_node,
               XferDesID _guid, XferDesID _pre_xd_guid, XferDesID _next_xd_guid,
@@ -221,6 +244,7 @@ namespace Realm {
           src_serdez_op(0), dst_serdez_op(0),
           src_ib_offset(_src_ib_offset), src_ib_size(_src_ib_size),
           max_req_size(_max_req_size), priority(_priority),
+          sched_seq(__sync_fetch_and_add(&next_sched_seq, 1)), sched_deficit(0),
           guid(_guid), pre_xd_guid(_pre_xd_guid), next_xd_guid(_next_xd_guid),
           kind (_kind), order(_order), channel(NULL), complete_fence(_complete_fence)
       {
@@ -245,6 +269,10 @@ namespace Realm {
 	//  locations can be freely written
 	if(next_xd_guid != XFERDES_NO_GUID)
 	  seq_next_read.add_span(0, _next_max_rw_gap);
+	// keep each request within a scheduling quantum so that a single
+	//  request can't hold the channel for too long
+	if((Config::xd_quantum > 0) && (max_req_size > Config::xd_quantum))
+	  max_req_size = Config::xd_quantum;
         offset_idx = 0;
         pthread_mutex_init(&xd_lock, NULL);
         pthread_mutex_init(&update_read_lock, NULL);
@@ -1186,6 +1214,7 @@ namespace Realm {
       void XferDes::default_notify_request_write_done(Request* req)
       {
         req->is_write_done = true;
+	channel->request_done(req);
 	update_bytes_write(req->write_seq_pos, req->write_seq_count);
 #if 0
         if (req->dim == Request::DIM_1D)
@@ -1237,6 +1266,203 @@ namespace Realm {
           memcpy_reqs[i].xd = this;
           enqueue_request(&memcpy_reqs[i]);
         }
+	// small pieces can be packed into gather/scatter requests as long
+	//  as there's no serialization going on
+	use_gather = ((Config::memcpy_gather_max_span > 0) &&
+		      (Config::memcpy_gather_max_spans > 1) &&
+		      (_src_serdez_id == 0) && (_dst_serdez_id == 0));
+	gather_spans = 0;
+	max_reqs = max_nr;
+	held_req = 0;
+      }
+
+      // returns the span list for 'req', allocating the lists for all
+      //  requests on the first gather - most copies never need them, and
+      //  they're not calloc'd because spans are always written before
+      //  they're read
+      GatherSpan *MemcpyXferDes::span_list(MemcpyRequest *req)
+      {
+	if(!gather_spans)
+	  gather_spans = (GatherSpan*) malloc(max_reqs * Config::memcpy_gather_max_spans *
+					      sizeof(GatherSpan));
+	return gather_spans + ((req - memcpy_reqs) *
+			       Config::memcpy_gather_max_spans);
+      }
+
+      void MemcpyXferDes::append_gather_span(MemcpyRequest *gather,
+					     off_t src_off, off_t dst_off,
+					     size_t bytes)
+      {
+	GatherSpan& span = gather->spans[gather->num_spans];
+	span.src = src_mem->get_direct_ptr(src_off, bytes);
+	assert(span.src != 0);
+	span.dst = dst_mem->get_direct_ptr(dst_off, bytes);
+	assert(span.dst != 0);
+	span.bytes = bytes;
+	if(gather->num_spans == 0) {
+	  gather->span_bytes = bytes;
+	  gather->src_packed = true;
+	  gather->dst_packed = true;
+	} else {
+	  const GatherSpan& prev = gather->spans[gather->num_spans - 1];
+	  if(gather->span_bytes != bytes)
+	    gather->span_bytes = 0;
+	  if(span.src != (static_cast<const char *>(prev.src) + prev.bytes))
+	    gather->src_packed = false;
+	  if(span.dst != (static_cast<char *>(prev.dst) + prev.bytes))
+	    gather->dst_packed = false;
+	}
+	gather->num_spans++;
+      }
+
+      // appends the lines/planes of 'req' to the spans of 'gather', if
+      //  there's room and they continue its sequence ranges
+      bool MemcpyXferDes::add_gather_spans(MemcpyRequest *gather,
+					   const MemcpyRequest *req)
+      {
+	size_t lines = ((req->dim == Request::DIM_1D) ? 1 : req->nlines);
+	size_t planes = ((req->dim == Request::DIM_3D) ? req->nplanes : 1);
+	if((gather->num_spans + (lines * planes)) >
+	   (size_t)Config::memcpy_gather_max_spans)
+	  return false;
+	if(gather->num_spans > 0) {
+	  if((req->read_seq_pos != (gather->read_seq_pos +
+				    gather->read_seq_count)) ||
+	     (req->write_seq_pos != (gather->write_seq_pos +
+				     gather->write_seq_count)))
+	    return false;
+	}
+
+	for(size_t p = 0; p < planes; p++)
+	  for(size_t l = 0; l < lines; l++)
+	    append_gather_span(gather,
+			       req->src_off + (p * req->src_pstr) + (l * req->src_str),
+			       req->dst_off + (p * req->dst_pstr) + (l * req->dst_str),
+			       req->nbytes);
+	return true;
+      }
+
+      // with no intermediate buffers on either side, there's no flow control
+      //  to honor, so small pieces can be taken straight from the iterators
+      //  without building (and then discarding) a Request for each one - stops
+      //  at the first piece that isn't small or doesn't line up between the
+      //  source and destination, and leaves it for default_get_requests
+      void MemcpyXferDes::add_direct_gather_spans(MemcpyRequest *gather)
+      {
+	while(!iteration_completed &&
+	      (gather->num_spans < (size_t)Config::memcpy_gather_max_spans)) {
+	  TransferIterator::AddressInfo src_info, dst_info;
+	  size_t bytes = src_iter->step(max_req_size, src_info, 0,
+					true /*tentative*/);
+	  if(bytes == 0)
+	    break;
+	  if(bytes > Config::memcpy_gather_max_span) {
+	    src_iter->cancel_step();
+	    break;
+	  }
+	  size_t dst_bytes = dst_iter->step(bytes, dst_info, 0,
+					    true /*tentative*/);
+	  if(dst_bytes != bytes) {
+	    src_iter->cancel_step();
+	    if(dst_bytes > 0)
+	      dst_iter->cancel_step();
+	    break;
+	  }
+	  src_iter->confirm_step();
+	  dst_iter->confirm_step();
+
+	  append_gather_span(gather, src_info.base_offset, dst_info.base_offset,
+			     bytes);
+	  gather->nbytes += bytes;
+	  gather->read_seq_count += bytes;
+	  gather->write_seq_count += bytes;
+	  read_bytes_total += bytes;
+	  write_bytes_total += bytes;
+	  write_bytes_cons = write_bytes_total; // completion detection uses this
+
+	  if(src_iter->done() || dst_iter->done()) {
+	    assert(src_iter->done() && dst_iter->done());
+	    iteration_completed = true;
+	  }
+	}
+      }
+
+      // like default_get_requests, but consecutive small pieces (e.g. the
+      //  rectangles of a sparse index space, each of which the iterators
+      //  return separately) are packed into gather/scatter requests so that
+      //  the per-request overhead is paid once for many of them
+      long MemcpyXferDes::get_gather_requests(MemcpyRequest** reqs, long nr,
+					      unsigned flags)
+      {
+	long idx = 0;
+	MemcpyRequest *gather = 0;
+
+	while(true) {
+	  if(gather && (pre_xd_guid == XFERDES_NO_GUID) &&
+	     (next_xd_guid == XFERDES_NO_GUID))
+	    add_direct_gather_spans(gather);
+
+	  MemcpyRequest *req;
+	  if(held_req) {
+	    req = held_req;
+	    held_req = 0;
+	  } else {
+	    // keep pulling pieces into a gather request that has room even
+	    //  after the caller's array is full
+	    if((idx == nr) &&
+	       !(gather &&
+		 (gather->num_spans < (size_t)Config::memcpy_gather_max_spans)))
+	      break;
+	    Request *r;
+	    if(default_get_requests(&r, 1, flags) == 0)
+	      break;
+	    req = static_cast<MemcpyRequest *>(r);
+	    req->num_spans = 0;
+	  }
+
+	  // a piece is small enough if its lines are and it doesn't carry
+	  //  any padding
+	  size_t total_bytes = req->nbytes;
+	  if(req->dim != Request::DIM_1D) total_bytes *= req->nlines;
+	  if(req->dim == Request::DIM_3D) total_bytes *= req->nplanes;
+	  bool small = ((req->num_spans == 0) &&
+			(req->nbytes > 0) &&
+			(req->nbytes <= Config::memcpy_gather_max_span) &&
+			(req->read_seq_count == total_bytes) &&
+			(req->write_seq_count == total_bytes));
+
+	  if(small && gather && add_gather_spans(gather, req)) {
+	    gather->read_seq_count += req->read_seq_count;
+	    gather->write_seq_count += req->write_seq_count;
+	    gather->nbytes += total_bytes;
+	    enqueue_request(req);
+	    continue;
+	  }
+
+	  if(idx == nr) {
+	    // no room for it - hand it out next time
+	    held_req = req;
+	    break;
+	  }
+
+	  gather = 0;
+	  if(small) {
+	    // start a new gather request with this piece (unless it has too
+	    //  many lines to fit) - the original request is reused for it
+	    MemcpyRequest tmp = *req;
+	    req->spans = span_list(req);
+	    if(add_gather_spans(req, &tmp)) {
+	      req->dim = Request::DIM_1D;
+	      req->nbytes = total_bytes;
+	      req->nlines = 1;
+	      req->nplanes = 1;
+	      gather = req;
+	    }
+	  }
+	  reqs[idx++] = req;
+	}
+
+	return idx;
       }
 
       long MemcpyXferDes::get_requests(Request** requests, long nr)
@@ -1245,9 +1471,16 @@ namespace Realm {
 	// allow 2D and 3D copies
 	unsigned flags = (TransferIterator::LINES_OK |
 			  TransferIterator::PLANES_OK);
-        long new_nr = default_get_requests(requests, nr, flags);
+        long new_nr;
+        if(use_gather)
+          new_nr = get_gather_requests(reqs, nr, flags);
+        else
+          new_nr = default_get_requests(requests, nr, flags);
         for (long i = 0; i < new_nr; i++)
         {
+          // gather/scatter requests have their pointers already
+          if(reqs[i]->num_spans > 0)
+            continue;
           if(!src_serdez_op && dst_serdez_op) {
             // source offset is determined later - not safe to call get_direct_ptr now
             reqs[i]->src_base = 0;
@@ -1684,6 +1917,7 @@ namespace Realm {
 		  _src_serdez_id, _dst_serdez_id,
 		  _max_req_size, _priority,
                   _order, _kind, _complete_fence)
+	, attach_inst(inst)
       {
 #ifdef USE_HDF_OLD
         HDF5Memory* hdf_mem;
@@ -1823,6 +2057,42 @@ namespace Realm {
             // not enough space for even a single element - try again later
             break;
           }
+
+#ifndef USE_HDF_OLD
+	  // the dataset stays open (in the handle cache) until the request
+	  //  is done with it
+	  HDF5::HDF5Dataset *dset;
+	  {
+	    AutoHSLLock al(HDF5::hdf5_lock);
+	    dset = HDF5::hdf5_handle_cache.open_dataset(*hdf5_info.filename,
+							*hdf5_info.dsetname,
+							hdf5_info.read_only,
+							attach_inst);
+	  }
+	  if(!dset) {
+	    // the file has to be reopened once other transfers are done with
+	    //  it - try again later
+	    hdf5_iter->cancel_step();
+	    break;
+	  }
+	  if(kind == XferDes::XFER_HDF_WRITE)
+	    files_written.insert(*hdf5_info.filename);
+
+	  // for a chunked dataset, try to end the step on a boundary between
+	  //  rows of chunks (in the slowest-varying dimension) so that the next
+	  //  request doesn't touch any of the same chunks
+	  if(dset->chunked) {
+	    size_t slab_bytes = dset->elem_size * dset->chunk_dims[0];
+	    for(int i = 1; i < dset->ndims; i++)
+	      slab_bytes *= dset->dims[i];
+	    if((hdf5_bytes > slab_bytes) && ((hdf5_bytes % slab_bytes) != 0)) {
+	      hdf5_iter->cancel_step();
+	      hdf5_bytes = hdf5_iter->step(hdf5_bytes - (hdf5_bytes % slab_bytes),
+					   hdf5_info, true /*tentative*/);
+	      assert(hdf5_bytes > 0);
+	    }
+	  }
+#endif
 	  // TODO: support 2D/3D for memory side of an HDF transfer?
 	  size_t mem_bytes = mem_iter->step(hdf5_bytes, mem_info, 0);
 	  if(mem_bytes == hdf5_bytes) {
@@ -1839,6 +2109,9 @@ namespace Realm {
 
 	  HDFRequest* new_req = (HDFRequest *)(dequeue_request());
 	  new_req->dim = Request::DIM_1D;
+#ifndef USE_HDF_OLD
+	  new_req->dset = dset;
+#endif
 	  new_req->mem_base = ((kind == XferDes::XFER_HDF_READ) ?
 			         dst_mem :
 			         src_mem)->get_direct_ptr(mem_info.base_offset,
@@ -1856,50 +2129,30 @@ namespace Realm {
 	  CHECK_HDF5( new_req->file_space_id = H5Screate_simple(hdf5_info.dset_bounds.size(), hdf5_info.dset_bounds.data(), 0) );
 	  CHECK_HDF5( H5Sselect_hyperslab(new_req->file_space_id, H5S_SELECT_SET, hdf5_info.offset.data(), 0, hdf5_info.extent.data(), 0) );
 #else
-	  HDFFileInfo *info;
-	  {
-	    std::map<std::string, HDFFileInfo *>::const_iterator it = file_infos.find(*hdf5_info.filename);
-	    if(it != file_infos.end()) {
-	      info = it->second;
-	    } else {
-	      info = new HDFFileInfo;
-	      // have to open the file
-	      CHECK_HDF5( info->file_id = H5Fopen(hdf5_info.filename->c_str(),
-						  ((kind == XferDes::XFER_HDF_READ) ?
-					             H5F_ACC_RDONLY :
-					             H5F_ACC_RDWR),
-						  H5P_DEFAULT) );
-	      log_hdf5.info() << "H5Fopen(\"" << *hdf5_info.filename << "\") = " << info->file_id;
-	      file_infos[*hdf5_info.filename] = info;
-	    }
+	  new_req->dataset_id = dset->dset_id;
+	  new_req->datatype_id = dset->dtype_id;
+
+	  int ndims = hdf5_info.extent.size();
+	  assert(ndims == dset->ndims);
+	  for(int i = 0; i < ndims; i++) {
+	    new_req->offset[i] = hdf5_info.offset[i];
+	    new_req->extent[i] = hdf5_info.extent[i];
 	  }
-	  hid_t dset_id;
-	  {
-	    std::map<std::string, hid_t>::const_iterator it = info->dset_ids.find(*hdf5_info.dsetname);
-	    if(it != info->dset_ids.end()) {
-	      dset_id = it->second;
-	    } else {
-	      // have to open the dataset
-	      CHECK_HDF5( dset_id = H5Dopen2(info->file_id,
-					     hdf5_info.dsetname->c_str(),
-					     H5P_DEFAULT) );
-	      log_hdf5.info() << "H5Dopen2(" << info->file_id << ", \"" << *hdf5_info.dsetname << "\") = " << dset_id;
-	      info->dset_ids[*hdf5_info.dsetname] = dset_id;
-	    }
-	  }
-	  hid_t dtype_id;
-	  CHECK_HDF5( dtype_id = H5Dget_type(dset_id) );
-
-	  new_req->dataset_id = dset_id;
-	  new_req->datatype_id = dtype_id;
 
-	  std::vector<hsize_t> mem_dims = hdf5_info.extent;
-	  CHECK_HDF5( new_req->mem_space_id = H5Screate_simple(mem_dims.size(), mem_dims.data(), NULL) );
-	  //std::vector<hsize_t> mem_start(DIM, 0);
-	  //CHECK_HDF5( H5Sselect_hyperslab(new_req->mem_space_id, H5S_SELECT_SET, ms_start, NULL, count, NULL) );
-
-	  CHECK_HDF5( new_req->file_space_id = H5Screate_simple(hdf5_info.dset_bounds.size(), hdf5_info.dset_bounds.data(), 0) );
-	  CHECK_HDF5( H5Sselect_hyperslab(new_req->file_space_id, H5S_SELECT_SET, hdf5_info.offset.data(), 0, hdf5_info.extent.data(), 0) );
+	  if(dset->raw_offset >= 0) {
+	    // no libhdf5 involvement at all
+	    new_req->mem_space_id = -1;
+	    new_req->file_space_id = -1;
+	  } else {
+	    AutoHSLLock al(HDF5::hdf5_lock);
+	    std::vector<hsize_t> mem_dims = hdf5_info.extent;
+	    CHECK_HDF5( new_req->mem_space_id = H5Screate_simple(mem_dims.size(), mem_dims.data(), NULL) );
+	    //std::vector<hsize_t> mem_start(DIM, 0);
+	    //CHECK_HDF5( H5Sselect_hyperslab(new_req->mem_space_id, H5S_SELECT_SET, ms_start, NULL, count, NULL) );
+
+	    CHECK_HDF5( new_req->file_space_id = H5Screate_simple(ndims, dset->dims, 0) );
+	    CHECK_HDF5( H5Sselect_hyperslab(new_req->file_space_id, H5S_SELECT_SET, hdf5_info.offset.data(), 0, hdf5_info.extent.data(), 0) );
+	  }
 #endif
 
 	  new_req->nbytes = hdf5_bytes;
@@ -2031,41 +2284,27 @@ namespace Realm {
       void HDFXferDes::notify_request_write_done(Request* req)
       {
         HDFRequest* hdf_req = (HDFRequest*) req;
-        //pthread_rwlock_wrlock(&hdf_metadata->hdf_memory->rwlock);
-        CHECK_HDF5( H5Sclose(hdf_req->mem_space_id) );
-        CHECK_HDF5( H5Sclose(hdf_req->file_space_id) );
-        //pthread_rwlock_unlock(&hdf_metadata->hdf_memory->rwlock);
+	{
+	  AutoHSLLock al(HDF5::hdf5_lock);
+	  if(hdf_req->mem_space_id >= 0)
+	    CHECK_HDF5( H5Sclose(hdf_req->mem_space_id) );
+	  if(hdf_req->file_space_id >= 0)
+	    CHECK_HDF5( H5Sclose(hdf_req->file_space_id) );
+	  HDF5::hdf5_handle_cache.release_dataset(hdf_req->dset);
+	}
 
 	default_notify_request_write_done(req);
       }
 
       void HDFXferDes::flush()
       {
-        if (kind == XferDes::XFER_HDF_READ) {
-        } else {
-          assert(kind == XferDes::XFER_HDF_WRITE);
-	  //CHECK_HDF5( H5Fflush(hdf_metadata->file_id, H5F_SCOPE_LOCAL) );
-          // for (fit = oas_vec.begin(); fit != oas_vec.end(); fit++) {
-          //   off_t hdf_idx = fit->dst_offset;
-          //   hid_t dataset_id = hdf_metadata->dataset_ids[hdf_idx];
-          //   //TODO: I am not sure if we need a lock here to protect HDFflush
-          //   H5Fflush(dataset_id, H5F_SCOPE_LOCAL);
-          // }
-        }
-
-	for(std::map<std::string, HDFFileInfo *>::const_iterator it = file_infos.begin();
-	    it != file_infos.end();
-	    ++it) {
-	  for(std::map<std::string, hid_t>::const_iterator it2 = it->second->dset_ids.begin();
-	      it2 != it->second->dset_ids.end();
-	      ++it2) {
-	    log_hdf5.info() << "H5Dclose(" << it2->second << " /* \"" << it2->first << "\" */)";
-	    CHECK_HDF5( H5Dclose(it2->second) );
-	  }
-	  log_hdf5.info() << "H5Fclose(" << it->second->file_id << " /* \"" << it->first << "\" */)";
-	  CHECK_HDF5( H5Fclose(it->second->file_id) );
-	  delete it->second;
-	}
+	// files (and datasets) stay open in the handle cache for the next
+	//  transfer, but anything this one wrote should make it to disk
+	AutoHSLLock al(HDF5::hdf5_lock);
+	for(std::set<std::string>::const_iterator it = files_written.begin();
+	    it != files_written.end();
+	    ++it)
+	  HDF5::hdf5_handle_cache.flush_file(*it);
       }
 #endif
 
@@ -2099,6 +2338,81 @@ namespace Realm {
 	return os;
       }
 	  
+      static const char *xfer_kind_name(XferDes::XferKind kind)
+      {
+	switch(kind) {
+	case XferDes::XFER_DISK_READ: return "disk read";
+	case XferDes::XFER_DISK_WRITE: return "disk write";
+	case XferDes::XFER_SSD_READ: return "ssd read";
+	case XferDes::XFER_SSD_WRITE: return "ssd write";
+	case XferDes::XFER_GPU_TO_FB: return "gpu to fb";
+	case XferDes::XFER_GPU_FROM_FB: return "gpu from fb";
+	case XferDes::XFER_GPU_IN_FB: return "gpu in fb";
+	case XferDes::XFER_GPU_PEER_FB: return "gpu peer fb";
+	case XferDes::XFER_MEM_CPY: return "memcpy";
+	case XferDes::XFER_GASNET_READ: return "gasnet read";
+	case XferDes::XFER_GASNET_WRITE: return "gasnet write";
+	case XferDes::XFER_REMOTE_WRITE: return "remote write";
+	case XferDes::XFER_HDF_READ: return "hdf read";
+	case XferDes::XFER_HDF_WRITE: return "hdf write";
+	case XferDes::XFER_FILE_READ: return "file read";
+	case XferDes::XFER_FILE_WRITE: return "file write";
+	default: return "none";
+	}
+      }
+
+      Channel::Gauges::Gauges(const std::string& prefix)
+	: xds_queued(prefix + "/xds queued")
+	, bytes_in_flight(prefix + "/bytes in flight")
+	, bytes_done(prefix + "/bytes done")
+      {}
+
+      Channel::Channel(XferDes::XferKind _kind)
+	: node(my_node_id), kind(_kind), gauges(0)
+      {
+	// remote channels are constructed as XFER_NONE and filled in later -
+	//  only the node that owns a channel samples it
+	if(kind != XferDes::XFER_NONE)
+	  gauges = new Gauges(stringbuilder() << "realm/channel " << node
+			                      << ":" << xfer_kind_name(kind));
+      }
+
+      Channel::~Channel()
+      {
+	delete gauges;
+      }
+
+      void Channel::xd_enqueued(void)
+      {
+	AutoHSLLock al(gauges->mutex);
+	gauges->xds_queued += 1;
+      }
+
+      void Channel::xd_finished(void)
+      {
+	AutoHSLLock al(gauges->mutex);
+	gauges->xds_queued -= 1;
+      }
+
+      // called before the requests are handed to submit(), which may
+      //  finish them right away
+      void Channel::requests_submitted(Request **requests, long nr)
+      {
+	size_t bytes = 0;
+	for(long i = 0; i < nr; i++)
+	  bytes += request_bytes(requests[i]);
+	AutoHSLLock al(gauges->mutex);
+	gauges->bytes_in_flight += bytes;
+      }
+
+      void Channel::request_done(Request *req)
+      {
+	size_t bytes = request_bytes(req);
+	gauges->bytes_done += bytes;
+	AutoHSLLock al(gauges->mutex);
+	gauges->bytes_in_flight -= bytes;
+      }
+
       void Channel::print(std::ostream& os) const
       {
 	os << "channel{ node=" << node << " kind=" << kind << " paths=[";
@@ -2288,6 +2602,324 @@ namespace Realm {
                                                     Memory::SOCKET_MEM };
       static const size_t num_cpu_mem_kinds = sizeof(cpu_mem_kinds) / sizeof(cpu_mem_kinds[0]);
 
+      namespace Config {
+	int memcpy_threads = 0;
+	size_t memcpy_split_threshold = 1 << 20;
+	size_t memcpy_nt_threshold = 0;
+	size_t memcpy_gather_max_span = 256;
+	int memcpy_gather_max_spans = 256;
+	size_t xd_quantum = 0;
+      };
+
+      // copies 'bytes' bytes using non-temporal stores where the target
+      //  supports them - callers must issue a store fence (see
+      //  streaming_copy_fence) before anybody else looks at the data
+      static void memcpy_streaming(void *dst, const void *src, size_t bytes)
+      {
+#if defined(__AVX__) || defined(__SSE2__)
+#ifdef __AVX__
+	typedef __m256i VT;
+#define REALM_VLOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define REALM_VSTREAM(p, v) _mm256_stream_si256((__m256i *)(p), (v))
+#else
+	typedef __m128i VT;
+#define REALM_VLOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define REALM_VSTREAM(p, v) _mm_stream_si128((__m128i *)(p), (v))
+#endif
+	char *d = static_cast<char *>(dst);
+	const char *s = static_cast<const char *>(src);
+
+	// streaming stores must be aligned, so do the head normally
+	size_t head = ((sizeof(VT) - (reinterpret_cast<uintptr_t>(d) % sizeof(VT))) %
+		       sizeof(VT));
+	if(head > bytes) head = bytes;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	bytes -= head;
+
+	// four vectors per iteration to keep plenty of loads in flight
+	while(bytes >= 4 * sizeof(VT)) {
+	  VT v0 = REALM_VLOAD(s);
+	  VT v1 = REALM_VLOAD(s + sizeof(VT));
+	  VT v2 = REALM_VLOAD(s + 2 * sizeof(VT));
+	  VT v3 = REALM_VLOAD(s + 3 * sizeof(VT));
+	  REALM_VSTREAM(d, v0);
+	  REALM_VSTREAM(d + sizeof(VT), v1);
+	  REALM_VSTREAM(d + 2 * sizeof(VT), v2);
+	  REALM_VSTREAM(d + 3 * sizeof(VT), v3);
+	  d += 4 * sizeof(VT);
+	  s += 4 * sizeof(VT);
+	  bytes -= 4 * sizeof(VT);
+	}
+#undef REALM_VLOAD
+#undef REALM_VSTREAM
+
+	memcpy(d, s, bytes);
+#else
+	memcpy(dst, src, bytes);
+#endif
+      }
+
+      static inline void streaming_copy_fence(void)
+      {
+#if defined(__AVX__) || defined(__SSE2__)
+	_mm_sfence();
+#endif
+      }
+
+      // performs part 'chunk' (of 'num_chunks') of a non-serdez copy - the
+      //  copy is divided by planes if there are several, by lines if there
+      //  are several, and by bytes otherwise
+      static void copy_request_chunk(const MemcpyRequest *req,
+				     size_t chunk, size_t num_chunks,
+				     bool streaming)
+      {
+	const char *src = static_cast<const char *>(req->src_base);
+	char *dst = static_cast<char *>(req->dst_base);
+	size_t bytes = req->nbytes;
+	size_t lines = ((req->dim == Request::DIM_1D) ? 1 : req->nlines);
+	size_t planes = ((req->dim == Request::DIM_3D) ? req->nplanes : 1);
+
+	if(planes > 1) {
+	  size_t first = (planes * chunk) / num_chunks;
+	  size_t last = (planes * (chunk + 1)) / num_chunks;
+	  src += first * req->src_pstr;
+	  dst += first * req->dst_pstr;
+	  planes = last - first;
+	} else if(lines > 1) {
+	  size_t first = (lines * chunk) / num_chunks;
+	  size_t last = (lines * (chunk + 1)) / num_chunks;
+	  src += first * req->src_str;
+	  dst += first * req->dst_str;
+	  lines = last - first;
+	} else {
+	  // keep pieces cache-line aligned relative to the start
+	  size_t first = ((bytes * chunk) / num_chunks) & ~(size_t)63;
+	  size_t last = ((chunk + 1 == num_chunks) ?
+			   bytes :
+			   (((bytes * (chunk + 1)) / num_chunks) & ~(size_t)63));
+	  src += first;
+	  dst += first;
+	  bytes = last - first;
+	}
+
+	for(size_t p = 0; p < planes; p++) {
+	  const char *s = src + (p * req->src_pstr);
+	  char *d = dst + (p * req->dst_pstr);
+	  for(size_t l = 0; l < lines; l++) {
+	    if(streaming)
+	      memcpy_streaming(d, s, bytes);
+	    else
+	      memcpy(d, s, bytes);
+	    s += req->src_str;
+	    d += req->dst_str;
+	  }
+	}
+
+	if(streaming)
+	  streaming_copy_fence();
+      }
+
+      // gather/scatter kernels for spans of a fixed size - the constant-size
+      //  memcpy's become single (vector, for 16 and 32 bytes) loads and
+      //  stores, and the packed side of a gather (or scatter) is just walked
+      //  rather than read from the span list
+      template <size_t BYTES>
+      static void copy_spans_fixed(const GatherSpan *spans, size_t num_spans,
+				   bool src_packed, bool dst_packed)
+      {
+	if(dst_packed) {
+	  // gather (pack)
+	  char *d = static_cast<char *>(spans[0].dst);
+	  for(size_t i = 0; i < num_spans; i++, d += BYTES)
+	    memcpy(d, spans[i].src, BYTES);
+	} else if(src_packed) {
+	  // scatter (unpack)
+	  const char *s = static_cast<const char *>(spans[0].src);
+	  for(size_t i = 0; i < num_spans; i++, s += BYTES)
+	    memcpy(spans[i].dst, s, BYTES);
+	} else {
+	  for(size_t i = 0; i < num_spans; i++)
+	    memcpy(spans[i].dst, spans[i].src, BYTES);
+	}
+      }
+
+      static void copy_gather_spans(const MemcpyRequest *req)
+      {
+	const GatherSpan *spans = req->spans;
+	size_t n = req->num_spans;
+	switch(req->span_bytes) {
+	case 1: copy_spans_fixed<1>(spans, n, req->src_packed, req->dst_packed); break;
+	case 2: copy_spans_fixed<2>(spans, n, req->src_packed, req->dst_packed); break;
+	case 4: copy_spans_fixed<4>(spans, n, req->src_packed, req->dst_packed); break;
+	case 8: copy_spans_fixed<8>(spans, n, req->src_packed, req->dst_packed); break;
+	case 16: copy_spans_fixed<16>(spans, n, req->src_packed, req->dst_packed); break;
+	case 32: copy_spans_fixed<32>(spans, n, req->src_packed, req->dst_packed); break;
+	default:
+	  {
+	    for(size_t i = 0; i < n; i++)
+	      memcpy(spans[i].dst, spans[i].src, spans[i].bytes);
+	    break;
+	  }
+	}
+      }
+
+      MemcpyThreadPool::MemcpyThreadPool(int _num_threads, int _numa_domain,
+					 CoreReservationSet& crs)
+	: num_threads(_num_threads), numa_domain(_numa_domain)
+	, shutdown_flag(false)
+      {
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+
+	// copies are all load/store, and the helpers are idle most of the time
+	CoreReservationParameters params;
+	params.set_num_cores(num_threads);
+	if(numa_domain >= 0)
+	  params.set_numa_domain(numa_domain);
+	params.set_alu_usage(params.CORE_USAGE_SHARED);
+	params.set_fpu_usage(params.CORE_USAGE_NONE);
+	params.set_ldst_usage(params.CORE_USAGE_SHARED);
+	core_rsrv = new CoreReservation("memcpy threads", crs, params);
+
+	ThreadLaunchParameters tlp;
+	for(int i = 0; i < num_threads; i++) {
+	  Thread *t = Thread::create_kernel_thread<MemcpyThreadPool,
+						   &MemcpyThreadPool::worker_loop>(this,
+										   tlp,
+										   *core_rsrv,
+										   0 /*default scheduler*/);
+	  worker_threads.push_back(t);
+	}
+      }
+
+      MemcpyThreadPool::~MemcpyThreadPool(void)
+      {
+	shutdown();
+	delete core_rsrv;
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&cond);
+      }
+
+      void MemcpyThreadPool::shutdown(void)
+      {
+	pthread_mutex_lock(&lock);
+	shutdown_flag = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+
+	for(std::vector<Thread *>::iterator it = worker_threads.begin();
+	    it != worker_threads.end();
+	    it++) {
+	  (*it)->join();
+	  delete (*it);
+	}
+	worker_threads.clear();
+      }
+
+      /*static*/ void MemcpyThreadPool::do_chunks(CopyJob *job)
+      {
+	while(true) {
+	  size_t chunk = __sync_fetch_and_add(&job->next_chunk, 1);
+	  if(chunk >= job->num_chunks) break;
+	  (job->func)(job->arg, chunk, job->num_chunks);
+	  __sync_fetch_and_sub(&job->remaining, 1);
+	}
+      }
+
+      void MemcpyThreadPool::worker_loop(void)
+      {
+	pthread_mutex_lock(&lock);
+	while(true) {
+	  while(jobs.empty() && !shutdown_flag)
+	    pthread_cond_wait(&cond, &lock);
+	  if(shutdown_flag) break;
+
+	  // jobs on the list are valid while we hold the lock - once all of a
+	  //  job's chunks are claimed it can come off the list
+	  CopyJob *job = jobs.front();
+	  if(job->next_chunk >= job->num_chunks) {
+	    jobs.pop_front();
+	    continue;
+	  }
+
+	  // the submitter waits for 'active' to drop to zero, so that
+	  //  decrement must be our last access to the job
+	  __sync_fetch_and_add(&job->active, 1);
+	  pthread_mutex_unlock(&lock);
+	  do_chunks(job);
+	  __sync_fetch_and_sub(&job->active, 1);
+	  pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+      }
+
+      struct PlainCopyArgs {
+	const MemcpyRequest *req;
+	bool streaming;
+      };
+
+      static void plain_copy_chunk(const void *arg, size_t chunk, size_t num_chunks)
+      {
+	const PlainCopyArgs *args = static_cast<const PlainCopyArgs *>(arg);
+	copy_request_chunk(args->req, chunk, num_chunks, args->streaming);
+      }
+
+      void MemcpyThreadPool::perform_copy(const MemcpyRequest *req, bool streaming)
+      {
+	size_t units;
+	if((req->dim == Request::DIM_3D) && (req->nplanes > 1))
+	  units = req->nplanes;
+	else if((req->dim != Request::DIM_1D) && (req->nlines > 1))
+	  units = req->nlines;
+	else
+	  units = req->nbytes >> 12;  // no point splitting below a page
+
+	PlainCopyArgs args;
+	args.req = req;
+	args.streaming = streaming;
+	perform_chunks(plain_copy_chunk, &args, units);
+      }
+
+      void MemcpyThreadPool::perform_chunks(ChunkFunc func, const void *arg,
+					    size_t units)
+      {
+	CopyJob job;
+	job.func = func;
+	job.arg = arg;
+	job.num_chunks = std::max((size_t)1, std::min(units, (size_t)(num_threads + 1)));
+	job.next_chunk = 0;
+	job.remaining = job.num_chunks;
+	job.active = 0;
+
+	if(job.num_chunks > 1) {
+	  pthread_mutex_lock(&lock);
+	  jobs.push_back(&job);
+	  pthread_cond_broadcast(&cond);
+	  pthread_mutex_unlock(&lock);
+	}
+
+	// do our share, then wait for any chunks the helpers are still copying
+	do_chunks(&job);
+
+	if(job.num_chunks > 1) {
+	  // the job lives on our stack, so take it off the list (if a helper
+	  //  hasn't already) and wait for any helpers still working on it
+	  pthread_mutex_lock(&lock);
+	  for(std::deque<CopyJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+	    if(*it == &job) {
+	      jobs.erase(it);
+	      break;
+	    }
+	  pthread_mutex_unlock(&lock);
+
+	  while((job.remaining > 0) || (job.active > 0))
+	    sched_yield();
+	}
+	__sync_synchronize();
+      }
+
       MemcpyChannel::MemcpyChannel(long max_nr)
 	: Channel(XferDes::XFER_MEM_CPY)
       {
@@ -2306,10 +2938,32 @@ namespace Realm {
 	    add_path(cpu_mem_kinds[i], false,
 		     cpu_mem_kinds[j], false,
 		     bw, latency, true, true);
+
+	if(Config::memcpy_threads > 0) {
+	  // one pool for memories without a NUMA affinity, plus one per
+	  //  domain that has a memory of its own, so that copies into a
+	  //  domain's memory are done by cores in that domain
+	  CoreReservationSet& crs = get_runtime()->core_reservation_set();
+	  thread_pools[-1] = new MemcpyThreadPool(Config::memcpy_threads, -1, crs);
+	  const std::vector<MemoryImpl *>& local_mems = get_runtime()->nodes[my_node_id].memories;
+	  for(std::vector<MemoryImpl *>::const_iterator it = local_mems.begin();
+	      it != local_mems.end();
+	      ++it) {
+	    if((*it)->lowlevel_kind != Memory::SOCKET_MEM) continue;
+	    int domain = static_cast<LocalCPUMemory *>(*it)->numa_node;
+	    if((domain >= 0) && (thread_pools.count(domain) == 0))
+	      thread_pools[domain] = new MemcpyThreadPool(Config::memcpy_threads,
+							  domain, crs);
+	  }
+	}
       }
 
       MemcpyChannel::~MemcpyChannel()
       {
+	for(std::map<int, MemcpyThreadPool *>::iterator it = thread_pools.begin();
+	    it != thread_pools.end();
+	    ++it)
+	  delete it->second;
         pthread_mutex_destroy(&pending_lock);
         pthread_mutex_destroy(&finished_lock);
         pthread_cond_destroy(&pending_cond);
@@ -2335,6 +2989,51 @@ namespace Realm {
 				      bw_ret, lat_ret);
       }
 
+      // copies with no serialization/deserialization - these can be split
+      //  across helper threads and/or use streaming stores
+      void MemcpyChannel::copy_plain(MemcpyRequest *req)
+      {
+	if(req->num_spans > 0) {
+	  copy_gather_spans(req);
+	  return;
+	}
+
+	size_t total_bytes = req->nbytes;
+	if(req->dim != Request::DIM_1D) total_bytes *= req->nlines;
+	if(req->dim == Request::DIM_3D) total_bytes *= req->nplanes;
+
+	bool streaming = ((Config::memcpy_nt_threshold > 0) &&
+			  (total_bytes >= Config::memcpy_nt_threshold));
+
+	if(!thread_pools.empty() &&
+	   (total_bytes >= Config::memcpy_split_threshold))
+	  find_thread_pool(req->xd->dst_mem)->perform_copy(req, streaming);
+	else
+	  copy_request_chunk(req, 0, 1, streaming);
+      }
+
+      // the pool closest to the destination
+      MemcpyThreadPool *MemcpyChannel::find_thread_pool(MemoryImpl *dst_mem)
+      {
+	int domain = -1;
+	if(dst_mem->lowlevel_kind == Memory::SOCKET_MEM)
+	  domain = static_cast<LocalCPUMemory *>(dst_mem)->numa_node;
+	std::map<int, MemcpyThreadPool *>::const_iterator it = thread_pools.find(domain);
+	if(it == thread_pools.end())
+	  it = thread_pools.find(-1);
+	return it->second;
+      }
+
+      void MemcpyChannel::perform_chunks(MemoryImpl *dst_mem,
+					 MemcpyThreadPool::ChunkFunc func,
+					 const void *arg, size_t units)
+      {
+	if(!thread_pools.empty() && (units > 1))
+	  find_thread_pool(dst_mem)->perform_chunks(func, arg, units);
+	else
+	  (*func)(arg, 0, 1);
+      }
+
       void MemcpyChannel::stop()
       {
         pthread_mutex_lock(&pending_lock);
@@ -2399,7 +3098,9 @@ namespace Realm {
 	    // we manage read_bytes_total, read_seq_{pos,count}
 	    req->read_seq_pos = req->xd->read_bytes_total;
 	  }
-	  {
+	  if(!req->xd->src_serdez_op && !req->xd->dst_serdez_op) {
+	    copy_plain(req);
+	  } else {
 	    char *wrap_buffer = 0;
 	    bool wrap_buffer_malloced = false;
 	    const size_t ALLOCA_LIMIT = 4096;
@@ -3174,22 +3875,125 @@ namespace Realm {
 
       HDFChannel::~HDFChannel() {}
 
+      // direct access to a contiguous dataset - the hyperslab is a set of
+      //  equal-length runs in the file (packed one after another in memory),
+      //  and the request's bytes are split evenly across the chunks
+      struct HDFDirectArgs {
+	const HDFRequest *req;
+	bool is_write;
+	// first errno seen by any chunk (-1 for an unexpected end of file)
+	int error;
+      };
+
+      static void hdf_direct_chunk(const void *arg, size_t chunk, size_t num_chunks)
+      {
+	HDFDirectArgs *args = static_cast<HDFDirectArgs *>(const_cast<void *>(arg));
+	const HDFRequest *req = args->req;
+	const HDF5::HDF5Dataset *dset = req->dset;
+	int ndims = dset->ndims;
+
+	// runs cover the innermost dimensions that are transferred in full,
+	//  plus the next one out
+	int j = ndims - 1;
+	while((j > 0) && (req->extent[j] == dset->dims[j]))
+	  j--;
+	size_t run_bytes = dset->elem_size;
+	for(int i = j; i < ndims; i++)
+	  run_bytes *= req->extent[i];
+
+	size_t elems = req->nbytes / dset->elem_size;
+	size_t pos = dset->elem_size * ((elems * chunk) / num_chunks);
+	size_t end = dset->elem_size * ((elems * (chunk + 1)) / num_chunks);
+	while(pos < end) {
+	  size_t run = pos / run_bytes;
+	  size_t run_ofs = pos % run_bytes;
+	  size_t bytes = std::min(run_bytes - run_ofs, end - pos);
+
+	  // file element index of the start of the run
+	  size_t elem_idx = 0;
+	  size_t stride = 1;
+	  size_t r = run;
+	  for(int i = ndims - 1; i >= 0; i--) {
+	    size_t idx = req->offset[i];
+	    if(i < j) {
+	      idx += r % req->extent[i];
+	      r /= req->extent[i];
+	    }
+	    elem_idx += idx * stride;
+	    stride *= dset->dims[i];
+	  }
+	  off_t file_ofs = dset->raw_offset + (elem_idx * dset->elem_size) + run_ofs;
+	  char *mem_ptr = static_cast<char *>(req->mem_base) + pos;
+
+	  while(bytes > 0) {
+	    ssize_t amt = (args->is_write ?
+			     pwrite(dset->raw_fd, mem_ptr, bytes, file_ofs) :
+			     pread(dset->raw_fd, mem_ptr, bytes, file_ofs));
+	    if(amt <= 0) {
+	      if((amt < 0) && (errno == EINTR))
+		continue;
+	      __sync_bool_compare_and_swap(&args->error, 0,
+					   ((amt < 0) ? errno : -1));
+	      return;
+	    }
+	    mem_ptr += amt;
+	    file_ofs += amt;
+	    pos += amt;
+	    bytes -= amt;
+	  }
+	}
+      }
+
       long HDFChannel::submit(Request** requests, long nr)
       {
         HDFRequest** hdf_reqs = (HDFRequest**) requests;
         for (long i = 0; i < nr; i++) {
           HDFRequest* req = hdf_reqs[i];
 	  assert(!req->xd->src_serdez_op && !req->xd->dst_serdez_op); // no serdez support
-          //pthread_rwlock_rdlock(req->rwlock);
-          if (kind == XferDes::XFER_HDF_READ)
-            CHECK_HDF5( H5Dread(req->dataset_id, req->datatype_id,
-				req->mem_space_id, req->file_space_id,
-				H5P_DEFAULT, req->mem_base) );
-	  else
-            CHECK_HDF5( H5Dwrite(req->dataset_id, req->datatype_id,
-				 req->mem_space_id, req->file_space_id,
-				 H5P_DEFAULT, req->mem_base) );
-          //pthread_rwlock_unlock(req->rwlock);
+	  if(req->mem_space_id < 0) {
+	    // a contiguous dataset we can access directly - large requests
+	    //  are split across the memcpy helper threads (if any)
+	    HDFDirectArgs args;
+	    args.req = req;
+	    args.is_write = (kind == XferDes::XFER_HDF_WRITE);
+	    args.error = 0;
+	    MemoryImpl *mem = ((kind == XferDes::XFER_HDF_READ) ?
+			         req->xd->dst_mem :
+			         req->xd->src_mem);
+	    MemcpyChannel *memcpy_channel = get_channel_manager()->get_memcpy_channel();
+	    if(memcpy_channel && (req->nbytes >= Config::memcpy_split_threshold))
+	      memcpy_channel->perform_chunks(mem, hdf_direct_chunk, &args,
+					     req->nbytes / req->dset->elem_size);
+	    else
+	      hdf_direct_chunk(&args, 0, 1);
+
+	    if(args.error != 0) {
+	      // redo the whole request through libhdf5, which either gets it
+	      //  right or reports what's wrong with the file - the dataspaces
+	      //  are cleaned up with the request's
+	      log_hdf5.warning() << "direct " << (args.is_write ? "write" : "read")
+				 << " of " << req->dset->filename << " failed ("
+				 << ((args.error > 0) ? strerror(args.error) :
+				                        "unexpected end of file")
+				 << ") - retrying through libhdf5";
+	      AutoHSLLock al(HDF5::hdf5_lock);
+	      int ndims = req->dset->ndims;
+	      CHECK_HDF5( req->mem_space_id = H5Screate_simple(ndims, req->extent, NULL) );
+	      CHECK_HDF5( req->file_space_id = H5Screate_simple(ndims, req->dset->dims, 0) );
+	      CHECK_HDF5( H5Sselect_hyperslab(req->file_space_id, H5S_SELECT_SET, req->offset, 0, req->extent, 0) );
+	    }
+	  }
+	  if(req->mem_space_id >= 0) {
+	    AutoHSLLock al(HDF5::hdf5_lock);
+	    if (kind == XferDes::XFER_HDF_READ)
+	      CHECK_HDF5( H5Dread(req->dataset_id, req->datatype_id,
+				  req->mem_space_id, req->file_space_id,
+				  H5P_DEFAULT, req->mem_base) );
+	    else
+	      CHECK_HDF5( H5Dwrite(req->dataset_id, req->datatype_id,
+				   req->mem_space_id, req->file_space_id,
+				   H5P_DEFAULT, req->mem_base) );
+	  }
           req->xd->notify_request_read_done(req);
           req->xd->notify_request_write_done(req);
         }
@@ -3448,29 +4252,62 @@ namespace Realm {
             long nr = it->first->available();
             if (nr == 0)
               continue;
-            std::vector<XferDes*> finish_xferdes;
+            // XferDes's are visited in priority order, so lower priorities
+            //  only get whatever room the higher ones leave - within a
+            //  priority, each one gets (up to) a quantum of bytes per turn
+            //  and then goes to the back of the line (deficit round robin)
+            //  so that a big transfer can't starve the small ones behind it
+            std::vector<XferDes*> finish_xferdes, requeue_xferdes;
             PriorityXferDesQueue::iterator it2;
             for (it2 = it->second->begin(); it2 != it->second->end(); it2++) {
-              assert((*it2)->channel == it->first);
+              XferDes *xd = *it2;
+              assert(xd->channel == it->first);
               // If we haven't mark started and we are the first xd, mark start
-              if ((*it2)->mark_start) {
-                (*it2)->dma_request->mark_started();
-                (*it2)->mark_start = false;
+              if (xd->mark_start) {
+                xd->dma_request->mark_started();
+                xd->mark_start = false;
               }
               // Do nothing for empty copies
               // if ((*it2)->bytes_total ==0) {
               //   finish_xferdes.push_back(*it2);
               //   continue;
               // }
-              long nr_got = (*it2)->get_requests(requests, std::min(nr, max_nr));
-              long nr_submitted = it->first->submit(requests, nr_got);
-              nr -= nr_submitted;
-              assert(nr_got == nr_submitted);
-              if ((*it2)->is_completed()) {
-                finish_xferdes.push_back(*it2);
+              bool blocked = false;
+              if (Config::xd_quantum > 0) {
+                xd->sched_deficit += Config::xd_quantum;
+                while ((nr > 0) && (xd->sched_deficit > 0)) {
+                  long nr_got = xd->get_requests(requests, 1);
+                  if (nr_got == 0) {
+                    blocked = true;
+                    break;
+                  }
+                  it->first->requests_submitted(requests, nr_got);
+                  long nr_submitted = it->first->submit(requests, nr_got);
+                  assert(nr_got == nr_submitted);
+                  nr -= nr_submitted;
+                  xd->sched_deficit -= request_bytes(requests[0]);
+                }
+              } else {
+                long nr_got = xd->get_requests(requests, std::min(nr, max_nr));
+                it->first->requests_submitted(requests, nr_got);
+                long nr_submitted = it->first->submit(requests, nr_got);
+                nr -= nr_submitted;
+                assert(nr_got == nr_submitted);
+              }
+              if (xd->is_completed()) {
+                finish_xferdes.push_back(xd);
                 //printf("finish_xferdes.size() = %lu\n", finish_xferdes.size());
 		continue;
               }
+              if (Config::xd_quantum > 0) {
+                if (blocked) {
+                  // nothing to do until more data shows up - unused credit
+                  //  isn't saved up for later
+                  if (xd->sched_deficit > 0)
+                    xd->sched_deficit = 0;
+                } else if (xd->sched_deficit <= 0)
+                  requeue_xferdes.push_back(xd);
+              }
               if (nr == 0)
                 break;
             }
@@ -3478,6 +4315,7 @@ namespace Realm {
               XferDes *xd = finish_xferdes.back();
               finish_xferdes.pop_back();
               it->second->erase(xd);
+              it->first->xd_finished();
               // We flush all changes into destination before mark this XferDes as completed
               xd->flush();
               log_new_dma.info("Finish XferDes : id(" IDFMT ")", xd->guid);
@@ -3488,6 +4326,15 @@ namespace Realm {
                 delete dma_request;
               }*/
             }
+            // those that used up their turn go behind the others of the
+            //  same priority
+            for (std::vector<XferDes*>::iterator it3 = requeue_xferdes.begin();
+                 it3 != requeue_xferdes.end();
+                 ++it3) {
+              it->second->erase(*it3);
+              (*it3)->sched_seq = __sync_fetch_and_add(&next_sched_seq, 1);
+              it->second->insert(*it3);
+            }
           }
         }
         log_new_dma.info("finish dma thread loop");
@@ -45,6 +45,35 @@
 
 namespace Realm {
 
+    namespace Config {
+      // number of helper threads per NUMA domain that large intra-node
+      //  copies are split across (0 = copies are done by the DMA thread
+      //  alone)
+      extern int memcpy_threads;
+
+      // copies of at least this many bytes are split across the helper
+      //  threads
+      extern size_t memcpy_split_threshold;
+
+      // if nonzero, copies of at least this many bytes use non-temporal
+      //  (streaming) stores that bypass the cache
+      extern size_t memcpy_nt_threshold;
+
+      // consecutive pieces of a copy that are no larger than this many
+      //  bytes (e.g. the rectangles of a sparse index space) are packed
+      //  into a single gather/scatter request (0 = disabled)
+      extern size_t memcpy_gather_max_span;
+
+      // maximum number of pieces packed into a gather/scatter request
+      extern int memcpy_gather_max_spans;
+
+      // bytes a transfer may submit to its channel per turn before the
+      //  other transfers of the same priority get a go - requests are also
+      //  capped at this size (0, the default, = no fair sharing, transfers
+      //  are served in priority order only)
+      extern size_t xd_quantum;
+    };
+
     class XferDes;
     class Channel;
 
@@ -206,11 +235,24 @@ namespace Realm {
       std::map<size_t, size_t> spans;  // noncontiguous spans
     };
 
+    // one contiguous piece of a gather/scatter request
+    struct GatherSpan {
+      const void *src;
+      void *dst;
+      size_t bytes;
+    };
+
     class MemcpyRequest : public Request {
     public:
       const void *src_base;
       void *dst_base;
       //size_t nbytes;
+      // if num_spans > 0, this is a gather/scatter request and the spans
+      //  are copied instead of src_base/dst_base
+      GatherSpan *spans;
+      size_t num_spans;
+      size_t span_bytes;  // size of every span, or 0 if they differ
+      bool src_packed, dst_packed;  // spans are back-to-back in src/dst
     };
 
     class GASNetRequest : public Request {
@@ -254,8 +296,11 @@ namespace Realm {
     class HDFRequest : public Request {
     public:
       void *mem_base; // could be source or dest
+      HDF5::HDF5Dataset *dset;
       hid_t dataset_id, datatype_id;
       hid_t mem_space_id, file_space_id;
+      // the hyperslab, for direct access to contiguous datasets
+      hsize_t offset[H5S_MAX_RANK], extent[H5S_MAX_RANK];
     };
 #endif
 
@@ -322,6 +367,11 @@ namespace Realm {
       uint64_t max_req_size;
       // priority of the containing XferDes
       int priority;
+      // position among the XferDes's of the same priority on a channel
+      //  (lower goes first), and the bytes it may still submit in its
+      //  current turn - both are only touched by the channel's DMA thread
+      uint64_t sched_seq;
+      int64_t sched_deficit;
       // current, previous and next XferDes in the chain, XFERDES_NO_GUID
       // means this XferDes is the first/last one.
       XferDesID guid, pre_xd_guid, next_xd_guid;
@@ -433,6 +483,7 @@ namespace Realm {
       ~MemcpyXferDes()
       {
         free(memcpy_reqs);
+        free(gather_spans);
       }
 
       long get_requests(Request** requests, long nr);
@@ -441,7 +492,23 @@ namespace Realm {
       void flush();
 
     private:
+      long get_gather_requests(MemcpyRequest** requests, long nr,
+			       unsigned flags);
+      GatherSpan *span_list(MemcpyRequest *req);
+      bool add_gather_spans(MemcpyRequest *gather, const MemcpyRequest *req);
+      void add_direct_gather_spans(MemcpyRequest *gather);
+      void append_gather_span(MemcpyRequest *gather,
+			      off_t src_off, off_t dst_off, size_t bytes);
+
       MemcpyRequest* memcpy_reqs;
+      // span lists for gather/scatter requests (memcpy_gather_max_spans
+      //  per request) - allocated when the first one is built
+      bool use_gather;
+      long max_reqs;
+      GatherSpan *gather_spans;
+      // a request that did not fit in the caller's array on the previous
+      //  call to get_gather_requests
+      MemcpyRequest *held_req;
       //const char *src_buf_base, *dst_buf_base;
     };
 
@@ -560,14 +627,11 @@ namespace Realm {
       void notify_request_write_done(Request* req);
       void flush();
 
-      struct HDFFileInfo {
-	hid_t file_id;
-	std::map<std::string, hid_t> dset_ids;
-      };
-
     private:
       HDFRequest* hdf_reqs;
-      std::map<std::string, HDFFileInfo *> file_infos;
+      RegionInstance attach_inst;
+      // files written by this transfer, which are flushed when it's done
+      std::set<std::string> files_written;
       //char *buf_base;
       //const HDF5Memory::HDFMetadata *hdf_metadata;
       //std::vector<OffsetsAndSize>::iterator fit;
@@ -579,14 +643,31 @@ namespace Realm {
 
     class Channel {
     public:
-      Channel(XferDes::XferKind _kind)
-	: node(my_node_id), kind(_kind) {}
-      virtual ~Channel() {};
+      Channel(XferDes::XferKind _kind);
+      virtual ~Channel();
     public:
       // which node manages this channel
       NodeID node;
       // the kind of XferDes this channel can accept
       XferDes::XferKind kind;
+
+      // sampled by the profiler to show how busy a (local) channel is over
+      //  time - the bandwidth achieved in a sample interval is the number
+      //  of bytes done in it
+      struct Gauges {
+	Gauges(const std::string& prefix);
+
+	GASNetHSL mutex;  // range gauges are updated from several threads
+	ProfilingGauges::AbsoluteRangeGauge<int> xds_queued;
+	ProfilingGauges::AbsoluteRangeGauge<size_t> bytes_in_flight;
+	ProfilingGauges::EventCounter<size_t> bytes_done;
+      };
+      Gauges *gauges;  // NULL for remote channels
+
+      void xd_enqueued(void);
+      void xd_finished(void);
+      void requests_submitted(Request **requests, long nr);
+      void request_done(Request *req);
       /*
        * Submit nr asynchronous requests into the channel instance.
        * This is supposed to be a non-blocking function call, and
@@ -731,6 +812,49 @@ namespace Realm {
       std::deque<MemcpyRequest*> thread_queue;
     };
 
+    // a pool of threads (optionally restricted to a single NUMA domain) that
+    //  the memcpy channel splits large copies across - the submitting thread
+    //  works on its own copy too and waits for the helpers to finish, so
+    //  requests still complete in the order they are submitted
+    class MemcpyThreadPool {
+    public:
+      MemcpyThreadPool(int _num_threads, int _numa_domain,
+		       CoreReservationSet& crs);
+      ~MemcpyThreadPool(void);
+
+      void perform_copy(const MemcpyRequest *req, bool streaming);
+
+      // performs part 'chunk' (of 'num_chunks') of a job
+      typedef void (*ChunkFunc)(const void *arg, size_t chunk, size_t num_chunks);
+
+      // runs a job that can be divided into (up to) 'units' independent
+      //  chunks, using as many helpers as are useful
+      void perform_chunks(ChunkFunc func, const void *arg, size_t units);
+
+      void shutdown(void);
+
+    protected:
+      struct CopyJob {
+	ChunkFunc func;
+	const void *arg;
+	size_t num_chunks;
+	volatile size_t next_chunk;
+	volatile size_t remaining;
+	volatile int active;  // helpers currently working on this job
+      };
+
+      void worker_loop(void);
+      static void do_chunks(CopyJob *job);
+
+      int num_threads, numa_domain;
+      CoreReservation *core_rsrv;
+      std::vector<Thread *> worker_threads;
+      std::deque<CopyJob *> jobs;
+      pthread_mutex_t lock;
+      pthread_cond_t cond;
+      bool shutdown_flag;
+    };
+
     class MemcpyChannel : public Channel {
     public:
       MemcpyChannel(long max_nr);
@@ -749,13 +873,25 @@ namespace Realm {
 				 unsigned *bw_ret = 0,
 				 unsigned *lat_ret = 0);
 
+      // runs a job of (up to) 'units' independent chunks that writes to
+      //  'dst_mem' on the helper threads closest to it, or just on the
+      //  calling thread if there are no helpers
+      void perform_chunks(MemoryImpl *dst_mem,
+			  MemcpyThreadPool::ChunkFunc func, const void *arg,
+			  size_t units);
+
       bool is_stopped;
     private:
+      void copy_plain(MemcpyRequest *req);
+      MemcpyThreadPool *find_thread_pool(MemoryImpl *dst_mem);
+
       std::deque<MemcpyRequest*> pending_queue, finished_queue;
       pthread_mutex_t pending_lock, finished_lock;
       pthread_cond_t pending_cond;
       long capacity;
       bool sleep_threads;
+      // helper thread pools by NUMA domain (-1 = any)
+      std::map<int, MemcpyThreadPool *> thread_pools;
       //std::vector<MemcpyRequest*> available_cb;
       //MemcpyRequest** cbs;
     };
@@ -926,13 +1062,16 @@ namespace Realm {
 #endif
     };
 
+    // higher priorities first, and then round-robin (see XferDes::sched_seq)
+    //  within a priority
     class CompareXferDes {
     public:
       bool operator() (XferDes* a, XferDes* b) {
-        if(a->priority == b->priority)
-          return (a < b);
-        else 
-          return (a->priority < b->priority);
+        if(a->priority != b->priority)
+          return (a->priority > b->priority);
+        if(a->sched_seq != b->sched_seq)
+          return (a->sched_seq < b->sched_seq);
+        return (a < b);
       }
     };
     //typedef std::priority_queue<XferDes*, std::vector<XferDes*>, CompareXferDes> PriorityXferDesQueue;
@@ -1374,6 +1513,7 @@ namespace Realm {
         assert(it2 != queues.end());
         // push ourself into the priority queue
         it2->second->insert(xd);
+        xd->channel->xd_enqueued();
         pthread_mutex_unlock(&queues_lock);
         if (dma_thread->sleep) {
           dma_thread->sleep = false;
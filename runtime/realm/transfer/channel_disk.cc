@@ -50,6 +50,7 @@ namespace Realm {
       // grab the file's name from the instance metadata
       RegionInstanceImpl *impl = get_runtime()->get_instance_impl(inst);
       filename = impl->metadata.filename;
+      file_base = impl->metadata.inst_offset;
 
       //MemoryImpl* src_mem_impl = get_runtime()->get_memory_impl(_src_buf.memory);
       //MemoryImpl* dst_mem_impl = get_runtime()->get_memory_impl(_dst_buf.memory);
@@ -92,7 +93,7 @@ namespace Realm {
         case XferDes::XFER_FILE_READ:
         {
           for (long i = 0; i < new_nr; i++) {
-            reqs[i]->file_off = reqs[i]->src_off;
+            reqs[i]->file_off = reqs[i]->src_off - file_base;
             //reqs[i]->mem_base = (char*)(buf_base + reqs[i]->dst_off);
 	    reqs[i]->mem_base = dst_mem->get_direct_ptr(reqs[i]->dst_off,
 							reqs[i]->nbytes);
@@ -120,7 +121,7 @@ namespace Realm {
 	    reqs[i]->mem_base = src_mem->get_direct_ptr(reqs[i]->src_off,
 							reqs[i]->nbytes);
 	    assert(reqs[i]->mem_base != 0);
-            reqs[i]->file_off = reqs[i]->dst_off;
+            reqs[i]->file_off = reqs[i]->dst_off - file_base;
 
 	    // have we opened the file yet?
 	    if(fd == -1) {
@@ -311,6 +312,7 @@ namespace Realm {
             assert(0);
         }
       }
+      aio_ctx->flush();
       return nr;
     }
 
@@ -364,6 +366,7 @@ namespace Realm {
             assert(0);
         }
       }
+      aio_ctx->flush();
       return nr;
     }
 
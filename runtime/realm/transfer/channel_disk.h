@@ -59,6 +59,9 @@ namespace Realm {
     private:
       FileRequest* file_reqs;
       std::string filename;
+      // the instance's offset in the file memory, which addresses are
+      //  relative to
+      off_t file_base;
       int fd; // The file that stores the physical instance
       //const char *buf_base;
     };
@@ -25,8 +25,12 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace Realm {
+
+    extern Logger log_inst; // in inst_impl.cc
   
     DiskMemory::DiskMemory(Memory _me, size_t _size, std::string _file)
       : MemoryImpl(_me, _size, MKIND_DISK, ALIGNMENT, Memory::DISK_MEM), file(_file)
@@ -108,6 +112,10 @@ namespace Realm {
 
     FileMemory::~FileMemory(void)
     {
+      for(std::map<off_t, MappedFile>::const_iterator it = mapped_files.begin();
+	  it != mapped_files.end();
+	  ++it)
+	munmap(it->second.base, it->second.size);
       pthread_mutex_destroy(&vector_lock);
     }
 
@@ -125,8 +133,33 @@ namespace Realm {
       // Do nothing in this function.
     }
 
+    const FileMemory::MappedFile *FileMemory::find_mapping(off_t offset, size_t size,
+							   off_t& rel_offset)
+    {
+      // caller holds vector_lock
+      std::map<off_t, MappedFile>::const_iterator it = mapped_files.upper_bound(offset);
+      if(it == mapped_files.begin())
+	return 0;
+      --it;
+      rel_offset = offset - it->first;
+      if((size_t)rel_offset + size > it->second.size)
+	return 0;
+      return &(it->second);
+    }
+
     void FileMemory::get_bytes(off_t offset, void *dst, size_t size)
     {
+      // mapped files can be read directly
+      {
+	pthread_mutex_lock(&vector_lock);
+	off_t rel_offset;
+	const MappedFile *mf = find_mapping(offset, size, rel_offset);
+	pthread_mutex_unlock(&vector_lock);
+	if(mf) {
+	  memcpy(dst, mf->base + rel_offset, size);
+	  return;
+	}
+      }
       // map from the offset back to the instance index
       assert(offset < next_offset);
       pthread_mutex_lock(&vector_lock);
@@ -154,8 +187,18 @@ namespace Realm {
 #endif
     }
 
-    void FileMemory::put_bytes(off_t offset, const void *src, size_t)
+    void FileMemory::put_bytes(off_t offset, const void *src, size_t size)
     {
+      {
+	pthread_mutex_lock(&vector_lock);
+	off_t rel_offset;
+	const MappedFile *mf = find_mapping(offset, size, rel_offset);
+	pthread_mutex_unlock(&vector_lock);
+	if(mf) {
+	  memcpy(mf->base + rel_offset, src, size);
+	  return;
+	}
+      }
       // map from the offset back to the instance index
       assert(offset < next_offset);
       pthread_mutex_lock(&vector_lock);
@@ -188,7 +231,12 @@ namespace Realm {
 
     void *FileMemory::get_direct_ptr(off_t offset, size_t size)
     {
-      return 0; // cannot provide a pointer for it;
+      // only files that have been mapped can provide a pointer
+      pthread_mutex_lock(&vector_lock);
+      off_t rel_offset;
+      const MappedFile *mf = find_mapping(offset, size, rel_offset);
+      pthread_mutex_unlock(&vector_lock);
+      return (mf ? (mf->base + rel_offset) : 0);
     }
 
     int FileMemory::get_home_node(off_t offset, size_t size)
@@ -196,6 +244,135 @@ namespace Realm {
       return my_node_id;
     }
 
+    bool FileMemory::allocate_instance_storage(RegionInstance i,
+					       size_t bytes, size_t alignment,
+					       Event precondition,
+					       size_t offset /*= 0*/)
+    {
+      // file memories are only used by their own node
+      assert(ID(me).memory.owner_node == my_node_id);
+
+      if(!precondition.has_triggered())
+	precondition.wait();
+
+      // there's no storage to manage here - just hand out the next range
+      //  of offsets (rounded up so instances don't share an aligned block)
+      size_t rounded = ((bytes + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT;
+      off_t inst_offset = alloc_bytes(rounded ? rounded : ALIGNMENT);
+
+      get_instance(i)->notify_allocation(true, inst_offset);
+      return true /*immediate notification*/;
+    }
+
+    // defers the release of an instance's storage until the release's
+    //  precondition has triggered
+    class DeferredFileRelease : public EventWaiter {
+    public:
+      DeferredFileRelease(FileMemory *_mem, RegionInstance _inst)
+	: mem(_mem), inst(_inst) { }
+      virtual ~DeferredFileRelease(void) { }
+    public:
+      virtual bool event_triggered(Event e, bool poisoned)
+      {
+	// the instance is being destroyed either way, so a poisoned
+	//  precondition doesn't stop the mapping from going away
+	mem->release_instance_storage(inst, Event::NO_EVENT);
+	return true;
+      }
+
+      virtual void print(std::ostream& os) const
+      {
+	os << "deferred file instance release: inst=" << inst;
+      }
+
+      virtual Event get_finish_event(void) const
+      {
+	return Event::NO_EVENT;
+      }
+
+    protected:
+      FileMemory *mem;
+      RegionInstance inst;
+    };
+
+    void FileMemory::release_instance_storage(RegionInstance i,
+					      Event precondition)
+    {
+      assert(ID(me).memory.owner_node == my_node_id);
+
+      // a mapping can't be torn down while anybody might still be using it
+      if(!precondition.has_triggered()) {
+	EventImpl::add_waiter(precondition, new DeferredFileRelease(this, i));
+	return;
+      }
+
+      RegionInstanceImpl *impl = get_instance(i);
+      off_t inst_offset = impl->metadata.inst_offset;
+
+      // unmap the file if it was mapped - for writable mappings, this is
+      //  when the kernel is told the changes should go back to the file
+      MappedFile mf;
+      mf.base = 0;
+      {
+	pthread_mutex_lock(&vector_lock);
+	std::map<off_t, MappedFile>::iterator it = mapped_files.find(inst_offset);
+	if(it != mapped_files.end()) {
+	  mf = it->second;
+	  mapped_files.erase(it);
+	}
+	pthread_mutex_unlock(&vector_lock);
+      }
+      if(mf.base)
+	munmap(mf.base, mf.size);
+
+      impl->notify_deallocation();
+    }
+
+    bool FileMemory::map_file(off_t offset, size_t size, const char *filename,
+			      realm_file_mode_t file_mode)
+    {
+      if(size == 0)
+	return false;
+
+      bool read_only = (file_mode == LEGION_FILE_READ_ONLY);
+      int fd = open(filename, (read_only ? O_RDONLY : O_RDWR));
+      if(fd < 0)
+	return false;
+
+      // touching a page past the end of the file raises SIGBUS, so a file
+      //  that's shorter than the instance (e.g. one being created) has to
+      //  use the read/write path instead
+      struct stat st;
+      if((fstat(fd, &st) < 0) || (st.st_size < 0) ||
+	 (static_cast<size_t>(st.st_size) < size)) {
+	close(fd);
+	return false;
+      }
+
+      // a shared mapping means the data comes straight from (and, for
+      //  writable files, goes straight back to) the page cache
+      void *base = mmap(0, size,
+			(read_only ? PROT_READ : (PROT_READ | PROT_WRITE)),
+			MAP_SHARED, fd, 0);
+      // the mapping holds its own reference to the file
+      close(fd);
+      if(base == MAP_FAILED)
+	return false;
+
+      // attached files are usually input data that will be streamed
+      //  through, so ask for readahead to start now
+      madvise(base, size, MADV_SEQUENTIAL);
+      madvise(base, size, MADV_WILLNEED);
+
+      MappedFile mf;
+      mf.base = static_cast<char *>(base);
+      mf.size = size;
+      pthread_mutex_lock(&vector_lock);
+      mapped_files[offset] = mf;
+      pthread_mutex_unlock(&vector_lock);
+      return true;
+    }
+
     int FileMemory::get_file_des(ID::IDType inst_id)
     {
       pthread_mutex_lock(&vector_lock);
@@ -225,7 +402,7 @@ namespace Realm {
     // for now, we put the fields in order and use a fortran
     //  linearization
     InstanceLayout<N,T> *layout = new InstanceLayout<N,T>;
-    layout->bytes_used = 0;
+    layout->bytes_used = 0;  // filled in once the file size is known
     layout->alignment_reqd = 0;  // no allocation being made
     layout->space = space;
     layout->piece_lists.resize(field_sizes.size());
@@ -265,6 +442,9 @@ namespace Realm {
       assert(ret == 0);
     }
     
+    // the instance's range of offsets in the file memory covers the file
+    layout->bytes_used = file_ofs;
+
     // and now create the instance using this layout
     Event e = create_instance(inst, memory, layout, prs, wait_on);
 
@@ -272,6 +452,17 @@ namespace Realm {
     RegionInstanceImpl *impl = get_runtime()->get_instance_impl(inst);
     impl->metadata.filename = file_name;
 
+    // file memory allocation is immediate, so the instance's offset is known
+    //  and the file can be mapped (if requested) before anybody asks for a
+    //  pointer
+    if(Config::file_mmap && (impl->metadata.inst_offset != (size_t)-2)) {
+      FileMemory *fmem = static_cast<FileMemory *>(get_runtime()->get_memory_impl(memory));
+      if(!fmem->map_file(impl->metadata.inst_offset, file_ofs,
+			 file_name, file_mode))
+	log_inst.warning() << "could not map file '" << file_name
+			   << "' for " << inst << " - only copies will be possible";
+    }
+
     return e;
   }
 
@@ -29,11 +29,23 @@
 #else
 #include <aio.h>
 #endif
+#ifdef REALM_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#endif
 
 #ifdef USE_CUDA
 #include "realm/cuda/cuda_module.h"
 #endif
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <queue>
 #include <algorithm>
 #include <iomanip>
@@ -48,9 +60,11 @@
 
 #include "realm/timers.h"
 #include "realm/serialize.h"
+#include "realm/utils.h"
 
 TYPE_IS_SERIALIZABLE(Realm::OffsetsAndSize);
 TYPE_IS_SERIALIZABLE(Realm::CopySrcDstField);
+TYPE_IS_SERIALIZABLE(Realm::TransferIterator::AddressInfo);
 
 namespace Realm {
 
@@ -88,17 +102,50 @@ namespace Realm {
       off_t ib_offset;
     };
 
+    // a persistent pool of fixed-size chunks covering an intermediate buffer
+    //  memory - leasing and returning a chunk is much cheaper than going
+    //  through the memory's allocator, and bounding each copy's buffer to a
+    //  chunk lets the hops of many copies share the memory at once instead
+    //  of the first large copy taking all of it
+    class IBChunkPool {
+    public:
+      IBChunkPool(Memory _mem, off_t _base, size_t _chunk_size, size_t _num_chunks);
+
+      // returns the offset of 'bytes' worth of contiguous chunks, or -1 if
+      //  no such range is free
+      off_t lease(size_t bytes);
+      void release(off_t offset, size_t bytes);
+
+      Memory mem;
+      off_t base;
+      size_t chunk_size;
+      std::vector<bool> in_use;
+      size_t next_chunk;  // where the next search starts
+      ProfilingGauges::AbsoluteRangeGauge<int> chunks_in_use;
+      ProfilingGauges::EventCounter<int> lease_waits;
+    };
+
     class PendingIBQueue {
     public:
       PendingIBQueue();
+      ~PendingIBQueue();
 
       void enqueue_request(Memory tgt_mem, IBAllocRequest* req);
 
       void dequeue_request(Memory tgt_mem);
 
+      // returns an intermediate buffer to its memory and then retries any
+      //  requests waiting for space in that memory
+      void free_buffer(Memory tgt_mem, off_t offset, size_t size);
+
     protected:
+      // caller must hold the mutex
+      IBChunkPool *get_pool(Memory tgt_mem);
+      off_t alloc_buffer(Memory tgt_mem, size_t size);
+
       GASNetHSL queue_mutex;
       std::map<Memory, std::queue<IBAllocRequest*> *> queues;
+      std::map<Memory, IBChunkPool *> pools;  // 0 if the memory has no pool
     };
 
     class DmaRequest;
@@ -127,6 +174,53 @@ namespace Realm {
       std::vector<Thread *> worker_threads;
     };
 
+    // everything about a copy that depends only on its signature (the
+    //  instances, fields and index space) rather than on the data - filled
+    //  in by the first copy with that signature and then shared (read-only)
+    //  by later ones
+    class CopyPlan {
+    public:
+      CopyPlan(RegionInstance _src_inst, RegionInstance _dst_inst);
+
+      RegionInstance src_inst, dst_inst;
+      std::vector<Memory> mem_path;
+      // addresses of the source and destination pieces in the order the
+      //  copy visits them - only built for direct memcpy copies
+      bool pieces_valid;
+      std::vector<TransferIterator::AddressInfo> src_pieces, dst_pieces;
+      size_t total_bytes;
+      // the rest are protected by the cache's mutex
+      bool ready;    // false while the first copy is still filling it in
+      bool stale;    // no longer in the cache - delete with last reference
+      int refcount;
+      unsigned long long last_use;
+    };
+
+    class CopyPlanCache {
+    public:
+      CopyPlanCache(size_t _max_plans);
+      ~CopyPlanCache(void);
+
+      // returns the plan for the copy 'req' (with a reference added), or 0
+      //  if the copy can't use the cache - a plan that is not ready must be
+      //  filled in by the caller and then passed to 'publish'
+      CopyPlan *acquire(CopyRequest *req);
+      void publish(CopyPlan *plan);
+      void release(CopyPlan *plan);
+
+      void invalidate(RegionInstance inst);
+
+    protected:
+      // caller must hold the mutex
+      void remove_plan(std::map<std::string, CopyPlan *>::iterator it);
+
+      size_t max_plans;
+      GASNetHSL mutex;
+      std::map<std::string, CopyPlan *> plans;
+      unsigned long long use_counter;
+      ProfilingGauges::EventCounter<int> hits, misses;
+    };
+
   ////////////////////////////////////////////////////////////////////////
   //
   // class DmaRequest
@@ -173,16 +267,141 @@ namespace Realm {
     {
     }
 
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class IBChunkPool
+  //
+
+    namespace Config {
+      size_t ib_chunk_size = 4 << 20;
+    };
+
+    IBChunkPool::IBChunkPool(Memory _mem, off_t _base, size_t _chunk_size, size_t _num_chunks)
+      : mem(_mem), base(_base), chunk_size(_chunk_size)
+      , in_use(_num_chunks, false), next_chunk(0)
+      , chunks_in_use(stringbuilder() << "realm/mem " << _mem << "/ib chunks in use")
+      , lease_waits(stringbuilder() << "realm/mem " << _mem << "/ib lease waits")
+    {}
+
+    off_t IBChunkPool::lease(size_t bytes)
+    {
+      size_t count = (bytes + chunk_size - 1) / chunk_size;
+      if(count == 0) count = 1;
+      size_t num_chunks = in_use.size();
+      if(count > num_chunks)
+	return -1;
+      // first fit, starting after the most recent lease so that chunks are
+      //  recycled round-robin
+      for(size_t i = 0; i < num_chunks; i++) {
+	size_t first = (next_chunk + i) % num_chunks;
+	if(first + count > num_chunks)
+	  continue;
+	size_t j = 0;
+	while((j < count) && !in_use[first + j])
+	  j++;
+	if(j < count)
+	  continue;
+	for(j = 0; j < count; j++)
+	  in_use[first + j] = true;
+	next_chunk = (first + count) % num_chunks;
+	chunks_in_use += count;
+	return base + (first * chunk_size);
+      }
+      return -1;
+    }
+
+    void IBChunkPool::release(off_t offset, size_t bytes)
+    {
+      size_t count = (bytes + chunk_size - 1) / chunk_size;
+      if(count == 0) count = 1;
+      assert(offset >= base);
+      assert(((offset - base) % chunk_size) == 0);
+      size_t first = (offset - base) / chunk_size;
+      assert((first + count) <= in_use.size());
+      for(size_t j = 0; j < count; j++) {
+	assert(in_use[first + j]);
+	in_use[first + j] = false;
+      }
+      chunks_in_use -= count;
+    }
+
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class PendingIBQueue
+  //
+
     static PendingIBQueue *ib_req_queue = 0;
 
     PendingIBQueue::PendingIBQueue() {}
 
+    PendingIBQueue::~PendingIBQueue()
+    {
+      // the pools' chunks are never handed back to the memories - they go
+      //  away with them
+      for(std::map<Memory, IBChunkPool *>::iterator it = pools.begin();
+	  it != pools.end();
+	  ++it)
+	delete it->second;
+    }
+
+    IBChunkPool *PendingIBQueue::get_pool(Memory tgt_mem)
+    {
+      std::map<Memory, IBChunkPool *>::const_iterator it = pools.find(tgt_mem);
+      if(it != pools.end())
+	return it->second;
+
+      // only dedicated intermediate buffer memories are pooled, and the
+      //  pool takes the whole memory the first time it's used
+      IBChunkPool *pool = 0;
+      if((Config::ib_chunk_size > 0) && ID(tgt_mem).is_ib_memory()) {
+	MemoryImpl *impl = get_runtime()->get_memory_impl(tgt_mem);
+	size_t num_chunks = impl->size / Config::ib_chunk_size;
+	if(num_chunks > 0) {
+	  off_t base = impl->alloc_bytes(num_chunks * Config::ib_chunk_size);
+	  if(base >= 0) {
+	    log_ib_alloc.info() << "ib pool: memory=" << tgt_mem
+				<< " chunks=" << num_chunks
+				<< " chunk_size=" << Config::ib_chunk_size;
+	    pool = new IBChunkPool(tgt_mem, base,
+				   Config::ib_chunk_size, num_chunks);
+	  } else
+	    log_ib_alloc.warning() << "ib pool: could not reserve memory " << tgt_mem
+				   << " - falling back to per-copy allocation";
+	}
+      }
+      pools[tgt_mem] = pool;
+      return pool;
+    }
+
+    off_t PendingIBQueue::alloc_buffer(Memory tgt_mem, size_t size)
+    {
+      IBChunkPool *pool = get_pool(tgt_mem);
+      if(pool)
+	return pool->lease(size);
+      else
+	return get_runtime()->get_memory_impl(tgt_mem)->alloc_bytes(size);
+    }
+
+    void PendingIBQueue::free_buffer(Memory tgt_mem, off_t offset, size_t size)
+    {
+      {
+	AutoHSLLock al(queue_mutex);
+	assert(ID(tgt_mem).memory.owner_node == my_node_id);
+	IBChunkPool *pool = get_pool(tgt_mem);
+	if(pool)
+	  pool->release(offset, size);
+	else
+	  get_runtime()->get_memory_impl(tgt_mem)->free_bytes(offset, size);
+      }
+      dequeue_request(tgt_mem);
+    }
+
     void PendingIBQueue::enqueue_request(Memory tgt_mem, IBAllocRequest* req)
     {
       AutoHSLLock al(queue_mutex);
       assert(ID(tgt_mem).memory.owner_node == my_node_id);
       // If we can allocate in target memory, no need to pend the request
-      off_t ib_offset = get_runtime()->get_memory_impl(tgt_mem)->alloc_bytes(req->ib_size);
+      off_t ib_offset = alloc_buffer(tgt_mem, req->ib_size);
       if (ib_offset >= 0) {
         if (req->owner == my_node_id) {
           // local ib alloc request
@@ -203,6 +422,11 @@ namespace Realm {
       }
       log_ib_alloc.info("enqueue_request: src_inst(%llx) dst_inst(%llx) "
                         "no enough space in memory(%llx)", req->src_inst_id, req->dst_inst_id, tgt_mem.id);
+      {
+	IBChunkPool *pool = get_pool(tgt_mem);
+	if(pool)
+	  pool->lease_waits += 1;
+      }
       //log_ib_alloc.info() << " (" << req->src_inst_id << "," 
       //  << req->dst_inst_id << "): no enough space in memory" << tgt_mem;
       std::map<Memory, std::queue<IBAllocRequest*> *>::iterator it = queues.find(tgt_mem);
@@ -226,7 +450,7 @@ namespace Realm {
       if (it == queues.end()) return;
       while (!it->second->empty()) {
         IBAllocRequest* req = it->second->front();
-        off_t ib_offset = get_runtime()->get_memory_impl(tgt_mem)->alloc_bytes(req->ib_size);
+        off_t ib_offset = alloc_buffer(tgt_mem, req->ib_size);
         if (ib_offset < 0) break;
         //printf("req: src_inst_id(%llx) dst_inst_id(%llx) ib_size(%lu) idx(%d)\n", req->src_inst_id, req->dst_inst_id, req->ib_size, req->idx);
         // deal with the completed ib alloc request
@@ -352,12 +576,156 @@ namespace Realm {
       return r;
     } 
 
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // class CopyPlanCache
+  //
+
+    namespace Config {
+      int copy_plan_cache_size = 0;
+      size_t copy_plan_max_pieces = 65536;
+    };
+
+    static CopyPlanCache *copy_plan_cache = 0;
+
+    CopyPlan::CopyPlan(RegionInstance _src_inst, RegionInstance _dst_inst)
+      : src_inst(_src_inst), dst_inst(_dst_inst)
+      , pieces_valid(false), total_bytes(0)
+      , ready(false), stale(false), refcount(0), last_use(0)
+    {}
+
+    CopyPlanCache::CopyPlanCache(size_t _max_plans)
+      : max_plans(_max_plans)
+      , use_counter(0)
+      , hits("realm/dma copy plan hits")
+      , misses("realm/dma copy plan misses")
+    {}
+
+    CopyPlanCache::~CopyPlanCache(void)
+    {
+      while(!plans.empty())
+	remove_plan(plans.begin());
+    }
+
+    CopyPlan *CopyPlanCache::acquire(CopyRequest *req)
+    {
+      // a plan is only valid as long as both instances exist, and we only
+      //  hear about destruction of instances in our own memories
+      if(req->oas_by_inst->size() != 1)
+	return 0;
+      const InstPair& ip = req->oas_by_inst->begin()->first;
+      if((NodeID(ID(ip.first).instance.owner_node) != my_node_id) ||
+	 (NodeID(ID(ip.second).instance.owner_node) != my_node_id))
+	return 0;
+      const OASVec& oasvec = req->oas_by_inst->begin()->second;
+      for(OASVec::const_iterator it = oasvec.begin(); it != oasvec.end(); ++it)
+	if(it->serdez_id != 0)
+	  return 0;
+
+      // the signature is the serialized form of the domain and fields
+      Serialization::DynamicBufferSerializer dbs(128);
+      bool ok = ((dbs << *(req->domain)) &&
+		 (dbs << *(req->oas_by_inst)));
+      assert(ok);
+      std::string key(static_cast<const char *>(dbs.get_buffer()),
+		      dbs.bytes_used());
+
+      CopyPlan *plan;
+      {
+	AutoHSLLock al(mutex);
+	std::map<std::string, CopyPlan *>::iterator it = plans.find(key);
+	if(it != plans.end()) {
+	  plan = it->second;
+	  if(!plan->ready) {
+	    // still being built by an earlier copy - plan separately
+	    misses += 1;
+	    return 0;
+	  }
+	  hits += 1;
+	} else {
+	  if(plans.size() >= max_plans) {
+	    // evict the least recently used plan
+	    std::map<std::string, CopyPlan *>::iterator victim = plans.begin();
+	    for(std::map<std::string, CopyPlan *>::iterator it2 = plans.begin();
+		it2 != plans.end();
+		++it2)
+	      if(it2->second->last_use < victim->second->last_use)
+		victim = it2;
+	    remove_plan(victim);
+	  }
+	  plan = new CopyPlan(ip.first, ip.second);
+	  plans[key] = plan;
+	  misses += 1;
+	}
+	plan->refcount++;
+	plan->last_use = ++use_counter;
+      }
+      return plan;
+    }
+
+    void CopyPlanCache::publish(CopyPlan *plan)
+    {
+      AutoHSLLock al(mutex);
+      plan->ready = true;
+    }
+
+    void CopyPlanCache::release(CopyPlan *plan)
+    {
+      AutoHSLLock al(mutex);
+      assert(plan->refcount > 0);
+      plan->refcount--;
+      if(plan->refcount == 0) {
+	if(plan->stale) {
+	  delete plan;
+	} else if(!plan->ready) {
+	  // the copy that was building it never got that far - try again
+	  //  next time
+	  for(std::map<std::string, CopyPlan *>::iterator it = plans.begin();
+	      it != plans.end();
+	      ++it)
+	    if(it->second == plan) {
+	      remove_plan(it);
+	      break;
+	    }
+	}
+      }
+    }
+
+    void CopyPlanCache::invalidate(RegionInstance inst)
+    {
+      AutoHSLLock al(mutex);
+      std::map<std::string, CopyPlan *>::iterator it = plans.begin();
+      while(it != plans.end()) {
+	if((it->second->src_inst == inst) || (it->second->dst_inst == inst))
+	  remove_plan(it++);
+	else
+	  ++it;
+      }
+    }
+
+    void CopyPlanCache::remove_plan(std::map<std::string, CopyPlan *>::iterator it)
+    {
+      CopyPlan *plan = it->second;
+      plans.erase(it);
+      if(plan->refcount > 0)
+	plan->stale = true;
+      else
+	delete plan;
+    }
+
+    void invalidate_copy_plans(RegionInstance inst)
+    {
+      if(copy_plan_cache)
+	copy_plan_cache->invalidate(inst);
+    }
+
     CopyRequest::CopyRequest(const void *data, size_t datalen,
 			     Event _before_copy,
 			     Event _after_copy,
 			     int _priority)
       : DmaRequest(_priority, _after_copy),
 	oas_by_inst(0),
+	plan(0),
 	before_copy(_before_copy)
     {
       Serialization::FixedBufferDeserializer deserializer(data, datalen);
@@ -416,6 +784,7 @@ namespace Realm {
       : DmaRequest(_priority, _after_copy, reqs)
       , domain(_domain->clone())
       , oas_by_inst(_oas_by_inst)
+      , plan(0)
       , before_copy(_before_copy)
     {
       // <NEW_DMA>
@@ -445,6 +814,8 @@ namespace Realm {
         destroy_xfer_des(*it);
       }
       //</NEWDMA>
+      if(plan)
+	copy_plan_cache->release(plan);
       delete oas_by_inst;
       delete domain;
     }
@@ -575,8 +946,7 @@ namespace Realm {
     /*static*/ void RemoteIBFreeRequestAsync::handle_request(RequestArgs args)
     {
       assert(ID(args.memory).memory.owner_node == my_node_id);
-      get_runtime()->get_memory_impl(args.memory)->free_bytes(args.ib_offset, args.ib_size);
-      ib_req_queue->dequeue_request(args.memory);
+      ib_req_queue->free_buffer(args.memory, args.ib_offset, args.ib_size);
     }
 
     /*static*/ void RemoteIBFreeRequestAsync::send_request(NodeID target, Memory tgt_mem, off_t ib_offset, size_t ib_size)
@@ -596,8 +966,7 @@ namespace Realm {
       //CopyRequest* cr = (CopyRequest*) req;
       //AutoHSLLock al(cr->ib_mutex);
       if(ID(mem).memory.owner_node == my_node_id) {
-        get_runtime()->get_memory_impl(mem)->free_bytes(offset, size);
-        ib_req_queue->dequeue_request(mem);
+        ib_req_queue->free_buffer(mem, offset, size);
       } else {
         RemoteIBFreeRequestAsync::send_request(ID(mem).memory.owner_node,
             mem, offset, size);
@@ -626,20 +995,25 @@ namespace Realm {
       }
       domain_size = domain->volume();
 
+      // with an IB pool, a copy gets (at most) a single chunk and larger
+      //  copies stream through it
+      size_t max_ib_size = ((Config::ib_chunk_size > 0) ?
+			      Config::ib_chunk_size :
+			      IB_MAX_SIZE);
       size_t ib_size = domain_size * ib_elmnt_size + serdez_pad;
-      if(ib_size > IB_MAX_SIZE) {
-	// take up to IB_MAX_SIZE, respecting the min granularity
+      if(ib_size > max_ib_size) {
+	// take up to max_ib_size, respecting the min granularity
 	if(min_granularity > 1) {
-	  // (really) corner case: if min_granulary exceeds IB_MAX_SIZE, use it
+	  // (really) corner case: if min_granulary exceeds max_ib_size, use it
 	  //  directly and hope it's ok
-	  if(min_granularity > IB_MAX_SIZE) {
+	  if(min_granularity > max_ib_size) {
 	    ib_size = min_granularity;
 	  } else {
-	    size_t extra = IB_MAX_SIZE % min_granularity;
-	    ib_size = IB_MAX_SIZE - extra;
+	    size_t extra = max_ib_size % min_granularity;
+	    ib_size = max_ib_size - extra;
 	  }
 	} else
-	  ib_size = IB_MAX_SIZE;
+	  ib_size = max_ib_size;
       }
       //log_ib_alloc.info("alloc_ib: src_inst_id(%llx) dst_inst_id(%llx) idx(%d) size(%lu) memory(%llx)", inst_pair.first.id, inst_pair.second.id, idx, ib_size, tgt_mem.id);
       if (ID(tgt_mem).memory.owner_node == my_node_id) {
@@ -744,7 +1118,15 @@ namespace Realm {
         Memory src_mem = get_runtime()->get_instance_impl(oas_by_inst->begin()->first.first)->memory;
         Memory dst_mem = get_runtime()->get_instance_impl(oas_by_inst->begin()->first.second)->memory;
 	CustomSerdezID serdez_id = oas_by_inst->begin()->second[0].serdez_id;
-        find_shortest_path(src_mem, dst_mem, serdez_id, mem_path);
+	if(copy_plan_cache)
+	  plan = copy_plan_cache->acquire(this);
+	if(plan && plan->ready) {
+	  mem_path = plan->mem_path;
+	} else {
+	  find_shortest_path(src_mem, dst_mem, serdez_id, mem_path);
+	  if(plan)
+	    plan->mem_path = mem_path;
+	}
         // Pass 1: create IBInfo blocks
         for (OASByInst::iterator it = oas_by_inst->begin(); it != oas_by_inst->end(); it++) {
           AutoHSLLock al(ib_mutex);
@@ -1074,6 +1456,315 @@ namespace Realm {
     }
 #endif
 
+#ifdef REALM_USE_IO_URING
+    inline int io_uring_setup(unsigned entries, struct io_uring_params *p)
+    {
+      return syscall(__NR_io_uring_setup, entries, p);
+    }
+
+    inline int io_uring_enter(int fd, unsigned to_submit,
+			      unsigned min_complete, unsigned flags)
+    {
+      return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		     flags, NULL, 0);
+    }
+
+    inline int io_uring_register(int fd, unsigned opcode,
+				 const void *arg, unsigned nr_args)
+    {
+      return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    }
+
+    // a minimal io_uring wrapper (no liburing dependency) - submission queue
+    //  entries are filled in as operations are launched and then handed to
+    //  the kernel in batches by submit(), and completions are polled directly
+    //  out of the shared completion ring without any syscalls
+    // NOT thread-safe - protected by the AsyncFileIOContext's mutex
+    class IOUringQueue {
+    public:
+      IOUringQueue(unsigned entries, bool sqpoll);
+      ~IOUringQueue(void);
+
+      bool is_valid(void) const { return ring_fd >= 0; }
+
+      void register_buffers(const std::vector<std::pair<void *, size_t> >& ranges);
+
+      // fills in an SQE - returns false if the submission queue is full
+      // 'iov' is used if 'buffer' isn't registered, and must stay valid
+      //  until the operation completes
+      bool queue_rw(bool is_write, int fd, size_t offset, size_t bytes,
+		    void *buffer, struct iovec *iov, void *user_data);
+
+      void submit(void);
+
+      // returns the user_data and result of the next completion, if any
+      bool reap(void *& user_data, int& result);
+
+    protected:
+      int ring_fd;
+      bool sqpoll;
+      unsigned to_submit;
+      void *sq_ring, *cq_ring;
+      size_t sq_ring_size, cq_ring_size, sqes_size;
+      unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+      unsigned *cq_head, *cq_tail, *cq_mask;
+      struct io_uring_sqe *sqes;
+      struct io_uring_cqe *cqes;
+      std::vector<std::pair<char *, size_t> > registered;
+    };
+
+    IOUringQueue::IOUringQueue(unsigned entries, bool _sqpoll)
+      : ring_fd(-1), sqpoll(_sqpoll), to_submit(0)
+      , sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sqes(0)
+    {
+      struct io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      if(sqpoll) {
+	params.flags |= IORING_SETUP_SQPOLL;
+	params.sq_thread_idle = 1000;  // ms
+      }
+      ring_fd = io_uring_setup(entries, &params);
+      if(ring_fd < 0) {
+	log_aio.warning() << "io_uring_setup failed: " << strerror(errno);
+	return;
+      }
+
+      // before 5.11, an SQPOLL ring can only use registered files, and
+      //  we don't know our files up front - the caller will retry without
+      //  SQPOLL
+      if(sqpoll) {
+#ifdef IORING_FEAT_SQPOLL_NONFIXED
+	bool nonfixed_ok = ((params.features & IORING_FEAT_SQPOLL_NONFIXED) != 0);
+#else
+	bool nonfixed_ok = false;
+#endif
+	if(!nonfixed_ok) {
+	  log_aio.info() << "io_uring SQPOLL requires registered files on this kernel";
+	  close(ring_fd);
+	  ring_fd = -1;
+	  return;
+	}
+      }
+
+      sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cq_ring_size = (params.cq_off.cqes +
+		      params.cq_entries * sizeof(struct io_uring_cqe));
+      sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+      sq_ring = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+      cq_ring = mmap(0, cq_ring_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+      void *sqes_ptr = mmap(0, sqes_size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+      if((sq_ring == MAP_FAILED) || (cq_ring == MAP_FAILED) ||
+	 (sqes_ptr == MAP_FAILED)) {
+	log_aio.warning() << "io_uring mmap failed: " << strerror(errno);
+	if(sqes_ptr != MAP_FAILED) munmap(sqes_ptr, sqes_size);
+	if(cq_ring != MAP_FAILED) munmap(cq_ring, cq_ring_size);
+	if(sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+	sq_ring = cq_ring = MAP_FAILED;
+	close(ring_fd);
+	ring_fd = -1;
+	return;
+      }
+      sqes = static_cast<struct io_uring_sqe *>(sqes_ptr);
+
+      char *sq_base = static_cast<char *>(sq_ring);
+      sq_head = reinterpret_cast<unsigned *>(sq_base + params.sq_off.head);
+      sq_tail = reinterpret_cast<unsigned *>(sq_base + params.sq_off.tail);
+      sq_mask = reinterpret_cast<unsigned *>(sq_base + params.sq_off.ring_mask);
+      sq_flags = reinterpret_cast<unsigned *>(sq_base + params.sq_off.flags);
+      sq_array = reinterpret_cast<unsigned *>(sq_base + params.sq_off.array);
+
+      char *cq_base = static_cast<char *>(cq_ring);
+      cq_head = reinterpret_cast<unsigned *>(cq_base + params.cq_off.head);
+      cq_tail = reinterpret_cast<unsigned *>(cq_base + params.cq_off.tail);
+      cq_mask = reinterpret_cast<unsigned *>(cq_base + params.cq_off.ring_mask);
+      cqes = reinterpret_cast<struct io_uring_cqe *>(cq_base + params.cq_off.cqes);
+
+      log_aio.info() << "io_uring created: entries=" << params.sq_entries
+		     << " sqpoll=" << sqpoll;
+    }
+
+    IOUringQueue::~IOUringQueue(void)
+    {
+      if(ring_fd >= 0) {
+	munmap(sqes, sqes_size);
+	munmap(cq_ring, cq_ring_size);
+	munmap(sq_ring, sq_ring_size);
+	close(ring_fd);
+      }
+    }
+
+    void IOUringQueue::register_buffers(const std::vector<std::pair<void *, size_t> >& ranges)
+    {
+      assert(registered.empty());
+
+      // the kernel limits each registered buffer to 1GB, so split up
+      //  anything larger
+      static const size_t MAX_BUFFER_SIZE = 1 << 30;
+      std::vector<struct iovec> iovs;
+      for(std::vector<std::pair<void *, size_t> >::const_iterator it = ranges.begin();
+	  it != ranges.end();
+	  ++it) {
+	char *base = static_cast<char *>(it->first);
+	size_t remaining = it->second;
+	while(remaining > 0) {
+	  size_t chunk = std::min(remaining, MAX_BUFFER_SIZE);
+	  struct iovec iov;
+	  iov.iov_base = base;
+	  iov.iov_len = chunk;
+	  iovs.push_back(iov);
+	  base += chunk;
+	  remaining -= chunk;
+	}
+      }
+      if(iovs.empty()) return;
+
+      // registration pins the memory, so it can fail due to RLIMIT_MEMLOCK -
+      //  that just means we don't get to use fixed buffers
+      int ret = io_uring_register(ring_fd, IORING_REGISTER_BUFFERS,
+				  &iovs[0], iovs.size());
+      if(ret < 0) {
+	log_aio.info() << "io_uring buffer registration failed: " << strerror(errno);
+	return;
+      }
+
+      for(size_t i = 0; i < iovs.size(); i++)
+	registered.push_back(std::make_pair(static_cast<char *>(iovs[i].iov_base),
+					    iovs[i].iov_len));
+    }
+
+    bool IOUringQueue::queue_rw(bool is_write, int fd, size_t offset, size_t bytes,
+				void *buffer, struct iovec *iov, void *user_data)
+    {
+      // we're the only producer, so only the head (advanced by the kernel)
+      //  needs an acquire
+      unsigned tail = *sq_tail;
+      unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+      if((tail - head) > *sq_mask)
+	return false;
+
+      unsigned idx = tail & *sq_mask;
+      struct io_uring_sqe *sqe = &sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = (is_write ? IORING_OP_WRITEV : IORING_OP_READV);
+      sqe->fd = fd;
+      sqe->off = offset;
+      sqe->user_data = reinterpret_cast<uint64_t>(user_data);
+
+      // use a fixed buffer if the whole transfer lies within one
+      char *ptr = static_cast<char *>(buffer);
+      for(size_t i = 0; i < registered.size(); i++)
+	if((ptr >= registered[i].first) &&
+	   ((ptr + bytes) <= (registered[i].first + registered[i].second))) {
+	  sqe->opcode = (is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED);
+	  sqe->buf_index = i;
+	  break;
+	}
+
+      if((sqe->opcode == IORING_OP_WRITE_FIXED) ||
+	 (sqe->opcode == IORING_OP_READ_FIXED)) {
+	sqe->addr = reinterpret_cast<uint64_t>(buffer);
+	sqe->len = bytes;
+      } else {
+	iov->iov_base = buffer;
+	iov->iov_len = bytes;
+	sqe->addr = reinterpret_cast<uint64_t>(iov);
+	sqe->len = 1;
+      }
+
+      sq_array[idx] = idx;
+      __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+      to_submit++;
+      return true;
+    }
+
+    void IOUringQueue::submit(void)
+    {
+      if(to_submit == 0) return;
+
+      if(sqpoll) {
+	// the kernel thread picks up new entries on its own unless it has
+	//  gone idle
+	__sync_synchronize();
+	if(__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+	  io_uring_enter(ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+	to_submit = 0;
+	return;
+      }
+
+      while(to_submit > 0) {
+	int ret = io_uring_enter(ring_fd, to_submit, 0, 0);
+	if(ret < 0) {
+	  if((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+	    break;  // try again on the next submit
+	  log_aio.fatal() << "io_uring_enter failed: " << strerror(errno);
+	  assert(0);
+	}
+	log_aio.debug() << "io_uring_enter submitted " << ret << " ops";
+	to_submit -= ret;
+      }
+    }
+
+    bool IOUringQueue::reap(void *& user_data, int& result)
+    {
+      unsigned head = *cq_head;
+      if(head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+	return false;
+
+      struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+      user_data = reinterpret_cast<void *>(cqe->user_data);
+      result = cqe->res;
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+
+    class IOUringOp : public AsyncFileIOContext::AIOOperation {
+    public:
+      IOUringOp(IOUringQueue *_uring, bool _is_write,
+		int _fd, size_t _offset, size_t _bytes,
+		void *_buffer, Request* request = NULL);
+      virtual void launch(void);
+      virtual bool check_completion(void);
+
+    public:
+      struct iovec iov;
+      IOUringQueue *uring;
+      bool is_write;
+      int fd;
+      size_t offset, bytes;
+      void *buffer;
+    };
+
+    IOUringOp::IOUringOp(IOUringQueue *_uring, bool _is_write,
+			 int _fd, size_t _offset, size_t _bytes,
+			 void *_buffer, Request* request)
+      : uring(_uring), is_write(_is_write)
+      , fd(_fd), offset(_offset), bytes(_bytes), buffer(_buffer)
+    {
+      completed = false;
+      req = request;
+    }
+
+    void IOUringOp::launch(void)
+    {
+      log_aio.debug("%s queued: op=%p", (is_write ? "write" : "read"), this);
+#ifndef NDEBUG
+      bool ok =
+#endif
+	uring->queue_rw(is_write, fd, offset, bytes, buffer, &iov, this);
+      // the ring has at least max_depth entries, so this can't fail
+      assert(ok);
+    }
+
+    bool IOUringOp::check_completion(void)
+    {
+      return completed;
+    }
+#endif
+
     class AIOFence : public Operation::AsyncWorkItem {
     public:
       AIOFence(Operation *_op) : Operation::AsyncWorkItem(_op) {}
@@ -1114,9 +1805,36 @@ namespace Realm {
       return true;
     }
 
-    AsyncFileIOContext::AsyncFileIOContext(int _max_depth)
+    namespace Config {
+      bool use_io_uring = false;
+      bool io_uring_sqpoll = false;
+      bool io_uring_register_buffers = false;
+      int aio_queue_depth = 256;
+    };
+
+    AsyncFileIOContext::AsyncFileIOContext(int _max_depth, bool _use_io_uring /*= false*/)
       : max_depth(_max_depth)
     {
+#ifdef REALM_USE_IO_URING
+      uring = 0;
+      if(_use_io_uring) {
+	uring = new IOUringQueue(max_depth, Config::io_uring_sqpoll);
+	// SQPOLL needs privileges (and registered files) on older kernels -
+	//  try again without it
+	if(!uring->is_valid() && Config::io_uring_sqpoll) {
+	  delete uring;
+	  uring = new IOUringQueue(max_depth, false);
+	}
+	if(!uring->is_valid()) {
+	  log_aio.warning() << "io_uring unavailable - using default file I/O backend";
+	  delete uring;
+	  uring = 0;
+	}
+      }
+#else
+      if(_use_io_uring)
+	log_aio.warning() << "io_uring support not compiled in - using default file I/O backend";
+#endif
 #ifdef REALM_USE_KERNEL_AIO
       aio_ctx = 0;
 #ifndef NDEBUG
@@ -1131,6 +1849,9 @@ namespace Realm {
     {
       assert(pending_operations.empty());
       assert(launched_operations.empty());
+#ifdef REALM_USE_IO_URING
+      delete uring;
+#endif
 #ifdef REALM_USE_KERNEL_AIO
 #ifndef NDEBUG
       int ret =
@@ -1144,11 +1865,18 @@ namespace Realm {
 					   size_t bytes, const void *buffer,
                                            Request* req)
     {
+      AIOOperation *op;
+#ifdef REALM_USE_IO_URING
+      if(uring)
+	op = new IOUringOp(uring, true /*write*/,
+			   fd, offset, bytes, const_cast<void *>(buffer), req);
+      else
+#endif
 #ifdef REALM_USE_KERNEL_AIO
-      KernelAIOWrite *op = new KernelAIOWrite(aio_ctx,
-					      fd, offset, bytes, buffer, req);
+      op = new KernelAIOWrite(aio_ctx,
+			      fd, offset, bytes, buffer, req);
 #else
-      PosixAIOWrite *op = new PosixAIOWrite(fd, offset, bytes, buffer, req);
+      op = new PosixAIOWrite(fd, offset, bytes, buffer, req);
 #endif
       {
 	AutoHSLLock al(mutex);
@@ -1165,11 +1893,18 @@ namespace Realm {
 					  size_t bytes, void *buffer,
                                           Request* req)
     {
+      AIOOperation *op;
+#ifdef REALM_USE_IO_URING
+      if(uring)
+	op = new IOUringOp(uring, false /*!write*/,
+			   fd, offset, bytes, buffer, req);
+      else
+#endif
 #ifdef REALM_USE_KERNEL_AIO
-      KernelAIORead *op = new KernelAIORead(aio_ctx,
-					    fd, offset, bytes, buffer, req);
+      op = new KernelAIORead(aio_ctx,
+			     fd, offset, bytes, buffer, req);
 #else
-      PosixAIORead *op = new PosixAIORead(fd, offset, bytes, buffer, req);
+      op = new PosixAIORead(fd, offset, bytes, buffer, req);
 #endif
       {
 	AutoHSLLock al(mutex);
@@ -1196,6 +1931,26 @@ namespace Realm {
       }
     }
 
+    void AsyncFileIOContext::flush(void)
+    {
+#ifdef REALM_USE_IO_URING
+      if(uring) {
+	AutoHSLLock al(mutex);
+	uring->submit();
+      }
+#endif
+    }
+
+    void AsyncFileIOContext::register_buffers(const std::vector<std::pair<void *, size_t> >& ranges)
+    {
+#ifdef REALM_USE_IO_URING
+      if(uring) {
+	AutoHSLLock al(mutex);
+	uring->register_buffers(ranges);
+      }
+#endif
+    }
+
     bool AsyncFileIOContext::empty(void)
     {
       AutoHSLLock al(mutex);
@@ -1213,6 +1968,50 @@ namespace Realm {
       AutoHSLLock al(mutex);
 
       // first, reap as many events as we can - oldest first
+#ifdef REALM_USE_IO_URING
+      if(uring) {
+	// anything still batched up goes to the kernel first
+	uring->submit();
+
+	void *user_data;
+	int result;
+	bool requeued = false;
+	while(uring->reap(user_data, result)) {
+	  IOUringOp *op = static_cast<IOUringOp *>(user_data);
+	  log_aio.debug("io_uring completion: op=%p res=%d", op, result);
+	  if((result == -EINTR) || (result == -EAGAIN)) {
+	    // nothing happened - just try again
+	    op->launch();
+	    requeued = true;
+	    continue;
+	  }
+	  // a zero-length result would never make progress (e.g. a read
+	  //  past the end of the file)
+	  if(result <= 0) {
+	    log_aio.fatal() << "io_uring " << (op->is_write ? "write" : "read")
+			    << " failed: fd=" << op->fd << " offset=" << op->offset
+			    << " bytes=" << op->bytes << " result=" << result
+			    << ((result < 0) ? strerror(-result) : "");
+	    assert(0);
+	  }
+	  if((size_t)result < op->bytes) {
+	    // short read/write - resubmit whatever is left (the operation
+	    //  keeps its slot, so the ring can't be full)
+	    log_aio.debug("io_uring short %s: op=%p res=%d bytes=%zd",
+			  (op->is_write ? "write" : "read"), op, result, op->bytes);
+	    op->offset += result;
+	    op->buffer = static_cast<char *>(op->buffer) + result;
+	    op->bytes -= result;
+	    op->launch();
+	    requeued = true;
+	    continue;
+	  }
+	  op->completed = true;
+	}
+	if(requeued)
+	  uring->submit();
+      }
+#endif
 #ifdef REALM_USE_KERNEL_AIO
       while(true) {
 	struct io_event events[8];
@@ -1254,6 +2053,10 @@ namespace Realm {
 	op->launch();
 	launched_operations.push_back(op);
       }
+#ifdef REALM_USE_IO_URING
+      if(uring)
+	uring->submit();
+#endif
     }
 
     /*static*/
@@ -1674,6 +2477,197 @@ namespace Realm {
 	    (serializer << tentative_valid));
   }
 
+  // replays a list of pieces recorded from another iterator (see CopyPlan),
+  //  splitting them up if the caller can't take a whole piece at once
+  class AddressListIterator : public TransferIterator {
+  public:
+    AddressListIterator(const std::vector<AddressInfo> *_pieces);
+
+    template <typename S>
+    static TransferIterator *deserialize_new(S& deserializer);
+
+    virtual void reset(void);
+    virtual bool done(void);
+
+    virtual size_t step(size_t max_bytes, AddressInfo& info,
+			unsigned flags,
+			bool tentative = false);
+    virtual void confirm_step(void);
+    virtual void cancel_step(void);
+
+    static Serialization::PolymorphicSerdezSubclass<TransferIterator, AddressListIterator> serdez_subclass;
+
+    template <typename S>
+    bool serialize(S& serializer) const;
+
+  protected:
+    // the list belongs to the CopyPlan unless we were deserialized
+    const std::vector<AddressInfo> *pieces;
+    std::vector<AddressInfo> owned_pieces;
+    size_t index, offset, prev_index, prev_offset;
+    bool tentative_valid;
+  };
+
+  AddressListIterator::AddressListIterator(const std::vector<AddressInfo> *_pieces)
+    : pieces(_pieces)
+    , index(0)
+    , offset(0)
+    , tentative_valid(false)
+  {}
+
+  template <typename S>
+  /*static*/ TransferIterator *AddressListIterator::deserialize_new(S& deserializer)
+  {
+    AddressListIterator *ali = new AddressListIterator(0);
+    if((deserializer >> ali->owned_pieces) &&
+       (deserializer >> ali->index) &&
+       (deserializer >> ali->offset) &&
+       (deserializer >> ali->prev_index) &&
+       (deserializer >> ali->prev_offset) &&
+       (deserializer >> ali->tentative_valid)) {
+      ali->pieces = &(ali->owned_pieces);
+      return ali;
+    } else {
+      delete ali;
+      return 0;
+    }
+  }
+
+  void AddressListIterator::reset(void)
+  {
+    index = 0;
+    offset = 0;
+  }
+
+  bool AddressListIterator::done(void)
+  {
+    return (index >= pieces->size());
+  }
+
+  size_t AddressListIterator::step(size_t max_bytes, AddressInfo &info,
+				   unsigned flags,
+				   bool tentative /*= false*/)
+  {
+    assert(!done());
+    assert(!tentative_valid);
+
+    if(tentative) {
+      prev_index = index;
+      prev_offset = offset;
+      tentative_valid = true;
+    }
+
+    const AddressInfo& p = (*pieces)[index];
+    size_t piece_bytes = p.bytes_per_chunk * p.num_lines * p.num_planes;
+
+    // common case: the whole piece
+    if((offset == 0) && (piece_bytes <= max_bytes) &&
+       ((p.num_lines == 1) || ((flags & LINES_OK) != 0)) &&
+       ((p.num_planes == 1) || ((flags & PLANES_OK) != 0))) {
+      info = p;
+      index++;
+      return piece_bytes;
+    }
+
+    // otherwise, take the biggest rectangle that starts at the current
+    //  position, the same way the iterator that recorded the piece would:
+    //  whole planes, whole lines from the current plane, or the rest of the
+    //  current line (or as much of it as fits)
+    size_t chunk = offset / p.bytes_per_chunk;
+    size_t chunk_ofs = offset % p.bytes_per_chunk;
+    size_t line = chunk % p.num_lines;
+    size_t plane = chunk / p.num_lines;
+    size_t plane_bytes = p.bytes_per_chunk * p.num_lines;
+    info.base_offset = (p.base_offset + (plane * p.plane_stride) +
+			(line * p.line_stride) + chunk_ofs);
+    size_t bytes;
+    if((chunk_ofs == 0) && (line == 0) && (p.num_lines > 1) &&
+       ((flags & LINES_OK) != 0) && ((flags & PLANES_OK) != 0) &&
+       (max_bytes >= plane_bytes)) {
+      size_t planes = std::min(p.num_planes - plane, max_bytes / plane_bytes);
+      info.bytes_per_chunk = p.bytes_per_chunk;
+      info.num_lines = p.num_lines;
+      info.line_stride = p.line_stride;
+      info.num_planes = planes;
+      info.plane_stride = ((planes > 1) ? p.plane_stride : 0);
+      bytes = planes * plane_bytes;
+    } else if((chunk_ofs == 0) && (p.num_lines > 1) &&
+	      ((flags & LINES_OK) != 0) &&
+	      (max_bytes >= p.bytes_per_chunk)) {
+      size_t lines = std::min(p.num_lines - line,
+			      max_bytes / p.bytes_per_chunk);
+      info.bytes_per_chunk = p.bytes_per_chunk;
+      info.num_lines = lines;
+      info.line_stride = ((lines > 1) ? p.line_stride : 0);
+      info.num_planes = 1;
+      info.plane_stride = 0;
+      bytes = lines * p.bytes_per_chunk;
+    } else {
+      bytes = std::min(p.bytes_per_chunk - chunk_ofs, max_bytes);
+      info.bytes_per_chunk = bytes;
+      info.num_lines = 1;
+      info.line_stride = 0;
+      info.num_planes = 1;
+      info.plane_stride = 0;
+    }
+    offset += bytes;
+    if(offset == piece_bytes) {
+      index++;
+      offset = 0;
+    }
+    return bytes;
+  }
+
+  void AddressListIterator::confirm_step(void)
+  {
+    assert(tentative_valid);
+    tentative_valid = false;
+  }
+
+  void AddressListIterator::cancel_step(void)
+  {
+    assert(tentative_valid);
+    index = prev_index;
+    offset = prev_offset;
+    tentative_valid = false;
+  }
+
+  /*static*/ Serialization::PolymorphicSerdezSubclass<TransferIterator, AddressListIterator> AddressListIterator::serdez_subclass;
+
+  template <typename S>
+  bool AddressListIterator::serialize(S& serializer) const
+  {
+    return ((serializer << *pieces) &&
+	    (serializer << index) &&
+	    (serializer << offset) &&
+	    (serializer << prev_index) &&
+	    (serializer << prev_offset) &&
+	    (serializer << tentative_valid));
+  }
+
+  // records the pieces 'iter' visits, giving up if there are more than
+  //  Config::copy_plan_max_pieces of them
+  static bool record_pieces(TransferIterator *iter,
+			    std::vector<TransferIterator::AddressInfo>& pieces,
+			    size_t& total_bytes)
+  {
+    total_bytes = 0;
+    while(!iter->done()) {
+      if(pieces.size() >= Config::copy_plan_max_pieces) {
+	pieces.clear();
+	return false;
+      }
+      TransferIterator::AddressInfo info;
+      size_t bytes = iter->step(size_t(-1), info,
+				(TransferIterator::LINES_OK |
+				 TransferIterator::PLANES_OK));
+      assert(bytes > 0);
+      pieces.push_back(info);
+      total_bytes += bytes;
+    }
+    return true;
+  }
+
     void CopyRequest::perform_new_dma(Memory src_mem, Memory dst_mem)
     {
       //mark_started();
@@ -1724,12 +2718,62 @@ namespace Realm {
 	    serdez_id = it2->serdez_id;
 	  }
 	}
-	TransferIterator *src_iter = domain->create_iterator(src_inst,
-							     dst_inst,
-							     src_fields);
-	TransferIterator *dst_iter = domain->create_iterator(dst_inst,
-							     src_inst,
-							     dst_fields);
+	TransferIterator *src_iter = 0;
+	TransferIterator *dst_iter = 0;
+	long max_nr = 100;
+
+	// a direct memcpy with a cached plan replays the pieces recorded by
+	//  the first copy instead of walking the index space again, and needs
+	//  only as many requests as it has pieces
+	if(plan && !plan->ready) {
+	  if((mem_path.size() == 2) &&
+	     (get_xfer_des(mem_path[0], mem_path[1],
+			   serdez_id, serdez_id, 0) == XferDes::XFER_MEM_CPY)) {
+	    TransferIterator *rec_src = domain->create_iterator(src_inst,
+								dst_inst,
+								src_fields);
+	    TransferIterator *rec_dst = domain->create_iterator(dst_inst,
+								src_inst,
+								dst_fields);
+	    if(rec_src->request_metadata().has_triggered() &&
+	       rec_dst->request_metadata().has_triggered()) {
+	      size_t src_bytes, dst_bytes;
+	      plan->pieces_valid = (record_pieces(rec_src, plan->src_pieces,
+						  src_bytes) &&
+				    record_pieces(rec_dst, plan->dst_pieces,
+						  dst_bytes));
+	      if(plan->pieces_valid) {
+		assert(src_bytes == dst_bytes);
+		plan->total_bytes = src_bytes;
+	      } else {
+		plan->src_pieces.clear();
+		plan->dst_pieces.clear();
+	      }
+	    }
+	    delete rec_src;
+	    delete rec_dst;
+	  }
+	  copy_plan_cache->publish(plan);
+	}
+	if(plan && plan->pieces_valid) {
+	  src_iter = new AddressListIterator(&(plan->src_pieces));
+	  dst_iter = new AddressListIterator(&(plan->dst_pieces));
+	  // one request per piece on either side, plus one per max_req_size
+	  size_t reqs_needed = (plan->src_pieces.size() +
+				plan->dst_pieces.size() +
+				(plan->total_bytes >> 24));
+	  if(reqs_needed < (size_t)max_nr)
+	    max_nr = std::max(reqs_needed, size_t(1));
+	}
+
+	if(!src_iter) {
+	  src_iter = domain->create_iterator(src_inst,
+					     dst_inst,
+					     src_fields);
+	  dst_iter = domain->create_iterator(dst_inst,
+					     src_inst,
+					     dst_fields);
+	}
 
         assert(mem_path.size() - 1 == sub_path.size());
 	//assert(ibvec.empty() || (0 && "SJT: intermediate buffer functionality temporarily disabled"));
@@ -1828,7 +2872,7 @@ namespace Realm {
 			    //pre_buf, cur_buf, domain, oasvec_src,
 			    xd_src_mem, xd_dst_mem, xd_src_iter, xd_dst_iter,
 			    xd_src_serdez_id, xd_dst_serdez_id,
-			    16 * 1024 * 1024/*max_req_size*/, 100/*max_nr*/,
+			    16 * 1024 * 1024/*max_req_size*/, max_nr,
 			    priority, order, kind, complete_fence, attach_inst);
             //pre_buf = cur_buf;
             //oasvec = oasvec_dst;
@@ -2102,6 +3146,266 @@ namespace Realm {
       return false;
     }
 
+  ////////////////////////////////////////////////////////////////////////
+  //
+  // fill and reduction kernels for directly-accessible memory
+  //
+
+    namespace Config {
+      size_t fill_nt_threshold = 16 << 20;
+    };
+
+    // runs a job on a block of data, splitting it across the memcpy helper
+    //  threads (if there are any) when it's large enough to be worth it
+    static void perform_block_job(MemoryImpl *dst_mem, size_t total_bytes,
+				  MemcpyThreadPool::ChunkFunc func,
+				  const void *arg, size_t units)
+    {
+      MemcpyChannel *channel = get_channel_manager()->get_memcpy_channel();
+      if(channel && (total_bytes >= Config::memcpy_split_threshold))
+	channel->perform_chunks(dst_mem, func, arg, units);
+      else
+	(*func)(arg, 0, 1);
+    }
+
+    // fills 'bytes' bytes at 'dst' (which is the start of a copy of the
+    //  pattern) with repeated copies of the pattern - a pattern that tiles a
+    //  vector register is broadcast into one and written with wide (and
+    //  optionally non-temporal) stores, anything else by repeatedly
+    //  doubling the filled prefix
+    static void fill_bytes(char *dst, size_t bytes,
+			   const void *pattern, size_t pattern_size,
+			   bool streaming)
+    {
+#if defined(__AVX__) || defined(__SSE2__)
+#ifdef __AVX__
+      typedef __m256i VT;
+#define REALM_VLOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define REALM_VSTORE(p, v) _mm256_store_si256((__m256i *)(p), (v))
+#define REALM_VSTREAM(p, v) _mm256_stream_si256((__m256i *)(p), (v))
+#else
+      typedef __m128i VT;
+#define REALM_VLOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define REALM_VSTORE(p, v) _mm_store_si128((__m128i *)(p), (v))
+#define REALM_VSTREAM(p, v) _mm_stream_si128((__m128i *)(p), (v))
+#endif
+      if(((sizeof(VT) % pattern_size) == 0) &&
+	 ((reinterpret_cast<uintptr_t>(dst) % pattern_size) == 0) &&
+	 (bytes >= 4 * sizeof(VT))) {
+	// whole patterns until the destination is vector-aligned
+	size_t head = ((sizeof(VT) - (reinterpret_cast<uintptr_t>(dst) % sizeof(VT))) %
+		       sizeof(VT));
+	for(size_t i = 0; i < head; i += pattern_size)
+	  memcpy(dst + i, pattern, pattern_size);
+	dst += head;
+	bytes -= head;
+
+	char rep[sizeof(VT)];
+	for(size_t i = 0; i < sizeof(VT); i += pattern_size)
+	  memcpy(rep + i, pattern, pattern_size);
+	VT v = REALM_VLOAD(rep);
+
+	if(streaming) {
+	  while(bytes >= 4 * sizeof(VT)) {
+	    REALM_VSTREAM(dst, v);
+	    REALM_VSTREAM(dst + sizeof(VT), v);
+	    REALM_VSTREAM(dst + 2 * sizeof(VT), v);
+	    REALM_VSTREAM(dst + 3 * sizeof(VT), v);
+	    dst += 4 * sizeof(VT);
+	    bytes -= 4 * sizeof(VT);
+	  }
+	} else {
+	  while(bytes >= 4 * sizeof(VT)) {
+	    REALM_VSTORE(dst, v);
+	    REALM_VSTORE(dst + sizeof(VT), v);
+	    REALM_VSTORE(dst + 2 * sizeof(VT), v);
+	    REALM_VSTORE(dst + 3 * sizeof(VT), v);
+	    dst += 4 * sizeof(VT);
+	    bytes -= 4 * sizeof(VT);
+	  }
+	}
+	while(bytes >= sizeof(VT)) {
+	  REALM_VSTORE(dst, v);
+	  dst += sizeof(VT);
+	  bytes -= sizeof(VT);
+	}
+	memcpy(dst, rep, bytes);
+	return;
+      }
+#undef REALM_VLOAD
+#undef REALM_VSTORE
+#undef REALM_VSTREAM
+#endif
+      size_t done = std::min(pattern_size, bytes);
+      memcpy(dst, pattern, done);
+      while(done < bytes) {
+	size_t n = std::min(done, bytes - done);
+	memcpy(dst + done, dst, n);
+	done += n;
+      }
+    }
+
+    // one (up to) 3-D block of a fill
+    struct FillBlockArgs {
+      char *base;
+      size_t bytes_per_line, num_lines, num_planes;
+      off_t line_stride, plane_stride;
+      const void *pattern;
+      size_t pattern_size;
+      bool streaming;
+    };
+
+    template <size_t BYTES>
+    static void fill_strided_fixed(char *base, size_t count, off_t stride,
+				   const void *pattern)
+    {
+      char val[BYTES];
+      memcpy(val, pattern, BYTES);
+      for(size_t i = 0; i < count; i++, base += stride)
+	memcpy(base, val, BYTES);
+    }
+
+    // fills part 'chunk' (of 'num_chunks') of a block - the block is divided
+    //  by planes if there are several, by lines if there are several, and
+    //  by (whole patterns') bytes otherwise
+    static void fill_block_chunk(const void *arg, size_t chunk, size_t num_chunks)
+    {
+      const FillBlockArgs *fb = static_cast<const FillBlockArgs *>(arg);
+      char *base = fb->base;
+      size_t bytes = fb->bytes_per_line;
+      size_t lines = fb->num_lines;
+      size_t planes = fb->num_planes;
+
+      if(planes > 1) {
+	size_t first = (planes * chunk) / num_chunks;
+	size_t last = (planes * (chunk + 1)) / num_chunks;
+	base += first * fb->plane_stride;
+	planes = last - first;
+      } else if(lines > 1) {
+	size_t first = (lines * chunk) / num_chunks;
+	size_t last = (lines * (chunk + 1)) / num_chunks;
+	base += first * fb->line_stride;
+	lines = last - first;
+      } else {
+	// keep pieces cache-line aligned and a whole number of patterns
+	size_t align = fb->pattern_size * 64;
+	size_t first = ((bytes * chunk) / num_chunks) / align * align;
+	size_t last = ((chunk + 1 == num_chunks) ?
+		         bytes :
+		         ((bytes * (chunk + 1)) / num_chunks) / align * align);
+	base += first;
+	bytes = last - first;
+      }
+
+      for(size_t p = 0; p < planes; p++) {
+	char *plane_base = base + (p * fb->plane_stride);
+	// lines of a single element (e.g. a field of an AOS instance) are
+	//  filled with one fixed-size store each
+	if((bytes == fb->pattern_size) && (lines > 1)) {
+	  bool done = true;
+	  switch(bytes) {
+	  case 1: fill_strided_fixed<1>(plane_base, lines, fb->line_stride, fb->pattern); break;
+	  case 2: fill_strided_fixed<2>(plane_base, lines, fb->line_stride, fb->pattern); break;
+	  case 4: fill_strided_fixed<4>(plane_base, lines, fb->line_stride, fb->pattern); break;
+	  case 8: fill_strided_fixed<8>(plane_base, lines, fb->line_stride, fb->pattern); break;
+	  case 16: fill_strided_fixed<16>(plane_base, lines, fb->line_stride, fb->pattern); break;
+	  default: done = false; break;
+	  }
+	  if(done) continue;
+	}
+	for(size_t l = 0; l < lines; l++)
+	  fill_bytes(plane_base + (l * fb->line_stride),
+		     bytes, fb->pattern, fb->pattern_size, fb->streaming);
+      }
+
+#if defined(__AVX__) || defined(__SSE2__)
+      if(fb->streaming)
+	_mm_sfence();
+#endif
+    }
+
+    // one (up to) 3-D block of a reduction - both sides have the same shape
+    //  in elements
+    struct ReduceBlockArgs {
+      char *dst;
+      const char *src;
+      size_t elems_per_line, num_lines, num_planes;
+      off_t dst_line_stride, src_line_stride;
+      off_t dst_plane_stride, src_plane_stride;
+      size_t dst_elem_size, src_elem_size;
+      const ReductionOpUntyped *redop;
+      bool fold;
+    };
+
+    // reduces part 'chunk' (of 'num_chunks') of a block, divided the same
+    //  way as a fill - lines holding a single element (e.g. a field of an
+    //  AOS instance) are handed to the strided form of the operator all at
+    //  once
+    static void reduce_block_chunk(const void *arg, size_t chunk, size_t num_chunks)
+    {
+      const ReduceBlockArgs *rb = static_cast<const ReduceBlockArgs *>(arg);
+      char *dst = rb->dst;
+      const char *src = rb->src;
+      size_t elems = rb->elems_per_line;
+      size_t lines = rb->num_lines;
+      size_t planes = rb->num_planes;
+
+      if(planes > 1) {
+	size_t first = (planes * chunk) / num_chunks;
+	size_t last = (planes * (chunk + 1)) / num_chunks;
+	dst += first * rb->dst_plane_stride;
+	src += first * rb->src_plane_stride;
+	planes = last - first;
+      } else if(lines > 1) {
+	size_t first = (lines * chunk) / num_chunks;
+	size_t last = (lines * (chunk + 1)) / num_chunks;
+	dst += first * rb->dst_line_stride;
+	src += first * rb->src_line_stride;
+	lines = last - first;
+      } else {
+	size_t first = (elems * chunk) / num_chunks;
+	size_t last = (elems * (chunk + 1)) / num_chunks;
+	dst += first * rb->dst_elem_size;
+	src += first * rb->src_elem_size;
+	elems = last - first;
+      }
+
+      for(size_t p = 0; p < planes; p++) {
+	char *d = dst + (p * rb->dst_plane_stride);
+	const char *s = src + (p * rb->src_plane_stride);
+	if((elems == 1) && (lines > 1)) {
+	  if(rb->fold)
+	    rb->redop->fold_strided(d, s, rb->dst_line_stride, rb->src_line_stride,
+				    lines, false /*!excl*/);
+	  else
+	    rb->redop->apply_strided(d, s, rb->dst_line_stride, rb->src_line_stride,
+				     lines, false /*!excl*/);
+	  continue;
+	}
+	for(size_t l = 0; l < lines; l++) {
+	  if(rb->fold)
+	    rb->redop->fold(d, s, elems, false /*!excl*/);
+	  else
+	    rb->redop->apply(d, s, elems, false /*!excl*/);
+	  d += rb->dst_line_stride;
+	  s += rb->src_line_stride;
+	}
+      }
+    }
+
+    // returns a pointer to the whole of a block if the memory can be
+    //  accessed directly by the CPU, or 0 otherwise
+    static void *get_block_ptr(MemoryImpl *mem,
+			       const TransferIterator::AddressInfo& info)
+    {
+      if(mem->kind == MemoryImpl::MKIND_GPUFB)
+	return 0;
+      size_t extent = (((info.num_planes - 1) * info.plane_stride) +
+		       ((info.num_lines - 1) * info.line_stride) +
+		       info.bytes_per_chunk);
+      return mem->get_direct_ptr(info.base_offset, extent);
+    }
+
     void ReduceRequest::perform_dma(void)
     {
       log_dma.debug("request %p executing", this);
@@ -2142,9 +3446,65 @@ namespace Realm {
       size_t src_scratch_size = 0;
       size_t dst_scratch_size = 0;
 
+      // when both sides can be accessed directly, whole 2D/3D blocks are
+      //  reduced at once (as long as the two sides agree on the shape)
+      bool try_blocks = !dst_is_remote;
+
       while(!src_iter->done()) {
 	TransferIterator::AddressInfo src_info, dst_info;
 
+	if(try_blocks) {
+	  unsigned flags = (TransferIterator::LINES_OK |
+			    TransferIterator::PLANES_OK);
+	  size_t src_bytes = src_iter->step(size_t(-1), src_info, flags,
+					    true /*tentative*/);
+	  size_t num_elems = src_bytes / src_elem_size;
+	  size_t exp_dst_bytes = num_elems * redop->sizeof_rhs;
+	  size_t dst_bytes = dst_iter->step(exp_dst_bytes, dst_info, flags,
+					    true /*tentative*/);
+	  if((dst_bytes == exp_dst_bytes) &&
+	     (dst_info.num_lines == src_info.num_lines) &&
+	     (dst_info.num_planes == src_info.num_planes) &&
+	     ((dst_info.bytes_per_chunk / redop->sizeof_rhs) ==
+	      (src_info.bytes_per_chunk / src_elem_size))) {
+	    void *src_ptr = get_block_ptr(src_mem, src_info);
+	    void *dst_ptr = get_block_ptr(dst_mem, dst_info);
+	    if(src_ptr && dst_ptr) {
+	      src_iter->confirm_step();
+	      dst_iter->confirm_step();
+
+	      ReduceBlockArgs rb;
+	      rb.dst = static_cast<char *>(dst_ptr);
+	      rb.src = static_cast<const char *>(src_ptr);
+	      rb.elems_per_line = src_info.bytes_per_chunk / src_elem_size;
+	      rb.num_lines = src_info.num_lines;
+	      rb.num_planes = src_info.num_planes;
+	      rb.dst_line_stride = dst_info.line_stride;
+	      rb.src_line_stride = src_info.line_stride;
+	      rb.dst_plane_stride = dst_info.plane_stride;
+	      rb.src_plane_stride = src_info.plane_stride;
+	      rb.dst_elem_size = redop->sizeof_rhs;
+	      rb.src_elem_size = src_elem_size;
+	      rb.redop = redop;
+	      rb.fold = red_fold;
+	      size_t units = ((rb.num_planes > 1) ? rb.num_planes :
+			      (rb.num_lines > 1) ? rb.num_lines :
+			      (rb.elems_per_line >> 10));
+	      perform_block_job(dst_mem, dst_bytes,
+				reduce_block_chunk, &rb, units);
+
+	      total_bytes += dst_bytes;
+	      continue;
+	    }
+
+	    // not directly accessible - no point trying again
+	    try_blocks = false;
+	  }
+	  // fall back to 1-D steps for this part
+	  src_iter->cancel_step();
+	  dst_iter->cancel_step();
+	}
+
 	size_t max_bytes = (size_t)-1;
 	size_t src_bytes = src_iter->step(max_bytes, src_info, 0,
 					  true /*tentative*/);
@@ -2523,45 +3883,33 @@ namespace Realm {
 #ifdef USE_HDF
       // fills of an HDF5 instance are also handled specially
       if (mem_impl->lowlevel_kind == Memory::HDF_MEM) {
-	hid_t file_id = -1;
-	hid_t dset_id = -1;
-	hid_t dtype_id = -1;
-	const std::string *prev_filename = 0;
-	const std::string *prev_dsetname = 0;
+	// all of this is libhdf5 calls
+	AutoHSLLock al(HDF5::hdf5_lock);
+
 	while(!iter->done()) {
 	  TransferIterator::AddressInfoHDF5 info;
 	  size_t act_bytes = iter->step(size_t(-1), // max_bytes
 					info);
 	  assert(act_bytes >= 0);
 
-	  // compare the pointers, not the string contents...
-	  if(info.filename != prev_filename) {
-	    // close dataset too
-	    if(dset_id != -1) {
-	      CHECK_HDF5( H5Tclose(dtype_id) );
-	      CHECK_HDF5( H5Dclose(dset_id) );
-	      prev_dsetname = 0;
-	    }
-	    if(file_id != -1)
-	      CHECK_HDF5( H5Fclose(file_id) );
-
-	    CHECK_HDF5( file_id = H5Fopen(info.filename->c_str(),
-					  H5F_ACC_RDWR, H5P_DEFAULT) );
-	    prev_filename = info.filename;
-	  }
-
-	  if(info.dsetname != prev_dsetname) {
-	    if(dset_id != -1) {
-	      CHECK_HDF5( H5Tclose(dtype_id) );
-	      CHECK_HDF5( H5Dclose(dset_id) );
-	    }
-	    CHECK_HDF5( dset_id = H5Dopen2(file_id, info.dsetname->c_str(),
-					   H5P_DEFAULT) );
-	    CHECK_HDF5( dtype_id = H5Dget_type(dset_id) );
-	    size_t dtype_size = H5Tget_size(dtype_id);
-	    assert(dtype_size == fill_size);
-	    prev_dsetname = info.dsetname;
+	  // the file and dataset stay open (in the handle cache) for later
+	  //  fills and copies
+	  HDF5::HDF5Dataset *dset;
+	  while(true) {
+	    dset = HDF5::hdf5_handle_cache.open_dataset(*info.filename,
+							*info.dsetname,
+							info.read_only,
+							dst.inst);
+	    if(dset) break;
+	    // the file is being reopened for writing, which has to wait for
+	    //  in-flight transfers to release it
+	    al.release();
+	    Thread::yield();
+	    al.reacquire();
 	  }
+	  assert(dset->elem_size == fill_size);
+	  hid_t dset_id = dset->dset_id;
+	  hid_t dtype_id = dset->dtype_id;
 
 	  // HDF5 doesn't seem to offer a way to fill a file without building
 	  //  an equivalently-sized memory buffer first, so just do point-wise
@@ -2595,15 +3943,10 @@ namespace Realm {
 
 	  CHECK_HDF5( H5Sclose(mem_space_id) );
 	  CHECK_HDF5( H5Sclose(file_space_id) );
-	}
 
-	// close the last dset and file we touched
-	if(dset_id != -1) {
-	  CHECK_HDF5( H5Tclose(dtype_id) );
-	  CHECK_HDF5( H5Dclose(dset_id) );
+	  HDF5::hdf5_handle_cache.flush_file(*info.filename);
+	  HDF5::hdf5_handle_cache.release_dataset(dset);
 	}
-	if(file_id != -1)
-	  CHECK_HDF5( H5Fclose(file_id) );
       }
 #endif
 
@@ -2617,6 +3960,27 @@ namespace Realm {
 	size_t act_bytes = iter->step(max_bytes, info, flags);
 	assert(act_bytes >= 0);
 
+	// if we can get at the memory directly, fill the whole block in place
+	void *block_ptr = get_block_ptr(mem_impl, info);
+	if(block_ptr) {
+	  FillBlockArgs fb;
+	  fb.base = static_cast<char *>(block_ptr);
+	  fb.bytes_per_line = info.bytes_per_chunk;
+	  fb.num_lines = info.num_lines;
+	  fb.num_planes = info.num_planes;
+	  fb.line_stride = info.line_stride;
+	  fb.plane_stride = info.plane_stride;
+	  fb.pattern = fill_buffer;
+	  fb.pattern_size = fill_size;
+	  fb.streaming = ((Config::fill_nt_threshold > 0) &&
+			  (act_bytes >= Config::fill_nt_threshold));
+	  size_t units = ((fb.num_planes > 1) ? fb.num_planes :
+			  (fb.num_lines > 1) ? fb.num_lines :
+			  (fb.bytes_per_line >> 12));
+	  perform_block_job(mem_impl, act_bytes, fill_block_chunk, &fb, units);
+	  continue;
+	}
+
 	// decide whether to use the original fill buffer or one that
 	//  repeats the data several times
 	const void *use_buffer = fill_buffer;
@@ -2787,9 +4151,27 @@ namespace Realm {
                           CoreReservationSet& crs)
     {
       //log_dma.add_stream(&std::cerr, Logger::LEVEL_DEBUG, false, false);
-      aio_context = new AsyncFileIOContext(256);
+      aio_context = new AsyncFileIOContext(Config::aio_queue_depth,
+					   Config::use_io_uring);
+      if(Config::io_uring_register_buffers) {
+	// local CPU-addressable memories are what file/disk transfers read
+	//  into and write out of
+	std::vector<std::pair<void *, size_t> > ranges;
+	const std::vector<MemoryImpl *>& local_mems = get_runtime()->nodes[my_node_id].memories;
+	for(std::vector<MemoryImpl *>::const_iterator it = local_mems.begin();
+	    it != local_mems.end();
+	    ++it)
+	  if((*it)->kind == MemoryImpl::MKIND_SYSMEM) {
+	    void *base = (*it)->get_direct_ptr(0, (*it)->size);
+	    if(base)
+	      ranges.push_back(std::make_pair(base, (*it)->size));
+	  }
+	aio_context->register_buffers(ranges);
+      }
       start_channel_manager(count, pinned, max_nr, crs);
       ib_req_queue = new PendingIBQueue();
+      if(Config::copy_plan_cache_size > 0)
+	copy_plan_cache = new CopyPlanCache(Config::copy_plan_cache_size);
     }
 
     void stop_dma_system(void)
@@ -2797,6 +4179,8 @@ namespace Realm {
       stop_channel_manager();
       delete ib_req_queue;
       ib_req_queue = 0;
+      delete copy_plan_cache;
+      copy_plan_cache = 0;
       delete aio_context;
       aio_context = 0;
     }
@@ -28,6 +28,41 @@
 namespace Realm {
   class CoreReservationSet;
 
+  namespace Config {
+    // if true (and supported), async file I/O uses io_uring rather than
+    //  kernel AIO/POSIX AIO
+    extern bool use_io_uring;
+
+    // if true, the io_uring instance uses a kernel thread to poll for new
+    //  submissions, avoiding a syscall per batch
+    extern bool io_uring_sqpoll;
+
+    // if true, the io_uring instance registers (and therefore pins) all
+    //  local system memories as fixed I/O buffers at startup
+    extern bool io_uring_register_buffers;
+
+    // maximum number of file I/O operations in flight at once
+    extern int aio_queue_depth;
+
+    // maximum number of copy plans (memory path and address lists for a
+    //  copy between a given pair of instances) remembered so that repeated
+    //  copies skip planning (0 = disabled)
+    extern int copy_plan_cache_size;
+
+    // copies whose source or destination has more pieces than this keep
+    //  only their memory path in the cache
+    extern size_t copy_plan_max_pieces;
+
+    // intermediate buffer memories are carved into chunks of this size
+    //  that multi-hop copies lease (one or more at a time) instead of
+    //  allocating a buffer sized to the copy (0 = disabled)
+    extern size_t ib_chunk_size;
+
+    // blocks of a fill of at least this many bytes are written with
+    //  non-temporal (streaming) stores that bypass the cache (0 = never)
+    extern size_t fill_nt_threshold;
+  };
+
     struct RemoteIBAllocRequestAsync {
       struct RequestArgs {
         int node;
@@ -276,6 +311,11 @@ namespace Realm {
 
     class TransferDomain;
     class TransferIterator;
+    class CopyPlan;
+
+    // drops any cached copy plans that use 'inst' - must be called before
+    //  the instance's storage is released
+    void invalidate_copy_plans(RegionInstance inst);
 
     // dma requests come in two flavors:
     // 1) CopyRequests, which are per memory pair, and
@@ -333,6 +373,10 @@ namespace Realm {
       std::vector<Memory> mem_path;
       // </NEW_DMA>
 
+      // cached plan for this copy (if any), held until the request is
+      //  destroyed
+      CopyPlan *plan;
+
       Event before_copy;
       Waiter waiter; // if we need to wait on events
     };
@@ -452,16 +496,29 @@ namespace Realm {
     };
 
     class Request;
+#ifdef REALM_USE_IO_URING
+    class IOUringQueue;
+#endif
 
     class AsyncFileIOContext {
     public:
-      AsyncFileIOContext(int _max_depth);
+      AsyncFileIOContext(int _max_depth, bool _use_io_uring = false);
       ~AsyncFileIOContext(void);
 
       void enqueue_write(int fd, size_t offset, size_t bytes, const void *buffer, Request* req = NULL);
       void enqueue_read(int fd, size_t offset, size_t bytes, void *buffer, Request* req = NULL);
       void enqueue_fence(DmaRequest *req);
 
+      // hands any enqueued operations that are batched up (io_uring only) to
+      //  the kernel - callers should do this after enqueueing a group of
+      //  operations
+      void flush(void);
+
+      // tells the io_uring backend about memory that will be used as I/O
+      //  buffers so that the kernel can pin it once rather than on every
+      //  operation - ignored by the other backends
+      void register_buffers(const std::vector<std::pair<void *, size_t> >& ranges);
+
       bool empty(void);
       long available(void);
       void make_progress(void);
@@ -482,6 +539,9 @@ namespace Realm {
       GASNetHSL mutex;
 #ifdef REALM_USE_KERNEL_AIO
       aio_context_t aio_ctx;
+#endif
+#ifdef REALM_USE_IO_URING
+      IOUringQueue *uring;  // 0 if not in use
 #endif
     };
 };
@@ -1023,6 +1023,13 @@ namespace Realm {
     size_t extra_elems;
     bool tentative_valid;
     int dim_order[N];
+    // layout of the current field and the last piece used, cached so that
+    //  stepping through many small rectangles doesn't redo the lookups
+    size_t cached_field_idx;
+    const InstancePieceList<N,T> *cached_piece_list;
+    int cached_rel_offset;
+    size_t cached_field_size;
+    const InstanceLayoutPiece<N,T> *prev_piece;
   };
 
   template <int N, typename T>
@@ -1032,6 +1039,7 @@ namespace Realm {
 								const std::vector<FieldID>& _fields,
 								size_t _extra_elems)
     : is(_is), field_idx(0), extra_elems(_extra_elems), tentative_valid(false)
+    , cached_field_idx((size_t)-1), prev_piece(0)
   {
     for(int i = 0; i < N; i++) dim_order[i] = _dim_order[i];
 
@@ -1059,6 +1067,8 @@ namespace Realm {
     : iter_init_deferred(false)
     , field_idx(0)
     , tentative_valid(false)
+    , cached_field_idx((size_t)-1)
+    , prev_piece(0)
   {}
 
   template <int N, typename T>
@@ -1150,14 +1160,24 @@ namespace Realm {
     size_t field_size;
     size_t total_bytes = 0;
     {
-      std::map<FieldID, InstanceLayoutGeneric::FieldLayout>::const_iterator it = inst_layout->fields.find(fields[field_idx]);
-      assert(it != inst_layout->fields.end());
-      const InstancePieceList<N,T>& piece_list = inst_layout->piece_lists[it->second.list_idx];
-      layout_piece = piece_list.find_piece(cur_point);
-      assert(layout_piece != 0);
-      field_rel_offset = it->second.rel_offset;
-      field_size = it->second.size_in_bytes;
-      //log_dma.print() << "F " << field_idx << " " << fields[field_idx] << " : " << it->second.list_idx << " " << field_rel_offset << " " << field_size;
+      if(field_idx != cached_field_idx) {
+	std::map<FieldID, InstanceLayoutGeneric::FieldLayout>::const_iterator it = inst_layout->fields.find(fields[field_idx]);
+	assert(it != inst_layout->fields.end());
+	cached_piece_list = &(inst_layout->piece_lists[it->second.list_idx]);
+	cached_rel_offset = it->second.rel_offset;
+	cached_field_size = it->second.size_in_bytes;
+	cached_field_idx = field_idx;
+	prev_piece = 0;
+	//log_dma.print() << "F " << field_idx << " " << fields[field_idx] << " : " << it->second.list_idx << " " << cached_rel_offset << " " << cached_field_size;
+      }
+      layout_piece = prev_piece;
+      if(!layout_piece || !layout_piece->bounds.contains(cur_point)) {
+	layout_piece = cached_piece_list->find_piece(cur_point);
+	assert(layout_piece != 0);
+	prev_piece = layout_piece;
+      }
+      field_rel_offset = cached_rel_offset;
+      field_size = cached_field_size;
     }
 
     size_t max_elems = max_bytes / field_size;
@@ -1329,6 +1349,7 @@ namespace Realm {
 
       info.filename = &hlp->filename;
       info.dsetname = &hlp->dsetname;
+      info.read_only = hlp->read_only;
 
       bool grow = true;
       cur_bytes = field_size;
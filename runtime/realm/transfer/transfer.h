@@ -67,6 +67,7 @@ namespace Realm {
       //hid_t dtype_id;
       const std::string *filename;
       const std::string *dsetname;
+      bool read_only;  // instance was attached read-only
       std::vector<hsize_t> dset_bounds;
       std::vector<hsize_t> offset; // start location in dataset
       std::vector<hsize_t> extent; // xfer dimensions in memory and dataset
@@ -208,6 +208,12 @@ ifeq ($(strip $(USE_OPENMP)),1)
   endif
 endif
 
+# per-priority-level locking for ready task queues
+REALM_SHARDED_TASK_QUEUES ?= 0
+ifeq ($(strip $(REALM_SHARDED_TASK_QUEUES)),1)
+  CC_FLAGS += -DREALM_SHARDED_TASK_QUEUES
+endif
+
 USE_PYTHON ?= 0
 ifeq ($(strip $(USE_PYTHON)),1)
   ifneq ($(strip $(USE_LIBDL)),1)
@@ -0,0 +1,200 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// active message ping-pong benchmark between two ranks - measures:
+//  - latency: the round trip of spawning an empty task on the other rank
+//     and waiting for it to finish (a spawn message there, and an event
+//     subscription/trigger back)
+//  - bandwidth: a stream of task spawns whose arguments carry a payload of
+//     increasing size, all in flight at once
+//  - loaded latency: the same round trip while the other rank floods this
+//     one with large task spawns - the completion events come back through
+//     the active message fast lane instead of waiting behind the spawn
+//     handlers (compare with the "nofast" RUNMODE, which disables it)
+//
+// without GASNet, run it with two shared memory ranks (-ll:shm_ranks 2, the
+//  default RUNMODE in the Makefile)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <vector>
+#include <set>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  int iterations = 1000;   // round trips for the latency test
+  int messages = 64;       // messages per payload size for the bandwidth test
+  size_t min_size = 64;
+  size_t max_size = 4 << 20;
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+  PONG_TASK,
+  SINK_TASK,
+  FLOOD_TASK,
+};
+
+struct FloodArgs {
+  Processor target;
+  int count;
+  size_t size;
+};
+
+Logger log_app("app");
+
+void pong_task(const void *args, size_t arglen,
+	       const void *userdata, size_t userlen, Processor p)
+{
+  // nothing to do - the reply is the task's completion
+}
+
+void sink_task(const void *args, size_t arglen,
+	       const void *userdata, size_t userlen, Processor p)
+{
+  // touch the payload so it can't be optimized away
+  volatile char c = ((const char *)args)[arglen - 1];
+  (void)c;
+}
+
+void flood_task(const void *args, size_t arglen,
+		const void *userdata, size_t userlen, Processor p)
+{
+  const FloodArgs& fargs = *(const FloodArgs *)args;
+  std::vector<char> payload(fargs.size, 1);
+  std::set<Event> events;
+  for(int i = 0; i < fargs.count; i++)
+    events.insert(fargs.target.spawn(SINK_TASK, &payload[0], fargs.size));
+  Event::merge_events(events).wait();
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  // find a processor on another rank
+  Processor remote = Processor::NO_PROC;
+  {
+    Machine::ProcessorQuery pq(Machine::get_machine());
+    pq.only_kind(Processor::LOC_PROC);
+    for(Machine::ProcessorQuery::iterator it = pq.begin(); it != pq.end(); ++it)
+      if((*it).address_space() != p.address_space()) {
+	remote = *it;
+	break;
+      }
+  }
+  if(!remote.exists()) {
+    log_app.error() << "no processor on another rank - run with two ranks (e.g. -ll:shm_ranks 2)";
+    exit(1);
+  }
+
+  log_app.print() << "am ping-pong: " << p << " (rank " << p.address_space()
+		  << ") <-> " << remote << " (rank " << remote.address_space() << ")";
+
+  // latency - warm up first
+  for(int i = 0; i < 10; i++)
+    remote.spawn(PONG_TASK, 0, 0).wait();
+  {
+    long long t_start = Clock::current_time_in_nanoseconds();
+    for(int i = 0; i < TestConfig::iterations; i++)
+      remote.spawn(PONG_TASK, 0, 0).wait();
+    long long t_end = Clock::current_time_in_nanoseconds();
+    log_app.print() << "  latency: " << (1e-3 * (t_end - t_start) / TestConfig::iterations)
+		    << " us per round trip (" << TestConfig::iterations << " iterations)";
+  }
+
+  // bandwidth
+  std::vector<char> payload(TestConfig::max_size);
+  for(size_t i = 0; i < payload.size(); i++)
+    payload[i] = i;
+  for(size_t size = TestConfig::min_size; size <= TestConfig::max_size; size <<= 2) {
+    long long t_start = Clock::current_time_in_nanoseconds();
+    std::set<Event> events;
+    for(int i = 0; i < TestConfig::messages; i++)
+      events.insert(remote.spawn(SINK_TASK, &payload[0], size));
+    Event::merge_events(events).wait();
+    long long t_end = Clock::current_time_in_nanoseconds();
+    double bytes = (double)size * TestConfig::messages;
+    log_app.print() << "  bandwidth: " << size << " B x " << TestConfig::messages << ": "
+		    << (bytes / (t_end - t_start)) << " GB/s, "
+		    << (1e-3 * (t_end - t_start) / TestConfig::messages) << " us per message";
+  }
+
+  // loaded latency - ping while the other rank floods us with the largest
+  //  payloads
+  {
+    FloodArgs fargs;
+    fargs.target = p;
+    fargs.count = TestConfig::messages;
+    fargs.size = TestConfig::max_size;
+    Event e_flood = remote.spawn(FLOOD_TASK, &fargs, sizeof(fargs));
+    int count = 0;
+    long long t_start = Clock::current_time_in_nanoseconds();
+    while((count < 10) || !e_flood.has_triggered()) {
+      remote.spawn(PONG_TASK, 0, 0).wait();
+      count++;
+    }
+    long long t_end = Clock::current_time_in_nanoseconds();
+    e_flood.wait();
+    log_app.print() << "  loaded latency: " << (1e-3 * (t_end - t_start) / count)
+		    << " us per round trip (" << count << " iterations)";
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_int("-iters", TestConfig::iterations)
+    .add_option_int("-msgs", TestConfig::messages)
+    .add_option_int("-minsize", TestConfig::min_size)
+    .add_option_int("-maxsize", TestConfig::max_size);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+  r.register_task(PONG_TASK, pong_task);
+  r.register_task(SINK_TASK, sink_task);
+  r.register_task(FLOOD_TASK, flood_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
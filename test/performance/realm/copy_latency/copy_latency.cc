@@ -0,0 +1,185 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// mixed-workload copy latency benchmark - measures the latency of small
+//  copies (think halo exchanges) issued one at a time, first on an idle
+//  DMA system and then while a stream of large copies keeps the same
+//  channel busy, and reports the median and tail latencies
+//
+// run with the different RUNMODEs in the Makefile to compare the fair
+//  (round-robin with a per-turn byte quantum) scheduling of transfers with
+//  the plain priority-order scheduling - how busy the channel is over time
+//  is visible through the "realm/channel 0:memcpy" gauges when the sampling
+//  profiler is enabled (e.g. -realm:prof 1), and can be drawn alongside a
+//  Legion Prof timeline with legion_prof.py -r realmprof_0.dat
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <vector>
+#include <algorithm>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  int small_copies = 1000;
+  int small_elements = 512;      // 4KB of doubles
+  int large_elements = 16 << 20; // 128MB of doubles
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+};
+
+Logger log_app("app");
+
+static void report(const char *label, std::vector<long long>& latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  size_t n = latencies.size();
+  log_app.print() << label << ": small copy latency (us):"
+		  << " p50=" << (1e-3 * latencies[n / 2])
+		  << " p99=" << (1e-3 * latencies[(n * 99) / 100])
+		  << " max=" << (1e-3 * latencies[n - 1]);
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  Memory m = Machine::MemoryQuery(Machine::get_machine())
+    .only_kind(Memory::SYSTEM_MEM)
+    .has_affinity_to(p)
+    .first();
+  assert(m.exists());
+
+  std::vector<size_t> field_sizes(1, sizeof(double));
+
+  IndexSpace<1> small_is(Rect<1>(0, TestConfig::small_elements - 1));
+  RegionInstance small_src, small_dst;
+  RegionInstance::create_instance(small_src, m, small_is, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+  RegionInstance::create_instance(small_dst, m, small_is, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+
+  IndexSpace<1> large_is(Rect<1>(0, TestConfig::large_elements - 1));
+  RegionInstance large_src, large_dst;
+  RegionInstance::create_instance(large_src, m, large_is, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+  RegionInstance::create_instance(large_dst, m, large_is, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+
+  std::vector<CopySrcDstField> small_srcs(1), small_dsts(1);
+  small_srcs[0].set_field(small_src, 0, sizeof(double));
+  small_dsts[0].set_field(small_dst, 0, sizeof(double));
+  std::vector<CopySrcDstField> large_srcs(1), large_dsts(1);
+  large_srcs[0].set_field(large_src, 0, sizeof(double));
+  large_dsts[0].set_field(large_dst, 0, sizeof(double));
+
+  // touch everything once so page faults aren't part of the measurement
+  double fill_val = 1.0;
+  small_is.fill(small_srcs, ProfilingRequestSet(), &fill_val, sizeof(fill_val)).wait();
+  large_is.fill(large_srcs, ProfilingRequestSet(), &fill_val, sizeof(fill_val)).wait();
+  large_is.copy(large_srcs, large_dsts, ProfilingRequestSet()).wait();
+
+  std::vector<long long> latencies(TestConfig::small_copies);
+  for(int i = 0; i < TestConfig::small_copies; i++) {
+    long long t_start = Clock::current_time_in_nanoseconds();
+    small_is.copy(small_srcs, small_dsts, ProfilingRequestSet()).wait();
+    latencies[i] = Clock::current_time_in_nanoseconds() - t_start;
+  }
+  report("idle", latencies);
+
+  // now again with a chain of large copies keeping the channel busy - two
+  //  are kept in flight so that there's always one waiting
+  int large_copies = 0;
+  Event prev_large = Event::NO_EVENT;
+  Event last_large = Event::NO_EVENT;
+  long long t_bg_start = Clock::current_time_in_nanoseconds();
+  for(int i = 0; i < TestConfig::small_copies; i++) {
+    while(prev_large.has_triggered()) {
+      prev_large = last_large;
+      last_large = large_is.copy(large_srcs, large_dsts,
+				 ProfilingRequestSet(), last_large);
+      large_copies++;
+    }
+
+    long long t_start = Clock::current_time_in_nanoseconds();
+    small_is.copy(small_srcs, small_dsts, ProfilingRequestSet()).wait();
+    latencies[i] = Clock::current_time_in_nanoseconds() - t_start;
+  }
+  last_large.wait();
+  long long t_bg_end = Clock::current_time_in_nanoseconds();
+  report("busy", latencies);
+
+  double bytes = (double)large_copies * TestConfig::large_elements * sizeof(double);
+  log_app.print() << "background: " << large_copies << " large copies, "
+		  << (bytes / (t_bg_end - t_bg_start)) << " GB/s";
+
+  // make sure the copies did something
+  {
+    AffineAccessor<double, 1> acc(small_dst, 0);
+    for(PointInRectIterator<1,int> pir(small_is.bounds); pir.valid; pir.step())
+      if(acc[pir.p] != fill_val) {
+	log_app.error() << "mismatch at " << pir.p;
+	exit(1);
+      }
+  }
+
+  small_src.destroy();
+  small_dst.destroy();
+  large_src.destroy();
+  large_dst.destroy();
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_int("-small", TestConfig::small_copies)
+    .add_option_int("-smallsize", TestConfig::small_elements)
+    .add_option_int("-largesize", TestConfig::large_elements);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
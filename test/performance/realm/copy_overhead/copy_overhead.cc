@@ -0,0 +1,176 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// copy issue overhead benchmark - an "iterative application" that issues
+//  the same small copy between the same pair of instances over and over,
+//  so the time per copy is almost entirely the runtime's cost of setting
+//  up and retiring a copy rather than moving data
+//
+// the copies are issued both as a dependent chain (each waits for the
+//  previous, which measures latency) and all at once (which measures
+//  throughput) - run with the different RUNMODEs in the Makefile to
+//  compare with and without the copy plan cache
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <vector>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  int num_copies = 10000;
+  int elements = 64;
+  int pieces = 1;   // > 1 makes the index space sparse
+  int fields = 1;
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+};
+
+Logger log_app("app");
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  Memory m = Machine::MemoryQuery(Machine::get_machine())
+    .only_kind(Memory::SYSTEM_MEM)
+    .has_affinity_to(p)
+    .first();
+  assert(m.exists());
+
+  // 'pieces' equal pieces with a one-element gap between each
+  std::vector<Rect<1> > rects;
+  for(int i = 0; i < TestConfig::pieces; i++)
+    rects.push_back(Rect<1>(i * (TestConfig::elements + 1),
+			    i * (TestConfig::elements + 1) + TestConfig::elements - 1));
+  IndexSpace<1> is(rects);
+
+  std::vector<size_t> field_sizes(TestConfig::fields, sizeof(double));
+  RegionInstance inst_src, inst_dst;
+  RegionInstance::create_instance(inst_src, m, is.bounds, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+  RegionInstance::create_instance(inst_dst, m, is.bounds, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+
+  std::vector<CopySrcDstField> srcs(TestConfig::fields), dsts(TestConfig::fields);
+  for(int i = 0; i < TestConfig::fields; i++) {
+    srcs[i].set_field(inst_src, i, sizeof(double));
+    dsts[i].set_field(inst_dst, i, sizeof(double));
+  }
+
+  for(int i = 0; i < TestConfig::fields; i++) {
+    AffineAccessor<double, 1> acc(inst_src, i);
+    for(PointInRectIterator<1,int> pir(is.bounds); pir.valid; pir.step())
+      acc[pir.p] = pir.p.x + (1000000.0 * i);
+  }
+
+  // warm up (and populate any caches)
+  is.copy(srcs, dsts, ProfilingRequestSet()).wait();
+
+  // dependent chain
+  double chain_us;
+  {
+    long long t_start = Clock::current_time_in_nanoseconds();
+    Event e = Event::NO_EVENT;
+    for(int i = 0; i < TestConfig::num_copies; i++)
+      e = is.copy(srcs, dsts, ProfilingRequestSet(), e);
+    e.wait();
+    long long t_end = Clock::current_time_in_nanoseconds();
+    chain_us = 1e-3 * (t_end - t_start) / TestConfig::num_copies;
+  }
+
+  // independent copies (all of the same data, so the order doesn't matter)
+  double issue_us, total_us;
+  {
+    std::vector<Event> events(TestConfig::num_copies);
+    long long t_start = Clock::current_time_in_nanoseconds();
+    for(int i = 0; i < TestConfig::num_copies; i++)
+      events[i] = is.copy(srcs, dsts, ProfilingRequestSet());
+    long long t_issued = Clock::current_time_in_nanoseconds();
+    Event::merge_events(events).wait();
+    long long t_end = Clock::current_time_in_nanoseconds();
+    issue_us = 1e-3 * (t_issued - t_start) / TestConfig::num_copies;
+    total_us = 1e-3 * (t_end - t_start) / TestConfig::num_copies;
+  }
+
+  log_app.print() << "copy overhead: " << TestConfig::num_copies << " copies of "
+		  << TestConfig::fields << " field(s), " << TestConfig::pieces
+		  << " piece(s) of " << TestConfig::elements << " elements";
+  log_app.print() << "  chained: " << chain_us << " us/copy";
+  log_app.print() << "  independent: issue = " << issue_us
+		  << " us/copy, complete = " << total_us << " us/copy";
+
+  // make sure the copies actually did something
+  int errors = 0;
+  for(int i = 0; i < TestConfig::fields; i++) {
+    AffineAccessor<double, 1> acc(inst_dst, i);
+    for(IndexSpaceIterator<1> isi(is); isi.valid; isi.step())
+      for(PointInRectIterator<1,int> pir(isi.rect); pir.valid; pir.step())
+	if(acc[pir.p] != (pir.p.x + (1000000.0 * i)))
+	  errors++;
+  }
+  if(errors > 0) {
+    log_app.error() << errors << " mismatched elements";
+    exit(1);
+  }
+
+  inst_src.destroy();
+  inst_dst.destroy();
+  is.destroy();
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_int("-copies", TestConfig::num_copies)
+    .add_option_int("-elements", TestConfig::elements)
+    .add_option_int("-pieces", TestConfig::pieces)
+    .add_option_int("-fields", TestConfig::fields);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// system memory page benchmark - measures runtime startup time and then the
+//  cost of random accesses to a large instance in SYSTEM_MEM, first while its
+//  pages are still being faulted in and then once they are all resident
+//
+// run with the different RUNMODEs in the Makefile to compare malloc'd,
+//  mmap'd, transparent huge page, prefaulted, and explicit huge page backing
+//  for the memory - TLB miss counts are reported when Realm is built with
+//  USE_PAPI=1
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  size_t size_in_mb = 1024;
+  int accesses = 1 << 24;
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+  ACCESS_TASK,
+  RESPONSE_TASK,
+};
+
+Logger log_app("app");
+
+struct AccessTaskArgs {
+  RegionInstance inst;
+  size_t elements;
+  int accesses;
+};
+
+struct ResponseArgs {
+  const char *label;
+  UserEvent done;
+};
+
+static long long init_time_us = 0;
+
+void access_task(const void *args, size_t arglen,
+		 const void *userdata, size_t userlen, Processor p)
+{
+  const AccessTaskArgs& ata = *(const AccessTaskArgs *)args;
+  AffineAccessor<long long, 1> acc(ata.inst, 0);
+
+  // cheap LCG so the random numbers don't cost more than the accesses
+  unsigned long long x = 12345;
+  for(int i = 0; i < ata.accesses; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    acc[(x >> 16) % ata.elements] += 1;
+  }
+}
+
+void response_task(const void *args, size_t arglen,
+		   const void *userdata, size_t userlen, Processor p)
+{
+  ProfilingResponse pr(args, arglen);
+  assert(pr.user_data_size() == sizeof(ResponseArgs));
+  const ResponseArgs& ra = *(const ResponseArgs *)(pr.user_data());
+
+  using namespace ProfilingMeasurements;
+
+  OperationTimeline timeline;
+  bool ok = pr.get_measurement(timeline);
+  assert(ok);
+  double ns_per_access = ((double)(timeline.end_time - timeline.start_time) /
+			  TestConfig::accesses);
+
+  TLBPerfCounters tlb;
+  if(pr.get_measurement(tlb))
+    log_app.print() << ra.label << ": " << ns_per_access << " ns/access, "
+		    << tlb.data_misses << " dTLB misses ("
+		    << ((double)tlb.data_misses / TestConfig::accesses)
+		    << "/access)";
+  else
+    log_app.print() << ra.label << ": " << ns_per_access << " ns/access"
+		    << " (TLB counters not available)";
+
+  ra.done.trigger();
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  log_app.print() << "runtime init: " << init_time_us << " us";
+
+  Memory m = Machine::MemoryQuery(Machine::get_machine())
+    .only_kind(Memory::SYSTEM_MEM)
+    .has_affinity_to(p)
+    .first();
+  assert(m.exists());
+
+  size_t elements = (TestConfig::size_in_mb << 20) / sizeof(long long);
+  IndexSpace<1> is(Rect<1>(0, elements - 1));
+  RegionInstance inst;
+  RegionInstance::create_instance(inst, m, is,
+				  std::vector<size_t>(1, sizeof(long long)),
+				  0 /*SOA*/,
+				  ProfilingRequestSet()).wait();
+  assert(inst.exists());
+
+  AccessTaskArgs ata;
+  ata.inst = inst;
+  ata.elements = elements;
+  ata.accesses = TestConfig::accesses;
+
+  // the first pass pays for faulting in any pages that weren't prefaulted,
+  //  the second sees only the TLB behavior of the backing page size
+  const char *labels[2] = { "first pass", "second pass" };
+  for(int i = 0; i < 2; i++) {
+    ResponseArgs ra;
+    ra.label = labels[i];
+    ra.done = UserEvent::create_user_event();
+
+    ProfilingRequestSet prs;
+    prs.add_request(p, RESPONSE_TASK, &ra, sizeof(ra))
+      .add_measurement<ProfilingMeasurements::OperationTimeline>()
+      .add_measurement<ProfilingMeasurements::TLBPerfCounters>();
+
+    p.spawn(ACCESS_TASK, &ata, sizeof(ata), prs).wait();
+    ra.done.wait();
+  }
+
+  inst.destroy();
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  // startup includes allocating (and possibly prefaulting) the memories
+  //  (absolute times, since init resets the clock's zero point)
+  long long t_start = Clock::current_time_in_microseconds(true /*absolute*/);
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+  init_time_us = Clock::current_time_in_microseconds(true /*absolute*/) - t_start;
+
+  CommandLineParser cp;
+  cp.add_option_int("-size", TestConfig::size_in_mb)
+    .add_option_int("-accesses", TestConfig::accesses);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+  r.register_task(ACCESS_TASK, access_task);
+  r.register_task(RESPONSE_TASK, response_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
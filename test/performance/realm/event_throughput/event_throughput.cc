@@ -21,6 +21,8 @@
 
 #include <time.h>
 
+#include <vector>
+
 #include <realm.h>
 
 using namespace Realm;
@@ -123,12 +125,52 @@ void construct_track(int levels, int fanout, Processor local, Event precondition
   receive_events.clear();
 }
 
+// measures the cost of merging a wide set of events: the time to build the
+//  merged event and the time from triggering the last input to the merged
+//  event being observed as triggered
+void merge_latency_test(int merge_width, int repeats)
+{
+  fprintf(stdout,"Running merge latency experiment with width %d (%d repeats)...\n",
+          merge_width, repeats);
+  fflush(stdout);
+
+  double total_merge = 0, total_trigger = 0;
+  for (int r = 0; r < repeats; r++)
+  {
+    std::vector<UserEvent> inputs(merge_width);
+    std::vector<Event> wait_for(merge_width);
+    for (int i = 0; i < merge_width; i++)
+    {
+      inputs[i] = UserEvent::create_user_event();
+      wait_for[i] = inputs[i];
+    }
+
+    double start, mid, stop;
+    start = Realm::Clock::current_time_in_microseconds();
+    Event merged = Event::merge_events(wait_for);
+    mid = Realm::Clock::current_time_in_microseconds();
+    for (int i = 0; i < merge_width; i++)
+      inputs[i].trigger();
+    merged.wait();
+    stop = Realm::Clock::current_time_in_microseconds();
+
+    total_merge += (mid - start);
+    total_trigger += (stop - mid);
+  }
+
+  fprintf(stdout,"Merge of %d: build %7.3f us, trigger-to-complete %7.3f us (%7.3f ns/input)\n",
+          merge_width, total_merge / repeats, total_trigger / repeats,
+          1000.0 * (total_merge + total_trigger) / (repeats * (double)merge_width));
+}
+
 void top_level_task(const void *args, size_t arglen, 
                     const void *userdata, size_t userlen, Processor p)
 {
   int levels = DEFAULT_LEVELS;
   int tracks = DEFAULT_TRACKS;
   int fanout = DEFAULT_FANOUT;
+  int merge_width = 0;
+  int merge_repeats = 10;
   // Parse the input arguments
 #define INT_ARG(argname, varname) do { \
         if(!strcmp((argv)[i], argname)) {		\
@@ -149,6 +191,8 @@ void top_level_task(const void *args, size_t arglen,
       INT_ARG("-l", levels);
       INT_ARG("-t", tracks);
       INT_ARG("-f", fanout);
+      INT_ARG("-merge", merge_width);
+      INT_ARG("-repeat", merge_repeats);
     }
     assert(levels > 0);
     assert(tracks > 0);
@@ -156,6 +200,12 @@ void top_level_task(const void *args, size_t arglen,
   }
 #undef INT_ARG
 #undef BOOL_ARG
+
+  if (merge_width > 0)
+  {
+    merge_latency_test(merge_width, merge_repeats);
+    return;
+  }
   
   // Make a user event that will be the trigger
   UserEvent start_event = UserEvent::create_user_event();
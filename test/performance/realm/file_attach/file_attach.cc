@@ -0,0 +1,270 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// attached file read benchmark - does what examples/attach_file does with its
+//  checkpoint file, but in the read direction: a file of doubles is attached
+//  as a read-only file instance and every element is read (summed) once,
+//  timing attach + read
+//
+// the data is always read by copying it into a system memory instance (the
+//  only option for unmapped file instances) - run with the "mmap" RUNMODE
+//  in the Makefile to also attach the file with a shared mapping and read it
+//  directly through an accessor with no copy at all
+//
+// the file is written just before it is read, so both paths read from the
+//  page cache
+//
+// before exiting, the file is cut to half its length and attached again -
+//  that must not be mapped (touching the missing half would raise SIGBUS),
+//  and the half that's still there must still be readable by a copy
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  std::string file_name = "file_attach.tmp";
+  int elements = 16 << 20; // 128MB of doubles
+  int rounds = 4;
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+};
+
+Logger log_app("app");
+
+static bool generate_file(const char *file_name, int num_elements)
+{
+  int fd = open(file_name, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  if(fd < 0) {
+    perror(file_name);
+    return false;
+  }
+
+  const size_t chunk = 1 << 20;
+  std::vector<double> buffer(chunk);
+  for(size_t ofs = 0; ofs < (size_t)num_elements; ofs += chunk) {
+    size_t count = std::min(chunk, num_elements - ofs);
+    for(size_t i = 0; i < count; i++)
+      buffer[i] = ofs + i;
+    ssize_t amt = write(fd, &buffer[0], count * sizeof(double));
+    if(amt != (ssize_t)(count * sizeof(double))) {
+      perror("write");
+      close(fd);
+      return false;
+    }
+  }
+
+  close(fd);
+  return true;
+}
+
+static double sum_instance(RegionInstance inst, const IndexSpace<1>& is)
+{
+  AffineAccessor<double, 1> acc(inst, 0);
+  double sum = 0;
+  for(PointInRectIterator<1,int> pir(is.bounds); pir.valid; pir.step())
+    sum += acc[pir.p];
+  return sum;
+}
+
+// attaches a file that is shorter than the instance covering it
+static bool check_truncated_attach(Memory m, const IndexSpace<1>& is)
+{
+  int half = TestConfig::elements / 2;
+  if(truncate(TestConfig::file_name.c_str(), half * sizeof(double)) < 0) {
+    perror("truncate");
+    return false;
+  }
+
+  std::vector<FieldID> field_ids(1, 0);
+  std::vector<size_t> field_sizes(1, sizeof(double));
+  RegionInstance file_inst, sys_inst;
+  RegionInstance::create_file_instance(file_inst,
+				       TestConfig::file_name.c_str(),
+				       is, field_ids, field_sizes,
+				       LEGION_FILE_READ_ONLY,
+				       ProfilingRequestSet()).wait();
+  bool ok = true;
+  if(file_inst.pointer_untyped(0, 0) != 0) {
+    log_app.error() << "truncated file was mapped";
+    ok = false;
+  }
+
+  // copy just the part of the file that still exists
+  IndexSpace<1> is_half(Rect<1>(0, half - 1));
+  RegionInstance::create_instance(sys_inst, m, is_half, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+  std::vector<CopySrcDstField> srcs(1), dsts(1);
+  srcs[0].set_field(file_inst, 0, sizeof(double));
+  dsts[0].set_field(sys_inst, 0, sizeof(double));
+  is_half.copy(srcs, dsts, ProfilingRequestSet()).wait();
+  double sum = sum_instance(sys_inst, is_half);
+  double expected = 0.5 * (double)half * (half - 1);
+  if(sum != expected) {
+    log_app.error() << "truncated file: sum = " << sum << ", expected " << expected;
+    ok = false;
+  }
+
+  file_inst.destroy();
+  sys_inst.destroy();
+  return ok;
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  Memory m = Machine::MemoryQuery(Machine::get_machine())
+    .only_kind(Memory::SYSTEM_MEM)
+    .has_affinity_to(p)
+    .first();
+  assert(m.exists());
+
+  bool ok = generate_file(TestConfig::file_name.c_str(), TestConfig::elements);
+  assert(ok);
+
+  IndexSpace<1> is(Rect<1>(0, TestConfig::elements - 1));
+  std::vector<FieldID> field_ids(1, 0);
+  std::vector<size_t> field_sizes(1, sizeof(double));
+
+  // sum of 0 .. n-1
+  double expected = 0.5 * (double)TestConfig::elements * (TestConfig::elements - 1);
+  double bytes = (double)TestConfig::elements * sizeof(double);
+
+  double best_copy_us = -1;
+  double best_direct_us = -1;
+  bool mapped = false;
+  for(int r = 0; r < TestConfig::rounds; r++) {
+    // current path: attach, copy into system memory, read that
+    {
+      long long t_start = Clock::current_time_in_nanoseconds();
+      RegionInstance file_inst, sys_inst;
+      RegionInstance::create_file_instance(file_inst,
+					   TestConfig::file_name.c_str(),
+					   is, field_ids, field_sizes,
+					   LEGION_FILE_READ_ONLY,
+					   ProfilingRequestSet()).wait();
+      RegionInstance::create_instance(sys_inst, m, is, field_sizes,
+				      0 /*SOA*/, ProfilingRequestSet()).wait();
+      std::vector<CopySrcDstField> srcs(1), dsts(1);
+      srcs[0].set_field(file_inst, 0, sizeof(double));
+      dsts[0].set_field(sys_inst, 0, sizeof(double));
+      is.copy(srcs, dsts, ProfilingRequestSet()).wait();
+      double sum = sum_instance(sys_inst, is);
+      long long t_end = Clock::current_time_in_nanoseconds();
+
+      if(sum != expected) {
+	log_app.error() << "copy path: sum = " << sum << ", expected " << expected;
+	exit(1);
+      }
+      double us = 1e-3 * (t_end - t_start);
+      if((best_copy_us < 0) || (us < best_copy_us))
+	best_copy_us = us;
+
+      file_inst.destroy();
+      sys_inst.destroy();
+    }
+
+    // mapped path: attach and read the file instance directly
+    {
+      long long t_start = Clock::current_time_in_nanoseconds();
+      RegionInstance file_inst;
+      RegionInstance::create_file_instance(file_inst,
+					   TestConfig::file_name.c_str(),
+					   is, field_ids, field_sizes,
+					   LEGION_FILE_READ_ONLY,
+					   ProfilingRequestSet()).wait();
+      mapped = (file_inst.pointer_untyped(0, 0) != 0);
+      if(mapped) {
+	double sum = sum_instance(file_inst, is);
+	long long t_end = Clock::current_time_in_nanoseconds();
+
+	if(sum != expected) {
+	  log_app.error() << "mapped path: sum = " << sum << ", expected " << expected;
+	  exit(1);
+	}
+	double us = 1e-3 * (t_end - t_start);
+	if((best_direct_us < 0) || (us < best_direct_us))
+	  best_direct_us = us;
+      }
+
+      file_inst.destroy();
+    }
+  }
+
+  log_app.print() << "file attach + read: " << TestConfig::elements << " elements";
+  log_app.print() << "  copy to sysmem: " << best_copy_us << " us ("
+		  << (1e-3 * bytes / best_copy_us) << " GB/s)";
+  if(mapped)
+    log_app.print() << "  direct (mmap): " << best_direct_us << " us ("
+		    << (1e-3 * bytes / best_direct_us) << " GB/s)";
+  else
+    log_app.print() << "  direct (mmap): not available (use -ll:file_mmap)";
+
+  ok = check_truncated_attach(m, is);
+  unlink(TestConfig::file_name.c_str());
+  if(!ok)
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_string("-file", TestConfig::file_name)
+    .add_option_int("-elements", TestConfig::elements)
+    .add_option_int("-rounds", TestConfig::rounds);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
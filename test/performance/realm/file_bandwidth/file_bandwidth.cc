@@ -0,0 +1,154 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// microbenchmark for AsyncFileIOContext - the async file I/O engine under
+//  the File/Disk channels - writes and then reads back a file with a sweep
+//  of request sizes and queue depths
+//
+// run with and without "-uring" (plus "-sqpoll" and/or "-regbufs") to
+//  compare the default backend with io_uring, and with "-direct" to bypass
+//  the page cache and measure the device rather than memcpy
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "realm/transfer/lowlevel_dma.h"
+#include "realm/timers.h"
+#include "realm/cmdline.h"
+
+using namespace Realm;
+
+namespace TestConfig {
+  std::string file_name = "file_bandwidth.tmp";
+  size_t size_in_mb = 256;
+  size_t min_req_size = 4 << 10;
+  size_t max_req_size = 1 << 20;
+  int min_depth = 1;
+  int max_depth = 64;
+  bool use_io_uring = false;
+  bool sqpoll = false;
+  bool register_buffers = false;
+  bool direct = false;
+};
+
+// issues the whole file as requests of 'req_size' with at most 'depth' in
+//  flight and returns the bandwidth in GB/s
+static double run_pass(AsyncFileIOContext *ctx, int fd, char *buffer,
+		       size_t total_bytes, size_t req_size, bool is_write)
+{
+  long long t_start = Clock::current_time_in_nanoseconds();
+
+  for(size_t ofs = 0; ofs < total_bytes; ofs += req_size) {
+    if(is_write)
+      ctx->enqueue_write(fd, ofs, req_size, buffer + ofs);
+    else
+      ctx->enqueue_read(fd, ofs, req_size, buffer + ofs);
+  }
+  ctx->flush();
+
+  while(!ctx->empty())
+    ctx->make_progress();
+
+  long long t_end = Clock::current_time_in_nanoseconds();
+  return ((double)total_bytes / (t_end - t_start));
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cp;
+  cp.add_option_string("-file", TestConfig::file_name)
+    .add_option_int("-size", TestConfig::size_in_mb)
+    .add_option_int("-minreq", TestConfig::min_req_size)
+    .add_option_int("-maxreq", TestConfig::max_req_size)
+    .add_option_int("-mindepth", TestConfig::min_depth)
+    .add_option_int("-maxdepth", TestConfig::max_depth)
+    .add_option_bool("-uring", TestConfig::use_io_uring)
+    .add_option_bool("-sqpoll", TestConfig::sqpoll)
+    .add_option_bool("-regbufs", TestConfig::register_buffers)
+    .add_option_bool("-direct", TestConfig::direct);
+  bool ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  Config::io_uring_sqpoll = TestConfig::sqpoll;
+
+  size_t total_bytes = TestConfig::size_in_mb << 20;
+  // O_DIRECT needs aligned buffers, offsets and sizes
+  char *buffer;
+  int ret = posix_memalign((void **)&buffer, 4096, total_bytes);
+  assert(ret == 0);
+  for(size_t i = 0; i < total_bytes; i++)
+    buffer[i] = (char)i;
+
+  int flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  if(TestConfig::direct)
+    flags |= O_DIRECT;
+#endif
+  int fd = open(TestConfig::file_name.c_str(), flags, 0666);
+  if(fd < 0) {
+    perror(TestConfig::file_name.c_str());
+    exit(1);
+  }
+  ret = ftruncate(fd, total_bytes);
+  assert(ret == 0);
+
+  printf("file I/O bandwidth (%s%s%s%s), %zd MB:\n",
+	 (TestConfig::use_io_uring ? "io_uring" : "default"),
+	 (TestConfig::sqpoll ? ", sqpoll" : ""),
+	 (TestConfig::register_buffers ? ", regbufs" : ""),
+	 (TestConfig::direct ? ", O_DIRECT" : ""),
+	 TestConfig::size_in_mb);
+
+  for(int depth = TestConfig::min_depth;
+      depth <= TestConfig::max_depth;
+      depth *= 4) {
+    AsyncFileIOContext *ctx = new AsyncFileIOContext(depth,
+						     TestConfig::use_io_uring);
+    if(TestConfig::register_buffers)
+      ctx->register_buffers(std::vector<std::pair<void *, size_t> >(1, std::make_pair((void *)buffer, total_bytes)));
+
+    for(size_t req_size = TestConfig::min_req_size;
+	req_size <= TestConfig::max_req_size;
+	req_size *= 4) {
+      double write_bw = run_pass(ctx, fd, buffer, total_bytes, req_size, true);
+      double read_bw = run_pass(ctx, fd, buffer, total_bytes, req_size, false);
+      printf("  depth=%3d req=%8zd: write = %6.2f GB/s, read = %6.2f GB/s\n",
+	     depth, req_size, write_bw, read_bw);
+    }
+
+    delete ctx;
+  }
+
+  // the last pass read back what was written
+  for(size_t i = 0; i < total_bytes; i++)
+    if(buffer[i] != (char)i) {
+      printf("data mismatch at offset %zd\n", i);
+      exit(1);
+    }
+
+  close(fd);
+  unlink(TestConfig::file_name.c_str());
+  free(buffer);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// HDF5 checkpoint bandwidth benchmark - a 2-D array of doubles in system
+//  memory is written to (checkpointed) and read back from a dataset in a
+//  local HDF5 file (several GB by default) through an HDF5 instance, and
+//  the bandwidth of each direction is reported
+//
+// run with the different RUNMODEs in the Makefile to compare direct
+//  (parallel) access to a contiguous dataset with going through libhdf5,
+//  and to use a chunked and/or compressed dataset instead
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <hdf5.h>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  std::string file_name = "hdf5_bandwidth.h5";
+  size_t size_in_mb = 4096;
+  int cols = 100000;
+  bool chunked = false;
+  int chunk_rows = 16;
+  int chunk_cols = 4096;
+  int deflate = 0;   // compression level (0 = none), requires -chunked
+  int rounds = 2;
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+};
+
+Logger log_app("app");
+
+static bool create_file(const char *file_name, int rows, int cols)
+{
+  hid_t file_id = H5Fcreate(file_name, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if(file_id < 0) {
+    log_app.error() << "H5Fcreate failed: " << file_id;
+    return false;
+  }
+
+  hsize_t dims[2];
+  dims[0] = rows;
+  dims[1] = cols;
+  hid_t dataspace_id = H5Screate_simple(2, dims, NULL);
+
+  hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+  if(TestConfig::chunked) {
+    hsize_t chunk_dims[2];
+    chunk_dims[0] = std::min(TestConfig::chunk_rows, rows);
+    chunk_dims[1] = std::min(TestConfig::chunk_cols, cols);
+    H5Pset_chunk(dcpl_id, 2, chunk_dims);
+    if(TestConfig::deflate > 0)
+      H5Pset_deflate(dcpl_id, TestConfig::deflate);
+  }
+
+  hid_t dataset = H5Dcreate2(file_id, "data", H5T_IEEE_F64LE, dataspace_id,
+			     H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+  bool ok = (dataset >= 0);
+  if(!ok)
+    log_app.error() << "H5Dcreate2 failed: " << dataset;
+  else
+    H5Dclose(dataset);
+
+  // close things up - the HDF5 instance will reopen it
+  H5Pclose(dcpl_id);
+  H5Sclose(dataspace_id);
+  H5Fclose(file_id);
+  return ok;
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  Memory m = Machine::MemoryQuery(Machine::get_machine())
+    .only_kind(Memory::SYSTEM_MEM)
+    .has_affinity_to(p)
+    .first();
+  assert(m.exists());
+
+  int cols = TestConfig::cols;
+  int rows = (TestConfig::size_in_mb << 20) / (cols * sizeof(double));
+  assert(rows > 0);
+  bool ok = create_file(TestConfig::file_name.c_str(), rows, cols);
+  assert(ok);
+
+  // x is the column (fastest-varying in both memory and the file)
+  IndexSpace<2> is(Rect<2>(Point<2>(0, 0), Point<2>(cols - 1, rows - 1)));
+  std::vector<FieldID> field_ids(1, 0);
+  std::vector<size_t> field_sizes(1, sizeof(double));
+  std::vector<const char *> field_files(1, "data");
+
+  RegionInstance mem_inst;
+  RegionInstance::create_instance(mem_inst, m, is, field_sizes,
+				  0 /*SOA*/, ProfilingRequestSet()).wait();
+  {
+    AffineAccessor<double, 2> acc(mem_inst, 0);
+    for(PointInRectIterator<2,int> pir(is.bounds); pir.valid; pir.step())
+      acc[pir.p] = ((double)pir.p.y * cols) + pir.p.x;
+  }
+
+  // the HDF5 instance (and therefore the open file) is reused by every
+  //  round
+  RegionInstance hdf5_inst;
+  RegionInstance::create_hdf5_instance(hdf5_inst,
+				       TestConfig::file_name.c_str(),
+				       is, field_ids, field_sizes, field_files,
+				       false /*!read_only*/,
+				       ProfilingRequestSet()).wait();
+
+  std::vector<CopySrcDstField> mem_fields(1), hdf5_fields(1);
+  mem_fields[0].set_field(mem_inst, 0, sizeof(double));
+  hdf5_fields[0].set_field(hdf5_inst, 0, sizeof(double));
+
+  double bytes = (double)rows * cols * sizeof(double);
+  double best_write = 0, best_read = 0;
+  int errors = 0;
+  for(int r = 0; r < TestConfig::rounds; r++) {
+    // checkpoint
+    long long t_start = Clock::current_time_in_nanoseconds();
+    is.copy(mem_fields, hdf5_fields, ProfilingRequestSet()).wait();
+    long long t_end = Clock::current_time_in_nanoseconds();
+    best_write = std::max(best_write, bytes / (t_end - t_start));
+
+    // clear the memory copy and read it back
+    double fill_val = -1.0;
+    is.fill(mem_fields, ProfilingRequestSet(), &fill_val, sizeof(fill_val)).wait();
+    t_start = Clock::current_time_in_nanoseconds();
+    is.copy(hdf5_fields, mem_fields, ProfilingRequestSet()).wait();
+    t_end = Clock::current_time_in_nanoseconds();
+    best_read = std::max(best_read, bytes / (t_end - t_start));
+
+    AffineAccessor<double, 2> acc(mem_inst, 0);
+    for(PointInRectIterator<2,int> pir(is.bounds); pir.valid; pir.step())
+      if(acc[pir.p] != (((double)pir.p.y * cols) + pir.p.x))
+	errors++;
+  }
+
+  log_app.print() << "hdf5 bandwidth: " << rows << " x " << cols << " doubles ("
+		  << (bytes / (1 << 20)) << " MB)"
+		  << (TestConfig::chunked ? ", chunked" : ", contiguous")
+		  << ((TestConfig::deflate > 0) ? ", compressed" : "");
+  log_app.print() << "  write: " << best_write << " GB/s, read: " << best_read << " GB/s";
+
+  hdf5_inst.destroy();
+  mem_inst.destroy();
+  unlink(TestConfig::file_name.c_str());
+
+  if(errors > 0) {
+    log_app.error() << errors << " mismatched elements";
+    exit(1);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_string("-file", TestConfig::file_name)
+    .add_option_int("-size", TestConfig::size_in_mb)
+    .add_option_int("-cols", TestConfig::cols)
+    .add_option_bool("-chunked", TestConfig::chunked)
+    .add_option_int("-chunkrows", TestConfig::chunk_rows)
+    .add_option_int("-chunkcols", TestConfig::chunk_cols)
+    .add_option_int("-deflate", TestConfig::deflate)
+    .add_option_int("-rounds", TestConfig::rounds);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
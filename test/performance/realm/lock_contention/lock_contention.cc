@@ -16,9 +16,11 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <stdlib.h>
 #include <cassert>
 #include <cstring>
 #include <set>
+#include <vector>
 #include <time.h>
 
 #include <realm.h>
@@ -34,6 +36,7 @@ enum {
   LAUNCH_UNFAIR_LOCK_TASK = Processor::TASK_ID_FIRST_AVAILABLE+4,
   ADD_FINAL_EVENT_TASK = Processor::TASK_ID_FIRST_AVAILABLE+5,
   DUMMY_TASK = Processor::TASK_ID_FIRST_AVAILABLE+6,
+  DIRECT_LOCK_TASK = Processor::TASK_ID_FIRST_AVAILABLE+7,
 };
 
 struct InputArgs {
@@ -104,6 +107,8 @@ void top_level_task(const void *args, size_t arglen,
   bool fair = false;
   int locks_per_processor = 16;
   int tasks_per_processor_per_lock = 8;
+  int direct_iterations = 0;
+  int shared_ratio = 0;
   // Parse the input arguments
 #define INT_ARG(argname, varname) do { \
         if(!strcmp((argv)[i], argname)) {		\
@@ -124,9 +129,13 @@ void top_level_task(const void *args, size_t arglen,
       INT_ARG("-lpp", locks_per_processor);
       INT_ARG("-tpppl",tasks_per_processor_per_lock);
       BOOL_ARG("-fair",fair);
+      INT_ARG("-direct",direct_iterations);
+      INT_ARG("-shared",shared_ratio);
     }
     assert(locks_per_processor > 0);
     assert(tasks_per_processor_per_lock > 0);
+    assert(direct_iterations >= 0);
+    assert(shared_ratio >= 0);
   }
 #undef INT_ARG
 #undef BOOL_ARG
@@ -152,7 +161,48 @@ void top_level_task(const void *args, size_t arglen,
     }
     free(buffer);
   }
-  if (fair)
+  // total number of grants expected, for the throughput calculation
+  long long total_grants = (long long)locks_per_processor * tasks_per_processor_per_lock * all_procs.size();
+  if (direct_iterations > 0)
+  {
+    fprintf(stdout,"Running DIRECT lock contention experiment with %d locks per processor and %d acquires per processor (shared ratio %d)\n",
+            locks_per_processor, direct_iterations, shared_ratio);
+    std::set<Reservation> &lock_set = get_lock_set();
+    // Every processor acquires and releases locks from inside a task, waiting
+    //  for each grant before moving on - this exercises the immediate acquire
+    //  path (and local handoff when processors collide on a lock)
+    size_t buffer_size = 3*sizeof(int) + sizeof(size_t) + (lock_set.size() * sizeof(Reservation));
+    void *buffer = malloc(buffer_size);
+    char *ptr = (char*)buffer;
+    *((int*)ptr) = direct_iterations;
+    ptr += sizeof(int);
+    *((int*)ptr) = shared_ratio;
+    ptr += sizeof(int);
+    *((int*)ptr) = 0; // filled in per processor below
+    int *seed_ptr = (int*)ptr;
+    ptr += sizeof(int);
+    *((size_t*)ptr) = lock_set.size();
+    ptr += sizeof(size_t);
+    for (std::set<Reservation>::const_iterator it = lock_set.begin();
+          it != lock_set.end(); it++)
+    {
+      Reservation lock = *it;
+      *((Reservation*)ptr) = lock;
+      ptr += sizeof(Reservation);
+    }
+    int seed = 0;
+    for (std::set<Processor>::const_iterator it = all_procs.begin();
+          it != all_procs.end(); it++)
+    {
+      *seed_ptr = seed++;
+      Processor target = *it;
+      Event done = target.spawn(DIRECT_LOCK_TASK,buffer,buffer_size,start_event);
+      get_final_events().insert(done);
+    }
+    free(buffer);
+    total_grants = (long long)direct_iterations * all_procs.size();
+  }
+  else if (fair)
   {
     fprintf(stdout,"Running FAIR lock contention experiment with %d locks per processor and %d tasks per lock per processor\n",
             locks_per_processor, tasks_per_processor_per_lock);
@@ -173,7 +223,7 @@ void top_level_task(const void *args, size_t arglen,
             locks_per_processor, tasks_per_processor_per_lock);
     std::set<Reservation> &lock_set = get_lock_set();
     // Package up all the locks and tell the processor how many tasks to register for each
-    size_t buffer_size = sizeof(Processor) + sizeof(Event) + sizeof(int) + sizeof(size_t) + (lock_set.size() * sizeof(Reservation));
+    size_t buffer_size = sizeof(Processor) + sizeof(Event) + 2*sizeof(int) + sizeof(size_t) + (lock_set.size() * sizeof(Reservation));
     void *buffer = malloc(buffer_size);
     char *ptr = (char*)buffer;
     *((Processor*)ptr) = p;
@@ -182,6 +232,8 @@ void top_level_task(const void *args, size_t arglen,
     ptr += sizeof(Event);
     *((int*)ptr) = tasks_per_processor_per_lock;
     ptr += sizeof(int);
+    *((int*)ptr) = shared_ratio;
+    ptr += sizeof(int);
     *((size_t*)ptr) = lock_set.size();
     ptr += sizeof(size_t);
     for (std::set<Reservation>::const_iterator it = lock_set.begin();
@@ -218,7 +270,7 @@ void top_level_task(const void *args, size_t arglen,
 
     double latency = stop - start;
     fprintf(stdout,"Total time: %7.3f us\n", latency);
-    double grants_per_sec = locks_per_processor * tasks_per_processor_per_lock * all_procs.size() / latency;
+    double grants_per_sec = total_grants / latency;
     fprintf(stdout,"Reservation Grants/s (in Thousands): %7.3f\n", grants_per_sec);
   }
   
@@ -300,6 +352,8 @@ void unfair_locks_task(const void *args, size_t arglen,
   ptr += sizeof(Event);
   int tasks_per_processor_per_lock = *((int*)ptr);
   ptr += sizeof(int);
+  int shared_ratio = *((int*)ptr);
+  ptr += sizeof(int);
   size_t num_locks = *((size_t*)ptr);
   ptr += sizeof(size_t);
   std::set<Reservation> lock_set;
@@ -316,7 +370,9 @@ void unfair_locks_task(const void *args, size_t arglen,
     Reservation lock = *it;
     for (int idx = 0; idx < tasks_per_processor_per_lock; idx++)
     {
-      Event lock_event = lock.acquire(0,true,precondition);
+      // with a shared ratio of N, all but every Nth request is a reader
+      bool exclusive = (shared_ratio == 0) || ((idx % shared_ratio) == 0);
+      Event lock_event = lock.acquire(exclusive ? 0 : 1,exclusive,precondition);
       Event task_event = p.spawn(DUMMY_TASK,NULL,0,lock_event);
       lock.release(task_event);
       wait_for_events.insert(task_event);
@@ -328,6 +384,36 @@ void unfair_locks_task(const void *args, size_t arglen,
   wait_event.wait();
 }
 
+void direct_locks_task(const void *args, size_t arglen, 
+                       const void *userdata, size_t userlen, Processor p)
+{
+  char *ptr = (char*)args;
+  int iterations = *((int*)ptr);
+  ptr += sizeof(int);
+  int shared_ratio = *((int*)ptr);
+  ptr += sizeof(int);
+  int seed = *((int*)ptr);
+  ptr += sizeof(int);
+  size_t num_locks = *((size_t*)ptr);
+  ptr += sizeof(size_t);
+  std::vector<Reservation> lock_vector;
+  for (unsigned idx = 0; idx < num_locks; idx++)
+  {
+    Reservation lock = *((Reservation*)ptr);
+    ptr += sizeof(Reservation);
+    lock_vector.push_back(lock);
+  }
+  srand48(seed);
+  for (int idx = 0; idx < iterations; idx++)
+  {
+    Reservation lock = lock_vector[lrand48() % lock_vector.size()];
+    bool exclusive = (shared_ratio == 0) || ((idx % shared_ratio) == 0);
+    Event lock_event = lock.acquire(exclusive ? 0 : 1,exclusive);
+    lock_event.wait();
+    lock.release();
+  }
+}
+
 void add_final_event(const void *args, size_t arglen, 
                      const void *userdata, size_t userlen, Processor p)
 {
@@ -356,6 +442,7 @@ int main(int argc, char **argv)
   r.register_task(LAUNCH_UNFAIR_LOCK_TASK, unfair_locks_task);
   r.register_task(ADD_FINAL_EVENT_TASK, add_final_event);
   r.register_task(DUMMY_TASK, dummy_task);
+  r.register_task(DIRECT_LOCK_TASK, direct_locks_task);
 
   // Set the input args
   get_input_args().argv = argv;
@@ -0,0 +1,147 @@
+/* Copyright 2018 Stanford University, NVIDIA Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// this file is compiled with -fopenmp, and is linked either into the Realm
+//  test (which supplies its own OpenMP runtime) or, with
+//  FORKJOIN_STANDALONE defined, into a plain program using the compiler's
+//  runtime
+
+#include "forkjoin_kernels.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+#include <omp.h>
+
+static double current_time_in_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e6) + (ts.tv_nsec * 1e-3);
+}
+
+static void report(const char *name, double start, double stop,
+		   int iterations)
+{
+  printf("  %-20s %8.3f us\n", name, (stop - start) / iterations);
+}
+
+#define ARRAY_SIZE 256
+
+void run_forkjoin_benchmarks(int iterations, int nested_outer)
+{
+  int num_threads = 1;
+#pragma omp parallel
+  {
+    if(omp_get_thread_num() == 0)
+      num_threads = omp_get_num_threads();
+  }
+  printf("fork/join latency: %d threads, %d iterations\n",
+	 num_threads, iterations);
+
+  // (nearly) empty parallel regions - this is the cost of waking up a team
+  //  and waiting for it to finish - the compiler removes a region with
+  //  nothing in it at all
+  {
+    static volatile int sink = 0;
+    double start = current_time_in_us();
+    for(int i = 0; i < iterations; i++) {
+#pragma omp parallel
+      {
+	sink = i;
+      }
+    }
+    double stop = current_time_in_us();
+    report("parallel", start, stop, iterations);
+  }
+
+  // a combined parallel loop over a small array
+  {
+    static int counts[ARRAY_SIZE];
+    memset(counts, 0, sizeof(counts));
+    double start = current_time_in_us();
+    for(int i = 0; i < iterations; i++) {
+#pragma omp parallel for
+      for(int j = 0; j < ARRAY_SIZE; j++)
+	counts[j]++;
+    }
+    double stop = current_time_in_us();
+    for(int j = 0; j < ARRAY_SIZE; j++)
+      if(counts[j] != iterations) {
+	printf("ERROR: counts[%d] = %d (expected %d)\n",
+	       j, counts[j], iterations);
+	exit(1);
+      }
+    report("parallel for", start, stop, iterations);
+  }
+
+  // barriers within a single region, for comparison with the above
+  {
+    double start = current_time_in_us();
+#pragma omp parallel
+    {
+      for(int i = 0; i < iterations; i++) {
+#pragma omp barrier
+      }
+    }
+    double stop = current_time_in_us();
+    report("barrier", start, stop, iterations);
+  }
+
+  // nested regions - each member of a small outer team opens its own
+  //  region, and we count how many threads take part in total (this
+  //  depends on the runtime's limit on active levels)
+  if(nested_outer > 0) {
+    long inner_threads = 0;
+    double start = current_time_in_us();
+    for(int i = 0; i < iterations; i++) {
+#pragma omp parallel num_threads(nested_outer) reduction(+:inner_threads)
+      {
+#pragma omp parallel reduction(+:inner_threads)
+	{
+	  inner_threads += 1;
+	}
+      }
+    }
+    double stop = current_time_in_us();
+    report("nested parallel", start, stop, iterations);
+    printf("  %-20s %8.3f\n", "nested threads",
+	   (double)inner_threads / iterations);
+  }
+}
+
+#ifdef FORKJOIN_STANDALONE
+int main(int argc, char **argv)
+{
+  int iterations = 10000;
+  int nested_outer = 0;
+
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-i")) {
+      iterations = atoi(argv[++i]);
+      continue;
+    }
+    if(!strcmp(argv[i], "-nested")) {
+      nested_outer = atoi(argv[++i]);
+      continue;
+    }
+  }
+
+  run_forkjoin_benchmarks(iterations, nested_outer);
+  return 0;
+}
+#endif
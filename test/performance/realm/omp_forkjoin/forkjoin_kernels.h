@@ -0,0 +1,24 @@
+/* Copyright 2018 Stanford University, NVIDIA Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FORKJOIN_KERNELS_H
+#define FORKJOIN_KERNELS_H
+
+// times back-to-back parallel regions, worksharing loops, and barriers in
+//  whatever OpenMP runtime we're linked against, and (if 'nested_outer' is
+//  nonzero) nested regions inside an outer team of that size
+void run_forkjoin_benchmarks(int iterations, int nested_outer);
+
+#endif
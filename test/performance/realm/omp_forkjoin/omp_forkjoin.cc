@@ -0,0 +1,122 @@
+/* Copyright 2018 Stanford University, NVIDIA Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <realm.h>
+
+#include "forkjoin_kernels.h"
+
+using namespace Realm;
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+  FORKJOIN_TASK  = Processor::TASK_ID_FIRST_AVAILABLE+1,
+};
+
+struct InputArgs {
+  int argc;
+  char **argv;
+};
+
+InputArgs& get_input_args(void)
+{
+  static InputArgs args;
+  return args;
+}
+
+struct ForkJoinArgs {
+  int iterations;
+  int nested_outer;
+};
+
+void forkjoin_task(const void *args, size_t arglen, 
+                   const void *userdata, size_t userlen, Processor p)
+{
+  assert(arglen == sizeof(ForkJoinArgs));
+  const ForkJoinArgs& fja = *(const ForkJoinArgs *)args;
+  run_forkjoin_benchmarks(fja.iterations, fja.nested_outer);
+}
+
+void top_level_task(const void *args, size_t arglen, 
+                    const void *userdata, size_t userlen, Processor p)
+{
+  ForkJoinArgs fja;
+  fja.iterations = 10000;
+  fja.nested_outer = 0;
+  // Parse the input arguments
+#define INT_ARG(argname, varname) do { \
+        if(!strcmp((argv)[i], argname)) {		\
+          varname = atoi((argv)[++i]);		\
+          continue;					\
+        } } while(0)
+  {
+    InputArgs &inputs = get_input_args();
+    char **argv = inputs.argv;
+    for (int i = 1; i < inputs.argc; i++)
+    {
+      INT_ARG("-i", fja.iterations);
+      INT_ARG("-nested", fja.nested_outer);
+    }
+    assert(fja.iterations > 0);
+  }
+#undef INT_ARG
+
+  // the benchmarks run on the first OpenMP processor
+  Processor omp_proc = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::OMP_PROC).first();
+  if(!omp_proc.exists()) {
+    fprintf(stderr, "no OpenMP processors found - run with -ll:ocpu 1\n");
+    exit(1);
+  }
+
+  Event e = omp_proc.spawn(FORKJOIN_TASK, &fja, sizeof(fja));
+  e.wait();
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+  r.register_task(FORKJOIN_TASK, forkjoin_task);
+
+  // Set the input args
+  get_input_args().argv = argv;
+  get_input_args().argc = argc;
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC).first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+  
+  return 0;
+}
@@ -0,0 +1,242 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// microbenchmark for BasicRangeAllocator - replays a trace of instance
+//  allocations and frees against each placement policy
+//
+// a trace can be recorded from a real run with "-level malloc=1" - the
+//  "alloc:" and "free:" lines logged by MemoryImpl are understood here
+//  (lines for other memories can be filtered with grep first)
+//
+// without a trace, a synthetic one is generated that keeps a target number
+//  of allocations live while randomly freeing and reallocating, which
+//  fragments the free list in the same way a long-running job does
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "realm/mem_impl.h"
+#include "realm/timers.h"
+#include "realm/cmdline.h"
+
+using namespace Realm;
+
+namespace TestConfig {
+  std::string trace_file;
+  std::string dump_file;
+  std::string policy = "both";
+  int num_ops = 200000;
+  int live_allocs = 4096;
+  size_t min_size = 256;
+  size_t max_size = 1 << 20;
+  size_t alignment = 256;
+  size_t capacity_in_mb = 16384;
+  int seed = 12345;
+};
+
+struct TraceOp {
+  bool is_alloc;
+  unsigned tag;
+  size_t size;
+  size_t align;
+};
+
+typedef BasicRangeAllocator<size_t, unsigned> TestAllocator;
+
+static bool read_trace(const std::string& filename, std::vector<TraceOp>& ops)
+{
+  std::ifstream ifs(filename.c_str());
+  if(!ifs.good()) {
+    fprintf(stderr, "could not open trace file '%s'\n", filename.c_str());
+    return false;
+  }
+
+  // instance names are mapped to small integer tags
+  std::map<std::string, unsigned> tags;
+  std::string line;
+  while(std::getline(ifs, line)) {
+    size_t pos = line.find("alloc: ");
+    bool is_alloc = (pos != std::string::npos);
+    if(!is_alloc) {
+      pos = line.find("free: ");
+      if(pos == std::string::npos) continue;
+    }
+
+    TraceOp op;
+    op.is_alloc = is_alloc;
+    op.tag = 0;
+    op.size = 0;
+    op.align = 0;
+    bool ok = true;
+
+    std::istringstream iss(line.substr(pos));
+    std::string word;
+    iss >> word; // "alloc:" or "free:"
+    while(iss >> word) {
+      size_t eq = word.find('=');
+      if(eq == std::string::npos) continue;
+      std::string key = word.substr(0, eq);
+      std::string val = word.substr(eq + 1);
+      if(key == "inst") {
+	std::map<std::string, unsigned>::const_iterator it = tags.find(val);
+	if(it == tags.end()) {
+	  unsigned t = tags.size();
+	  tags[val] = t;
+	  op.tag = t;
+	} else
+	  op.tag = it->second;
+      } else if(key == "size")
+	op.size = strtoull(val.c_str(), 0, 10);
+      else if(key == "align")
+	op.align = strtoull(val.c_str(), 0, 10);
+      else if(key == "ok")
+	ok = (val != "0");
+    }
+
+    // failed allocations are not replayed (nor are their frees)
+    if(ok)
+      ops.push_back(op);
+  }
+  return true;
+}
+
+static void make_trace(std::vector<TraceOp>& ops)
+{
+  srand48(TestConfig::seed);
+
+  std::vector<unsigned> live;
+  unsigned next_tag = 0;
+  double log_min = log((double)TestConfig::min_size);
+  double log_max = log((double)TestConfig::max_size);
+
+  while(ops.size() < (size_t)TestConfig::num_ops) {
+    TraceOp op;
+    op.align = TestConfig::alignment;
+    if((live.size() < (size_t)TestConfig::live_allocs) || (drand48() < 0.5)) {
+      // log-uniform sizes give lots of small holes and a few big ones
+      op.is_alloc = true;
+      op.tag = next_tag++;
+      op.size = (size_t)exp(log_min + drand48() * (log_max - log_min));
+      live.push_back(op.tag);
+    } else {
+      size_t idx = lrand48() % live.size();
+      op.is_alloc = false;
+      op.tag = live[idx];
+      op.size = 0;
+      live[idx] = live.back();
+      live.pop_back();
+    }
+    ops.push_back(op);
+  }
+}
+
+static void dump_trace(const std::string& filename, const std::vector<TraceOp>& ops)
+{
+  FILE *f = fopen(filename.c_str(), "w");
+  assert(f != 0);
+  for(std::vector<TraceOp>::const_iterator it = ops.begin();
+      it != ops.end();
+      ++it)
+    if(it->is_alloc)
+      fprintf(f, "alloc: inst=%u size=%zd align=%zd ok=1\n",
+	      it->tag, it->size, it->align);
+    else
+      fprintf(f, "free: inst=%u\n", it->tag);
+  fclose(f);
+}
+
+static void replay_trace(const char *name, TestAllocator::AllocPolicy policy,
+			 const std::vector<TraceOp>& ops)
+{
+  TestAllocator alloc;
+  alloc.policy = policy;
+  alloc.add_range(0, TestConfig::capacity_in_mb << 20);
+
+  std::vector<bool> live;
+  size_t failures = 0;
+  size_t max_free_ranges = 0;
+
+  long long t_start = Clock::current_time_in_nanoseconds();
+  for(std::vector<TraceOp>::const_iterator it = ops.begin();
+      it != ops.end();
+      ++it) {
+    if(it->tag >= live.size())
+      live.resize(it->tag + 1, false);
+    if(it->is_alloc) {
+      size_t first;
+      if(alloc.allocate(it->tag, it->size, it->align, first))
+	live[it->tag] = true;
+      else
+	failures++;
+    } else {
+      if(live[it->tag]) {
+	alloc.deallocate(it->tag);
+	live[it->tag] = false;
+      }
+    }
+    if(alloc.free_by_size.size() > max_free_ranges)
+      max_free_ranges = alloc.free_by_size.size();
+  }
+  long long t_end = Clock::current_time_in_nanoseconds();
+
+  double ns_per_op = (double)(t_end - t_start) / ops.size();
+  printf("%s: %zd ops, %.1f ns/op, %zd failed allocs, %zd free ranges at end (max %zd), largest free = %zd\n",
+	 name, ops.size(), ns_per_op, failures,
+	 alloc.free_by_size.size(), max_free_ranges,
+	 alloc.largest_free_range());
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cp;
+  cp.add_option_string("-trace", TestConfig::trace_file)
+    .add_option_string("-dump", TestConfig::dump_file)
+    .add_option_string("-policy", TestConfig::policy)
+    .add_option_int("-ops", TestConfig::num_ops)
+    .add_option_int("-live", TestConfig::live_allocs)
+    .add_option_int("-minsize", TestConfig::min_size)
+    .add_option_int("-maxsize", TestConfig::max_size)
+    .add_option_int("-align", TestConfig::alignment)
+    .add_option_int("-capacity", TestConfig::capacity_in_mb)
+    .add_option_int("-seed", TestConfig::seed);
+  bool ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  std::vector<TraceOp> ops;
+  if(!TestConfig::trace_file.empty()) {
+    if(!read_trace(TestConfig::trace_file, ops))
+      exit(1);
+  } else
+    make_trace(ops);
+
+  if(!TestConfig::dump_file.empty())
+    dump_trace(TestConfig::dump_file, ops);
+
+  if((TestConfig::policy == "first") || (TestConfig::policy == "both"))
+    replay_trace("first-fit", TestAllocator::FIRST_FIT, ops);
+  if((TestConfig::policy == "best") || (TestConfig::policy == "both"))
+    replay_trace("best-fit", TestAllocator::BEST_FIT, ops);
+
+  return 0;
+}
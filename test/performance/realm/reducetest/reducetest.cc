@@ -215,6 +215,75 @@ static void run_case(const char *name, int task_id,
   printf("ELAPSED(%s) = %f\n", name, (end_time - start_time)*1e-6);
 }		     
 
+// measures the bandwidth of DMA-engine fills and reductions (both apply
+//  and fold) on SOA instances and on a field of an AOS instance
+static void run_dma_bandwidth(Processor p, int elements, int reps)
+{
+  Memory m = closest_memory(p);
+  IndexSpace<1, coord_t> is = Rect<1, coord_t>(0, elements - 1);
+
+  // 0 = SOA, 1 = AOS with four fields (so the reduced field is strided)
+  RegionInstance src_insts[2], dst_insts[2];
+  for(int aos = 0; aos < 2; aos++) {
+    std::vector<size_t> field_sizes((aos ? 4 : 1), sizeof(BucketType));
+    RegionInstance::create_instance(src_insts[aos], m, is, field_sizes,
+				    aos, ProfilingRequestSet()).wait();
+    RegionInstance::create_instance(dst_insts[aos], m, is, field_sizes,
+				    aos, ProfilingRequestSet()).wait();
+    assert(src_insts[aos].exists() && dst_insts[aos].exists());
+  }
+
+  for(int aos = 0; aos < 2; aos++) {
+    const char *layout = (aos ? "aos" : "soa");
+    std::vector<CopySrcDstField> src(1), dst(1);
+    src[0].set_field(src_insts[aos], 0, sizeof(BucketType));
+    dst[0].set_field(dst_insts[aos], 0, sizeof(BucketType));
+
+    BucketType zero = 0;
+    BucketReduction::RHS one = 1;
+    double bytes = (double)elements * sizeof(BucketType) * reps;
+
+    // fills (leaving the destination zeroed for the reductions)
+    double t_start = Realm::Clock::current_time_in_microseconds();
+    Event e = Event::NO_EVENT;
+    for(int i = 0; i < reps; i++)
+      e = is.fill(dst, ProfilingRequestSet(), &zero, sizeof(zero), e);
+    e.wait();
+    double t_end = Realm::Clock::current_time_in_microseconds();
+    printf("DMA_BW(fill,%s) = %.2f GB/s\n", layout, 1e-3 * bytes / (t_end - t_start));
+
+    is.fill(src, ProfilingRequestSet(), &one, sizeof(one)).wait();
+
+    // apply and then fold, each adding 1 to every element 'reps' times
+    for(int fold = 0; fold < 2; fold++) {
+      t_start = Realm::Clock::current_time_in_microseconds();
+      e = Event::NO_EVENT;
+      for(int i = 0; i < reps; i++)
+	e = is.copy(src, dst, ProfilingRequestSet(), e,
+		    REDOP_BUCKET_ADD, (fold != 0));
+      e.wait();
+      t_end = Realm::Clock::current_time_in_microseconds();
+      printf("DMA_BW(%s,%s) = %.2f GB/s\n", (fold ? "fold" : "apply"), layout,
+	     1e-3 * bytes / (t_end - t_start));
+    }
+
+    int errors = 0;
+    AffineAccessor<BucketType, 1, coord_t> acc(dst_insts[aos], 0);
+    for(coord_t i = 0; i < elements; i++)
+      if(acc[i] != (BucketType)(2 * reps))
+	errors++;
+    if(errors > 0) {
+      log_app.error() << errors << " mismatched elements (" << layout << ")";
+      exit(1);
+    }
+  }
+
+  for(int aos = 0; aos < 2; aos++) {
+    src_insts[aos].destroy();
+    dst_insts[aos].destroy();
+  }
+}
+
 void top_level_task(const void *args, size_t arglen, 
                     const void *userdata, size_t userlen, Processor p)
 {
@@ -224,6 +293,8 @@ void top_level_task(const void *args, size_t arglen,
   int seed1 = 12345;
   int seed2 = 54321;
   int do_slow = 0;
+  int dma_reps = 0;
+  int dma_elements = 16 << 20;
 
   // Parse the input arguments
 #define INT_ARG(argname, varname) do { \
@@ -246,11 +317,16 @@ void top_level_task(const void *args, size_t arglen,
       INT_ARG("-buckets", buckets);
       INT_ARG("-batches", num_batches);
       INT_ARG("-bsize", batch_size);
+      INT_ARG("-dmareps", dma_reps);
+      INT_ARG("-dmasize", dma_elements);
     }
   }
 #undef INT_ARG
 #undef BOOL_ARG
 
+  if(dma_reps > 0)
+    run_dma_bandwidth(p, dma_elements, dma_reps);
+
   //UserEvent start_event = UserEvent::create_user_event();
 
   IndexSpace<1, coord_t> hist_region = Rect<1, coord_t>(0, buckets - 1);
@@ -0,0 +1,163 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// load imbalance benchmark - every CPU processor gets the same number of
+//  tasks, but the tasks sent to the first processor run much longer than
+//  the rest
+//
+// without work stealing, the elapsed time is set by the first processor
+//  while the others sit idle - run with and without "-ll:steal" to compare
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <vector>
+
+#include <realm.h>
+#include <realm/timers.h>
+#include <realm/cmdline.h>
+
+using namespace Realm;
+
+namespace TestConfig {
+  int tasks_per_processor = 64;
+  int task_duration_us = 200;  // duration of a "light" task
+  int skew = 16;               // how much longer a "heavy" task runs
+  int heavy_processors = 1;    // number of processors that get heavy tasks
+};
+
+// TASK IDs
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+  SPIN_TASK,
+};
+
+Logger log_app("app");
+
+struct SpinTaskArgs {
+  long long duration_us;
+};
+
+// processors in the order tasks were assigned to them, and how many tasks
+//  each actually ran
+static std::vector<Processor> all_procs;
+static int *tasks_run = 0;
+
+void spin_task(const void *args, size_t arglen,
+	       const void *userdata, size_t userlen, Processor p)
+{
+  const SpinTaskArgs& sta = *(const SpinTaskArgs *)args;
+
+  long long stop = Clock::current_time_in_microseconds() + sta.duration_us;
+  while(Clock::current_time_in_microseconds() < stop) {}
+
+  for(size_t i = 0; i < all_procs.size(); i++)
+    if(all_procs[i] == p) {
+      __sync_fetch_and_add(&tasks_run[i], 1);
+      break;
+    }
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  Machine::ProcessorQuery pq(Machine::get_machine());
+  pq.only_kind(Processor::LOC_PROC).local_address_space();
+  for(Machine::ProcessorQuery::iterator it = pq.begin(); it != pq.end(); ++it)
+    all_procs.push_back(*it);
+
+  tasks_run = new int[all_procs.size()];
+  for(size_t i = 0; i < all_procs.size(); i++)
+    tasks_run[i] = 0;
+
+  // launches wait on a common start event so that every processor's queue
+  //  is full before anybody starts running
+  UserEvent start_event = UserEvent::create_user_event();
+  std::vector<Event> events;
+  long long total_work_us = 0;
+
+  for(size_t i = 0; i < all_procs.size(); i++) {
+    SpinTaskArgs sta;
+    sta.duration_us = TestConfig::task_duration_us;
+    if((int)i < TestConfig::heavy_processors)
+      sta.duration_us *= TestConfig::skew;
+
+    for(int j = 0; j < TestConfig::tasks_per_processor; j++) {
+      events.push_back(all_procs[i].spawn(SPIN_TASK, &sta, sizeof(sta), start_event));
+      total_work_us += sta.duration_us;
+    }
+  }
+
+  Event all_done = Event::merge_events(events);
+
+  long long t_start = Clock::current_time_in_microseconds();
+  start_event.trigger();
+  all_done.wait();
+  long long t_end = Clock::current_time_in_microseconds();
+
+  double elapsed = 1e-6 * (t_end - t_start);
+  double ideal = 1e-6 * total_work_us / all_procs.size();
+  log_app.print() << "skewed tasks: " << all_procs.size() << " procs, "
+		  << events.size() << " tasks: elapsed = " << elapsed
+		  << " s, ideal = " << ideal
+		  << " s, efficiency = " << (100.0 * ideal / elapsed) << "%";
+  for(size_t i = 0; i < all_procs.size(); i++)
+    log_app.print() << "  " << all_procs[i] << ": assigned "
+		    << TestConfig::tasks_per_processor
+		    << ", ran " << tasks_run[i];
+
+  delete[] tasks_run;
+}
+
+int main(int argc, char **argv)
+{
+  Runtime r;
+
+  bool ok = r.init(&argc, &argv);
+  assert(ok);
+
+  CommandLineParser cp;
+  cp.add_option_int("-tpp", TestConfig::tasks_per_processor)
+    .add_option_int("-us", TestConfig::task_duration_us)
+    .add_option_int("-skew", TestConfig::skew)
+    .add_option_int("-heavy", TestConfig::heavy_processors);
+  ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  r.register_task(TOP_LEVEL_TASK, top_level_task);
+  r.register_task(SPIN_TASK, spin_task);
+  // spin tasks don't care which processor they run on, so they may be
+  //  stolen - the top level task stays put
+  Processor::set_task_stealable(Processor::LOC_PROC, SPIN_TASK);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = r.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  r.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  r.wait_for_shutdown();
+
+  return 0;
+}
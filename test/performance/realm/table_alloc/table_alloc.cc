@@ -0,0 +1,200 @@
+/* Copyright 2018 Stanford University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// microbenchmark for DynamicTable/DynamicTableFreeList - measures ID
+//  allocation/free and lookup throughput for increasing numbers of threads
+//  sharing a single table, the way event/barrier/reservation IDs are
+//  handed out and looked up by a node's worker threads
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <vector>
+
+#include <pthread.h>
+
+#include "realm/dynamic_table.h"
+#include "realm/timers.h"
+#include "realm/cmdline.h"
+
+using namespace Realm;
+
+namespace TestConfig {
+  int max_threads = 8;
+  int alloc_ops = 1 << 20;     // per thread
+  int alloc_depth = 64;        // entries a thread holds at once
+  int lookup_ops = 1 << 22;    // per thread
+  int table_entries = 1 << 20;
+};
+
+class TestLock {
+public:
+  TestLock(void) { pthread_mutex_init(&mutex, 0); }
+  ~TestLock(void) { pthread_mutex_destroy(&mutex); }
+
+  void lock(void) { pthread_mutex_lock(&mutex); }
+  void unlock(void) { pthread_mutex_unlock(&mutex); }
+
+protected:
+  pthread_mutex_t mutex;
+};
+
+struct TestEntry {
+  void init(int _index, int _owner) { index = _index; }
+
+  int index;
+  TestEntry *next_free;
+};
+
+// same shape as the runtime's event table
+struct TestTableAllocator {
+  typedef TestEntry ET;
+  static const size_t INNER_BITS = 10;
+  static const size_t LEAF_BITS = 8;
+
+  typedef TestLock LT;
+  typedef int IT;
+  typedef DynamicTableNode<DynamicTableNodeBase<LT, IT> *, 1 << INNER_BITS, LT, IT> INNER_TYPE;
+  typedef DynamicTableNode<ET, 1 << LEAF_BITS, LT, IT> LEAF_TYPE;
+  typedef DynamicTableFreeList<TestTableAllocator> FreeList;
+
+  static LEAF_TYPE *new_leaf_node(IT first_index, IT last_index,
+				  int owner, FreeList *free_list)
+  {
+    LEAF_TYPE *leaf = new LEAF_TYPE(0, first_index, last_index);
+    IT last_ofs = (((IT)1) << LEAF_BITS) - 1;
+    for(IT i = 0; i <= last_ofs; i++)
+      leaf->elems[i].init(first_index + i, owner);
+
+    if(free_list) {
+      free_list->lock.lock();
+
+      for(IT i = 0; i <= last_ofs; i++)
+	leaf->elems[i].next_free = ((i < last_ofs) ?
+				      &(leaf->elems[i+1]) :
+				      free_list->first_free);
+
+      free_list->first_free = &(leaf->elems[first_index ? 0 : 1]);
+
+      free_list->lock.unlock();
+    }
+
+    return leaf;
+  }
+};
+
+typedef DynamicTable<TestTableAllocator> TestTable;
+
+struct ThreadArgs {
+  TestTable *table;
+  TestTableAllocator::FreeList *free_list;
+  int seed;
+  long long checksum;
+};
+
+static void *alloc_thread(void *data)
+{
+  ThreadArgs *args = static_cast<ThreadArgs *>(data);
+  std::vector<TestEntry *> held(TestConfig::alloc_depth, (TestEntry *)0);
+
+  long long checksum = 0;
+  for(int i = 0; i < TestConfig::alloc_ops; i++) {
+    TestEntry *& slot = held[i % TestConfig::alloc_depth];
+    if(slot)
+      args->free_list->free_entry(slot);
+    slot = args->free_list->alloc_entry();
+    checksum += slot->index;
+  }
+  for(size_t i = 0; i < held.size(); i++)
+    if(held[i])
+      args->free_list->free_entry(held[i]);
+
+  args->checksum = checksum;
+  return 0;
+}
+
+static void *lookup_thread(void *data)
+{
+  ThreadArgs *args = static_cast<ThreadArgs *>(data);
+
+  // cheap LCG so the random numbers don't cost more than the lookups
+  unsigned x = args->seed;
+  long long checksum = 0;
+  for(int i = 0; i < TestConfig::lookup_ops; i++) {
+    x = x * 1103515245 + 12345;
+    int index = (x >> 4) % TestConfig::table_entries;
+    TestEntry *e = args->table->lookup_entry(index, 0);
+    checksum += e->index;
+  }
+
+  args->checksum = checksum;
+  return 0;
+}
+
+static double run_threads(int num_threads, void *(*fn)(void *),
+			  TestTable *table, TestTableAllocator::FreeList *free_list)
+{
+  std::vector<pthread_t> threads(num_threads);
+  std::vector<ThreadArgs> args(num_threads);
+
+  long long t_start = Clock::current_time_in_nanoseconds();
+  for(int i = 0; i < num_threads; i++) {
+    args[i].table = table;
+    args[i].free_list = free_list;
+    args[i].seed = 12345 + i;
+    args[i].checksum = 0;
+    int ret = pthread_create(&threads[i], 0, fn, &args[i]);
+    assert(ret == 0);
+  }
+  for(int i = 0; i < num_threads; i++)
+    pthread_join(threads[i], 0);
+  long long t_end = Clock::current_time_in_nanoseconds();
+
+  return 1e-9 * (t_end - t_start);
+}
+
+int main(int argc, char **argv)
+{
+  CommandLineParser cp;
+  cp.add_option_int("-threads", TestConfig::max_threads)
+    .add_option_int("-allocs", TestConfig::alloc_ops)
+    .add_option_int("-depth", TestConfig::alloc_depth)
+    .add_option_int("-lookups", TestConfig::lookup_ops)
+    .add_option_int("-entries", TestConfig::table_entries);
+  bool ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  for(int t = 1; t <= TestConfig::max_threads; t *= 2) {
+    // a fresh table for each run, so the allocation test includes the
+    //  cost of growing it
+    TestTable table;
+    TestTableAllocator::FreeList free_list(table, 0);
+
+    double alloc_time = run_threads(t, alloc_thread, &table, &free_list);
+
+    // make sure the whole range being looked up is populated
+    table.lookup_entry(TestConfig::table_entries - 1, 0);
+    double lookup_time = run_threads(t, lookup_thread, &table, &free_list);
+
+    printf("threads=%d: alloc/free = %.2f Mops/s, lookup = %.2f Mops/s\n",
+	   t,
+	   1e-6 * t * TestConfig::alloc_ops / alloc_time,
+	   1e-6 * t * TestConfig::lookup_ops / lookup_time);
+  }
+
+  return 0;
+}
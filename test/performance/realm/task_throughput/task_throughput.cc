@@ -22,6 +22,8 @@
 
 #include <time.h>
 
+#include <algorithm>
+
 #include <realm.h>
 #include <realm/cmdline.h>
 
@@ -33,6 +35,7 @@ namespace TestConfig {
   int task_argument_size = 0;
   bool remote_tasks = false;
   bool with_profiling = false;
+  bool scaling = false;
 };
 
 // TASK IDs
@@ -175,9 +178,56 @@ void task_launcher(const void *args, size_t arglen,
   la.start_barrier.arrive();
 }
 
+// measures how aggregate throughput scales with the number of worker
+//  processors - for N = 1, 2, 4, ... local CPU processors, this task spawns
+//  tasks_per_processor no-op tasks onto each of the first N processors and
+//  waits for all of them to finish
+void scaling_test(Processor p)
+{
+  std::vector<Processor> procs;
+  {
+    Machine::ProcessorQuery pq(Machine::get_machine());
+    pq.only_kind(Processor::LOC_PROC).local_address_space();
+    for(Machine::ProcessorQuery::iterator it = pq.begin(); it != pq.end(); ++it)
+      procs.push_back(*it);
+  }
+
+  TestTaskArgs tta;
+  tta.which_task = MIDDLE_TASK;
+  tta.instance = RegionInstance::NO_INST;
+  tta.finish_barrier = Barrier::NO_BARRIER;
+
+  size_t n = 1;
+  while(true) {
+    std::vector<Event> events;
+    events.reserve(n * TestConfig::tasks_per_processor);
+
+    double t1 = Clock::current_time();
+    for(int i = 0; i < TestConfig::tasks_per_processor; i++)
+      for(size_t j = 0; j < n; j++)
+	events.push_back(procs[j].spawn(DUMMY_TASK, &tta, sizeof(tta),
+					Event::NO_EVENT, MIDDLE_TASK));
+    Event::merge_events(events).wait();
+    double t2 = Clock::current_time();
+
+    double rate = events.size() / (t2 - t1);
+    log_app.print() << "scaling: " << n << " procs: "
+		    << rate << " tasks/s, "
+		    << (rate / n) << " tasks/s/proc";
+
+    if(n == procs.size()) break;
+    n = std::min(n * 2, procs.size());
+  }
+}
+
 void top_level_task(const void *args, size_t arglen, 
 		    const void *userdata, size_t userlen, Processor p)
 {
+  if(TestConfig::scaling) {
+    scaling_test(p);
+    return;
+  }
+
   LauncherArgs launch_args;
 
   // go through all processors and organize by address space
@@ -273,7 +323,8 @@ int main(int argc, char **argv)
     .add_option_int("-lp", TestConfig::launching_processors)
     .add_option_int("-args", TestConfig::task_argument_size)
     .add_option_bool("-remote", TestConfig::remote_tasks)
-    .add_option_bool("-prof", TestConfig::with_profiling);
+    .add_option_bool("-prof", TestConfig::with_profiling)
+    .add_option_bool("-scaling", TestConfig::scaling);
   ok = cp.parse_command_line(argc, (const char **)argv);
   assert(ok);
 
@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <csignal>
+
+#include <vector>
+
+#include "realm.h"
+#include "realm/timers.h"
+#include "realm/cmdline.h"
+
+using namespace Realm;
+
+// barrier latency benchmark - one task on every CPU processor in the machine
+//  repeatedly arrives at a (reducing) barrier and waits for it, so each
+//  iteration costs one full round of arrivals and trigger notifications
+//
+// run on many nodes with and without "-realm:barrier_radix" (plus
+//  "-realm:event_batch_us" to combine arrivals) to compare the flat and
+//  tree-based protocols
+
+// Task IDs, some IDs are reserved so start at first available number
+enum {
+  TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
+  PHASE_TASK     = Processor::TASK_ID_FIRST_AVAILABLE+1,
+};
+
+enum { REDOP_ADD = 1 };
+
+class ReductionOpIntAdd {
+public:
+  typedef int LHS;
+  typedef int RHS;
+
+  template <bool EXCL>
+  static void apply(LHS& lhs, RHS rhs) { lhs += rhs; }
+
+  // both of these are optional
+  static const RHS identity;
+
+  template <bool EXCL>
+  static void fold(RHS& rhs1, RHS rhs2) { rhs1 += rhs2; }
+};
+
+const ReductionOpIntAdd::RHS ReductionOpIntAdd::identity = 0;
+
+namespace TestConfig {
+  int num_iters = 1000;
+  bool no_reduction = false;
+};
+
+struct PhaseTaskArgs {
+  int num_iters;
+  int index;
+  int num_tasks;
+  bool use_reduction;
+  Barrier b;
+};
+
+static const int BARRIER_INITIAL_VALUE = 0;
+
+// we're going to use alarm() as a watchdog to detect deadlocks
+void sigalrm_handler(int sig)
+{
+  fprintf(stderr, "HELP!  Alarm triggered - likely hang!\n");
+  exit(1);
+}
+
+void phase_task(const void *args, size_t arglen,
+		const void *userdata, size_t userlen, Processor p)
+{
+  assert(arglen == sizeof(PhaseTaskArgs));
+  const PhaseTaskArgs& pta = *(const PhaseTaskArgs *)args;
+
+  Barrier b = pta.b;
+  int errors = 0;
+  for(int i = 0; i < pta.num_iters; i++) {
+    if(pta.use_reduction) {
+      int reduce_val = i + pta.index;
+      b.arrive(1, Event::NO_EVENT, &reduce_val, sizeof(reduce_val));
+    } else
+      b.arrive(1);
+
+    b.wait();
+
+    if(pta.use_reduction) {
+      int result;
+      bool ready = b.get_result(&result, sizeof(result));
+      // sum over tasks of (i + index)
+      int exp_result = (BARRIER_INITIAL_VALUE + (i * pta.num_tasks) +
+			(pta.num_tasks * (pta.num_tasks - 1) / 2));
+      if(!ready || (result != exp_result)) {
+	if(errors < 10)
+	  printf("task %d: iter %d = %d (%d) ERROR (expected %d)\n",
+		 pta.index, i, result, ready, exp_result);
+	errors++;
+      }
+    }
+
+    b = b.advance_barrier();
+  }
+
+  if(errors > 0) {
+    printf("task %d: %d errors\n", pta.index, errors);
+    exit(1);
+  }
+}
+
+void top_level_task(const void *args, size_t arglen,
+		    const void *userdata, size_t userlen, Processor p)
+{
+  std::vector<Processor> all_cpus;
+  {
+    Machine::ProcessorQuery pq(Machine::get_machine());
+    pq.only_kind(Processor::LOC_PROC);
+    for(Machine::ProcessorQuery::iterator it = pq.begin(); it != pq.end(); ++it)
+      all_cpus.push_back(*it);
+  }
+
+  Barrier b = (TestConfig::no_reduction ?
+	         Barrier::create_barrier(all_cpus.size()) :
+	         Barrier::create_barrier(all_cpus.size(), REDOP_ADD,
+					 &BARRIER_INITIAL_VALUE,
+					 sizeof(BARRIER_INITIAL_VALUE)));
+
+  // set an alarm so that we turn hangs into error messages
+  alarm(60 + TestConfig::num_iters / 100);
+
+  std::vector<Event> task_events;
+  long long t_start = Clock::current_time_in_microseconds();
+  for(size_t i = 0; i < all_cpus.size(); i++) {
+    PhaseTaskArgs pta;
+    pta.num_iters = TestConfig::num_iters;
+    pta.index = i;
+    pta.num_tasks = all_cpus.size();
+    pta.use_reduction = !TestConfig::no_reduction;
+    pta.b = b;
+    task_events.push_back(all_cpus[i].spawn(PHASE_TASK, &pta, sizeof(pta)));
+  }
+
+  Event::merge_events(task_events).wait();
+  long long t_end = Clock::current_time_in_microseconds();
+
+  alarm(0);
+
+  b.destroy_barrier();
+
+  double us_per_phase = (double)(t_end - t_start) / TestConfig::num_iters;
+  printf("barrier latency: %zd tasks, %d phases, %s: %.1f us/phase\n",
+	 all_cpus.size(), TestConfig::num_iters,
+	 (TestConfig::no_reduction ? "no reduction" : "with reduction"),
+	 us_per_phase);
+}
+
+int main(int argc, char **argv)
+{
+  Runtime rt;
+
+  rt.init(&argc, &argv);
+
+  CommandLineParser cp;
+  cp.add_option_int("-i", TestConfig::num_iters)
+    .add_option_bool("-noredop", TestConfig::no_reduction);
+  bool ok = cp.parse_command_line(argc, (const char **)argv);
+  assert(ok);
+
+  rt.register_task(TOP_LEVEL_TASK, top_level_task);
+  rt.register_task(PHASE_TASK, phase_task);
+
+  rt.register_reduction(REDOP_ADD,
+			ReductionOpUntyped::create_reduction_op<ReductionOpIntAdd>());
+
+  signal(SIGALRM, sigalrm_handler);
+
+  // select a processor to run the top level task on
+  Processor p = Machine::ProcessorQuery(Machine::get_machine())
+    .only_kind(Processor::LOC_PROC)
+    .first();
+  assert(p.exists());
+
+  // collective launch of a single task - everybody gets the same finish event
+  Event e = rt.collective_spawn(p, TOP_LEVEL_TASK, 0, 0);
+
+  // request shutdown once that task is complete
+  rt.shutdown(e);
+
+  // now sleep this thread until that shutdown actually happens
+  rt.wait_for_shutdown();
+
+  return 0;
+}
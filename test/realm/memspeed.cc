@@ -20,6 +20,7 @@ enum {
   TOP_LEVEL_TASK = Processor::TASK_ID_FIRST_AVAILABLE+0,
   MEMSPEED_TASK,
   COPYPROF_TASK,
+  STREAM_TASK,
 };
 
 struct SpeedTestArgs {
@@ -55,6 +56,52 @@ void copy_profiling_task(const void *args, size_t arglen,
 static size_t buffer_size = 64 << 20; // should be bigger than any cache in system
 static bool do_tasks = true;   // should tasks accessing memories be tested
 static bool do_copies = true;  // should DMAs between memories be tested
+static bool do_stream = false; // should STREAM triad be run from every CPU to every memory
+
+struct StreamTestArgs {
+  Memory mem;
+  RegionInstance inst;
+  size_t elements;
+  int reps;
+  bool local;
+};
+
+// STREAM-style triad (a = b + s * c) - reports GB/s, counting the two reads
+//  and one write of each element (the processor may be on another node, so
+//  the result is logged here, like the other tests do)
+void stream_task(const void *args, size_t arglen,
+		 const void *userdata, size_t userlen, Processor p)
+{
+  const StreamTestArgs& sargs = *(const StreamTestArgs *)args;
+
+  // field IDs are the fields' offsets when created from a list of sizes
+  AffineAccessor<double, 1> a(sargs.inst, 0);
+  AffineAccessor<double, 1> b(sargs.inst, sizeof(double));
+  AffineAccessor<double, 1> c(sargs.inst, 2 * sizeof(double));
+
+  for(size_t i = 0; i < sargs.elements; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+
+  const double scalar = 3.0;
+  long long t1 = Clock::current_time_in_nanoseconds();
+  for(int j = 0; j < sargs.reps; j++)
+    for(size_t i = 0; i < sargs.elements; i++)
+      a[i] = b[i] + scalar * c[i];
+  long long t2 = Clock::current_time_in_nanoseconds();
+
+  for(size_t i = 0; i < sargs.elements; i++)
+    assert(a[i] == 7.0);
+
+  double bandwidth = (3.0 * sizeof(double) * sargs.elements * sargs.reps /
+		      (t2 - t1));
+  log_app.print() << "stream triad: proc " << p << " -> mem " << sargs.mem
+		  << " (kind=" << sargs.mem.kind() << ", "
+		  << (sargs.local ? "local" : "remote")
+		  << "): " << bandwidth << " GB/s";
+}
 
 void memspeed_cpu_task(const void *args, size_t arglen, 
 		       const void *userdata, size_t userlen, Processor p)
@@ -293,6 +340,57 @@ void top_level_task(const void *args, size_t arglen,
     }
   }
 
+  // STREAM triad from each CPU processor to each memory it can reach - a
+  //  processor's "local" memory is the one with the best affinity (e.g. the
+  //  SOCKET_MEM of its own NUMA domain), and the rest are "remote"
+  if(do_stream) {
+    size_t stream_elements = buffer_size / (3 * sizeof(double));
+    IndexSpace<1> sd = Rect<1>(0, stream_elements - 1);
+
+    Machine::ProcessorQuery pq = Machine::ProcessorQuery(machine).only_kind(Processor::LOC_PROC);
+    for(Machine::ProcessorQuery::iterator it = pq.begin(); it; ++it) {
+      Processor p = *it;
+
+      std::vector<Memory> reachable;
+      unsigned best_bandwidth = 0;
+      for(std::vector<Memory>::const_iterator it2 = memories.begin();
+	  it2 != memories.end();
+	  ++it2) {
+	Machine::AffinityDetails affinity;
+	if(!machine.has_affinity(p, *it2, &affinity))
+	  continue;
+	reachable.push_back(*it2);
+	if(affinity.bandwidth > best_bandwidth)
+	  best_bandwidth = affinity.bandwidth;
+      }
+
+      for(std::vector<Memory>::const_iterator it2 = reachable.begin();
+	  it2 != reachable.end();
+	  ++it2) {
+	Memory m = *it2;
+	Machine::AffinityDetails affinity;
+	machine.has_affinity(p, m, &affinity);
+
+	RegionInstance inst;
+	RegionInstance::create_instance(inst, m, sd,
+					std::vector<size_t>(3, sizeof(double)),
+					0 /*SOA*/,
+					ProfilingRequestSet()).wait();
+	assert(inst.exists());
+
+	StreamTestArgs sargs;
+	sargs.mem = m;
+	sargs.inst = inst;
+	sargs.elements = stream_elements;
+	sargs.reps = 8;
+	sargs.local = (affinity.bandwidth == best_bandwidth);
+	p.spawn(STREAM_TASK, &sargs, sizeof(sargs)).wait();
+
+	inst.destroy();
+      }
+    }
+  }
+
   if(do_copies) {
     std::vector<size_t> field_sizes(1, sizeof(void *));
 
@@ -397,6 +495,11 @@ int main(int argc, char **argv)
       continue;
     }
 
+    if(!strcmp(argv[i], "-stream")) {
+      do_stream = true;
+      continue;
+    }
+
   }
 
   rt.register_task(TOP_LEVEL_TASK, top_level_task);
@@ -431,6 +534,12 @@ int main(int argc, char **argv)
   supported_proc_kinds.insert(Processor::TOC_PROC);
 #endif
 
+  Processor::register_task_by_kind(Processor::LOC_PROC, false /*!global*/,
+				   STREAM_TASK,
+				   CodeDescriptor(stream_task),
+				   ProfilingRequestSet(),
+				   0, 0).wait();
+
   Processor::register_task_by_kind(Processor::LOC_PROC, false /*!global*/,
 				   COPYPROF_TASK,
 				   CodeDescriptor(copy_profiling_task),
@@ -20,7 +20,7 @@ import tempfile
 import legion_spy
 import argparse
 import sys, os, shutil
-import string, re, json, heapq, time, itertools
+import string, re, json, heapq, time, itertools, struct
 from collections import defaultdict
 from math import sqrt, log
 from cgi import escape
@@ -153,6 +153,60 @@ def color_helper(step, num_steps):
     return ("#"+r+g+b)
 
 
+# gauges written by the Realm sampling profiler (-realm:prof) - the file
+# layout is defined in runtime/realm/sampling.h (see also rprof_to_csv.py)
+REALM_PACKET_NEWGAUGE = 1
+REALM_PACKET_SAMPLES = 2
+REALM_GTYPE_ABSOLUTE = 1
+REALM_GTYPE_ABSOLUTERANGE = 2
+REALM_GTYPE_EVENTCOUNT = 3
+
+def read_realm_samples(file_name):
+    # returns a map from gauge name to a map from sample index to the
+    # sample (a tuple of values)
+    gauges = {}
+    samples = {}
+    with open(file_name, 'rb') as f:
+        while True:
+            hdr = f.read(8)
+            if len(hdr) < 8:
+                break
+            pkt_type, pkt_size = struct.unpack('<II', hdr)
+            if pkt_type == REALM_PACKET_NEWGAUGE:
+                gauge_id, gtype, dtype, name = struct.unpack('<ii8s48s', f.read(64))
+                dtype = dtype.split('\0')[0]
+                name = name.split('\0')[0]
+                if dtype == 'i':
+                    fmt = 'i'
+                elif dtype in ('x', 'l'):
+                    fmt = 'q'
+                elif dtype in ('y', 'm'):
+                    fmt = 'Q'
+                else:
+                    fmt = None # not a type we know about
+                if fmt is not None and gtype == REALM_GTYPE_ABSOLUTERANGE:
+                    fmt = fmt * 3
+                gauges[gauge_id] = (name, fmt)
+                samples[name] = {}
+            elif pkt_type == REALM_PACKET_SAMPLES:
+                gauge_id, comp_len, first_sample, last_sample = struct.unpack('<iiii', f.read(16))
+                data = f.read(pkt_size - 16)
+                if gauge_id not in gauges or gauges[gauge_id][1] is None:
+                    continue
+                name, fmt = gauges[gauge_id]
+                sample_size = struct.calcsize('<' + fmt)
+                runs = struct.unpack('<%dH' % comp_len,
+                                     data[comp_len * sample_size:])
+                index = first_sample
+                for i in xrange(comp_len):
+                    value = struct.unpack('<' + fmt, data[i * sample_size:(i + 1) * sample_size])
+                    for j in xrange(runs[i]):
+                        samples[name][index] = value
+                        index += 1
+            else:
+                f.seek(pkt_size, 1)
+    return samples
+
 class PathRange(object):
     def __init__(self, start, stop, path):
         assert start <= stop
@@ -685,6 +739,85 @@ class Channel(object):
             else:
                 return 0
 
+class RealmChannel(object):
+    # a DMA channel as seen by the Realm sampling profiler - these are the
+    # channels that actually move the data (memcpy, remote write, disk, ...)
+    # rather than the memory pairs above, and the samples show how busy each
+    # one was over time
+    def __init__(self, node_id, kind):
+        self.node_id = node_id
+        self.kind = kind
+        self.samples = {} # sample index -> [xds queued, bytes in flight, bytes done]
+
+    def add_sample(self, index, series, value):
+        if index not in self.samples:
+            self.samples[index] = [None, None, None]
+        self.samples[index][series] = value
+
+    def get_short_text(self):
+        return self.kind + " Channel"
+
+    def is_used(self):
+        return any(s[2] is not None and s[2][0] > 0
+                   for s in self.samples.itervalues())
+
+    def get_bandwidth(self, sample_times):
+        # (time, bytes/us) at the end of each sample interval
+        bandwidth = list()
+        last_time = None
+        for index in sorted(self.samples):
+            time = sample_times.get(index)
+            if time is None:
+                continue
+            done = self.samples[index][2]
+            if last_time is not None and time > last_time and done is not None:
+                bandwidth.append((time, done[0] / float(time - last_time)))
+            last_time = time
+        return bandwidth
+
+    def emit_utilization(self, util_tsv_file, sample_times):
+        # utilization is the fraction of the best bandwidth seen on this
+        # channel during the run
+        bandwidth = self.get_bandwidth(sample_times)
+        peak = max([bw for time, bw in bandwidth] + [0])
+        util_tsv_file.write("time\tcount\n")
+        util_tsv_file.write("0.00\t0.00\n") # initial point
+        for time, bw in bandwidth:
+            util_tsv_file.write("%.2f\t%.2f\n" % (time, (bw / peak) if peak > 0 else 0))
+
+    def print_stats(self, verbose, sample_times):
+        bandwidth = self.get_bandwidth(sample_times)
+        total_bytes = 0
+        busy_samples = 0
+        max_queued = 0
+        for index in sorted(self.samples):
+            queued, in_flight, done = self.samples[index]
+            if done is not None:
+                total_bytes += done[0]
+            if queued is not None:
+                max_queued = max(max_queued, queued[2])
+            if ((queued is not None and queued[2] > 0) or
+                (in_flight is not None and in_flight[2] > 0) or
+                (done is not None and done[0] > 0)):
+                busy_samples += 1
+        if total_bytes > 0 or verbose:
+            peak = max([bw for time, bw in bandwidth] + [0])
+            busy_fraction = float(busy_samples) / max(len(self.samples), 1)
+            print(self)
+            print("    Total Bytes: %d" % total_bytes)
+            print("    Peak Bandwidth: %.3f GB/s" % (peak / 1000.0))
+            if busy_samples > 0 and len(bandwidth) > 0:
+                interval = float(bandwidth[-1][0] - bandwidth[0][0]) / max(len(bandwidth) - 1, 1)
+                print("    Average Bandwidth (when busy): %.3f GB/s" %
+                      (total_bytes / (busy_samples * interval) / 1000.0
+                       if interval > 0 else 0))
+            print("    Maximum Queued Transfers: %d" % max_queued)
+            print("    Busy Samples: %.3f%%" % (100.0 * busy_fraction))
+            print()
+
+    def __repr__(self):
+        return 'Node ' + str(self.node_id) + ' ' + self.get_short_text()
+
 class WaitInterval(object):
     def __init__(self, start, ready, end):
         self.start = start
@@ -1674,6 +1807,8 @@ class State(object):
         self.processors = {}
         self.memories = {}
         self.channels = {}
+        self.realm_channels = {}
+        self.realm_sample_times = {}
         self.task_kinds = {}
         self.variants = {}
         self.meta_variants = {}
@@ -2077,6 +2212,44 @@ class State(object):
             channel.print_stats(verbose)
         print
 
+    def add_realm_samples(self, file_name):
+        samples = read_realm_samples(file_name)
+        # every sample is taken at the time recorded by this gauge (in the
+        # same clock as the Legion Prof logs)
+        times = dict((index, value[0] / 1000) for index, value in
+                     samples.get('realm/sampling start', {}).iteritems())
+        series_names = { 'xds queued': 0, 'bytes in flight': 1, 'bytes done': 2 }
+        channel_pat = re.compile(r'realm/channel (\d+):(.+)/(.+)')
+        matches = 0
+        keys = set()
+        for name, gauge_samples in samples.iteritems():
+            m = channel_pat.match(name)
+            if m is None or m.group(3) not in series_names:
+                continue
+            node_id = int(m.group(1))
+            key = (node_id, m.group(2))
+            if key not in self.realm_channels:
+                self.realm_channels[key] = RealmChannel(node_id, m.group(2))
+            channel = self.realm_channels[key]
+            keys.add(key)
+            series = series_names[m.group(3)]
+            for index, value in gauge_samples.iteritems():
+                channel.add_sample(index, series, value)
+            matches += 1
+        # sample indices are per-file, so channels from different nodes
+        # need their own times
+        for key in keys:
+            self.realm_sample_times[key] = times
+        return matches
+
+    def print_realm_channel_stats(self, verbose):
+        print('****************************************************')
+        print('   REALM CHANNEL STATS')
+        print('****************************************************')
+        for key, channel in sorted(self.realm_channels.iteritems()):
+            channel.print_stats(verbose, self.realm_sample_times[key])
+        print
+
     def print_task_stats(self, verbose):
         print('****************************************************')
         print('   TASK STATS')
@@ -2089,6 +2262,8 @@ class State(object):
         self.print_processor_stats(verbose)
         self.print_memory_stats(verbose)
         self.print_channel_stats(verbose)
+        if len(self.realm_channels) > 0:
+            self.print_realm_channel_stats(verbose)
         self.print_task_stats(verbose)
 
     def assign_colors(self):
@@ -2325,6 +2500,15 @@ class State(object):
                 if group in timepoints_dict:
                     stats_structure[node].append(group)
 
+        # channel utilization from the Realm sampling profiler, if we have it
+        realm_channel_groups = {}
+        for key, channel in sorted(self.realm_channels.iteritems()):
+            node = str(channel.node_id)
+            if node in stats_structure and channel.is_used():
+                group = node + " (" + channel.get_short_text() + ")"
+                stats_structure[node].append(group)
+                realm_channel_groups[group] = key
+
         json_file_name = os.path.join(output_dirname, "json", "utils.json")
 
         with open(json_file_name, "w") as json_file:
@@ -2357,6 +2541,12 @@ class State(object):
                 for util_point in utilization:
                     util_tsv_file.write("%.2f\t%.2f\n" % util_point)
 
+        for group, key in realm_channel_groups.iteritems():
+            util_tsv_filename = os.path.join(output_dirname, "tsv", group + "_util.tsv")
+            with open(util_tsv_filename, "w") as util_tsv_file:
+                self.realm_channels[key].emit_utilization(util_tsv_file,
+                                                          self.realm_sample_times[key])
+
     def simplify_op(self, op_dependencies, op_existence_set, transitive_map, op_path, _dir):
         cur_op_id = op_path[-1]
 
@@ -2862,6 +3052,11 @@ def main():
     parser.add_argument(
         '-f', '--force', dest='force', action='store_true',
         help='overwrite output directory if it exists')
+    parser.add_argument(
+        '-r', '--realm-prof', dest='realm_filenames', action='append',
+        default=[], metavar='FILE',
+        help='Realm sampling profiler (-realm:prof) file to draw channel '
+             'utilization from (may be given more than once)')
     parser.add_argument(
         dest='filenames', nargs='+',
         help='input Legion Prof log filenames')
@@ -2917,6 +3112,11 @@ def main():
         print('No matches found! Exiting...')
         return
 
+    for file_name in args.realm_filenames:
+        print('Reading Realm sample file %s...' % file_name)
+        total_matches = state.add_realm_samples(file_name)
+        print('Matched %s channel gauges' % total_matches)
+
     # Once we are done loading everything, do the sorting
     state.sort_time_ranges()
 
@@ -213,6 +213,10 @@ function getLineColor(elem) {
     "L2 Cache Memory": "darkmagenta",
     "L1 Cache Memory": "olivedrab"
   };
+  // Realm DMA channels (from the sampling profiler) all share a color
+  if (kind != undefined && kind.endsWith(" Channel")) {
+    return "darkcyan";
+  }
   return colorMap[kind];
 }
 